@@ -0,0 +1,621 @@
+//
+//  bench_pitchflock.c
+//  pitchflock
+//
+//  Timed kernels and workloads, reported as JSON on standard output:
+//
+//    bench_pitchflock [min_seconds_per_kernel] [name_filter]
+//
+//  Every kernel runs in rounds until it has used at least min_seconds (default 0.25),
+//  and reports ns per operation and operations (frames, for the workloads) per second.
+//  Build with optimizations (make bench, or CMAKE_BUILD_TYPE=Release) before comparing numbers.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/harmony_state.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_naming.h"
+#include "../include/qdkpdve_nametable.h"
+#include "../include/qdkpdve_codec.h"
+#include "../include/qdkpdve_format.h"
+#include "../include/qdkpdve_tables.h"
+#include "../include/qdkpdve_latency.h"
+#include "../include/qdkpdve_engine.h"
+#include "../include/qdkpdve_anchor.h"
+#include "../include/qdkpdve_prior.h"
+#include "../include/qdkpdve_rt.h"
+#include "../include/qdkpdve_tune.h"
+
+#define INPUTS 4096 // size of each precomputed input array (a power of two)
+#define CM 0b10010001
+
+static double min_seconds = 0.25;
+static const char *filter = NULL;
+static int first_result = 1;
+static volatile long sink; // keeps results alive
+
+static int chroma_inputs[INPUTS];
+static int triad_inputs[INPUTS];
+static int kpdve_inputs[INPUTS];
+static int context_inputs[INPUTS];
+static int dve_inputs[INPUTS];
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+/**
+ * @brief A kernel runs one round of work and returns how many operations it did.
+ */
+typedef long (*bench_kernel)(void);
+
+static void report(const char *name, const char *unit, long ops, double seconds)
+{
+    printf("%s\n    {\"name\": \"%s\", \"unit\": \"%s\", \"ops\": %ld, \"seconds\": %.6f, \"ns_per_op\": %.3f, \"%s_per_s\": %.1f}",
+           first_result ? "" : ",", name, unit, ops, seconds, 1e9 * seconds / (double)ops, unit, (double)ops / seconds);
+    first_result = 0;
+    fflush(stdout);
+}
+
+static void run(const char *name, const char *unit, bench_kernel kernel)
+{
+    if (filter != NULL && strstr(name, filter) == NULL)
+    {
+        return;
+    }
+    kernel(); // warm up caches and lazily built tables
+
+    long ops = 0;
+    double start = now_seconds();
+    double elapsed = 0;
+    do {
+        ops += kernel();
+        elapsed = now_seconds() - start;
+    } while (elapsed < min_seconds);
+
+    report(name, unit, ops, elapsed);
+}
+
+static void make_inputs(void)
+{
+    srand(2024);
+    for (int i = 0; i < INPUTS; i++)
+    {
+        chroma_inputs[i] = rand() & 0xFFF;
+
+        // like continuous_binary_test: three random bits (some coincide)
+        int triad = 0;
+        for (int b = 0; b < 3; b++)
+        {
+            triad |= 1 << (rand() % 12);
+        }
+        triad_inputs[i] = triad;
+
+        int kpdve[] = { rand() % 12, rand() % 7, rand() % 7, rand() % 7, rand() % 7 };
+        kpdve_inputs[i] = KPDVEtoBinaryEncoding(kpdve);
+        int context[] = { rand() % 12, rand() % 7, rand() % 7, 0, 0 };
+        context_inputs[i] = KPDVEtoBinaryEncoding(context);
+        dve_inputs[i] = rand() & 0x7F;
+    }
+}
+
+//////////////////////////////////// kernels
+
+static long k_set_kp_list(void)
+{
+    harmony_state state;
+    long acc = 0;
+    for (int i = 0; i < INPUTS; i++)
+    {
+        state.chromatic_notes = triad_inputs[i];
+        set_kp_list(&state);
+        acc += state.kpdve_list_length;
+    }
+    sink = acc;
+    return INPUTS;
+}
+
+static long k_set_min_index(void)
+{
+    static harmony_state states[64];
+    static int prepared = 0;
+    if (!prepared)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            states[i].chromatic_notes = triad_inputs[i];
+            set_kp_list(&states[i]);
+        }
+        prepared = 1;
+    }
+    long acc = 0;
+    for (int i = 0; i < INPUTS; i++)
+    {
+        set_min_index(&states[i & 63], context_inputs[i]);
+        acc += states[i & 63].kpdve_min_index;
+    }
+    sink = acc;
+    return INPUTS;
+}
+
+static long k_tables_set_kp_list(void)
+{
+    const kpdve_tables *tables = kpdve_tables_default();
+    harmony_state state;
+    long acc = 0;
+    for (int i = 0; i < INPUTS; i++)
+    {
+        state.chromatic_notes = triad_inputs[i];
+        set_kp_list_from_tables(tables, &state);
+        acc += state.kpdve_list_length;
+    }
+    sink = acc;
+    return INPUTS;
+}
+
+static long k_tables_set_min_index(void)
+{
+    const kpdve_tables *tables = kpdve_tables_default();
+    static harmony_state states[64];
+    static int prepared = 0;
+    if (!prepared)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            states[i].chromatic_notes = triad_inputs[i];
+            set_kp_list(&states[i]);
+        }
+        prepared = 1;
+    }
+    long acc = 0;
+    for (int i = 0; i < INPUTS; i++)
+    {
+        set_min_index_from_tables(tables, &states[i & 63], context_inputs[i]);
+        acc += states[i & 63].kpdve_min_index;
+    }
+    sink = acc;
+    return INPUTS;
+}
+
+static long k_kpd_distance(void)
+{
+    double acc = 0;
+    for (int i = 0; i < INPUTS; i++)
+    {
+        acc += KPD_distance(kpdve_inputs[i], context_inputs[i]);
+    }
+    sink = (long)acc;
+    return INPUTS;
+}
+
+static long k_minimize_dve_value(void)
+{
+    long acc = 0;
+    for (int i = 0; i < INPUTS; i++)
+    {
+        struct dve_value dve = minimize_dve_value(make_dve(dve_inputs[i]));
+        acc += dve.d + dve.ve_val.bin_val;
+    }
+    sink = acc;
+    return INPUTS;
+}
+
+static long k_chroma_to_circle(void)
+{
+    long acc = 0;
+    for (int i = 0; i < INPUTS; i++)
+    {
+        acc += chroma_to_circle(chroma_inputs[i]);
+    }
+    sink = acc;
+    return INPUTS;
+}
+
+static long k_chord_notes_string(void)
+{
+    char buf[32];
+    long acc = 0;
+    for (int i = 0; i < INPUTS; i++)
+    {
+        acc += (long)chordNotesStringForKPDVE(kpdve_inputs[i], buf, sizeof(buf));
+    }
+    sink = acc;
+    return INPUTS;
+}
+
+static long k_naming_labels(void)
+{
+    long acc = 0;
+    for (int i = 0; i < INPUTS; i++)
+    {
+        int kpdve = kpdve_inputs[i];
+        acc += conventionalTonicStringForKPDVE(kpdve)[0] + rootStringForKPDVE(kpdve)[0]
+            + conventionalDegreeStringForKPDVE(kpdve)[0] + scaleNameForKPDVE(kpdve)[0];
+    }
+    sink = acc;
+    return INPUTS;
+}
+
+static long k_kpdve_string(void)
+{
+    char buf[17];
+    long acc = 0;
+    for (int i = 0; i < INPUTS; i++)
+    {
+        acc += (long)kpdveStringForKPDVE(kpdve_inputs[i], buf, sizeof(buf));
+    }
+    sink = acc;
+    return INPUTS;
+}
+
+static long k_name_table_labels(void)
+{
+    long acc = 0;
+    kpdve_name_table_init();
+    for (int i = 0; i < INPUTS; i++)
+    {
+        int kpdve = kpdve_inputs[i];
+        acc += kpdve_name_tonic(kpdve)[0] + kpdve_name_root(kpdve)[0]
+            + kpdve_name_degree(kpdve)[0] + kpdve_name_scale(kpdve)[0] + kpdve_name_chord(kpdve)[0];
+    }
+    sink = acc;
+    return INPUTS;
+}
+
+//////////////////////////////////// workloads (ops are frames)
+
+static long w_random_triads(void)
+{
+    static harmony_state state;
+    static int context = 35;
+    static int ready = 0;
+    if (!ready)
+    {
+        state = harmony_state_default();
+        ready = 1;
+    }
+    for (int i = 0; i < INPUTS; i++)
+    {
+        adjust_harmony_state_from_chroma_and_context(&state, triad_inputs[i], context);
+        context = state.kpdve;
+    }
+    sink = state.encoded_state;
+    return INPUTS;
+}
+
+// the same, through the timed wrapper: the difference is the cost of leaving the histogram on
+static long w_random_triads_timed(void)
+{
+    static harmony_state state;
+    static kpdve_latency_histogram histogram;
+    static int context = 35;
+    static int ready = 0;
+    if (!ready)
+    {
+        state = harmony_state_default();
+        kpdve_latency_init(&histogram);
+        ready = 1;
+    }
+    for (int i = 0; i < INPUTS; i++)
+    {
+        adjust_harmony_state_from_chroma_and_context_timed(&state, triad_inputs[i], context, &histogram);
+        context = state.kpdve;
+    }
+    sink = state.encoded_state;
+    return INPUTS;
+}
+
+static long w_random_chroma(void)
+{
+    static harmony_state state;
+    static int context = 35;
+    static int ready = 0;
+    if (!ready)
+    {
+        state = harmony_state_default();
+        ready = 1;
+    }
+    for (int i = 0; i < INPUTS; i++)
+    {
+        adjust_harmony_state_from_chroma_and_context(&state, chroma_inputs[i], context);
+        if (state.kpdve_list_length > 0)
+        {
+            context = state.kpdve;
+        }
+    }
+    sink = state.encoded_state;
+    return INPUTS;
+}
+
+// pf_rt on random chroma, and the same with a decayed anchor as a second context
+static long w_rt_random_chroma(void)
+{
+    static pf_rt_analyzer analyzer;
+    static int ready = 0;
+    if (!ready)
+    {
+        pf_rt_init(&analyzer, NULL);
+        ready = 1;
+    }
+    long acc = 0;
+    for (int i = 0; i < INPUTS; i++)
+    {
+        acc += pf_rt_analyze_chroma(&analyzer, chroma_inputs[i]);
+    }
+    sink = acc;
+    return INPUTS;
+}
+
+static long w_rt_anchored(void)
+{
+    static pf_rt_analyzer analyzer;
+    static kpdve_anchor anchor;
+    static int ready = 0;
+    if (!ready)
+    {
+        pf_rt_init(&analyzer, NULL);
+        kpdve_anchor_init(&anchor, NULL, 2048.0, 0.5f);
+        pf_rt_set_anchor(&analyzer, &anchor);
+        ready = 1;
+    }
+    long acc = 0;
+    for (int i = 0; i < INPUTS; i++)
+    {
+        acc += pf_rt_analyze_chroma(&analyzer, chroma_inputs[i]);
+    }
+    sink = acc;
+    return INPUTS;
+}
+
+// with a transition prior (empty: the scan costs the same whatever the levels)
+static long w_rt_prior(void)
+{
+    static pf_rt_analyzer analyzer;
+    static kpdve_prior prior;
+    static int ready = 0;
+    if (!ready)
+    {
+        pf_rt_init(&analyzer, NULL);
+        kpdve_prior_init(&prior, 1.0f);
+        pf_rt_set_prior(&analyzer, &prior);
+        ready = 1;
+    }
+    long acc = 0;
+    for (int i = 0; i < INPUTS; i++)
+    {
+        acc += pf_rt_analyze_chroma(&analyzer, chroma_inputs[i]);
+    }
+    sink = acc;
+    return INPUTS;
+}
+
+// KPDVE_TUNE_LANES * 2 configurations over INPUTS labeled frames; one op is one
+// configuration's frame (compare analyze/rt_random_chroma)
+static long w_tune_configs(void)
+{
+    static int labels[INPUTS];
+    static struct kpdve_tune_config configs[KPDVE_TUNE_LANES * 2];
+    static struct kpdve_tune_score scores[KPDVE_TUNE_LANES * 2];
+    static struct kpdve_tune_options options;
+    static int ready = 0;
+    if (!ready)
+    {
+        pf_rt_analyzer analyzer;
+        pf_rt_init(&analyzer, NULL);
+        for (int i = 0; i < INPUTS; i++)
+        {
+            labels[i] = pf_rt_analyze_chroma(&analyzer, chroma_inputs[i]);
+        }
+        for (int c = 0; c < KPDVE_TUNE_LANES * 2; c++)
+        {
+            kpdve_tune_default_config(&configs[c]);
+            configs[c].axis_scale[0] += 0.1f * (float)c;
+            configs[c].metric = c & 1;
+        }
+        kpdve_tune_default_options(&options);
+        ready = 1;
+    }
+    kpdve_tune_evaluate_states(labels, INPUTS, configs, KPDVE_TUNE_LANES * 2, &options, scores);
+    sink = (long)scores[0].kp_right;
+    return (long)INPUTS * KPDVE_TUNE_LANES * 2;
+}
+
+// one update for each of INPUTS sessions per tick
+static long w_engine_tick(void)
+{
+    static pf_engine *engine = NULL;
+    static struct pf_update updates[INPUTS];
+    static struct pf_change changes[INPUTS];
+    static int round = 0;
+    if (engine == NULL)
+    {
+        engine = pf_engine_create(INPUTS, NULL);
+    }
+    for (int i = 0; i < INPUTS; i++)
+    {
+        updates[i].session = (uint32_t)i;
+        updates[i].chroma = (uint16_t)triad_inputs[(i + round) & (INPUTS - 1)];
+    }
+    round += 7;
+    sink = pf_engine_tick(engine, updates, INPUTS, changes);
+    return INPUTS;
+}
+
+// as scrollBinaryValues: every chroma value, in order, carrying the context along
+static long w_chroma_sweep(void)
+{
+    harmony_state state = harmony_state_default();
+    int context = 35;
+    for (int i = 0; i < 4096; i++)
+    {
+        adjust_harmony_state_from_chroma_and_context(&state, i, context);
+        if (state.kpdve_list_length > 0)
+        {
+            context = state.kpdve;
+        }
+    }
+    sink = state.encoded_state;
+    return 4096;
+}
+
+// as scrollKPDEvalues, over all keys: every KPDVE value
+static long w_kpdve_sweep(void)
+{
+    harmony_state state = harmony_state_default();
+    long frames = 0;
+    for (int k = 0; k < 12; k++)
+    for (int p = 0; p < 7; p++)
+    for (int d = 0; d < 7; d++)
+    for (int v = 0; v < 7; v++)
+    for (int e = 0; e < 7; e++)
+    {
+        int kpdve[] = { k, p, d, v, e };
+        adjust_harmony_state_from_kpdve(&state, KPDVEtoBinaryEncoding(kpdve));
+        frames++;
+    }
+    sink = state.encoded_state;
+    return frames;
+}
+
+// as the majorTriadSequence tests: triads modulating by half steps and fifths, both ways
+static long w_modulations(void)
+{
+    harmony_state state = harmony_state_default();
+    int context = 0;
+    long frames = 0;
+    static const int steps[] = { 1, -1, 7, -7 };
+    for (int s = 0; s < 4; s++)
+    {
+        for (int i = 0; i < 48; i++)
+        {
+            adjust_harmony_state_from_chroma_and_context(&state, mod_rot(CM, loop_mod(i * steps[s], 12), 12), context);
+            context = state.kpdve;
+            frames++;
+        }
+    }
+    sink = state.encoded_state;
+    return frames;
+}
+
+//////////////////////////////////// output stages (ops are frames)
+
+static int analyzed[INPUTS];
+
+static void make_analyzed(void)
+{
+    harmony_state state = harmony_state_default();
+    int context = 35;
+    for (int i = 0; i < INPUTS; i++)
+    {
+        // hold each triad for 8 frames, as a frame rate above the chord rate would
+        adjust_harmony_state_from_chroma_and_context(&state, triad_inputs[i / 8], context);
+        context = state.kpdve;
+        analyzed[i] = state.encoded_state;
+    }
+}
+
+static long o_codec_encode(void)
+{
+    static uint8_t coded[KPDVE_CODEC_HEADER_SIZE + INPUTS * 6];
+    sink = kpdve_codec_encode_chunk(analyzed, INPUTS, coded, sizeof(coded));
+    return INPUTS;
+}
+
+static long o_codec_decode(void)
+{
+    static uint8_t coded[KPDVE_CODEC_HEADER_SIZE + INPUTS * 6];
+    static long coded_len = -1;
+    static int decoded[INPUTS];
+    if (coded_len < 0)
+    {
+        coded_len = kpdve_codec_encode_chunk(analyzed, INPUTS, coded, sizeof(coded));
+    }
+    sink = kpdve_codec_decode_chunk(coded, (size_t)coded_len, decoded, INPUTS, NULL);
+    return INPUTS;
+}
+
+static long o_format_csv(void)
+{
+    static kpdve_textbuf buf;
+    kpdve_textbuf_clear(&buf);
+    kpdve_format_states(&buf, KPDVE_FORMAT_CSV, analyzed, INPUTS, 0);
+    sink = (long)buf.len;
+    return INPUTS;
+}
+
+static long o_format_jsonl(void)
+{
+    static kpdve_textbuf buf;
+    kpdve_textbuf_clear(&buf);
+    kpdve_format_states(&buf, KPDVE_FORMAT_JSONL, analyzed, INPUTS, 0);
+    sink = (long)buf.len;
+    return INPUTS;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+    {
+        min_seconds = atof(argv[1]);
+    }
+    if (argc > 2)
+    {
+        filter = argv[2];
+    }
+
+    make_inputs();
+    make_analyzed();
+
+#ifdef __OPTIMIZE__
+    const char *optimized = "true";
+#else
+    const char *optimized = "false";
+#endif
+#ifdef __VERSION__
+    const char *compiler = __VERSION__;
+#else
+    const char *compiler = "unknown";
+#endif
+
+    printf("{\n  \"benchmark\": \"pitchflock\",\n  \"compiler\": \"%s\",\n  \"optimized\": %s,\n  \"min_seconds\": %.3f,\n  \"results\": [",
+           compiler, optimized, min_seconds);
+
+    run("set_kp_list", "op", k_set_kp_list);
+    run("set_min_index", "op", k_set_min_index);
+    run("tables/set_kp_list", "op", k_tables_set_kp_list);
+    run("tables/set_min_index", "op", k_tables_set_min_index);
+    run("KPD_distance", "op", k_kpd_distance);
+    run("minimize_dve_value", "op", k_minimize_dve_value);
+    run("chroma_to_circle", "op", k_chroma_to_circle);
+    run("naming/chordNotesStringForKPDVE", "op", k_chord_notes_string);
+    run("naming/labels", "op", k_naming_labels);
+    run("naming/kpdveStringForKPDVE", "op", k_kpdve_string);
+    run("naming/name_table_labels", "op", k_name_table_labels);
+
+    run("analyze/random_triads", "frame", w_random_triads);
+    run("analyze/random_triads_timed", "frame", w_random_triads_timed);
+    run("analyze/random_chroma", "frame", w_random_chroma);
+    run("analyze/rt_random_chroma", "frame", w_rt_random_chroma);
+    run("analyze/rt_anchored", "frame", w_rt_anchored);
+    run("analyze/rt_prior", "frame", w_rt_prior);
+    run("analyze/tune_configs", "op", w_tune_configs);
+    run("analyze/engine_tick", "frame", w_engine_tick);
+    run("analyze/chroma_sweep", "frame", w_chroma_sweep);
+    run("analyze/kpdve_sweep", "frame", w_kpdve_sweep);
+    run("analyze/modulations", "frame", w_modulations);
+
+    run("output/codec_encode", "frame", o_codec_encode);
+    run("output/codec_decode", "frame", o_codec_decode);
+    run("output/format_csv", "frame", o_format_csv);
+    run("output/format_jsonl", "frame", o_format_jsonl);
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,619 @@
+//
+//  pitchflock.hpp
+//  pitchflock
+//
+
+#ifndef pitchflock_hpp
+#define pitchflock_hpp
+
+/**
+ * @file pitchflock.hpp
+ * @brief C++17 header-only layer: the KPDVE value type, compile-time crystal tables and
+ * an analyzer specialized on the crystal.
+ *
+ * Everything the C library computes at run time from the crystal (masks, the DVE/VE
+ * minimizer, the candidate lists, the per-axis distances) is computed here in constexpr
+ * functions and stored in static constexpr members of pitchflock::crystal<M>, so an
+ * analyzer<crystal<1>> compiles to loads from constant tables and loops with constant
+ * bounds. The rules are those of qdkpdve_crystal.h (which states them for any crystal),
+ * and on 12/7 the tables are bit-identical to the C tables: crystal<1>::tables() is a
+ * kpdve_tables over them that the C functions accept.
+ *
+ * Interoperation with the C structs:
+ *
+ *   kpdve                  <-> the 16-bit KPDVE encoding (int), kpdve_crystal_candidate
+ *   analyzer<crystal<1>>   fills harmony_state lists and choices as set_kp_list and
+ *                          set_min_index do
+ *   crystal<1>::tables()   a kpdve_tables for kpdve_tables_choose, pf_engine_create,
+ *                          pf_rt_init...
+ *
+ * The 12/7 candidate table is built at compile time (about 350k cell tests); larger
+ * crystals have constexpr masks but minimize each candidate when it is listed, since
+ * their minimizer tables are too large for the compilers' constexpr limits.
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "harmony_state.h"
+#include "qdkpdve_crystal.h"
+#include "qdkpdve_tables.h"
+
+namespace pitchflock {
+
+using chroma_t = std::uint64_t;
+
+/**
+ * @brief A KPDVE location. encode() and decode() are the 16-bit layout of
+ * KPDVEtoBinaryEncoding (K in the top bits, 3 bits for each of P, D, V, E).
+ */
+struct kpdve {
+    int k = 0, p = 0, d = 0, v = 0, e = 0;
+
+    constexpr kpdve() = default;
+    constexpr kpdve(int k_, int p_, int d_, int v_, int e_) : k(k_), p(p_), d(d_), v(v_), e(e_) {}
+
+    static constexpr kpdve decode(int encoded)
+    {
+        return kpdve(encoded >> 12, (encoded >> 9) & 7, (encoded >> 6) & 7, (encoded >> 3) & 7, encoded & 7);
+    }
+    static constexpr kpdve from_c(const kpdve_crystal_candidate &c) { return kpdve(c.k, c.p, c.d, c.v, c.e); }
+
+    // as KPDVEtoBinaryEncoding: fields OR-ed in 3-bit steps (E of -1 makes -1)
+    constexpr int encode() const { return (((((k << 3 | p) << 3) | d) << 3 | v) << 3) | e; }
+    // x---KKKKPPPDDDVVVEEEb-a-g-fe-d-c (as kpdve_chromatic_byte)
+    constexpr int encoded_state(int chroma) const { return (encode() << 12) | chroma; }
+    constexpr bool same_kp(const kpdve &o) const { return k == o.k && p == o.p; }
+
+    constexpr bool operator==(const kpdve &o) const { return k == o.k && p == o.p && d == o.d && v == o.v && e == o.e; }
+    constexpr bool operator!=(const kpdve &o) const { return !(*this == o); }
+};
+
+/**
+ * @brief A candidate: the location and the DVE and VE bit patterns (as dve_list, ve_list).
+ */
+struct candidate {
+    kpdve location;
+    std::uint32_t dve = 0;
+    std::uint32_t ve = 0;
+};
+
+namespace detail {
+
+constexpr int loop_mod(int x, int m)
+{
+    int r = x % m;
+    return r < 0 ? r + m : r;
+}
+
+constexpr std::uint64_t bunch(int breadth)
+{
+    return breadth >= 64 ? ~0ull : (1ull << breadth) - 1;
+}
+
+// mod_rot on n bits
+constexpr std::uint64_t rot(std::uint64_t val, int r, int n)
+{
+    r = loop_mod(r, n);
+    return r == 0 ? (val & bunch(n)) : bunch(n) & ((val << r) | (val >> (n - r)));
+}
+
+constexpr int largest_bit(std::uint64_t val)
+{
+    int bit = -1;
+    while (val != 0)
+    {
+        bit++;
+        val >>= 1;
+    }
+    return bit;
+}
+
+constexpr bool is_prime(int n)
+{
+    if (n < 2)
+    {
+        return false;
+    }
+    for (int i = 2; i * i <= n; i++)
+    {
+        if (n % i == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// modDistance, in the same float steps
+constexpr float mod_distance(int a, int b, int m)
+{
+    float diff = (float)b - (float)a;
+    diff = diff < 0 ? -diff : diff;
+    float wrapped = (float)m - diff;
+    return diff < wrapped ? diff : wrapped;
+}
+
+// the library's weights (kpdve_default_axis_scale), as floats
+constexpr float axis_scale[5] = KPDVE_AXIS_SCALE;
+
+struct minimized {
+    int d = 0, v = 0, e = -1;
+    std::uint32_t ve = 0;
+};
+
+} // namespace detail
+
+/**
+ * @brief The crystal of multiple M: N = 12M notes, q = 6M + 1 notes per mode.
+ */
+template <int M>
+struct crystal {
+    static constexpr int multiple = M;
+    static constexpr int notes = 12 * M;
+    static constexpr int division = 6 * M + 1;
+    static constexpr int cells = notes * division;
+
+    static_assert(M >= 1 && notes <= 60, "a crystal's notes must fit 64 bits");
+    static_assert(detail::is_prime(6 * M + 1) && detail::is_prime(6 * M - 1), "the divisions must be twin primes");
+
+    // apply_p_filt: P moves one note of the mode by q circle positions
+    static constexpr std::uint64_t p_filter(std::uint64_t val, int p)
+    {
+        if (p == 0)
+        {
+            return val;
+        }
+        int offset = (p <= (division - 1) / 2) ? p - 1 : p - division;
+        std::uint64_t filter = detail::rot(1ull | (1ull << division), offset, notes);
+        return (filter & val) ? val ^ filter : val;
+    }
+
+    static constexpr int circle_position(int note) { return (division * note + 1) % notes; }
+
+    static constexpr std::uint64_t chroma_to_circle(chroma_t chroma)
+    {
+        std::uint64_t circle = 0;
+        for (int i = 0; i < notes; i++)
+        {
+            circle |= ((chroma >> i) & 1) << circle_position(i);
+        }
+        return circle;
+    }
+
+    static constexpr chroma_t circle_to_chroma(std::uint64_t circle)
+    {
+        chroma_t chroma = 0;
+        for (int i = 0; i < notes; i++)
+        {
+            chroma |= ((circle >> circle_position(i)) & 1) << i;
+        }
+        return chroma;
+    }
+
+    // V = 1, 2, 4.. below q and their inverses mod q
+    static constexpr int v_count()
+    {
+        int count = 0;
+        for (int v = 1; v < division; v <<= 1)
+        {
+            count++;
+        }
+        return count;
+    }
+
+    static constexpr std::array<int, v_count()> make_v_inverse()
+    {
+        std::array<int, v_count()> inverse{};
+        int v = 1;
+        for (int i = 0; i < v_count(); i++, v <<= 1)
+        {
+            int x = 1;
+            while ((x * v) % division != 1)
+            {
+                x++;
+            }
+            inverse[i] = x;
+        }
+        return inverse;
+    }
+    static constexpr std::array<int, v_count()> v_inverse = make_v_inverse();
+
+    // minimize_ve_value, then minimize_dve_value, for a q-bit mode subset
+    static constexpr detail::minimized minimize(std::uint32_t val)
+    {
+        detail::minimized best;
+        std::uint32_t slide = val;
+        std::uint32_t low = 1u << division;
+        for (int i = 0; i < division; i++)
+        {
+            if (slide & 1)
+            {
+                detail::minimized test;
+                for (int j = 0; j < v_count(); j++)
+                {
+                    std::uint32_t permuted = 0;
+                    for (int b = 0; b < division; b++)
+                    {
+                        permuted |= ((slide >> b) & 1u) << ((b * v_inverse[j]) % division);
+                    }
+                    if (slide >= permuted)
+                    {
+                        test.ve = permuted;
+                        test.v = 1 << j;
+                        test.e = detail::largest_bit(permuted);
+                    }
+                }
+                if (low >= test.ve)
+                {
+                    best = test;
+                    best.d = i;
+                    low = test.ve;
+                }
+            }
+            slide = (std::uint32_t)detail::rot(slide, -1, division);
+        }
+        return best;
+    }
+
+    // the minimizer for every subset of the mode, where that is cheap to build at compile
+    // time (12/7: 128 entries; 24/13 would take 8192, past the compilers' constexpr limits)
+    static constexpr bool tabulated = division <= 7;
+    static constexpr std::size_t minimized_size = tabulated ? (std::size_t)1 << division : 1;
+
+    static constexpr std::array<detail::minimized, minimized_size> make_minimized()
+    {
+        std::array<detail::minimized, minimized_size> table{};
+        if (tabulated)
+        {
+            for (std::size_t i = 0; i < minimized_size; i++)
+            {
+                table[i] = minimize((std::uint32_t)i);
+            }
+        }
+        return table;
+    }
+    static constexpr std::array<detail::minimized, minimized_size> minimizer = make_minimized();
+
+    static constexpr detail::minimized lookup(std::uint32_t val)
+    {
+        if constexpr (tabulated)
+        {
+            return minimizer[val];
+        }
+        else
+        {
+            return minimize(val);
+        }
+    }
+
+    static constexpr std::array<std::uint64_t, cells> make_masks()
+    {
+        std::array<std::uint64_t, cells> masks{};
+        for (int i = 0; i < cells; i++)
+        {
+            masks[i] = detail::rot(p_filter(detail::bunch(division), i % division), i / division, notes);
+        }
+        return masks;
+    }
+    static constexpr std::array<std::uint64_t, cells> masks = make_masks();
+
+    // per-axis distances, as summed by KPD_distance
+    template <int Mod, std::size_t Size>
+    static constexpr std::array<float, Size * Size> make_distance(int axis)
+    {
+        std::array<float, Size * Size> table{};
+        for (std::size_t a = 0; a < Size; a++)
+        {
+            for (std::size_t b = 0; b < Size; b++)
+            {
+                table[a * Size + b] = detail::mod_distance((int)a, (int)b, Mod) * detail::axis_scale[axis];
+            }
+        }
+        return table;
+    }
+    // P and D rows are padded to a power of two, as in kpdve_tables (8 for q = 7)
+    static constexpr std::size_t pd_size = (std::size_t)1 << (detail::largest_bit((std::uint64_t)division) + 1);
+    static constexpr std::array<float, notes * notes> k_distance = make_distance<notes, notes>(0);
+    static constexpr std::array<float, pd_size * pd_size> p_distance = make_distance<division, pd_size>(1);
+    static constexpr std::array<float, pd_size * pd_size> d_distance = make_distance<division, pd_size>(2);
+
+    static constexpr kpdve default_context()
+    {
+        return M == 1 ? kpdve::decode(34) : kpdve(0, 0, 0, 1, 0); // harmony_state_default
+    }
+};
+
+namespace detail {
+
+using c12 = crystal<1>;
+
+constexpr std::array<std::uint16_t, KPDVE_TABLES_CELLS> make_crystal_masks()
+{
+    std::array<std::uint16_t, KPDVE_TABLES_CELLS> masks{};
+    for (int i = 0; i < KPDVE_TABLES_CELLS; i++)
+    {
+        masks[i] = (std::uint16_t)c12::masks[i];
+    }
+    return masks;
+}
+
+constexpr std::array<std::uint32_t, 128> make_minimized()
+{
+    std::array<std::uint32_t, 128> packed{};
+    for (std::uint32_t i = 0; i < 128; i++)
+    {
+        minimized m = c12::minimizer[i];
+        packed[i] = (std::uint32_t)m.d | ((std::uint32_t)m.v << 3) | (((std::uint32_t)m.e & 7) << 6)
+                  | (i << 9) | (m.ve << 16);
+    }
+    return packed;
+}
+
+struct candidate_table {
+    std::array<std::uint16_t, KPDVE_TABLES_CHROMA + 1> offsets{};
+    std::array<std::uint32_t, KPDVE_TABLES_CANDIDATES> candidates{};
+};
+
+// as set_kp_list, for every chroma value (the empty one fits every cell, as 0xFFFF)
+constexpr candidate_table make_candidates()
+{
+    candidate_table t{};
+    int count = 0;
+    for (int chroma = 0; chroma < KPDVE_TABLES_CHROMA; chroma++)
+    {
+        t.offsets[chroma] = (std::uint16_t)count;
+        std::uint64_t circle = c12::chroma_to_circle((chroma_t)chroma);
+        for (int i = 0; i < KPDVE_TABLES_CELLS; i++)
+        {
+            if ((c12::masks[i] & circle) != circle)
+            {
+                continue;
+            }
+            int k = i / 7, p = i % 7;
+            std::uint32_t dve = (std::uint32_t)c12::p_filter(rot(circle, -k, 12), p) & 0x7F;
+            minimized m = c12::minimizer[dve];
+            std::uint32_t location = circle == 0 ? KPDVE_CANDIDATE_NONE : (std::uint32_t)kpdve(k, p, m.d, m.v, m.e).encode();
+            t.candidates[count++] = location | (dve << 16) | (m.ve << 23);
+        }
+    }
+    t.offsets[KPDVE_TABLES_CHROMA] = (std::uint16_t)count;
+    return t;
+}
+
+} // namespace detail
+
+/**
+ * @brief The 12/7 tables in the packed layout of qdkpdve_tables.h, built at compile time.
+ */
+struct tables12 {
+    using c = crystal<1>;
+
+    static constexpr std::array<std::uint16_t, KPDVE_TABLES_CELLS> crystal_masks = detail::make_crystal_masks();
+    static constexpr std::array<std::uint32_t, 128> minimized = detail::make_minimized();
+    static constexpr detail::candidate_table candidates = detail::make_candidates();
+
+    /**
+     * @brief The compile-time tables as a kpdve_tables, for the C functions that take one.
+     */
+    static kpdve_tables view()
+    {
+        kpdve_tables t;
+        t.crystal_masks = crystal_masks.data();
+        t.minimized = minimized.data();
+        t.offsets = candidates.offsets.data();
+        t.candidates = candidates.candidates.data();
+        t.k_distance = c::k_distance.data();
+        t.p_distance = c::p_distance.data();
+        t.d_distance = c::d_distance.data();
+        return t;
+    }
+};
+
+/**
+ * @brief Analysis in one crystal: candidates (set_kp_list), choice (set_min_index), and a
+ * running context.
+ *
+ * 12/7 reads its candidates from the compile-time table; other crystals test each cell
+ * against the constexpr masks (a loop with a constant trip count) and minimize through
+ * the constexpr table.
+ */
+template <class Crystal>
+class analyzer {
+public:
+    using crystal_type = Crystal;
+    static constexpr int max_candidates = Crystal::cells;
+
+    constexpr analyzer() : context_(Crystal::default_context()) {}
+
+    // the candidates of a chroma (bit i is note i; bits from the Nth up ignored), into out[max_candidates];
+    // none for silence
+    static constexpr int candidates(chroma_t chroma, candidate *out)
+    {
+        chroma &= detail::bunch(Crystal::notes);
+        if (chroma == 0)
+        {
+            return 0;
+        }
+        if constexpr (Crystal::multiple == 1)
+        {
+            int first = tables12::candidates.offsets[chroma];
+            int count = tables12::candidates.offsets[chroma + 1] - first;
+            for (int i = 0; i < count; i++)
+            {
+                std::uint32_t packed = tables12::candidates.candidates[first + i];
+                out[i].location = kpdve::decode((int)(packed & 0xFFFF));
+                out[i].dve = (packed >> 16) & 0x7F;
+                out[i].ve = (packed >> 23) & 0x7F;
+            }
+            return count;
+        }
+        else
+        {
+            std::uint64_t circle = Crystal::chroma_to_circle(chroma);
+            int count = 0;
+            for (int i = 0; i < Crystal::cells; i++)
+            {
+                if ((Crystal::masks[i] & circle) != circle)
+                {
+                    continue;
+                }
+                int k = i / Crystal::division, p = i % Crystal::division;
+                auto dve = (std::uint32_t)Crystal::p_filter(detail::rot(circle, -k, Crystal::notes), p);
+                detail::minimized m = Crystal::lookup(dve);
+                out[count].location = kpdve(k, p, m.d, m.v, m.e);
+                out[count].dve = dve;
+                out[count].ve = m.ve;
+                count++;
+            }
+            return count;
+        }
+    }
+
+    // set_min_index: the candidate in the context's K and P, otherwise the first closest one.
+    // A context outside the distance tables (K not in 0..notes-1, P or D not in 0..pd_size-1,
+    // as decode(-1) gives) is ranked on the modular distances themselves, as set_min_index does
+    static constexpr int choose(const candidate *list, int count, const kpdve &context)
+    {
+        if (count == 0)
+        {
+            return -1;
+        }
+        if (context.k < 0 || context.k >= Crystal::notes || context.p < 0 || context.p >= (int)Crystal::pd_size
+            || context.d < 0 || context.d >= (int)Crystal::pd_size)
+        {
+            return choose_outside(list, count, context);
+        }
+        const float *k_row = Crystal::k_distance.data() + context.k * Crystal::notes;
+        const float *p_row = Crystal::p_distance.data() + context.p * Crystal::pd_size;
+        const float *d_row = Crystal::d_distance.data() + context.d * Crystal::pd_size;
+        float min_dist = 100.0f;
+        int min_index = 0;
+        for (int i = 0; i < count; i++)
+        {
+            const kpdve &l = list[i].location;
+            if (l.same_kp(context))
+            {
+                return i;
+            }
+            float dist = 0;
+            dist += k_row[l.k];
+            dist += p_row[l.p];
+            dist += d_row[l.d];
+            if (dist < min_dist)
+            {
+                min_dist = dist;
+                min_index = i;
+            }
+        }
+        return min_index;
+    }
+
+    // choose for a context outside the tables: KPD_distance's sum, term by term
+    static constexpr int choose_outside(const candidate *list, int count, const kpdve &context)
+    {
+        float min_dist = 100.0f;
+        int min_index = 0;
+        for (int i = 0; i < count; i++)
+        {
+            const kpdve &l = list[i].location;
+            if (l.same_kp(context))
+            {
+                return i;
+            }
+            float dist = 0;
+            dist += detail::mod_distance(l.k, context.k, Crystal::notes) * detail::axis_scale[0];
+            dist += detail::mod_distance(l.p, context.p, Crystal::division) * detail::axis_scale[1];
+            dist += detail::mod_distance(l.d, context.d, Crystal::division) * detail::axis_scale[2];
+            if (dist < min_dist)
+            {
+                min_dist = dist;
+                min_index = i;
+            }
+        }
+        return min_index;
+    }
+
+    // candidates and choice against the running context, which follows the choice
+    constexpr int analyze(chroma_t chroma)
+    {
+        count_ = candidates(chroma, list_.data());
+        index_ = choose(list_.data(), count_, context_);
+        if (index_ >= 0)
+        {
+            context_ = list_[index_].location;
+        }
+        return index_;
+    }
+
+    constexpr const kpdve &context() const { return context_; }
+    constexpr void set_context(const kpdve &context) { context_ = context; }
+    constexpr int count() const { return count_; }
+    constexpr int index() const { return index_; }
+    constexpr const candidate &operator[](int i) const { return list_[i]; }
+
+    /**
+     * @brief set_kp_list, then set_min_index against context, on a harmony_state (12/7);
+     * the state's kpdve and encoded_state follow the choice as in choose_kpdve_from_context.
+     *
+     * Silence is filled as set_kp_list fills it: every cell holds the empty set, so the
+     * list has 84 placeholders (KPDVE -1, DVE and VE 0) and the choice is the first,
+     * although candidates() reports none for it. A chroma no cell holds (more than seven
+     * notes) leaves the list as it was and, as choose_kpdve_from_context does, takes its
+     * first entry with the new chroma and the invalid bit.
+     */
+    template <class C = Crystal>
+    static void fill(harmony_state &state, int context)
+    {
+        static_assert(C::multiple == 1, "harmony_state holds 12/7 analyses only");
+        if ((state.chromatic_notes & 0xFFF) == 0)
+        {
+            for (int i = 0; i < max_candidates; i++)
+            {
+                state.kpdve_list[i] = -1;
+                state.dve_list[i] = 0;
+                state.ve_list[i] = 0;
+            }
+            state.kpdve_list_length = max_candidates;
+            state.kpdve_min_index = 0;
+            state.kpdve = -1;
+            state.dve = 0;
+            state.ve = 0;
+            state.encoded_state = (int)(~0u << 12) | state.chromatic_notes;
+            return;
+        }
+        std::array<candidate, max_candidates> list{};
+        int count = candidates((chroma_t)state.chromatic_notes, list.data());
+        for (int i = 0; i < count; i++)
+        {
+            state.kpdve_list[i] = list[i].location.encode();
+            state.dve_list[i] = (int)list[i].dve;
+            state.ve_list[i] = (int)list[i].ve;
+        }
+        state.kpdve_list_length = count;
+        int index = choose(list.data(), count, kpdve::decode(context));
+        state.kpdve_min_index = index < 0 ? 0 : index;
+        state.kpdve = state.kpdve_list[state.kpdve_min_index];
+        state.dve = state.dve_list[state.kpdve_min_index];
+        state.ve = state.ve_list[state.kpdve_min_index];
+        state.encoded_state = (int)((unsigned int)state.kpdve << 12) | state.chromatic_notes;
+        if (index < 0)
+        {
+            state.encoded_state |= (int)0x80000000u;
+        }
+    }
+
+private:
+    kpdve context_;
+    std::array<candidate, max_candidates> list_{};
+    int count_ = 0;
+    int index_ = -1;
+};
+
+using crystal12 = crystal<1>;
+using crystal24 = crystal<2>;
+
+} // namespace pitchflock
+
+#endif /* pitchflock_hpp */
@@ -11,6 +11,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Define constants for chromaCount and primeDivision
 #define CHROMA_COUNT 12
 #define PRIME_DIVISION 7
@@ -60,4 +64,8 @@ int pdve_chord_val(int p, int d, int v, int e);
 int kpdve_val(int kpdve);
 int kpdve_chord_val(int kpdve);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* qdkpdve_h */
@@ -13,6 +13,10 @@
 #include <stdio.h>
 #include "qdkpdve.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 struct ve_value
  {
      int bin_val; // seven bits, with bits to be adjusted rightward (lowest possible value)
@@ -52,4 +56,8 @@ struct kpdve_value make_kpdve(int input_val);
 struct ve_value minimize_ve_value(struct ve_value ve_val);
 struct dve_value minimize_dve_value(struct dve_value dve_val);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* qdkpdve_analysis_h */
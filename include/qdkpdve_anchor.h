@@ -0,0 +1,82 @@
+//
+//  qdkpdve_anchor.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_anchor_h
+#define qdkpdve_anchor_h
+
+#include <stdint.h>
+
+#include "qdkpdve_tables.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_anchor.h
+ * @brief A long-memory context: the exponentially decayed distribution of the K x P
+ * cells a stream has been analyzed in, used as a second distance term by the chooser.
+ *
+ * The context of set_min_index is the previous analysis only, so a stream that drifts
+ * one step at a time can wander away from where it has been. The anchor is the origin
+ * its comment asks for: every analyzed frame adds its cell with weight 1, and older
+ * frames count for 2^(-age / half_life). The chooser then adds, to each candidate's
+ * distance from the context,
+ *
+ *   weight * (mean K distance + mean P distance from the candidate to the anchor)
+ *
+ * with the means taken over the decayed distribution and measured with the K and P
+ * distances of the tables given to kpdve_anchor_init (normally the chooser's). The
+ * choice rule is otherwise that of kpdve_tables_choose: a candidate in the context's K
+ * and P is still taken first, so the anchor only decides where a stream goes when it
+ * has to move. With weight 0 the choice is exactly kpdve_tables_choose's.
+ *
+ * Updates cost O(1): instead of decaying every cell each frame, the weight of the next
+ * frame grows by 2^(1 / half_life) (kept in 32.32 fixed point, so the growth of long
+ * half-lives, less than 1 per frame, is not truncated away), and cells, sums and
+ * increment are scaled down together by 2^-8 when the increment reaches 2^24, once
+ * every 8 half-lives. The per-K and per-P distance sums are kept the same way (12 and 8
+ * adds per frame), so a candidate's anchor term is two lookups. All counts are integers;
+ * only the final mean is a float.
+ *
+ * kpdve_anchor_reset, kpdve_anchor_update and kpdve_anchor_choose are RT-safe
+ * (qdkpdve_rt.h); pf_rt_set_anchor attaches an anchor to a pf_rt analyzer.
+ */
+
+#define KPDVE_ANCHOR_ONE (1u << 16)        /**< weight of a frame right after a rescale */
+#define KPDVE_ANCHOR_RESCALE (1u << 24)    /**< the increment is scaled down when it reaches this */
+#define KPDVE_ANCHOR_DISTANCE_ONE 1024     /**< fixed-point scale of the K and P distances */
+
+struct kpdve_anchor {
+    float weight;                /**< of the anchor term against the context distance */
+    uint32_t growth;             /**< per-frame growth of the increment, in 2^-32 */
+    uint32_t increment;          /**< weight of the next frame */
+    uint32_t fraction;           /**< and its fractional part, in 2^-32 */
+    uint64_t frames;             /**< frames added since the last reset */
+    uint64_t total;              /**< decayed weight of all frames */
+    uint64_t cells[KPDVE_TABLES_CELLS]; /**< decayed weight per cell (k * 7 + p) */
+    uint64_t k_sum[12];          /**< decayed sum of the K distances from each K */
+    uint64_t p_sum[8];           /**< decayed sum of the P distances from each P */
+    uint16_t k_fixed[12 * 12];   /**< the tables' K distances, fixed point */
+    uint16_t p_fixed[8 * 8];     /**< the tables' P distances, fixed point */
+};
+typedef struct kpdve_anchor kpdve_anchor;
+
+// not RT-safe (builds the tables on first use). Half-lives are clamped to 1 .. 2^20 frames.
+void kpdve_anchor_init(kpdve_anchor *anchor, const kpdve_tables *tables, double half_life_frames, float weight);
+
+// RT-safe
+void kpdve_anchor_reset(kpdve_anchor *anchor);
+void kpdve_anchor_update(kpdve_anchor *anchor, int kpdve);
+int kpdve_anchor_choose(const kpdve_tables *tables, const kpdve_anchor *anchor, int chroma, int context);
+
+float kpdve_anchor_distance(const kpdve_anchor *anchor, int kpdve);
+float kpdve_anchor_share(const kpdve_anchor *anchor, int k, int p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_anchor_h */
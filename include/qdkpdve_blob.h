@@ -0,0 +1,127 @@
+//
+//  qdkpdve_blob.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_blob_h
+#define qdkpdve_blob_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "qdkpdve_nametable.h"
+#include "qdkpdve_tables.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_blob.h
+ * @brief Analysis tables in one file, mapped read-only instead of built.
+ *
+ * A table blob holds everything the table engine and the name lookups use, for one
+ * configuration of axis weights (KPD_distance_weighted):
+ *
+ *   header           struct kpdve_blob_header (224 bytes)
+ *   crystal masks    uint16[KPDVE_TABLES_CELLS]
+ *   minimized        uint32[128]
+ *   offsets          uint16[KPDVE_TABLES_CHROMA + 1]
+ *   candidates       uint32[KPDVE_TABLES_CANDIDATES]
+ *   distances        float[12 * 12] K, float[8 * 8] P, float[8 * 8] D, for the weights
+ *   decisions        uint8[KPDVE_TABLES_CONTEXTS][KPDVE_TABLES_CHROMA]: the index
+ *                    kpdve_tables_choose gives for each context K, P, D and chroma
+ *                    (KPDVE_BLOB_NO_CHOICE where the chroma has no candidates)
+ *   name entries     struct kpdve_name_entry[KPDVE_NAME_TABLE_SIZE]
+ *   name pool        char[], offsets of the entries point into it
+ *
+ * Sections start on 64-byte boundaries, in native byte order (the magic number rejects
+ * foreign files). The checksum is a word-wise FNV-1a over the whole file with the
+ * checksum field zeroed.
+ *
+ * Decision rows are indexed as the prior's, k * 49 + p * 7 + d (KPDVE_PRIOR_INDEX).
+ * The tables depend on the K, P and D weights only; V and E stay the built-in ones.
+ *
+ * Opening maps the file shared and read-only, so every process using the same blob
+ * shares one page-cache copy of it. It checks the layout and bounds every index the
+ * blob holds (offsets, candidate K, decisions, name offsets into a NUL-terminated
+ * pool), reading all but the distances and the pool; a blob that passes cannot make
+ * a lookup read outside it, whatever its checksum. KPDVE_BLOB_VERIFY also checks the
+ * checksum.
+ * pitchflock_blob writes blobs and validates them against the tables the library builds.
+ */
+
+#define KPDVE_BLOB_MAGIC 0x31424650u /**< "PFB1" */
+#define KPDVE_BLOB_VERSION 1
+#define KPDVE_BLOB_NO_CHOICE 0xFF
+
+#define KPDVE_BLOB_OK 0
+#define KPDVE_BLOB_ERR_IO -1
+#define KPDVE_BLOB_ERR_FORMAT -2
+#define KPDVE_BLOB_ERR_MEMORY -3
+#define KPDVE_BLOB_ERR_CHECKSUM -4
+#define KPDVE_BLOB_ERR_CONTENT -5
+#define KPDVE_BLOB_ERR_WEIGHTS -6 /**< V or E weights other than the built-in ones */
+
+// kpdve_blob_open flags
+#define KPDVE_BLOB_VERIFY 0x01 /**< check the checksum as well */
+
+// sections, in file order
+#define KPDVE_BLOB_CRYSTAL_MASKS 0
+#define KPDVE_BLOB_MINIMIZED 1
+#define KPDVE_BLOB_OFFSETS 2
+#define KPDVE_BLOB_CANDIDATES 3
+#define KPDVE_BLOB_K_DISTANCE 4
+#define KPDVE_BLOB_P_DISTANCE 5
+#define KPDVE_BLOB_D_DISTANCE 6
+#define KPDVE_BLOB_DECISIONS 7
+#define KPDVE_BLOB_NAME_ENTRIES 8
+#define KPDVE_BLOB_NAME_POOL 9
+#define KPDVE_BLOB_SECTIONS 10
+
+struct kpdve_blob_section {
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct kpdve_blob_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t section_count;
+    uint64_t file_size;
+    uint64_t checksum;
+    float axis_scale[5];       /**< the K, P, D, V, E weights the distances and decisions use */
+    uint32_t reserved[3];
+    struct kpdve_blob_section sections[KPDVE_BLOB_SECTIONS];
+};
+
+/**
+ * @brief A mapped blob. The tables and names point straight into the mapping, so they
+ * can be passed wherever the built-in ones go (pf_engine_create, pf_rt_init...).
+ */
+struct kpdve_blob {
+    void *map;
+    size_t map_size;
+    const struct kpdve_blob_header *header;
+    kpdve_tables tables;
+    struct kpdve_name_table names;
+    const uint8_t *decisions;
+};
+typedef struct kpdve_blob kpdve_blob;
+
+int kpdve_blob_write(const char *path, const float *axis_scale);
+int kpdve_blob_open(kpdve_blob *blob, const char *path, int flags);
+void kpdve_blob_close(kpdve_blob *blob);
+int kpdve_blob_verify(const kpdve_blob *blob);
+int kpdve_blob_validate(const kpdve_blob *blob, int *section);
+
+// kpdve_tables_choose as a single load: chroma 0..4095; -1 if no candidates or the
+// context is not in the table (K >= 12, P or D of 7)
+int kpdve_blob_choose(const kpdve_blob *blob, int chroma, int context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_blob_h */
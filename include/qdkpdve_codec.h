@@ -0,0 +1,111 @@
+//
+//  qdkpdve_codec.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_codec_h
+#define qdkpdve_codec_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_codec.h
+ * @brief Compact coding of encoded_state sequences (x---KKKKPPPDDDVVVEEEb-a-g-fe-d-c).
+ *
+ * A stream is a sequence of independent chunks. Each chunk starts with a small header
+ * (magic, frame count, payload size) followed by byte-aligned tokens:
+ *
+ *   00LLLLLL              repeat the previous state L+1 times
+ *   01X-CCCC [cc cc]      same KPDVE, new chroma (X = invalid bit)
+ *   10XKDDD- [kkkkppp-] VVVEEE [cc cc]
+ *                         D as a delta (mod 7) from the previous state; K and P deltas
+ *                         (mod 12, mod 7) only when the K flag is set
+ *   11------ ssssssss x4  literal 32-bit state
+ *
+ * Chroma is coded through a 15-entry move-to-front cache: CCCC is the cache slot,
+ * or 15 when the 12-bit chroma follows as two literal bytes. The cache adapts to the
+ * chords actually present in the stream, so a chunk of repeated progressions codes
+ * most chroma in four bits. Every chunk resets the model, so chunks can be decoded
+ * independently (and in parallel).
+ */
+
+#define KPDVE_CODEC_MAGIC 0x31434650u /**< "PFC1" little endian */
+#define KPDVE_CODEC_HEADER_SIZE 12
+#define KPDVE_CODEC_CHUNK_FRAMES 65536 /**< default number of frames per chunk */
+
+#define KPDVE_CODEC_OK 0
+#define KPDVE_CODEC_ERR_SPACE -1   /**< output buffer too small */
+#define KPDVE_CODEC_ERR_CORRUPT -2 /**< malformed or truncated input */
+
+/**
+ * @brief Worst-case encoded size of a chunk of count frames (header included).
+ */
+size_t kpdve_codec_bound(size_t count);
+
+/**
+ * @brief Encodes one chunk of encoded_state values.
+ *
+ * @param states The encoded states to compress.
+ * @param count Number of states (at most UINT32_MAX).
+ * @param out Output buffer.
+ * @param out_cap Capacity of the output buffer; kpdve_codec_bound(count) is always enough.
+ * @return Number of bytes written, or KPDVE_CODEC_ERR_SPACE.
+ */
+long kpdve_codec_encode_chunk(const int *states, size_t count, uint8_t *out, size_t out_cap);
+
+/**
+ * @brief Reads the header of a chunk without decoding it.
+ *
+ * @param in Start of the chunk.
+ * @param in_len Bytes available.
+ * @param frame_count Receives the number of frames in the chunk.
+ * @param chunk_size Receives the total size of the chunk in bytes (header included).
+ * @return KPDVE_CODEC_OK or KPDVE_CODEC_ERR_CORRUPT.
+ */
+int kpdve_codec_chunk_info(const uint8_t *in, size_t in_len, size_t *frame_count, size_t *chunk_size);
+
+/**
+ * @brief Decodes one chunk.
+ *
+ * @param in Start of the chunk.
+ * @param in_len Bytes available (may extend past the chunk).
+ * @param states Output array.
+ * @param states_cap Capacity of the output array.
+ * @param consumed Receives the size of the chunk in bytes (may be NULL).
+ * @return Number of frames decoded, or a negative KPDVE_CODEC_ERR value.
+ */
+long kpdve_codec_decode_chunk(const uint8_t *in, size_t in_len, int *states, size_t states_cap, size_t *consumed);
+
+/**
+ * @brief Streaming encoder: buffers frames and emits one chunk every chunk_frames frames.
+ */
+struct kpdve_encoder {
+    int *pending;        /**< frames not yet coded */
+    size_t pending_count;
+    size_t chunk_frames;
+    uint8_t *chunk;      /**< scratch space for one coded chunk */
+    size_t chunk_cap;
+};
+typedef struct kpdve_encoder kpdve_encoder;
+
+/**
+ * @brief Writes a completed chunk somewhere (file, socket, memory).
+ * @return 0 on success, non-zero to abort the encoder.
+ */
+typedef int (*kpdve_codec_sink)(void *ctx, const uint8_t *bytes, size_t len);
+
+int kpdve_encoder_init(kpdve_encoder *enc, size_t chunk_frames);
+int kpdve_encoder_push(kpdve_encoder *enc, const int *states, size_t count, kpdve_codec_sink sink, void *ctx);
+int kpdve_encoder_finish(kpdve_encoder *enc, kpdve_codec_sink sink, void *ctx);
+void kpdve_encoder_free(kpdve_encoder *enc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_codec_h */
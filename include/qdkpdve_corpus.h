@@ -0,0 +1,99 @@
+//
+//  qdkpdve_corpus.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_corpus_h
+#define qdkpdve_corpus_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_corpus.h
+ * @brief Analysis of a whole corpus of input files on a work-stealing thread pool.
+ *
+ * Every input file is a chroma stream, in one of three formats:
+ *
+ *   KPDVE_CORPUS_CHROMA   uint16 per frame, the low 12 bits a chroma (b-a-g-fe-d-c);
+ *                         files named *.chroma
+ *   KPDVE_CORPUS_CODED    a codec stream (qdkpdve_codec.h), recognised by its magic
+ *   KPDVE_CORPUS_STATES   anything else: raw int32 encoded_state words
+ *
+ * Encoded states are re-analyzed from their chroma bits. Each file is analyzed as one
+ * stream from harmony_state_default(), frame after frame as
+ * adjust_harmony_state_from_chroma would (through the table engine, qdkpdve_tables.h),
+ * exactly as a single sequential pass would, and the
+ * results are appended to one store (qdkpdve_store.h) in input order.
+ *
+ * Files longer than segment_frames are split into segments. A segment after the first
+ * starts warmup_frames early from the default state, analyzing frames it then discards
+ * to re-establish the context. Segments are the tasks of the pool, dealt round-robin:
+ * each worker owns a deque of them and has its own harmony_state; an idle worker
+ * steals half of another worker's remaining tasks. A segment is started only within
+ * four segments per thread of the merge, so at most that many are held in memory at
+ * once, however large the corpus.
+ *
+ * The calling thread merges. At each seam it compares the warmed-up state with the
+ * state the previous segment really ended in; if they differ (the warm-up was too
+ * short to converge), it re-analyzes the segment from the true state before appending
+ * it. The store is therefore always identical to a sequential analysis; warm-up only
+ * decides how often that fallback is needed.
+ */
+
+#define KPDVE_CORPUS_CHROMA 1
+#define KPDVE_CORPUS_CODED 2
+#define KPDVE_CORPUS_STATES 3
+
+#define KPDVE_CORPUS_OK 0
+#define KPDVE_CORPUS_ERR_IO -1     /**< the store could not be written */
+#define KPDVE_CORPUS_ERR_MEMORY -2
+
+struct kpdve_corpus_options {
+    int threads;              /**< worker threads; 0 for one per online CPU */
+    size_t segment_frames;    /**< split files into segments of this many frames; 0 never splits */
+    size_t warmup_frames;     /**< frames analyzed before a segment to re-establish context */
+    uint32_t block_frames;    /**< store block size */
+    uint64_t frame_period;    /**< store time units per frame */
+};
+
+/**
+ * @brief What became of one input file.
+ */
+struct kpdve_corpus_file {
+    const char *path;
+    int format;               /**< KPDVE_CORPUS_ format, 0 if the file could not be read */
+    int err;                  /**< nonzero if the file could not be read or decoded; frames stops at the error */
+    uint64_t first_frame;     /**< where the file's frames start in the store */
+    size_t frames;
+    size_t invalid;           /**< frames with the x bit set */
+    size_t segments;
+};
+
+struct kpdve_corpus_result {
+    size_t files;             /**< files analyzed (without errors) */
+    size_t frames;
+    size_t segments;
+    size_t reanalyzed;        /**< segments whose warm-up did not converge, redone at the merge */
+    size_t steals;            /**< times a worker took tasks from another */
+    size_t peak_segments;     /**< most segments analyzed (or being analyzed) and not yet stored at once */
+    int threads;
+};
+
+void kpdve_corpus_default_options(struct kpdve_corpus_options *options);
+
+int kpdve_corpus_format(const char *path, const uint8_t *bytes, size_t size);
+
+int kpdve_corpus_analyze(const char *const *paths, size_t count, const char *store_path,
+                         const struct kpdve_corpus_options *options,
+                         struct kpdve_corpus_file *files, struct kpdve_corpus_result *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_corpus_h */
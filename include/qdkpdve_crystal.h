@@ -0,0 +1,97 @@
+//
+//  qdkpdve_crystal.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_crystal_h
+#define qdkpdve_crystal_h
+
+#include <stdint.h>
+
+#include "qdkpdve_harmonycrystal.h"
+#include "qdkpdve_tables.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_crystal.h
+ * @brief The analysis for any harmony crystal (harmonycrystal_atmultiple), not only 12/7.
+ *
+ * A crystal of multiple m divides N = 12m notes (24 for m = 2: quarter tones) and builds
+ * its patterns from q = 6m + 1 of them (7, 13, 19, 31), so it has N x q K, P cells. Each
+ * step of set_kp_list, set_min_index and the minimizers is the 12/7 one with 12 and 7
+ * replaced by N and q:
+ *
+ *   circle order   note i sits at (q * i + 1) mod N of the circle (q = 7: the circle of
+ *                  fifths from F); a cell's mode is q adjacent circle positions
+ *   patterns       P moves one note of the mode by q positions, as apply_p_filt: P = 1..
+ *                  (q - 1) / 2 at offsets 0, 1.., the rest at offsets -(q - 1) / 2..-1
+ *   D              the rotation of the q-note mode that gives the lowest VE
+ *   V, E           V is a power of two below q (1, 2, 4 for q = 7): the VE value is the
+ *                  mode read every V steps (bit i to bit i * V^-1 mod q); the reference
+ *                  keeps the last V whose value is no higher than V = 1's, and so does this
+ *   distance       KPD_distance's, with K mod N and P, D mod q
+ *
+ * The candidate list is sized for the crystal (N x q entries) instead of harmony_state's
+ * 84, and candidates are plain K, P, D, V, E fields, since beyond 12/7 they no longer fit
+ * the 16-bit KPDVE encoding. Chroma values are N-bit (bit i is note i), up to 60 notes.
+ *
+ * For the 12/7 crystal the analyzer runs on the candidate tables (qdkpdve_tables.h), with
+ * the reference's results, and the 12-tone API (harmony_state, set_kp_list...) does not
+ * change at all; clearing `fast` runs the general code on 12/7 too, which is how
+ * test_crystal checks that both agree with set_kp_list and set_min_index.
+ */
+
+#define KPDVE_CRYSTAL_MAX_NOTES 60
+
+struct kpdve_crystal_candidate {
+    int k, p, d, v, e;
+    uint32_t dve;         /**< the notes as a q-bit mode subset, K and P undone (as dve_list) */
+    uint32_t ve;          /**< the minimized VE bits (as ve_list) */
+    int kpdve;            /**< the 16-bit KPDVE encoding in the 12/7 crystal, -1 in others */
+};
+typedef struct kpdve_crystal_candidate kpdve_crystal_candidate;
+
+struct kpdve_crystal_analyzer {
+    harmonycrystal crystal;
+    int notes;                          /**< N = 12 * twelvemultiple */
+    int division;                       /**< q, notes per mode */
+    int cells;                          /**< N * q */
+    int fast;                           /**< 12/7: use the candidate tables (clear to force the general code) */
+    const kpdve_tables *tables;         /**< the 12/7 tables, NULL in other crystals */
+    uint64_t *cell_masks;               /**< [cells] circle-ordered notes of cell k * q + p */
+    int *circle_position;               /**< [N] circle position of each note */
+    int *v_inverse;                     /**< [v_count] V^-1 mod q, for V = 1, 2, 4.. */
+    int v_count;
+
+    kpdve_crystal_candidate *candidates; /**< [cells] the candidates of the last chroma */
+    int count;
+    int min_index;                      /**< the choice of the last analysis, -1 if none */
+    kpdve_crystal_candidate context;    /**< context for the next analysis (K, P, D used) */
+};
+typedef struct kpdve_crystal_analyzer kpdve_crystal_analyzer;
+
+int kpdve_crystal_init(kpdve_crystal_analyzer *analyzer, int twelvemult);
+void kpdve_crystal_free(kpdve_crystal_analyzer *analyzer);
+
+uint64_t kpdve_crystal_chroma_to_circle(const kpdve_crystal_analyzer *analyzer, uint64_t chroma);
+uint64_t kpdve_crystal_circle_to_chroma(const kpdve_crystal_analyzer *analyzer, uint64_t circle);
+
+// set_kp_list and set_min_index for the crystal
+int kpdve_crystal_candidates(kpdve_crystal_analyzer *analyzer, uint64_t chroma);
+int kpdve_crystal_choose(const kpdve_crystal_analyzer *analyzer, uint64_t chroma, const kpdve_crystal_candidate *context);
+float kpdve_crystal_distance(const kpdve_crystal_analyzer *analyzer, const kpdve_crystal_candidate *a, const kpdve_crystal_candidate *b);
+
+// both, against the analyzer's context, which follows the choice (-1: no candidates, context kept)
+int kpdve_crystal_analyze(kpdve_crystal_analyzer *analyzer, uint64_t chroma);
+
+// the notes of a candidate's chord (as kpdve_chord_val, in chroma order)
+uint64_t kpdve_crystal_chord(const kpdve_crystal_analyzer *analyzer, const kpdve_crystal_candidate *candidate);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_crystal_h */
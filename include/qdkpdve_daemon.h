@@ -0,0 +1,111 @@
+//
+//  qdkpdve_daemon.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_daemon_h
+#define qdkpdve_daemon_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_daemon.h
+ * @brief A local analysis server on a Unix domain socket, and its client functions.
+ *
+ * One daemon serves every process on the machine from one copy of the tables. Clients
+ * send batches of chroma frames for a session and get the encoded states back; the
+ * daemon keeps each session's context between batches, as pf_rt does for one stream.
+ *
+ * Framing (native byte order: the socket is local). Requests and responses share a
+ * 16-byte header:
+ *
+ *   uint32 tag      chosen by the client, echoed in the response
+ *   uint32 session  0 .. sessions - 1
+ *   uint16 op       PF_DAEMON_ANALYZE, _RESET or _SET_CONTEXT
+ *   uint16 status   0 in requests; a PF_DAEMON_STATUS_ value in responses
+ *   uint32 count    ANALYZE: frames that follow (at most max_frames); SET_CONTEXT: the
+ *                   context KPDVE; RESET: 0
+ *
+ * An ANALYZE request is followed by count uint16 chroma values, its response by count
+ * uint32 encoded states (x---KKKKPPPDDDVVVEEEb-a-g-fe-d-c, as pf_rt_analyze_chroma);
+ * other responses, and failed ones, carry no payload. Clients may pipeline any number of
+ * requests. Responses for one session come back in request order; responses for
+ * different sessions may overtake each other, which is what the tag is for.
+ *
+ * Inside, one thread runs an epoll loop over the listening socket and every connection,
+ * and hands each complete request to the worker owning its session (session % workers),
+ * which keeps a pf_rt_analyzer per session. Each session is only ever touched by one
+ * worker, in arrival order, so sessions need no locks. Workers pass responses back
+ * through a queue and an eventfd; the loop writes them out without blocking. A
+ * connection with max_pending requests in flight is not read until some complete.
+ *
+ * The server is Linux-only (epoll, eventfd); elsewhere pf_daemon_create fails with
+ * PF_DAEMON_ERR_UNSUPPORTED. The client functions are plain POSIX.
+ */
+
+#define PF_DAEMON_ANALYZE 1
+#define PF_DAEMON_RESET 2
+#define PF_DAEMON_SET_CONTEXT 3
+
+#define PF_DAEMON_STATUS_OK 0
+#define PF_DAEMON_STATUS_BAD_SESSION 1
+#define PF_DAEMON_STATUS_BAD_OP 2
+#define PF_DAEMON_STATUS_BAD_CONTEXT 3
+
+#define PF_DAEMON_OK 0
+#define PF_DAEMON_ERR_IO -1          /**< socket error (errno is set) */
+#define PF_DAEMON_ERR_MEMORY -2
+#define PF_DAEMON_ERR_UNSUPPORTED -3 /**< no server on this platform */
+#define PF_DAEMON_ERR_PROTOCOL -4    /**< malformed or oversized message */
+
+#define PF_DAEMON_MAX_FRAMES 65536   /**< default largest ANALYZE batch */
+
+struct pf_daemon_header {
+    uint32_t tag;
+    uint32_t session;
+    uint16_t op;
+    uint16_t status;
+    uint32_t count;
+};
+
+struct pf_daemon_options {
+    const char *path;       /**< socket path (an existing socket is replaced; any other file fails with EADDRINUSE) */
+    unsigned workers;       /**< analysis threads (0: one) */
+    uint32_t sessions;      /**< session ids accepted */
+    uint32_t max_frames;    /**< largest ANALYZE batch */
+    unsigned max_pending;   /**< requests in flight per connection before it is throttled */
+};
+
+struct pf_daemon_stats {
+    uint64_t connections;   /**< accepted so far */
+    uint64_t requests;
+    uint64_t frames;
+    uint64_t errors;        /**< connections closed for protocol errors */
+};
+
+typedef struct pf_daemon pf_daemon;
+
+// server
+void pf_daemon_default_options(struct pf_daemon_options *options);
+pf_daemon *pf_daemon_create(const struct pf_daemon_options *options, int *error);
+int pf_daemon_run(pf_daemon *daemon);
+void pf_daemon_stop(pf_daemon *daemon);
+void pf_daemon_destroy(pf_daemon *daemon);
+void pf_daemon_get_stats(const pf_daemon *daemon, struct pf_daemon_stats *stats);
+
+// client (blocking sockets)
+int pf_client_connect(const char *path);
+int pf_client_send(int fd, const struct pf_daemon_header *header, const uint16_t *chroma);
+int pf_client_recv(int fd, struct pf_daemon_header *header, uint32_t *states, size_t cap);
+int pf_client_analyze(int fd, uint32_t session, const uint16_t *chroma, uint32_t count, uint32_t *states);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_daemon_h */
@@ -0,0 +1,86 @@
+//
+//  qdkpdve_diffcheck.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_diffcheck_h
+#define qdkpdve_diffcheck_h
+
+#include <stdio.h>
+
+#include "harmony_state.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_diffcheck.h
+ * @brief Differential checker: alternative analysis engines against the reference code.
+ *
+ * An engine replaces set_kp_list and set_min_index. Every engine must give exactly the
+ * reference results (lists, their order, and the chosen index, ties included) for:
+ *
+ *   1. exhaustive: all 4096 chroma values, each against all 588 K, P, D contexts;
+ *   2. round trips: all 28812 KPDVE values through harmony_state_from_kpdve;
+ *   3. streams: long random chroma streams, each frame's context being the previous analysis.
+ *
+ * The cases are split across threads. Cases are numbered in the order above, and the
+ * report is always the lowest numbered divergence, whatever the thread timing.
+ */
+
+#define KPDVE_DIFF_EXHAUSTIVE 0
+#define KPDVE_DIFF_ROUNDTRIP 1
+#define KPDVE_DIFF_STREAM 2
+
+/**
+ * @brief An analysis engine: replacements for set_kp_list and set_min_index.
+ */
+struct kpdve_engine {
+    const char *name;
+    void (*set_kp_list)(harmony_state *a_state);
+    void (*set_min_index)(harmony_state *current_state, int context);
+};
+typedef struct kpdve_engine kpdve_engine;
+
+struct kpdve_diffcheck_options {
+    int threads;          /**< worker threads; 0 for one per online CPU */
+    int stream_count;     /**< random streams */
+    int stream_length;    /**< frames per stream */
+    unsigned int seed;    /**< seed of the first stream (stream i uses seed + i) */
+};
+
+/**
+ * @brief Result of a check. When diverged is set, the other fields describe the first divergence.
+ */
+struct kpdve_diffcheck_result {
+    long cases;           /**< cases compared (all of them if nothing diverged) */
+    int diverged;
+    const char *engine;
+    int suite;            /**< KPDVE_DIFF_EXHAUSTIVE, _ROUNDTRIP or _STREAM */
+    long case_index;      /**< within the suite */
+    int chroma;           /**< input chroma (exhaustive, stream) */
+    int context;          /**< context KPDVE (exhaustive, stream); -1 when the candidate lists differ */
+    int kpdve;            /**< input KPDVE (round trip) */
+    const char *field;    /**< what differed: "kpdve_list", "kpdve_min_index", "encoded_state", ... */
+    int field_index;      /**< list position for list fields, else -1 */
+    int expected;         /**< reference value */
+    int actual;           /**< engine value */
+};
+
+void kpdve_diffcheck_default_options(struct kpdve_diffcheck_options *options);
+
+// the alternative engines built into the library
+const kpdve_engine *kpdve_diffcheck_engines(int *count);
+
+int kpdve_diffcheck_engine(const kpdve_engine *engine, const struct kpdve_diffcheck_options *options,
+                           struct kpdve_diffcheck_result *result);
+int kpdve_diffcheck_all(const struct kpdve_diffcheck_options *options, struct kpdve_diffcheck_result *result);
+
+void kpdve_diffcheck_print(FILE *out, const struct kpdve_diffcheck_result *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_diffcheck_h */
@@ -0,0 +1,85 @@
+//
+//  qdkpdve_engine.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_engine_h
+#define qdkpdve_engine_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "qdkpdve_tables.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_engine.h
+ * @brief Many independent analysis sessions, stored as parallel arrays.
+ *
+ * A session is one running analysis (an instrument, a user, a room) with its own
+ * context. Instead of one 1 KB harmony_state per session, the engine keeps a few bytes
+ * per session in parallel arrays (context, last chroma, chosen KPDVE, encoded state,
+ * flags) and analyzes with the table engine (qdkpdve_tables.h), which needs no
+ * candidate lists in the session at all.
+ *
+ * A tick takes a batch of (session, chroma) updates, applied in batch order (a session
+ * may appear more than once), and reports each session whose encoded state ended up
+ * different from what it was before the tick.
+ *
+ * The choice is the reference's (set_kp_list then set_min_index with the session's
+ * context, which then becomes the chosen KPDVE). A frame that determines no KPDVE -- the
+ * empty chroma, or notes no pattern holds -- leaves the session's KPDVE and context as
+ * they were; the second kind is flagged invalid, as encode_and_validate_state does.
+ * (A harmony_state would instead pick up a leftover entry of its previous list.)
+ *
+ * An engine is used by one thread at a time.
+ */
+
+#define PF_SESSION_INVALID 0x01 /**< the last frame could not be analyzed */
+
+struct pf_update {
+    uint32_t session;
+    uint16_t chroma;  /**< 12-bit chroma (b-a-g-fe-d-c) */
+};
+
+struct pf_change {
+    uint32_t session;
+    int previous;     /**< encoded state before the tick */
+    int encoded;      /**< encoded state after the tick */
+};
+
+struct pf_engine {
+    size_t sessions;
+    const kpdve_tables *tables;
+    int default_kpdve;  /**< the state of a new or reset session */
+    int default_chroma;
+
+    // per session
+    int *context;       /**< context KPDVE for the next frame */
+    int *kpdve;         /**< chosen KPDVE */
+    int *encoded;       /**< x---KKKKPPPDDDVVVEEEb-a-g-fe-d-c */
+    uint16_t *chroma;   /**< last chroma */
+    uint8_t *flags;     /**< PF_SESSION_ flags */
+
+    // per tick scratch
+    int *tick_start;    /**< encoded state before the tick (valid while touched) */
+    uint8_t *touched;
+};
+typedef struct pf_engine pf_engine;
+
+pf_engine *pf_engine_create(size_t sessions, const kpdve_tables *tables);
+void pf_engine_destroy(pf_engine *engine);
+
+void pf_engine_reset_session(pf_engine *engine, uint32_t session);
+int pf_engine_set_context(pf_engine *engine, uint32_t session, int context);
+
+long pf_engine_tick(pf_engine *engine, const struct pf_update *updates, size_t count, struct pf_change *changes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_engine_h */
@@ -0,0 +1,55 @@
+//
+//  qdkpdve_format.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_format_h
+#define qdkpdve_format_h
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_format.h
+ * @brief Renders arrays of encoded_state values as aligned text, CSV or JSON lines.
+ *
+ * Each frame becomes one line with its index, the raw state, the invalid flag, the five
+ * KPDVE parameters, the chroma bits (b-a-g-fe-d-c) and the names from the name table
+ * (tonic, scale, distortion, mode, degree, root, chord notes). Everything is appended to
+ * a growable buffer with hand-rolled formatting; nothing goes through stdio.
+ *
+ * The names come from qdkpdve_nametable.h. The formatter builds the table on first
+ * use (once, whichever thread gets there first).
+ */
+
+#define KPDVE_FORMAT_TEXT 0  /**< aligned columns, like the test program's summary (no colors) */
+#define KPDVE_FORMAT_CSV 1   /**< comma separated, with a header line from kpdve_format_header */
+#define KPDVE_FORMAT_JSONL 2 /**< one JSON object per line */
+
+/**
+ * @brief A growable byte buffer. Zero-initialized is a valid empty buffer.
+ */
+struct kpdve_textbuf {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+typedef struct kpdve_textbuf kpdve_textbuf;
+
+int kpdve_textbuf_reserve(kpdve_textbuf *buf, size_t extra);
+void kpdve_textbuf_clear(kpdve_textbuf *buf);
+void kpdve_textbuf_free(kpdve_textbuf *buf);
+int kpdve_textbuf_writev(int fd, const kpdve_textbuf *bufs, int count);
+
+int kpdve_format_header(kpdve_textbuf *buf, int format);
+int kpdve_format_states(kpdve_textbuf *buf, int format, const int *states, size_t count, size_t first_frame);
+int kpdve_format_to_fd(int fd, int format, const int *states, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_format_h */
@@ -12,6 +12,10 @@
 #include <stdbool.h>
 #include "qdkpdve.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 struct harmonycrystal {
     int twelvemultiple;
     
@@ -29,4 +33,8 @@ int kp_for_harmonycrystal(harmonycrystal a_crystal, int k, int p);
 
 bool is_prime(int num);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* qdkpdve_harmonycrystal_h */
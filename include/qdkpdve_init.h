@@ -0,0 +1,47 @@
+//
+//  qdkpdve_init.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_init_h
+#define qdkpdve_init_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_init.h
+ * @brief One-time initialization of the library's shared tables.
+ *
+ * The shared tables (the candidate and distance tables of qdkpdve_tables.h, the name
+ * table of qdkpdve_nametable.h) are each built exactly once, under pthread_once, by
+ * whichever thread needs them first; every other thread that needs them meanwhile waits
+ * and then reads them without locks. pitchflock_init builds all of them at once, so a
+ * program can pay the cost at a moment of its choosing (about a millisecond) instead of
+ * in its first analysis.
+ *
+ * Two build options remove even that:
+ *
+ *   PITCHFLOCK_EAGER_INIT      build the tables from a load-time constructor, before main
+ *                              (CMake -DPITCHFLOCK_EAGER_INIT=ON, make EAGER=1)
+ *   PITCHFLOCK_PREBUILT_TABLES compile the tables into the library as const data,
+ *                              generated at build time by pitchflock_gentables; nothing
+ *                              is built at run time and the data is shared read-only
+ *                              between processes (CMake -DPITCHFLOCK_PREBUILT_TABLES=ON,
+ *                              make PREBUILT=1)
+ *
+ * For cross builds, run pitchflock_gentables on the host and pass its output with
+ * -DPITCHFLOCK_PREBUILT_TABLES_SOURCE=<file>.
+ */
+
+void pitchflock_init(void);
+
+// 1 if the tables are compiled into the library (PITCHFLOCK_PREBUILT_TABLES)
+int pitchflock_tables_prebuilt(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_init_h */
@@ -0,0 +1,70 @@
+//
+//  qdkpdve_latency.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_latency_h
+#define qdkpdve_latency_h
+
+#include <stdint.h>
+
+#include "harmony_state.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_latency.h
+ * @brief Log-bucketed latency histogram for the per-frame analysis call.
+ *
+ * Values (nanoseconds) below 32 have a bucket each; above that, every power of two is
+ * split into 32 buckets, so a percentile is reported within about 3% of the true value
+ * (and never above the recorded maximum). The whole 64-bit range fits in 1920 buckets.
+ *
+ * Recording is lock-free: one relaxed atomic add per sample, plus a compare-and-swap when
+ * a new maximum is seen. A reader on another thread can take a copy, and optionally
+ * reset the histogram at the same time, without stopping the recording thread and
+ * without losing samples: every sample lands in exactly one read.
+ *
+ * Times come from clock_gettime(CLOCK_MONOTONIC), which is a vDSO call (no system call)
+ * on Linux.
+ */
+
+#define KPDVE_LATENCY_SUB_BUCKETS 32
+#define KPDVE_LATENCY_BUCKETS (60 * KPDVE_LATENCY_SUB_BUCKETS)
+
+struct kpdve_latency_histogram {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[KPDVE_LATENCY_BUCKETS];
+};
+typedef struct kpdve_latency_histogram kpdve_latency_histogram;
+
+struct kpdve_latency_summary {
+    uint64_t count;
+    double mean_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+};
+
+void kpdve_latency_init(kpdve_latency_histogram *histogram);
+uint64_t kpdve_latency_now_ns(void);
+void kpdve_latency_record(kpdve_latency_histogram *histogram, uint64_t ns);
+
+void kpdve_latency_read(kpdve_latency_histogram *histogram, kpdve_latency_histogram *copy, int reset);
+uint64_t kpdve_latency_percentile(const kpdve_latency_histogram *copy, double percentile);
+void kpdve_latency_summarize(kpdve_latency_histogram *histogram, struct kpdve_latency_summary *summary, int reset);
+
+// adjust_harmony_state_from_chroma_and_context, timed into the histogram
+void adjust_harmony_state_from_chroma_and_context_timed(harmony_state *a_state, int chroma_val, int context,
+                                                        kpdve_latency_histogram *histogram);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_latency_h */
@@ -0,0 +1,72 @@
+//
+//  qdkpdve_nametable.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_nametable_h
+#define qdkpdve_nametable_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_nametable.h
+ * @brief Precomputed names for every KPDVE value.
+ *
+ * One entry per 16-bit KPDVE encoding (K < 12), holding offsets into a single interned
+ * string pool: any label is one load from the entry plus the pool base. The table is
+ * filled from the functions in qdkpdve_naming.h, which remain the reference.
+ *
+ * Offsets rather than pointers keep the table position independent, so the same bytes
+ * can be compiled in, written to a file or mapped read-only by several processes.
+ *
+ * Encodings with a P, D, V or E field of 7 are not KPDVE values; all their labels are "".
+ * Chord note strings have the same format as chordNotesStringForKPDVE ("F  A  C  ").
+ */
+
+#define KPDVE_NAME_TABLE_SIZE (12 << 12)           /**< 16-bit encodings with K < 12 */
+#define KPDVE_NAME_CHORD_POOL_SIZE (12 * 7 * 7 * 7 * 91) /**< 7 chord prefixes of 3..21 chars + NUL per KPDV */
+#define KPDVE_NAME_LABEL_POOL_SIZE 1024
+#define KPDVE_NAME_POOL_SIZE (KPDVE_NAME_LABEL_POOL_SIZE + KPDVE_NAME_CHORD_POOL_SIZE)
+
+struct kpdve_name_entry {
+    uint16_t tonic;       /**< conventionalTonicStringForKPDVE */
+    uint16_t scale;       /**< scaleNameForKPDVE */
+    uint16_t distortion;  /**< patternDistortionForKPDVE */
+    uint16_t mode;        /**< modeNameForKPDVE */
+    uint16_t degree;      /**< conventionalDegreeStringForKPDVE (roman numeral) */
+    uint16_t root;        /**< rootStringForKPDVE */
+    uint32_t chord;       /**< chordNotesStringForKPDVE */
+};
+
+struct kpdve_name_table {
+    const struct kpdve_name_entry *entries; /**< [KPDVE_NAME_TABLE_SIZE] */
+    const char *pool;
+    size_t pool_size;
+};
+
+// builds the table, once; thread-safe (a no-op when it is compiled in, see qdkpdve_init.h)
+void kpdve_name_table_init(void);
+// the table, for code that wants to index it directly (NULL before kpdve_name_table_init returns)
+const struct kpdve_name_table *kpdve_name_table(void);
+
+// table lookups: the same strings as the naming functions, without recomputation. Safe
+// from any thread at any time: the first lookup builds the table if kpdve_name_table_init
+// has not (which is not RT-safe, so RT code calls that first; see qdkpdve_init.h)
+const char* kpdve_name_tonic(int kpdve);
+const char* kpdve_name_scale(int kpdve);
+const char* kpdve_name_distortion(int kpdve);
+const char* kpdve_name_mode(int kpdve);
+const char* kpdve_name_degree(int kpdve);
+const char* kpdve_name_root(int kpdve);
+const char* kpdve_name_chord(int kpdve);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_nametable_h */
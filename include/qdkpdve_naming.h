@@ -16,6 +16,10 @@
 #include <string.h>
 #include "qdkpdve.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 extern char* noteStrings[];
 extern char* basePatternConventionalNames[];
 extern char* basePatternConventionalNamesShort[];
@@ -49,21 +53,27 @@ const char* conventionalDegreeStringForKPDVE(int kpdve);
 
 double freqRatioForKPDVE(int kpdve);
 
-// fill in the string buffer with the chord notes for a given KPDVE
-void chordNotesStringForKPDVE(int kpdve, char*stringBuf, size_t bufSize);
+// fill in the string buffer with the chord notes for a given KPDVE; returns the length of the string
+size_t chordNotesStringForKPDVE(int kpdve, char*stringBuf, size_t bufSize);
 
 // these will give a mode starting at the root of the chord (d)
-void modeNotesStringForKPDVE(int kpdve, char*stringBuf, size_t bufSize); // in the order of the voicing
-void modeNotesScaleStringForKPDVE(int kpdve, char* stringBuf, size_t bufSize); // in the order of the scale
-void modeNotesFifthsStringForKPDVE(int kpdve, char* stringBuf, size_t bufSize); // in the order of fifths
+size_t modeNotesStringForKPDVE(int kpdve, char*stringBuf, size_t bufSize); // in the order of the voicing
+size_t modeNotesScaleStringForKPDVE(int kpdve, char* stringBuf, size_t bufSize); // in the order of the scale
+size_t modeNotesFifthsStringForKPDVE(int kpdve, char* stringBuf, size_t bufSize); // in the order of fifths
 
 // Conventional names for consistency in the pattern naming. 
 const char* modeNameForKPDVE(int kpdve);
 const char* patternDistortionForKPDVE(int kpdve);
 const char* scaleNameForKPDVE(int kpdve);
 
-// utility for printing binary values
+// utility for printing binary values: writes "[ K. P. D. V. E]" into the buffer, returns the length
+size_t kpdveStringForKPDVE(int kpdve, char* stringBuf, size_t bufSize);
+// the same, in a per-thread buffer that is overwritten by the next call
 const char* kpdve_as_string(int kpdve);
 
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // QDKPDVE_NAMING_H
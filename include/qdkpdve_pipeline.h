@@ -0,0 +1,127 @@
+//
+//  qdkpdve_pipeline.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_pipeline_h
+#define qdkpdve_pipeline_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "qdkpdve_format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_pipeline.h
+ * @brief Stages of an end-to-end job on their own threads, passing batches of frames.
+ *
+ * A pipeline is a chain of stages (typically read -> chroma -> analyze -> format ->
+ * write). Each stage runs on its own thread and is connected to the next by a bounded
+ * single-producer, single-consumer queue of batch pointers, without locks. A fixed set
+ * of batches circulates: the last stage hands each batch back to the first through a
+ * recycle queue, so nothing is allocated per batch once the text buffers have grown.
+ *
+ * A stage that finds its input queue empty is starved; one that finds the next queue
+ * full is blocked (backpressure from a slower stage downstream). Both yield the CPU for a
+ * few tens of microseconds and then sleep until the other side moves the queue, so an idle
+ * stage costs no CPU; both are counted and timed per stage, next to the time spent working,
+ * so the slowest stage shows up as the one that is never starved or blocked.
+ *
+ * The first stage fills batches and returns KPDVE_PIPELINE_END with the last one (which
+ * may be empty); every later stage sees that batch too, so sinks can flush, and then
+ * stops. A negative return from any stage stops the whole pipeline.
+ */
+
+#define KPDVE_PIPELINE_MAX_STAGES 8
+#define KPDVE_PIPELINE_END 1       /**< returned by the first stage with the last batch */
+
+#define KPDVE_PIPELINE_OK 0
+#define KPDVE_PIPELINE_ERR_MEMORY -1
+#define KPDVE_PIPELINE_ERR_THREAD -2
+#define KPDVE_PIPELINE_ERR_STAGES -3 /**< no stages, or too many */
+
+/**
+ * @brief A batch of frames. The stages fill the arrays in turn.
+ */
+struct kpdve_batch {
+    uint64_t sequence;     /**< batch number in the stream, from 0 */
+    uint64_t first_frame;  /**< stream index of frame 0 of the batch */
+    size_t count;          /**< frames in the batch */
+    size_t cap;            /**< room in each array */
+    int format;            /**< KPDVE_CORPUS_ format of words (qdkpdve_corpus.h) */
+    int last;              /**< set on the last batch of the stream */
+    uint32_t *words;       /**< input words as read */
+    int *chroma;           /**< 12-bit chroma */
+    int *states;           /**< encoded states */
+    kpdve_textbuf text;    /**< formatted output */
+};
+typedef struct kpdve_batch kpdve_batch;
+
+/**
+ * @brief A stage: processes one batch in place.
+ *
+ * @return 0, KPDVE_PIPELINE_END (first stage only), or a negative error that stops the pipeline.
+ */
+typedef int (*kpdve_stage_fn)(void *ctx, kpdve_batch *batch);
+
+struct kpdve_stage_stats {
+    const char *name;
+    uint64_t batches;
+    uint64_t frames;
+    uint64_t busy_ns;        /**< inside the stage function */
+    uint64_t starved_ns;     /**< waiting for a batch from upstream */
+    uint64_t blocked_ns;     /**< waiting for room downstream */
+    uint64_t starved_waits;  /**< times the input queue was empty */
+    uint64_t blocked_waits;  /**< times the output queue was full */
+    uint64_t wall_ns;        /**< from the start of the run to the stage's end */
+};
+
+typedef struct kpdve_pipeline kpdve_pipeline;
+
+kpdve_pipeline *kpdve_pipeline_create(size_t batch_frames, size_t queue_depth);
+void kpdve_pipeline_destroy(kpdve_pipeline *pipeline);
+
+int kpdve_pipeline_add_stage(kpdve_pipeline *pipeline, const char *name, kpdve_stage_fn fn, void *ctx);
+int kpdve_pipeline_run(kpdve_pipeline *pipeline);
+
+int kpdve_pipeline_stage_count(const kpdve_pipeline *pipeline);
+void kpdve_pipeline_stats(const kpdve_pipeline *pipeline, int stage, struct kpdve_stage_stats *stats);
+void kpdve_pipeline_print(FILE *out, const kpdve_pipeline *pipeline);
+
+// the standard stages
+
+/**
+ * @brief Reader state: a file of uint16 chroma, raw int32 states or a codec stream.
+ */
+struct kpdve_read_stage {
+    FILE *in;
+    int format;            /**< KPDVE_CORPUS_CHROMA, _CODED or _STATES */
+    uint64_t frames;       /**< frames read so far */
+    // decoded codec chunk not yet passed on
+    uint8_t *chunk;
+    size_t chunk_cap;
+    int *decoded;
+    size_t decoded_cap;
+    size_t decoded_count;
+    size_t decoded_pos;
+};
+
+void kpdve_read_stage_init(struct kpdve_read_stage *stage, FILE *in, int format);
+void kpdve_read_stage_free(struct kpdve_read_stage *stage);
+
+int kpdve_stage_read(void *ctx, kpdve_batch *batch);     /**< ctx: struct kpdve_read_stage */
+int kpdve_stage_chroma(void *ctx, kpdve_batch *batch);   /**< ctx: unused */
+int kpdve_stage_analyze(void *ctx, kpdve_batch *batch);  /**< ctx: harmony_state, carried across batches */
+int kpdve_stage_format(void *ctx, kpdve_batch *batch);   /**< ctx: int, a KPDVE_FORMAT_ value */
+int kpdve_stage_write(void *ctx, kpdve_batch *batch);    /**< ctx: int, a file descriptor */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_pipeline_h */
@@ -0,0 +1,128 @@
+//
+//  qdkpdve_prior.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_prior_h
+#define qdkpdve_prior_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "qdkpdve_anchor.h"
+#include "qdkpdve_tables.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_prior.h
+ * @brief A transition prior learned from an analyzed corpus: how much likelier each
+ * K, P, D has been, after each K, P, D, than a move never seen.
+ *
+ * set_min_index scores candidates by kpdve_axis_scale distance alone. The prior adds
+ * what a corpus says about where streams actually go. Counting: for every pair of
+ * consecutive valid frames whose K or P differs, the transition from the first frame's
+ * K, P, D (the context the chooser would see) to the second's. Frames that stay in the
+ * context's K and P are not counted, since the chooser never scores those.
+ *
+ * Each transition's bonus is log2((count + alpha) / alpha), in bits, quantized to
+ * 1/KPDVE_PRIOR_STEPS bit and capped at 255 steps: an additively smoothed log
+ * probability, relative to a move never seen in that context. An unseen move costs
+ * exactly 0 (not a float that rounds to it), so a prior learned from nothing, or used
+ * with weight 0, chooses exactly as kpdve_tables_choose.
+ *
+ * kpdve_prior_choose is kpdve_tables_choose with
+ *
+ *   - weight * steps / KPDVE_PRIOR_STEPS
+ *
+ * added to each candidate's distance: one byte load from the context's row of the
+ * 588 x 588 table, one lookup in a 256-entry float table, one add. A candidate in the
+ * context's K and P is still taken first. An anchor (qdkpdve_anchor.h) may be given as
+ * well; its term is added as kpdve_anchor_choose adds it.
+ *
+ * In memory the table is dense (345744 bytes, inside struct kpdve_prior). On disk it
+ * is sparse, only the transitions seen, in native byte order (the magic number rejects
+ * foreign files):
+ *
+ *   header         struct kpdve_prior_header (48 bytes)
+ *   rows           uint32[KPDVE_TABLES_CONTEXTS + 1], first entry of each context
+ *   entries        uint32[entry_count]: KPD index of the next state in the low 16 bits,
+ *                  steps (1..255) in bits 16..23, ascending by index within a row
+ *
+ * KPD indexes are k * 49 + p * 7 + d (KPDVE_PRIOR_INDEX), as the sweep and blob
+ * decision tables number contexts. pitchflock_prior learns priors from stores
+ * (qdkpdve_store.h) and shows them.
+ */
+
+#define KPDVE_PRIOR_MAGIC 0x31504650u /**< "PFP1" */
+#define KPDVE_PRIOR_VERSION 1
+#define KPDVE_PRIOR_STATES KPDVE_TABLES_CONTEXTS /**< K, P, D states: 588 */
+#define KPDVE_PRIOR_STEPS 16          /**< quantization steps per bit */
+#define KPDVE_PRIOR_MAX_LEVEL 255
+
+#define KPDVE_PRIOR_OK 0
+#define KPDVE_PRIOR_ERR_IO -1
+#define KPDVE_PRIOR_ERR_FORMAT -2
+
+// K, P, D index of a KPDVE whose K < 12, P < 7 and D < 7
+#define KPDVE_PRIOR_INDEX(kpdve) ((((kpdve) >> 12) & 0xF) * 49 + (((kpdve) >> 9) & 0x7) * 7 + (((kpdve) >> 6) & 0x7))
+
+struct kpdve_prior_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t states;          /**< KPDVE_PRIOR_STATES */
+    uint32_t steps;           /**< KPDVE_PRIOR_STEPS */
+    uint32_t entry_count;
+    float alpha;              /**< the smoothing the levels were computed with */
+    uint32_t reserved;
+    uint64_t transitions;     /**< transitions counted */
+    uint64_t file_size;
+};
+
+/**
+ * @brief Transition counts, collected stream by stream. 1.4 MB: allocate it.
+ */
+struct kpdve_prior_counts {
+    uint64_t transitions;
+    int last;                 /**< K, P, D index of the last valid frame of the stream, or -1 */
+    uint32_t counts[KPDVE_PRIOR_STATES * KPDVE_PRIOR_STATES]; /**< [from * 588 + to], saturating */
+};
+typedef struct kpdve_prior_counts kpdve_prior_counts;
+
+/**
+ * @brief A prior ready for the chooser.
+ */
+struct kpdve_prior {
+    float weight;             /**< distance units per bit */
+    float alpha;
+    uint64_t transitions;
+    uint32_t entry_count;     /**< transitions with a nonzero level */
+    float bonus[KPDVE_PRIOR_MAX_LEVEL + 1]; /**< weight * level / KPDVE_PRIOR_STEPS, bonus[0] = 0 */
+    uint8_t levels[KPDVE_PRIOR_STATES * KPDVE_PRIOR_STATES]; /**< [from * 588 + to] */
+};
+typedef struct kpdve_prior kpdve_prior;
+
+void kpdve_prior_counts_reset(kpdve_prior_counts *counts);
+void kpdve_prior_count(kpdve_prior_counts *counts, const int *states, size_t count);
+void kpdve_prior_end_stream(kpdve_prior_counts *counts);
+
+void kpdve_prior_init(kpdve_prior *prior, float weight);
+void kpdve_prior_build(kpdve_prior *prior, const kpdve_prior_counts *counts, float alpha, float weight);
+void kpdve_prior_set_weight(kpdve_prior *prior, float weight);
+int kpdve_prior_level(const kpdve_prior *prior, int from_kpdve, int to_kpdve);
+
+int kpdve_prior_write(const kpdve_prior *prior, const char *path);
+int kpdve_prior_read(kpdve_prior *prior, const char *path, float weight);
+
+// RT-safe (qdkpdve_rt.h): chroma 1..4095, context K < 12; anchor may be NULL
+int kpdve_prior_choose(const kpdve_tables *tables, const kpdve_prior *prior, const kpdve_anchor *anchor,
+                       int chroma, int context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_prior_h */
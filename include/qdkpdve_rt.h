@@ -0,0 +1,96 @@
+//
+//  qdkpdve_rt.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_rt_h
+#define qdkpdve_rt_h
+
+#include <stdint.h>
+
+#include "qdkpdve_anchor.h"
+#include "qdkpdve_prior.h"
+#include "qdkpdve_tables.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_rt.h
+ * @brief Analysis for real-time threads (audio callbacks).
+ *
+ * Functions marked RT-safe never allocate, never take a lock, never call stdio or any
+ * other system call, and do bounded work: a note event is a counter update, and an
+ * analysis is one lookup in the candidate table plus a scan of at most 84 packed
+ * candidates (KPDVE_TABLES_CELLS), with no loop that depends on history.
+ *
+ * Everything that is not RT-safe happens in pf_rt_init and pf_rt_prepare_thread:
+ * building the tables (on first use), and, in PITCHFLOCK_STATS builds, allocating the
+ * calling thread's counter block. Call pf_rt_init before the audio thread starts and
+ * pf_rt_prepare_thread once on the audio thread (e.g. in its first callback, or before
+ * it is marked real-time).
+ *
+ * The analyzer chooses as pf_engine does (qdkpdve_engine.h): the reference choice with
+ * the previous KPDVE as context, and a frame that determines no KPDVE (silence, or notes
+ * no pattern holds) keeps the previous one; the second kind is flagged invalid. With an
+ * anchor attached (pf_rt_set_anchor), it chooses with kpdve_anchor_choose instead and
+ * adds every analyzed frame to the anchor; with a learned prior (pf_rt_set_prior), it
+ * chooses with kpdve_prior_choose, and the anchor's term, if any, is added there.
+ *
+ * The RT-safe subset of the library is:
+ *
+ *   pf_rt_reset, pf_rt_set_context, pf_rt_note_on, pf_rt_note_off, pf_rt_all_notes_off,
+ *   pf_rt_analyze, pf_rt_analyze_chroma, pf_rt_encoded,
+ *   pf_rt_set_anchor, pf_rt_set_prior                     (this file)
+ *   kpdve_tables_choose, set_kp_list_from_tables          (qdkpdve_tables.h, once built)
+ *   adjust_harmony_state_from_chroma_and_context, adjust_harmony_state_from_chroma
+ *                                                         (qdkpdve_statemaker.h; about 70x
+ *                                                         slower, but with the same guarantees)
+ *   pf_snapshot_record, pf_snapshot_analyze               (qdkpdve_snapshot.h)
+ *   kpdve_anchor_reset, kpdve_anchor_update, kpdve_anchor_choose
+ *                                                         (qdkpdve_anchor.h)
+ *   kpdve_prior_choose                                    (qdkpdve_prior.h)
+ *   kpdve_latency_record                                  (qdkpdve_latency.h)
+ *
+ * test_rt_safety calls all of them with malloc, the mutex functions and stdio wrapped at
+ * link time, and fails if any is reached.
+ */
+
+#define PF_RT_INVALID 0x01 /**< the last analysis found no KPDVE for a non-empty chroma */
+
+struct pf_rt_analyzer {
+    const kpdve_tables *tables;
+    int default_kpdve;
+    int context;          /**< context KPDVE for the next analysis */
+    int kpdve;            /**< chosen KPDVE */
+    int encoded;          /**< x---KKKKPPPDDDVVVEEEb-a-g-fe-d-c */
+    int chroma;           /**< notes held now (b-a-g-fe-d-c) */
+    int flags;            /**< PF_RT_ flags */
+    uint8_t held[12];     /**< note-ons without a note-off, per pitch class (saturating) */
+    kpdve_anchor *anchor; /**< long-memory context, or NULL (pf_rt_set_anchor) */
+    const kpdve_prior *prior; /**< learned transition prior, or NULL (pf_rt_set_prior) */
+};
+typedef struct pf_rt_analyzer pf_rt_analyzer;
+
+// not RT-safe
+void pf_rt_init(pf_rt_analyzer *analyzer, const kpdve_tables *tables);
+void pf_rt_prepare_thread(void);
+
+// RT-safe
+void pf_rt_reset(pf_rt_analyzer *analyzer);
+int pf_rt_set_context(pf_rt_analyzer *analyzer, int context);
+void pf_rt_set_anchor(pf_rt_analyzer *analyzer, kpdve_anchor *anchor);
+void pf_rt_set_prior(pf_rt_analyzer *analyzer, const kpdve_prior *prior);
+int pf_rt_note_on(pf_rt_analyzer *analyzer, int note);
+int pf_rt_note_off(pf_rt_analyzer *analyzer, int note);
+void pf_rt_all_notes_off(pf_rt_analyzer *analyzer);
+int pf_rt_analyze(pf_rt_analyzer *analyzer);
+int pf_rt_analyze_chroma(pf_rt_analyzer *analyzer, int chroma);
+int pf_rt_encoded(const pf_rt_analyzer *analyzer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_rt_h */
@@ -0,0 +1,103 @@
+//
+//  qdkpdve_shmring.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_shmring_h
+#define qdkpdve_shmring_h
+
+#include <stdint.h>
+
+#include "qdkpdve_rt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_shmring.h
+ * @brief A shared-memory ring between a producer process (the audio host) and an
+ * analysis process.
+ *
+ * The ring lives in a POSIX shared memory object (shm_open) and is an array of
+ * capacity frame slots with three counters, each written by one side only:
+ *
+ *   produced   producer: slots filled with a chroma frame (and its timestamp)
+ *   analyzed   consumer: slots whose state has been written back in place
+ *   collected  producer: slots whose result has been read, free to fill again
+ *
+ * so collected <= analyzed <= produced <= collected + capacity. A frame is written once
+ * by the producer, analyzed where it lies, and read back from the same slot: nothing is
+ * copied on the way. Each counter is published with a release store after the slots it
+ * covers, and read with an acquire load.
+ *
+ * Neither side makes a system call while the other is awake. A side that finds nothing
+ * to do spins for a while (spin_ns), then announces that it sleeps and waits on the other
+ * side's counter with a futex; the other side, after publishing, makes the wake call only
+ * if that announcement is up. On systems without futexes the waiting side polls.
+ *
+ * The producer side is RT-safe (qdkpdve_rt.h) apart from pf_ring_wait_results:
+ * pf_ring_reserve, pf_ring_publish, pf_ring_results and pf_ring_release touch only the
+ * mapping, plus one futex wake when the consumer is asleep. Frames carry an opaque
+ * timestamp, returned with the result, so the producer can measure the round trip.
+ */
+
+#define PF_RING_OK 0
+#define PF_RING_ERR_IO -1          /**< shm_open, ftruncate or mmap failed (errno is set) */
+#define PF_RING_ERR_MEMORY -2
+#define PF_RING_ERR_FORMAT -3      /**< not a ring, or another version or size */
+#define PF_RING_ERR_CAPACITY -4    /**< capacity 0 or above PF_RING_MAX_CAPACITY */
+
+#define PF_RING_MAX_CAPACITY (1u << 24)
+
+#define PF_RING_FRAME_RESET 0x01   /**< reset the analyzer to the default context first */
+
+/**
+ * @brief A slot. The producer fills timestamp_ns, chroma and flags; the consumer fills
+ * state (x---KKKKPPPDDDVVVEEEb-a-g-fe-d-c, as pf_rt_analyze_chroma).
+ */
+struct pf_ring_frame {
+    uint64_t timestamp_ns;
+    uint16_t chroma;
+    uint16_t flags;         /**< PF_RING_FRAME_ flags */
+    uint32_t state;
+};
+
+/**
+ * @brief Counts of this process's side of the ring (not shared).
+ */
+struct pf_ring_stats {
+    uint64_t frames;        /**< published (producer) or analyzed (consumer) */
+    uint64_t sleeps;        /**< futex waits entered */
+    uint64_t wakes;         /**< futex wake calls made */
+};
+
+typedef struct pf_ring pf_ring;
+
+// setup (not RT-safe). Capacity is rounded up to a power of two.
+pf_ring *pf_ring_create(const char *name, uint32_t capacity, int *error);
+pf_ring *pf_ring_open(const char *name, int *error);
+void pf_ring_close(pf_ring *ring);
+int pf_ring_unlink(const char *name);
+uint32_t pf_ring_capacity(const pf_ring *ring);
+void pf_ring_get_stats(const pf_ring *ring, struct pf_ring_stats *stats);
+
+// producer
+struct pf_ring_frame *pf_ring_reserve(pf_ring *ring, uint32_t *count);
+void pf_ring_publish(pf_ring *ring, uint32_t count);
+const struct pf_ring_frame *pf_ring_results(pf_ring *ring, uint32_t *count);
+void pf_ring_release(pf_ring *ring, uint32_t count);
+uint32_t pf_ring_wait_results(pf_ring *ring, uint64_t spin_ns, int64_t timeout_ns);
+void pf_ring_shutdown(pf_ring *ring);
+
+// consumer
+uint32_t pf_ring_wait_input(pf_ring *ring, uint64_t spin_ns, int64_t timeout_ns);
+uint32_t pf_ring_analyze(pf_ring *ring, pf_rt_analyzer *analyzer);
+int pf_ring_closed(const pf_ring *ring);
+uint64_t pf_ring_serve(pf_ring *ring, pf_rt_analyzer *analyzer, uint64_t spin_ns, const int *stop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_shmring_h */
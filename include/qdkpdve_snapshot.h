@@ -0,0 +1,99 @@
+//
+//  qdkpdve_snapshot.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_snapshot_h
+#define qdkpdve_snapshot_h
+
+#include <stdint.h>
+
+#include "qdkpdve_rt.h"
+#include "qdkpdve_tables.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_snapshot.h
+ * @brief The latest analysis of each stream, published in shared memory for readers
+ * in other processes (visualizers) that poll it at their own rate.
+ *
+ * The analysis process creates a snapshot region (a POSIX shared memory object) with a
+ * slot per stream and records every frame it analyzes; a reader maps the region
+ * read-only and copies out a stream's state whenever it draws. Per stream the state
+ * holds the latest encoded state and its context, the candidates of its chroma (the
+ * choice first, then the others nearest the context on the tables' distances; an
+ * anchor or a prior can make a choice that is not the nearest), the recent K/P changes
+ * and running counters (struct pf_snapshot_state).
+ *
+ * Each slot is a seqlock: the writer makes the slot's sequence odd, stores the state and
+ * makes it even again; a reader copies the state between two loads of the sequence and
+ * keeps the copy only if both are the same even value. The writer never waits for a
+ * reader and never learns that one exists, and readers cannot write to the region, so
+ * no reader can hold up the analysis. A reader that keeps overlapping writes gives up
+ * after PF_SNAPSHOT_READ_TRIES attempts with PF_SNAPSHOT_BUSY and tries again on its
+ * next poll.
+ *
+ * Recording is RT-safe (qdkpdve_rt.h): no allocation, locks or system calls (the time
+ * stamp comes from clock_gettime, a vDSO call on Linux), and at most 84 candidates are
+ * ranked. Each stream must have a single writer.
+ */
+
+#define PF_SNAPSHOT_CANDIDATES 8      /**< candidates kept per stream */
+#define PF_SNAPSHOT_HISTORY 32        /**< K/P changes kept per stream */
+#define PF_SNAPSHOT_READ_TRIES 64
+
+#define PF_SNAPSHOT_OK 0
+#define PF_SNAPSHOT_BUSY 1            /**< every attempt overlapped a write; poll again */
+#define PF_SNAPSHOT_ERR_IO -1         /**< shm_open, ftruncate or mmap failed (errno is set) */
+#define PF_SNAPSHOT_ERR_MEMORY -2
+#define PF_SNAPSHOT_ERR_FORMAT -3     /**< not a snapshot region, or another version or size */
+#define PF_SNAPSHOT_ERR_RANGE -4      /**< no such stream, or no streams */
+
+struct pf_snapshot_candidate {
+    uint32_t kpdve;
+    float distance;                   /**< to the context on the tables' distances (0: same K and P) */
+};
+
+struct pf_snapshot_kp {
+    uint64_t frame;                   /**< first frame with this K and P */
+    uint32_t kpdve;                   /**< the KPDVE chosen at that frame */
+    uint32_t reserved;
+};
+
+struct pf_snapshot_state {
+    uint64_t frames;                  /**< frames recorded */
+    uint64_t invalid_frames;          /**< of which no pattern held the notes */
+    uint64_t kp_changes;              /**< frames whose K or P differs from the frame before */
+    uint64_t updated_ns;              /**< kpdve_latency_now_ns() at the last record */
+    uint32_t encoded;                 /**< latest state: x---KKKKPPPDDDVVVEEEb-a-g-fe-d-c */
+    uint32_t context;                 /**< the KPDVE it was chosen in */
+    uint32_t candidate_count;         /**< candidates of its chroma (0 for silence; may exceed the kept ones) */
+    uint32_t history_count;           /**< entries in history */
+    struct pf_snapshot_candidate candidates[PF_SNAPSHOT_CANDIDATES]; /**< the choice, then the others nearest first */
+    struct pf_snapshot_kp history[PF_SNAPSHOT_HISTORY];              /**< newest first */
+};
+
+typedef struct pf_snapshot pf_snapshot;
+
+// setup (not RT-safe)
+pf_snapshot *pf_snapshot_create(const char *name, uint32_t streams, const kpdve_tables *tables, int *error);
+pf_snapshot *pf_snapshot_open(const char *name, int *error);
+void pf_snapshot_close(pf_snapshot *snapshot);
+int pf_snapshot_unlink(const char *name);
+uint32_t pf_snapshot_streams(const pf_snapshot *snapshot);
+
+// writer (RT-safe)
+void pf_snapshot_record(pf_snapshot *snapshot, uint32_t stream, int encoded, int context);
+int pf_snapshot_analyze(pf_snapshot *snapshot, uint32_t stream, pf_rt_analyzer *analyzer, int chroma);
+
+// reader
+int pf_snapshot_read(const pf_snapshot *snapshot, uint32_t stream, struct pf_snapshot_state *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_snapshot_h */
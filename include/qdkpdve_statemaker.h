@@ -20,6 +20,10 @@
 
 #endif /* qdkpdve_statemaker_h */
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 
 // KPDVE ENCODING for C
 int KPDVEtoBinaryEncoding(int aKPDVE[]);
@@ -29,6 +33,9 @@ void binaryEncodingToKPDVE(int encodedByte, int result[]);
 int undo_kp_for_input_val(int input_val, int k, int p);
 float modDistance(int val1, int val2, int mod);
 double KPD_distance(int kpdve_1, int kpdve_2);
+// the same distance with other K, P, D, V, E weights (KPD_distance uses the built-in ones)
+double KPD_distance_weighted(int kpdve_1, int kpdve_2, const float axis_scale[5]);
+void kpdve_default_axis_scale(float axis_scale[5]);
 
 harmony_state harmony_state_default(void);
 harmony_state harmony_state_from_kpdve(int a_kpdve);
@@ -51,5 +58,6 @@ void adjust_harmony_state_from_kpdve(harmony_state *a_state, int a_kpdve);
 
 void encode_and_validate_state(harmony_state *a_state);
 
-
-
+#ifdef __cplusplus
+}
+#endif
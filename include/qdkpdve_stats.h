@@ -0,0 +1,90 @@
+//
+//  qdkpdve_stats.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_stats_h
+#define qdkpdve_stats_h
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_stats.h
+ * @brief Optional counters inside the analysis (build with PITCHFLOCK_STATS defined).
+ *
+ * Each thread counts into its own cache-line aligned block, with plain (relaxed) stores
+ * and no locking, so the counters cost a few increments per frame. A thread's first count
+ * claims its block from a static slab without locks or allocation, so the hooks stay
+ * RT-safe on any thread (past 256 threads a block is allocated). kpdve_stats_snapshot
+ * adds the blocks of all threads together; kpdve_stats_reset makes the current totals the
+ * new zero (it never writes to another thread's block).
+ *
+ * Without PITCHFLOCK_STATS the hooks compile to nothing and snapshots are all zero.
+ *
+ * CMake: -DPITCHFLOCK_STATS=ON. make: make STATS=1.
+ */
+
+#define KPDVE_STATS_LIST_LENGTHS 85 /**< kpdve_list_length is 0..84 */
+
+struct kpdve_stats {
+    uint64_t frames;          /**< chroma analyses (choose_kpdve_from_context) */
+    uint64_t invalid;         /**< states flagged invalid by encode_and_validate_state */
+    uint64_t kp_lists;        /**< candidate lists made (set_kp_list and the table engine) */
+    uint64_t kp_cells_tested; /**< K x P cells tested against the chroma by set_kp_list */
+    uint64_t candidates;      /**< candidates produced, over all lists */
+    uint64_t min_index_calls; /**< set_min_index calls (and the table engine's) */
+    uint64_t same_kp_hits;    /**< set_min_index calls that stopped at a candidate in the context's K and P */
+    uint64_t key_changes;     /**< chroma analyses whose K differs from the state's previous K */
+    uint64_t pattern_changes; /**< chroma analyses whose P differs from the state's previous P */
+    uint64_t list_lengths[KPDVE_STATS_LIST_LENGTHS]; /**< histogram of kpdve_list_length */
+};
+
+int kpdve_stats_enabled(void);
+void kpdve_stats_snapshot(struct kpdve_stats *out);
+void kpdve_stats_reset(void);
+
+#ifdef PITCHFLOCK_STATS
+
+// one per thread; the alignment keeps threads from sharing cache lines
+struct kpdve_stats_block {
+    struct kpdve_stats counts;
+    struct kpdve_stats_block *next;
+} __attribute__((aligned(64)));
+
+extern __thread struct kpdve_stats_block *kpdve_stats_local;
+struct kpdve_stats_block *kpdve_stats_register(void);
+
+// only the owning thread writes its block: a relaxed load and store, no locked instruction
+#define KPDVE_STATS_ADD(field, n) do { \
+        struct kpdve_stats_block *stats_block_ = kpdve_stats_local ? kpdve_stats_local : kpdve_stats_register(); \
+        if (stats_block_ != NULL) { \
+            uint64_t *stats_counter_ = &stats_block_->counts.field; \
+            __atomic_store_n(stats_counter_, __atomic_load_n(stats_counter_, __ATOMIC_RELAXED) + (uint64_t)(n), __ATOMIC_RELAXED); \
+        } \
+    } while (0)
+
+#define KPDVE_STATS_LIST(length) do { \
+        int stats_length_ = (length); \
+        KPDVE_STATS_ADD(kp_lists, 1); \
+        KPDVE_STATS_ADD(candidates, stats_length_); \
+        if (stats_length_ >= 0 && stats_length_ < KPDVE_STATS_LIST_LENGTHS) { \
+            KPDVE_STATS_ADD(list_lengths[stats_length_], 1); \
+        } \
+    } while (0)
+
+#else
+
+#define KPDVE_STATS_ADD(field, n) do { } while (0)
+#define KPDVE_STATS_LIST(length) do { } while (0)
+
+#endif /* PITCHFLOCK_STATS */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_stats_h */
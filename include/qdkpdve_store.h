@@ -0,0 +1,123 @@
+//
+//  qdkpdve_store.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_store_h
+#define qdkpdve_store_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_store.h
+ * @brief Time-indexed, memory-mapped storage for analyzed encoded_state streams.
+ *
+ * Layout of a store file (native byte order; the magic number rejects foreign files):
+ *
+ *   header          struct kpdve_store_header (64 bytes)
+ *   states          int32[frame_count], the encoded_state column
+ *   block summaries struct kpdve_store_block[block_count]
+ *   time index      uint64[block_count], time of the first frame of each block
+ *
+ * Frames are grouped in fixed-size blocks of block_frames frames, so frame i lives in
+ * block i / block_frames and can be read without any index at all. The per-block
+ * summaries (K and P ranges, a bitset of present keys, key change count) let queries
+ * skip whole blocks; the sparse time index maps a time to a block, and the frame
+ * period interpolates within it.
+ *
+ * A reader maps the file and uses the sections in place: there is no parsing step.
+ * Invalid frames (x bit set) are stored but do not contribute to summaries; a block
+ * with an empty key_mask held no valid frame at all.
+ */
+
+#define KPDVE_STORE_MAGIC 0x31534650u /**< "PFS1" */
+#define KPDVE_STORE_VERSION 1
+#define KPDVE_STORE_BLOCK_FRAMES 4096 /**< default frames per block */
+
+#define KPDVE_STORE_OK 0
+#define KPDVE_STORE_ERR_IO -1
+#define KPDVE_STORE_ERR_FORMAT -2
+#define KPDVE_STORE_ERR_MEMORY -3
+
+struct kpdve_store_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_frames;
+    uint32_t reserved;
+    uint64_t frame_count;
+    uint64_t block_count;
+    uint64_t frame_period;     /**< time units per frame (caller's choice: samples, ns...) */
+    uint64_t states_offset;
+    uint64_t blocks_offset;
+    uint64_t times_offset;
+};
+
+/**
+ * @brief Summary of one block of frames. 16 bytes, so four share a cache line.
+ */
+struct kpdve_store_block {
+    uint16_t key_mask;      /**< bit k is set if key k occurs in the block */
+    uint8_t pattern_mask;   /**< bit p is set if pattern p occurs in the block */
+    uint8_t k_min;
+    uint8_t k_max;
+    uint8_t p_min;
+    uint8_t p_max;
+    uint8_t k_in;           /**< K of the last valid frame before the block, 0xFF if none */
+    uint32_t k_changes;     /**< frames whose K differs from the previous valid frame */
+    uint32_t kp_changes;    /**< frames whose K or P differs from the previous valid frame */
+};
+
+/**
+ * @brief Writer: streams states to disk, keeping only the (small) block index in memory.
+ */
+struct kpdve_store_writer {
+    FILE *file;
+    struct kpdve_store_header header;
+    struct kpdve_store_block *blocks;
+    uint64_t *times;
+    size_t blocks_cap;
+    uint64_t next_time;     /**< time of the next appended frame */
+    int last_valid;         /**< last valid encoded_state, or -1 before the first one */
+};
+typedef struct kpdve_store_writer kpdve_store_writer;
+
+int kpdve_store_writer_open(kpdve_store_writer *w, const char *path, uint32_t block_frames, uint64_t frame_period);
+int kpdve_store_append(kpdve_store_writer *w, const int *states, size_t count);
+void kpdve_store_set_time(kpdve_store_writer *w, uint64_t time);
+int kpdve_store_writer_close(kpdve_store_writer *w);
+
+/**
+ * @brief A mapped store. All pointers refer directly into the mapping.
+ */
+struct kpdve_store {
+    void *map;
+    size_t map_size;
+    const struct kpdve_store_header *header;
+    const int *states;
+    const struct kpdve_store_block *blocks;
+    const uint64_t *times;
+};
+typedef struct kpdve_store kpdve_store;
+
+int kpdve_store_open(kpdve_store *store, const char *path);
+void kpdve_store_close(kpdve_store *store);
+
+size_t kpdve_store_frame_count(const kpdve_store *store);
+size_t kpdve_store_block_count(const kpdve_store *store);
+int kpdve_store_frame(const kpdve_store *store, size_t frame);
+size_t kpdve_store_frame_at_time(const kpdve_store *store, uint64_t time);
+
+size_t kpdve_store_key_changes(const kpdve_store *store, size_t first_frame, size_t last_frame, size_t *frames, size_t cap);
+long kpdve_store_next_block_with_key(const kpdve_store *store, int key, size_t from_block);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_store_h */
@@ -0,0 +1,50 @@
+//
+//  qdkpdve_sweep.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_sweep_h
+#define qdkpdve_sweep_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_sweep.h
+ * @brief Exhaustive sweeps of the analysis, on several threads, into flat arrays.
+ *
+ * These run the reference code (qdkpdve_statemaker.h) over whole input spaces, for
+ * lookup assets and validation data:
+ *
+ *   - contexts: every chroma value (4096) against every K, P, D context (588, as KPD << 6),
+ *     stored context-major: [context_index * 4096 + chroma], with
+ *     context_index = k * 49 + p * 7 + d;
+ *   - candidates: the set_kp_list result of every chroma value, packed as in
+ *     qdkpdve_tables.h, with 4097 offsets;
+ *   - kpdve: adjust_harmony_state_from_kpdve for every KPDVE value (28812), in
+ *     K, P, D, V, E counting order.
+ *
+ * Each chroma is analyzed from a fresh harmony_state_default(), so chroma values with no
+ * candidates (flagged invalid) carry the same stale choice whatever the thread split.
+ */
+
+#define KPDVE_SWEEP_CHROMA 4096
+#define KPDVE_SWEEP_CONTEXTS (12 * 7 * 7)
+#define KPDVE_SWEEP_KPDVES (12 * 7 * 7 * 7 * 7)
+#define KPDVE_SWEEP_CANDIDATES (84 * 128)
+
+int kpdve_sweep_context_kpdve(int context_index);
+
+int kpdve_sweep_contexts(int *states, uint8_t *choices, int threads);
+size_t kpdve_sweep_candidates(uint32_t *offsets, uint32_t *entries);
+int kpdve_sweep_kpdves(int *states, int threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_sweep_h */
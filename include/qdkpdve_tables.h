@@ -0,0 +1,88 @@
+//
+//  qdkpdve_tables.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_tables_h
+#define qdkpdve_tables_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "harmony_state.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_tables.h
+ * @brief Precomputed analysis tables and the table-driven engine built on them.
+ *
+ * set_kp_list depends only on the chroma, so its whole result (the candidate KPDVE, DVE
+ * and VE values, in the reference order) is stored for each of the 4096 chroma values.
+ * set_min_index only needs K, P and D of each candidate and of the context, so the
+ * distances are stored per axis, as the same floats KPD_distance computes, and added in
+ * the same order: the table engine picks exactly the index the reference picks, ties
+ * included.
+ *
+ * Everything is reached through the pointers of struct kpdve_tables, so the same engine
+ * can run on tables built at startup, compiled in, or mapped from a file.
+ *
+ * The reference code in qdkpdve_statemaker.c stays authoritative; qdkpdve_diffcheck.h
+ * checks the table engine against it.
+ */
+
+#define KPDVE_TABLES_CELLS 84        /**< K x P cells of the 12/7 crystal */
+#define KPDVE_TABLES_CHROMA 4096     /**< 12-bit chroma values */
+#define KPDVE_TABLES_CANDIDATES (KPDVE_TABLES_CELLS * 128) /**< each cell fits each subset of its 7 notes once */
+#define KPDVE_TABLES_CONTEXTS (12 * 7 * 7) /**< distinct K, P, D of a context */
+// the built-in K, P, D, V, E weights of KPD_distance (kpdve_default_axis_scale); a
+// macro so that constant expressions (pitchflock.hpp's tables) can use them too
+#define KPDVE_AXIS_SCALE { 1.02, 1.01, 1.0, 1.0, 1.0 }
+
+// packed candidate: KPDVE in the low 16 bits, then the minimized DVE and VE bit patterns.
+// the empty chroma fits every cell with no extension, which set_kp_list encodes as -1: stored as 0xFFFF.
+#define KPDVE_CANDIDATE_NONE 0xFFFF
+#define KPDVE_CANDIDATE_KPDVE(c) (((c) & 0xFFFF) == KPDVE_CANDIDATE_NONE ? -1 : (int)((c) & 0xFFFF))
+#define KPDVE_CANDIDATE_DVE(c) ((int)(((c) >> 16) & 0x7F))
+#define KPDVE_CANDIDATE_VE(c) ((int)(((c) >> 23) & 0x7F))
+
+// packed minimizer result: d, v, e, then the minimized DVE and VE bit patterns (e of the empty input, -1, reads 7)
+#define KPDVE_MINIMIZED_D(m) ((int)((m) & 0x7))
+#define KPDVE_MINIMIZED_V(m) ((int)(((m) >> 3) & 0x7))
+#define KPDVE_MINIMIZED_E(m) ((int)(((m) >> 6) & 0x7))
+#define KPDVE_MINIMIZED_DVE(m) ((int)(((m) >> 9) & 0x7F))
+#define KPDVE_MINIMIZED_VE(m) ((int)(((m) >> 16) & 0x7F))
+
+struct kpdve_tables {
+    const uint16_t *crystal_masks; /**< [KPDVE_TABLES_CELLS] circle-ordered notes of cell k * 7 + p */
+    const uint32_t *minimized;     /**< [128] minimize_dve_value(make_dve(i)), packed */
+    const uint16_t *offsets;       /**< [KPDVE_TABLES_CHROMA + 1] first candidate of each chroma */
+    const uint32_t *candidates;    /**< [KPDVE_TABLES_CANDIDATES] packed, in set_kp_list order */
+    const float *k_distance;       /**< [12 * 12] scaled K distance, as summed by KPD_distance */
+    const float *p_distance;       /**< [8 * 8] scaled P distance (8 so that any 3-bit context field works) */
+    const float *d_distance;       /**< [8 * 8] scaled D distance */
+};
+typedef struct kpdve_tables kpdve_tables;
+
+// builds the tables, once; thread-safe (a no-op when they are compiled in, see qdkpdve_init.h)
+void kpdve_tables_init(void);
+// the built-in tables (built on first call, from any thread)
+const kpdve_tables *kpdve_tables_default(void);
+
+// per-axis distance tables for other K, P, D weights (NULL: the built-in ones)
+void kpdve_tables_build_distances(const float *axis_scale, float *k_distance, float *p_distance, float *d_distance);
+
+// the table engine: the same results as set_kp_list and set_min_index
+void set_kp_list_from_tables(const kpdve_tables *tables, harmony_state *a_state);
+void set_min_index_from_tables(const kpdve_tables *tables, harmony_state *current_state, int context);
+
+// the same choice straight from the packed candidates of a chroma value (1..4095; context K < 12)
+int kpdve_tables_choose(const kpdve_tables *tables, int chroma, int context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_tables_h */
@@ -0,0 +1,117 @@
+//
+//  qdkpdve_tune.h
+//  pitchflock
+//
+
+#ifndef qdkpdve_tune_h
+#define qdkpdve_tune_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "qdkpdve_prior.h"
+#include "qdkpdve_tables.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file qdkpdve_tune.h
+ * @brief Evaluates many chooser configurations over a labeled corpus in one pass.
+ *
+ * kpdve_axis_scale "would require some more investigation to determine the best
+ * values". Here a configuration is a set of K, P, D weights, a metric, and a weight
+ * for a learned prior (qdkpdve_prior.h), and every configuration analyzes every file
+ * as pf_rt would with it: each frame's choice becomes the next frame's context, so
+ * each configuration follows its own path through the stream.
+ *
+ * A labeled file is a stream of encoded states (raw int32 words, a codec stream, or a
+ * store, qdkpdve_store.h): the chroma bits are the input, the KPDVE bits the label.
+ * Frames with the x bit set, and silent frames, are analyzed but not scored. Chroma
+ * files carry no labels and are refused.
+ *
+ * The work is shared across configurations. A frame's candidates are looked up once
+ * and each candidate's K, P and D decoded once. The distances for all configurations
+ * are then computed KPDVE_TUNE_LANES at a time, with GCC vector extensions. Each lane
+ * has its own distance tables (kpdve_tables_build_distances with its weights), and
+ * the rows for its context are kept transposed across the lanes, so a candidate's
+ * distance in every lane is three vector loads indexed by the candidate (only the
+ * prior's level is gathered lane by lane). The same-K/P rule and the first-minimum
+ * rule run as lane masks. Files are spread over threads.
+ *
+ * With KPDVE_TUNE_L1 the distance is the table chooser's: the same float rows added in
+ * the same order. A configuration with the built-in weights and no prior therefore
+ * chooses exactly as pf_rt does, and with a prior weight, exactly as pf_rt with that
+ * prior attached. KPDVE_TUNE_L2 sums the squares of the weighted axis distances (the
+ * Euclidean variant left commented out in KPD_distance_weighted, without the square
+ * root, which does not change the order).
+ */
+
+// configurations per vector: 16 bytes of floats, the width every x86-64 and AArch64
+// target has (wider generic vectors are split, and their compares scalarized, on SSE2)
+#define KPDVE_TUNE_LANES 4
+
+#define KPDVE_TUNE_L1 0               /**< sum of the weighted axis distances, as KPD_distance */
+#define KPDVE_TUNE_L2 1               /**< sum of their squares */
+
+#define KPDVE_TUNE_OK 0
+#define KPDVE_TUNE_ERR_IO -1          /**< a file could not be read */
+#define KPDVE_TUNE_ERR_FORMAT -2      /**< a file holds no labels (or a corrupt codec stream) */
+#define KPDVE_TUNE_ERR_MEMORY -3
+
+struct kpdve_tune_config {
+    float axis_scale[3];      /**< K, P, D weights (kpdve_axis_scale's first three) */
+    int metric;               /**< KPDVE_TUNE_L1 or KPDVE_TUNE_L2 */
+    float prior_weight;       /**< distance units per bit of the prior, if one is given */
+};
+
+/**
+ * @brief What one configuration made of the corpus.
+ */
+struct kpdve_tune_score {
+    uint64_t frames;          /**< labeled frames scored */
+    uint64_t k_right;         /**< scored frames in the label's K */
+    uint64_t kp_right;        /**< ... in its K and P */
+    uint64_t kpdve_right;     /**< ... with exactly its KPDVE */
+    uint64_t k_changes;       /**< frames whose choice changed K */
+    uint64_t kp_changes;      /**< frames whose choice changed K or P */
+    uint64_t label_k_changes; /**< scored frames whose label K differs from the last scored one's */
+    uint64_t k_change_hits;   /**< label K changes the configuration made on the same frame, to the same K */
+};
+
+struct kpdve_tune_options {
+    int threads;              /**< worker threads; 0 for one per online CPU */
+    const kpdve_tables *tables; /**< NULL for kpdve_tables_default() */
+    const kpdve_prior *prior; /**< NULL: prior weights are ignored */
+};
+
+/**
+ * @brief What became of one input file.
+ */
+struct kpdve_tune_file {
+    const char *path;
+    int err;                  /**< KPDVE_TUNE_ error, 0 if the file was evaluated */
+    size_t frames;
+    size_t labeled;
+};
+
+void kpdve_tune_default_config(struct kpdve_tune_config *config);
+void kpdve_tune_default_options(struct kpdve_tune_options *options);
+
+// one stream, on the calling thread; adds to scores[config_count]
+int kpdve_tune_evaluate_states(const int *states, size_t count,
+                               const struct kpdve_tune_config *configs, size_t config_count,
+                               const struct kpdve_tune_options *options, struct kpdve_tune_score *scores);
+
+// every file (each one stream from the default state) on a pool of threads; fills scores[config_count]
+int kpdve_tune_evaluate(const char *const *paths, size_t count,
+                        const struct kpdve_tune_config *configs, size_t config_count,
+                        const struct kpdve_tune_options *options,
+                        struct kpdve_tune_file *files, struct kpdve_tune_score *scores);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* qdkpdve_tune_h */
@@ -0,0 +1,902 @@
+//
+//  pitchflockmodule.c
+//  pitchflock
+//
+
+/**
+ * @file pitchflockmodule.c
+ * @brief The pitchflock Python module: batch analysis, the offline decoders and the
+ * candidate bitsets over buffers.
+ *
+ * Arrays cross the boundary through the buffer protocol (PEP 3118), so NumPy arrays,
+ * array.array and memoryviews all work and nothing is copied: inputs are read in place,
+ * results are written into the caller's `out` array when one is given, or into a new
+ * buffer returned as a typed memoryview (numpy.asarray wraps it without a copy). The
+ * module does not link against NumPy.
+ *
+ * The per-frame work runs with the GIL released, so Python threads analyzing different
+ * streams run on different cores. An Analyzer carries one stream's context and must not
+ * be used by two threads at once (it raises instead of racing).
+ *
+ *   analyze(chroma, out=None, context=None)   uint16 chroma -> uint32 encoded states
+ *   Analyzer(context=None)                    the same, with the context kept across calls
+ *   candidates(chroma)                        [(kpdve, dve, ve)] of one chroma value
+ *   candidate_bitsets(chroma, out=None)       uint64 [n, 2]: bit k * 7 + p set where the
+ *                                             cell holds the chroma
+ *   encode(states, chunk_frames=65536)        uint32 states -> codec bytes (qdkpdve_codec.h)
+ *   decode(data)                              codec bytes -> uint32 states
+ *   Store(path)                               a mapped store (qdkpdve_store.h); its
+ *                                             buffer is the uint32 state column, in place
+ *   write_store(path, states, ...)            uint32 states -> a store file
+ *
+ * Encoded states are as in pf_rt (qdkpdve_rt.h): x---KKKKPPPDDDVVVEEEb-a-g-fe-d-c, with
+ * the x bit (INVALID) set on frames no pattern holds, which keep the previous KPDVE.
+ * A context is a 16-bit KPDVE encoding with K below 12; anything else is a ValueError.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../include/qdkpdve.h"
+#include "../include/qdkpdve_codec.h"
+#include "../include/qdkpdve_rt.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_store.h"
+#include "../include/qdkpdve_tables.h"
+
+#define PF_PY_INVALID 0x80000000u
+
+// the 84 cells holding each chroma, built at import
+static uint64_t cell_bitsets[KPDVE_TABLES_CHROMA][2];
+
+static void build_cell_bitsets(const kpdve_tables *tables)
+{
+    for (int chroma = 0; chroma < KPDVE_TABLES_CHROMA; chroma++)
+    {
+        int circle = chroma_to_circle(chroma);
+        cell_bitsets[chroma][0] = 0;
+        cell_bitsets[chroma][1] = 0;
+        for (int i = 0; i < KPDVE_TABLES_CELLS; i++)
+        {
+            if ((tables->crystal_masks[i] & circle) == circle)
+            {
+                cell_bitsets[chroma][i >> 6] |= 1ull << (i & 63);
+            }
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------- buffers */
+
+// a buffer of one-dimensional items of the given struct code (native order)
+static int buffer_is(const Py_buffer *view, char code, Py_ssize_t itemsize)
+{
+    const char *format = view->format ? view->format : "B";
+    if (*format == '@' || *format == '=')
+    {
+        format++;
+    }
+    else if (*format == '<' || *format == '>' || *format == '!')
+    {
+        const int little = 1;
+        int native_little = *(const char *)&little == 1;
+        if ((*format == '<') != native_little)
+        {
+            return 0;
+        }
+        format++;
+    }
+    return format[0] == code && format[1] == '\0' && view->itemsize == itemsize;
+}
+
+static int get_input(PyObject *obj, Py_buffer *view, char code, Py_ssize_t itemsize, const char *what)
+{
+    if (PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+    {
+        return -1;
+    }
+    if (!buffer_is(view, code, itemsize))
+    {
+        PyErr_Format(PyExc_TypeError, "%s must be a contiguous %s array (format '%c'), not '%s'",
+                     what, itemsize == 2 ? "uint16" : "uint32", code, view->format ? view->format : "B");
+        PyBuffer_Release(view);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief The output array: the caller's (writable, contiguous, of the code, at least
+ * count items), or a new one. *result receives the object to return.
+ */
+static int get_output(PyObject *out, Py_buffer *view, char code, Py_ssize_t itemsize, Py_ssize_t count,
+                      Py_ssize_t columns, PyObject **result, void **data)
+{
+    if (out != NULL && out != Py_None)
+    {
+        if (PyObject_GetBuffer(out, view, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+        {
+            return -1;
+        }
+        if (!buffer_is(view, code, itemsize) || view->len < count * columns * itemsize)
+        {
+            PyErr_Format(PyExc_ValueError, "out must be a writable contiguous array of %zd items of format '%c'",
+                         count * columns, code);
+            PyBuffer_Release(view);
+            return -1;
+        }
+        Py_INCREF(out);
+        *result = out;
+        *data = view->buf;
+        return 0;
+    }
+
+    view->obj = NULL;
+    PyObject *bytes = PyByteArray_FromStringAndSize(NULL, count * columns * itemsize);
+    if (bytes == NULL)
+    {
+        return -1;
+    }
+    *result = bytes;
+    *data = PyByteArray_AS_STRING(bytes);
+    return 0;
+}
+
+// the new buffer of get_output as a typed memoryview ([count] or [count, columns])
+static PyObject *finish_output(PyObject *result, Py_buffer *view, const char *format, Py_ssize_t count, Py_ssize_t columns)
+{
+    if (view->obj != NULL)
+    {
+        PyBuffer_Release(view);
+        return result;
+    }
+    PyObject *bytes_view = PyMemoryView_FromObject(result);
+    Py_DECREF(result);
+    if (bytes_view == NULL)
+    {
+        return NULL;
+    }
+    PyObject *typed;
+    if (columns > 1)
+    {
+        typed = PyObject_CallMethod(bytes_view, "cast", "s(nn)", format, count, columns);
+    }
+    else
+    {
+        typed = PyObject_CallMethod(bytes_view, "cast", "s", format);
+    }
+    Py_DECREF(bytes_view);
+    return typed;
+}
+
+static void release_output(PyObject *result, Py_buffer *view)
+{
+    if (view->obj != NULL)
+    {
+        PyBuffer_Release(view);
+    }
+    Py_DECREF(result);
+}
+
+/* ------------------------------------------------------------------------ Analyzer */
+
+typedef struct {
+    PyObject_HEAD
+    pf_rt_analyzer analyzer;
+    int busy;
+} AnalyzerObject;
+
+static int context_arg(PyObject *context, int *value)
+{
+    if (context == NULL || context == Py_None)
+    {
+        *value = -1;
+        return 0;
+    }
+    long v = PyLong_AsLong(context);
+    if (v == -1 && PyErr_Occurred())
+    {
+        return -1;
+    }
+    if (v < 0 || v > 0xFFFF)
+    {
+        PyErr_SetString(PyExc_ValueError, "context must be a 16-bit KPDVE encoding");
+        return -1;
+    }
+    *value = (int)v;
+    return 0;
+}
+
+// a context from context_arg (-1 keeps the analyzer's); ValueError for K above 11
+static int apply_context(pf_rt_analyzer *analyzer, int value)
+{
+    if (value >= 0 && pf_rt_set_context(analyzer, value) != 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "context must be a KPDVE encoding (K below 12)");
+        return -1;
+    }
+    return 0;
+}
+
+// chroma[count] -> states[count], from the analyzer's context; the GIL is released
+static PyObject *analyze_buffer(pf_rt_analyzer *analyzer, PyObject *chroma, PyObject *out)
+{
+    Py_buffer in;
+    if (get_input(chroma, &in, 'H', 2, "chroma") != 0)
+    {
+        return NULL;
+    }
+    Py_ssize_t count = in.len / 2;
+    Py_buffer out_view;
+    PyObject *result;
+    void *data;
+    if (get_output(out, &out_view, 'I', 4, count, 1, &result, &data) != 0)
+    {
+        PyBuffer_Release(&in);
+        return NULL;
+    }
+
+    const uint16_t *frames = in.buf;
+    uint32_t *states = data;
+    Py_BEGIN_ALLOW_THREADS
+    for (Py_ssize_t i = 0; i < count; i++)
+    {
+        states[i] = (uint32_t)pf_rt_analyze_chroma(analyzer, frames[i]);
+    }
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&in);
+    return finish_output(result, &out_view, "I", count, 1);
+}
+
+static int Analyzer_init(AnalyzerObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "context", NULL };
+    PyObject *context = NULL;
+    int value;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &context) || context_arg(context, &value) != 0)
+    {
+        return -1;
+    }
+    pf_rt_init(&self->analyzer, kpdve_tables_default());
+    self->busy = 0;
+    return apply_context(&self->analyzer, value);
+}
+
+static int Analyzer_acquire(AnalyzerObject *self)
+{
+    if (__atomic_exchange_n(&self->busy, 1, __ATOMIC_ACQUIRE))
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Analyzer is in use by another thread");
+        return -1;
+    }
+    return 0;
+}
+
+static void Analyzer_release(AnalyzerObject *self)
+{
+    __atomic_store_n(&self->busy, 0, __ATOMIC_RELEASE);
+}
+
+static PyObject *Analyzer_analyze(AnalyzerObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "chroma", "out", NULL };
+    PyObject *chroma, *out = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", kwlist, &chroma, &out) || Analyzer_acquire(self) != 0)
+    {
+        return NULL;
+    }
+    PyObject *result = analyze_buffer(&self->analyzer, chroma, out);
+    Analyzer_release(self);
+    return result;
+}
+
+static PyObject *Analyzer_reset(AnalyzerObject *self, PyObject *Py_UNUSED(ignored))
+{
+    if (Analyzer_acquire(self) != 0)
+    {
+        return NULL;
+    }
+    pf_rt_reset(&self->analyzer);
+    Analyzer_release(self);
+    Py_RETURN_NONE;
+}
+
+static PyObject *Analyzer_get_context(AnalyzerObject *self, void *Py_UNUSED(closure))
+{
+    return PyLong_FromLong(self->analyzer.context);
+}
+
+static int Analyzer_set_context(AnalyzerObject *self, PyObject *value, void *Py_UNUSED(closure))
+{
+    int context;
+    if (value == NULL)
+    {
+        PyErr_SetString(PyExc_AttributeError, "the context cannot be deleted");
+        return -1;
+    }
+    if (context_arg(value, &context) != 0 || Analyzer_acquire(self) != 0)
+    {
+        return -1;
+    }
+    int err = apply_context(&self->analyzer, context);
+    Analyzer_release(self);
+    return err;
+}
+
+static PyObject *Analyzer_get_encoded(AnalyzerObject *self, void *Py_UNUSED(closure))
+{
+    return PyLong_FromUnsignedLong((uint32_t)self->analyzer.encoded);
+}
+
+static PyMethodDef Analyzer_methods[] = {
+    { "analyze", (PyCFunction)(void (*)(void))Analyzer_analyze, METH_VARARGS | METH_KEYWORDS,
+      "analyze(chroma, out=None)\n--\n\nAnalyzes uint16 chroma frames, continuing from the "
+      "context of the last call; returns uint32 encoded states (out, if given)." },
+    { "reset", (PyCFunction)Analyzer_reset, METH_NOARGS, "Returns to the default context." },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyGetSetDef Analyzer_getset[] = {
+    { "context", (getter)Analyzer_get_context, (setter)Analyzer_set_context,
+      "KPDVE context of the next frame", NULL },
+    { "encoded", (getter)Analyzer_get_encoded, NULL, "encoded state of the last frame", NULL },
+    { NULL, NULL, NULL, NULL, NULL }
+};
+
+static PyTypeObject AnalyzerType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pitchflock.Analyzer",
+    .tp_doc = "Analyzer(context=None)\n--\n\nTable-driven analysis of one stream (pf_rt).",
+    .tp_basicsize = sizeof(AnalyzerObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)Analyzer_init,
+    .tp_methods = Analyzer_methods,
+    .tp_getset = Analyzer_getset,
+};
+
+/* --------------------------------------------------------------------------- Store */
+
+typedef struct {
+    PyObject_HEAD
+    kpdve_store store;
+    int open;
+    Py_ssize_t exports;
+    Py_ssize_t shape;
+    Py_ssize_t stride;
+} StoreObject;
+
+static int Store_check(StoreObject *self)
+{
+    if (!self->open)
+    {
+        PyErr_SetString(PyExc_ValueError, "store is closed");
+        return -1;
+    }
+    return 0;
+}
+
+static int Store_init(StoreObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "path", NULL };
+    PyObject *path;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O&", kwlist, PyUnicode_FSConverter, &path))
+    {
+        return -1;
+    }
+    if (self->open)
+    {
+        PyErr_SetString(PyExc_ValueError, "store is already open");
+        Py_DECREF(path);
+        return -1;
+    }
+    int result;
+    Py_BEGIN_ALLOW_THREADS
+    result = kpdve_store_open(&self->store, PyBytes_AS_STRING(path));
+    Py_END_ALLOW_THREADS
+    if (result != KPDVE_STORE_OK)
+    {
+        if (result == KPDVE_STORE_ERR_IO)
+        {
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+        }
+        else if (result == KPDVE_STORE_ERR_MEMORY)
+        {
+            PyErr_NoMemory();
+        }
+        else
+        {
+            PyErr_Format(PyExc_ValueError, "%s is not a pitchflock store", PyBytes_AS_STRING(path));
+        }
+        Py_DECREF(path);
+        return -1;
+    }
+    Py_DECREF(path);
+    self->open = 1;
+    return 0;
+}
+
+static PyObject *Store_close(StoreObject *self, PyObject *Py_UNUSED(ignored))
+{
+    if (self->exports > 0)
+    {
+        PyErr_SetString(PyExc_BufferError, "the store's states are still in use by a buffer");
+        return NULL;
+    }
+    if (self->open)
+    {
+        kpdve_store_close(&self->store);
+        self->open = 0;
+    }
+    Py_RETURN_NONE;
+}
+
+static void Store_dealloc(StoreObject *self)
+{
+    if (self->open)
+    {
+        kpdve_store_close(&self->store);
+    }
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+// the state column, in the mapping, as a read-only uint32 buffer
+static int Store_getbuffer(StoreObject *self, Py_buffer *view, int flags)
+{
+    if (Store_check(self) != 0)
+    {
+        view->obj = NULL;
+        return -1;
+    }
+    if (flags & PyBUF_WRITABLE)
+    {
+        PyErr_SetString(PyExc_BufferError, "a store is read-only");
+        view->obj = NULL;
+        return -1;
+    }
+    self->shape = (Py_ssize_t)kpdve_store_frame_count(&self->store);
+    self->stride = 4;
+    view->buf = (void *)self->store.states;
+    view->obj = (PyObject *)self;
+    Py_INCREF(self);
+    view->len = self->shape * 4;
+    view->readonly = 1;
+    view->itemsize = 4;
+    view->format = (flags & PyBUF_FORMAT) ? "I" : NULL;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) ? &self->shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) ? &self->stride : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    self->exports++;
+    return 0;
+}
+
+static void Store_releasebuffer(StoreObject *self, Py_buffer *Py_UNUSED(view))
+{
+    self->exports--;
+}
+
+static Py_ssize_t Store_len(StoreObject *self)
+{
+    return self->open ? (Py_ssize_t)kpdve_store_frame_count(&self->store) : 0;
+}
+
+static PyObject *Store_frame_at_time(StoreObject *self, PyObject *arg)
+{
+    unsigned long long time = PyLong_AsUnsignedLongLong(arg);
+    if ((time == (unsigned long long)-1 && PyErr_Occurred()) || Store_check(self) != 0)
+    {
+        return NULL;
+    }
+    return PyLong_FromSize_t(kpdve_store_frame_at_time(&self->store, (uint64_t)time));
+}
+
+static PyObject *Store_key_changes(StoreObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "first", "last", NULL };
+    Py_ssize_t first = 0, last = -1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|nn", kwlist, &first, &last) || Store_check(self) != 0)
+    {
+        return NULL;
+    }
+    size_t frames = kpdve_store_frame_count(&self->store);
+    size_t to = (last < 0 || (size_t)last > frames) ? frames : (size_t)last;
+    size_t from = (first < 0) ? 0 : (size_t)first;
+    if (from > to)
+    {
+        from = to;
+    }
+
+    size_t count, cap = 0;
+    size_t *changes = NULL;
+    // the first call counts, the second fills
+    for (;;)
+    {
+        Py_BEGIN_ALLOW_THREADS
+        count = kpdve_store_key_changes(&self->store, from, to, changes, cap);
+        Py_END_ALLOW_THREADS
+        if (count <= cap)
+        {
+            break;
+        }
+        PyMem_Free(changes);
+        cap = count;
+        changes = PyMem_Malloc(cap * sizeof(size_t));
+        if (changes == NULL)
+        {
+            return PyErr_NoMemory();
+        }
+    }
+    PyObject *list = PyList_New((Py_ssize_t)count);
+    for (size_t i = 0; list != NULL && i < count; i++)
+    {
+        PyObject *frame = PyLong_FromSize_t(changes[i]);
+        if (frame == NULL)
+        {
+            Py_CLEAR(list);
+            break;
+        }
+        PyList_SET_ITEM(list, (Py_ssize_t)i, frame);
+    }
+    PyMem_Free(changes);
+    return list;
+}
+
+static PyObject *Store_enter(StoreObject *self, PyObject *Py_UNUSED(ignored))
+{
+    if (Store_check(self) != 0)
+    {
+        return NULL;
+    }
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *Store_exit(StoreObject *self, PyObject *Py_UNUSED(args))
+{
+    return Store_close(self, NULL);
+}
+
+static PyMethodDef Store_methods[] = {
+    { "close", (PyCFunction)Store_close, METH_NOARGS, "Unmaps the store (no buffer may still use it)." },
+    { "frame_at_time", (PyCFunction)Store_frame_at_time, METH_O, "The frame playing at a time." },
+    { "key_changes", (PyCFunction)(void (*)(void))Store_key_changes, METH_VARARGS | METH_KEYWORDS,
+      "key_changes(first=0, last=None)\n--\n\nThe frames in [first, last) where K changes." },
+    { "__enter__", (PyCFunction)Store_enter, METH_NOARGS, NULL },
+    { "__exit__", (PyCFunction)Store_exit, METH_VARARGS, NULL },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyBufferProcs Store_as_buffer = {
+    (getbufferproc)Store_getbuffer,
+    (releasebufferproc)Store_releasebuffer,
+};
+
+static PySequenceMethods Store_as_sequence = {
+    .sq_length = (lenfunc)Store_len,
+};
+
+static PyTypeObject StoreType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pitchflock.Store",
+    .tp_doc = "Store(path)\n--\n\nA mapped state store; its buffer is the uint32 state column.",
+    .tp_basicsize = sizeof(StoreObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)Store_init,
+    .tp_dealloc = (destructor)Store_dealloc,
+    .tp_methods = Store_methods,
+    .tp_as_buffer = &Store_as_buffer,
+    .tp_as_sequence = &Store_as_sequence,
+};
+
+/* ------------------------------------------------------------------------ functions */
+
+static PyObject *pf_analyze(PyObject *Py_UNUSED(module), PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "chroma", "out", "context", NULL };
+    PyObject *chroma, *out = NULL, *context = NULL;
+    int value;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO", kwlist, &chroma, &out, &context)
+        || context_arg(context, &value) != 0)
+    {
+        return NULL;
+    }
+    pf_rt_analyzer analyzer;
+    pf_rt_init(&analyzer, kpdve_tables_default());
+    if (apply_context(&analyzer, value) != 0)
+    {
+        return NULL;
+    }
+    return analyze_buffer(&analyzer, chroma, out);
+}
+
+static PyObject *pf_candidates(PyObject *Py_UNUSED(module), PyObject *arg)
+{
+    long chroma = PyLong_AsLong(arg);
+    if (chroma == -1 && PyErr_Occurred())
+    {
+        return NULL;
+    }
+    if (chroma < 0 || chroma >= KPDVE_TABLES_CHROMA)
+    {
+        PyErr_SetString(PyExc_ValueError, "chroma must be a 12-bit value");
+        return NULL;
+    }
+    const kpdve_tables *tables = kpdve_tables_default();
+    int first = (chroma == 0) ? 0 : tables->offsets[chroma];
+    int count = (chroma == 0) ? 0 : tables->offsets[chroma + 1] - first;
+    PyObject *list = PyList_New(count);
+    for (int i = 0; list != NULL && i < count; i++)
+    {
+        uint32_t packed = tables->candidates[first + i];
+        PyObject *item = Py_BuildValue("(iii)", KPDVE_CANDIDATE_KPDVE(packed), KPDVE_CANDIDATE_DVE(packed),
+                                       KPDVE_CANDIDATE_VE(packed));
+        if (item == NULL)
+        {
+            Py_CLEAR(list);
+            break;
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+    return list;
+}
+
+static PyObject *pf_candidate_bitsets(PyObject *Py_UNUSED(module), PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "chroma", "out", NULL };
+    PyObject *chroma, *out = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", kwlist, &chroma, &out))
+    {
+        return NULL;
+    }
+    Py_buffer in;
+    if (get_input(chroma, &in, 'H', 2, "chroma") != 0)
+    {
+        return NULL;
+    }
+    Py_ssize_t count = in.len / 2;
+    Py_buffer out_view;
+    PyObject *result;
+    void *data;
+    if (get_output(out, &out_view, 'Q', 8, count, 2, &result, &data) != 0)
+    {
+        PyBuffer_Release(&in);
+        return NULL;
+    }
+
+    const uint16_t *frames = in.buf;
+    uint64_t *bits = data;
+    Py_BEGIN_ALLOW_THREADS
+    for (Py_ssize_t i = 0; i < count; i++)
+    {
+        bits[2 * i] = cell_bitsets[frames[i] & 0xFFF][0];
+        bits[2 * i + 1] = cell_bitsets[frames[i] & 0xFFF][1];
+    }
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&in);
+    return finish_output(result, &out_view, "Q", count, 2);
+}
+
+static PyObject *pf_encode(PyObject *Py_UNUSED(module), PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "states", "chunk_frames", NULL };
+    PyObject *states;
+    Py_ssize_t chunk_frames = KPDVE_CODEC_CHUNK_FRAMES;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|n", kwlist, &states, &chunk_frames))
+    {
+        return NULL;
+    }
+    if (chunk_frames <= 0 || (size_t)chunk_frames > UINT32_MAX)
+    {
+        PyErr_SetString(PyExc_ValueError, "chunk_frames must be positive");
+        return NULL;
+    }
+    Py_buffer in;
+    if (get_input(states, &in, 'I', 4, "states") != 0)
+    {
+        return NULL;
+    }
+    size_t count = (size_t)in.len / 4;
+    // no chunk is longer than the input, so a large chunk_frames does not inflate the bound
+    size_t chunk = ((size_t)chunk_frames < count) ? (size_t)chunk_frames : count;
+    size_t chunks = chunk ? (count + chunk - 1) / chunk : 0;
+    size_t cap = chunks * kpdve_codec_bound(chunk);
+    PyObject *bytes = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)cap);
+    if (bytes == NULL)
+    {
+        PyBuffer_Release(&in);
+        return NULL;
+    }
+
+    uint8_t *out = (uint8_t *)PyBytes_AS_STRING(bytes);
+    const int *frames = in.buf;
+    size_t size = 0;
+    long written = 0;
+    Py_BEGIN_ALLOW_THREADS
+    for (size_t first = 0; first < count && written >= 0; first += chunk)
+    {
+        size_t n = (count - first < chunk) ? count - first : chunk;
+        written = kpdve_codec_encode_chunk(frames + first, n, out + size, cap - size);
+        size += (written > 0) ? (size_t)written : 0;
+    }
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&in);
+    if (written < 0)
+    {
+        Py_DECREF(bytes);
+        PyErr_SetString(PyExc_RuntimeError, "codec output exceeded its bound");
+        return NULL;
+    }
+    if (_PyBytes_Resize(&bytes, (Py_ssize_t)size) != 0)
+    {
+        return NULL;
+    }
+    return bytes;
+}
+
+static PyObject *pf_decode(PyObject *Py_UNUSED(module), PyObject *arg)
+{
+    Py_buffer in;
+    if (PyObject_GetBuffer(arg, &in, PyBUF_SIMPLE) != 0)
+    {
+        return NULL;
+    }
+    const uint8_t *bytes = in.buf;
+    size_t len = (size_t)in.len;
+
+    // frame count from the chunk headers, then one pass of decoding
+    size_t total = 0;
+    for (size_t at = 0; at < len;)
+    {
+        size_t frames, size;
+        if (kpdve_codec_chunk_info(bytes + at, len - at, &frames, &size) != KPDVE_CODEC_OK)
+        {
+            PyBuffer_Release(&in);
+            PyErr_SetString(PyExc_ValueError, "corrupt codec data");
+            return NULL;
+        }
+        total += frames;
+        at += size;
+    }
+
+    Py_buffer out_view;
+    PyObject *result;
+    void *data;
+    if (get_output(NULL, &out_view, 'I', 4, (Py_ssize_t)total, 1, &result, &data) != 0)
+    {
+        PyBuffer_Release(&in);
+        return NULL;
+    }
+    int *states = data;
+    long decoded = 0;
+    Py_BEGIN_ALLOW_THREADS
+    size_t frame = 0;
+    for (size_t at = 0; at < len && decoded >= 0;)
+    {
+        size_t consumed;
+        decoded = kpdve_codec_decode_chunk(bytes + at, len - at, states + frame, total - frame, &consumed);
+        frame += (decoded > 0) ? (size_t)decoded : 0;
+        at += consumed;
+    }
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&in);
+    if (decoded < 0)
+    {
+        release_output(result, &out_view);
+        PyErr_SetString(PyExc_ValueError, "corrupt codec data");
+        return NULL;
+    }
+    return finish_output(result, &out_view, "I", (Py_ssize_t)total, 1);
+}
+
+static PyObject *pf_write_store(PyObject *Py_UNUSED(module), PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "path", "states", "block_frames", "frame_period", NULL };
+    PyObject *path, *states;
+    unsigned int block_frames = 0;
+    unsigned long long frame_period = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O&O|IK", kwlist, PyUnicode_FSConverter, &path, &states,
+                                     &block_frames, &frame_period))
+    {
+        return NULL;
+    }
+    Py_buffer in;
+    if (get_input(states, &in, 'I', 4, "states") != 0)
+    {
+        Py_DECREF(path);
+        return NULL;
+    }
+    kpdve_store_writer writer;
+    int result;
+    Py_BEGIN_ALLOW_THREADS
+    result = kpdve_store_writer_open(&writer, PyBytes_AS_STRING(path), (uint32_t)block_frames, (uint64_t)frame_period);
+    if (result == KPDVE_STORE_OK)
+    {
+        result = kpdve_store_append(&writer, in.buf, (size_t)in.len / 4);
+        int closed = kpdve_store_writer_close(&writer);
+        result = (result == KPDVE_STORE_OK) ? closed : result;
+    }
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&in);
+    if (result != KPDVE_STORE_OK)
+    {
+        if (result == KPDVE_STORE_ERR_MEMORY)
+        {
+            PyErr_NoMemory();
+        }
+        else
+        {
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+        }
+        Py_DECREF(path);
+        return NULL;
+    }
+    Py_DECREF(path);
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef pitchflock_methods[] = {
+    { "analyze", (PyCFunction)(void (*)(void))pf_analyze, METH_VARARGS | METH_KEYWORDS,
+      "analyze(chroma, out=None, context=None)\n--\n\nAnalyzes uint16 chroma frames (b-a-g-fe-d-c) "
+      "as one stream; returns uint32 encoded states (out, if given)." },
+    { "candidates", (PyCFunction)pf_candidates, METH_O,
+      "candidates(chroma)\n--\n\nThe (kpdve, dve, ve) candidates of a chroma value, as set_kp_list." },
+    { "candidate_bitsets", (PyCFunction)(void (*)(void))pf_candidate_bitsets, METH_VARARGS | METH_KEYWORDS,
+      "candidate_bitsets(chroma, out=None)\n--\n\nuint64 [n, 2] bitsets of the K, P cells (bit k * 7 + p) "
+      "holding each chroma; the empty chroma fits every cell." },
+    { "encode", (PyCFunction)(void (*)(void))pf_encode, METH_VARARGS | METH_KEYWORDS,
+      "encode(states, chunk_frames=65536)\n--\n\nCompresses uint32 encoded states (qdkpdve_codec.h)." },
+    { "decode", (PyCFunction)pf_decode, METH_O,
+      "decode(data)\n--\n\nDecompresses codec bytes into uint32 encoded states." },
+    { "write_store", (PyCFunction)(void (*)(void))pf_write_store, METH_VARARGS | METH_KEYWORDS,
+      "write_store(path, states, block_frames=0, frame_period=1)\n--\n\nWrites uint32 encoded states "
+      "to a store file (block_frames 0: the default)." },
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef pitchflock_module = {
+    PyModuleDef_HEAD_INIT,
+    "pitchflock",
+    "KPDVE harmony analysis over NumPy-compatible buffers.",
+    -1,
+    pitchflock_methods,
+    NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_pitchflock(void)
+{
+    // the shared tables, before any call releases the GIL
+    build_cell_bitsets(kpdve_tables_default());
+
+    if (PyType_Ready(&AnalyzerType) < 0 || PyType_Ready(&StoreType) < 0)
+    {
+        return NULL;
+    }
+    PyObject *module = PyModule_Create(&pitchflock_module);
+    if (module == NULL)
+    {
+        return NULL;
+    }
+    Py_INCREF(&AnalyzerType);
+    Py_INCREF(&StoreType);
+    if (PyModule_AddObject(module, "Analyzer", (PyObject *)&AnalyzerType) < 0
+        || PyModule_AddObject(module, "Store", (PyObject *)&StoreType) < 0
+        || PyModule_AddIntConstant(module, "DEFAULT_CONTEXT", harmony_state_default().kpdve) < 0
+        || PyModule_AddObject(module, "INVALID", PyLong_FromUnsignedLong(PF_PY_INVALID)) < 0
+        || PyModule_AddIntConstant(module, "CODEC_CHUNK_FRAMES", KPDVE_CODEC_CHUNK_FRAMES) < 0)
+    {
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
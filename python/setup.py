@@ -0,0 +1,34 @@
+#
+#  setup.py
+#  pitchflock
+#
+# Builds the pitchflock extension with the library sources compiled in:
+#
+#   cd python && python3 setup.py build_ext --inplace
+#
+# CMake builds the same module with -DPITCHFLOCK_PYTHON=ON.
+
+import glob
+import os
+
+from setuptools import Extension, setup
+
+here = os.path.dirname(os.path.abspath(__file__))
+root = os.path.dirname(here)
+
+sources = [os.path.join(here, "pitchflockmodule.c")] + sorted(glob.glob(os.path.join(root, "src", "*.c")))
+
+setup(
+    name="pitchflock",
+    version="0.1.0",
+    description="KPDVE harmony analysis over NumPy-compatible buffers",
+    ext_modules=[
+        Extension(
+            "pitchflock",
+            sources=sources,
+            include_dirs=[os.path.join(root, "include")],
+            extra_compile_args=["-std=gnu99", "-O2"],
+            extra_link_args=["-pthread"],
+        )
+    ],
+)
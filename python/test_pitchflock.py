@@ -0,0 +1,192 @@
+#
+#  test_pitchflock.py
+#  pitchflock
+#
+# Checks the Python module: batch analysis against one-frame analysis and the candidate
+# lists, continuation across calls, the output buffers, the codec and store round trips,
+# and analysis on several threads. Runs with array.array; with NumPy installed it also
+# checks that NumPy arrays go in and come out without copies.
+
+import array
+import os
+import random
+import tempfile
+import threading
+import unittest
+
+import pitchflock
+
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
+
+def chroma_stream(count, seed=42):
+    rng = random.Random(seed)
+    triads = [0x91, 0x221, 0x84, 0x109, 0x412, 0x8A, 0x891, 0xA4]
+    return array.array("H", (rng.choice(triads) if rng.random() < 0.8 else rng.randrange(4096)
+                             for _ in range(count)))
+
+
+class AnalyzeTest(unittest.TestCase):
+    def test_c_major_triad_from_default_context(self):
+        state = pitchflock.analyze(array.array("H", [0x91]))[0]
+        same_kp = [c for c in pitchflock.candidates(0x91) if c[0] >> 9 == 0]
+        self.assertEqual(state & 0xFFF, 0x91)
+        self.assertEqual(state >> 12, same_kp[0][0])
+
+    def test_invalid_frame_keeps_kpdve(self):
+        states = pitchflock.analyze(array.array("H", [0x91, 0x7]))
+        self.assertEqual(pitchflock.candidates(0x7), [])
+        self.assertTrue(states[1] & pitchflock.INVALID)
+        self.assertEqual((states[1] >> 12) & 0xFFFF, states[0] >> 12)
+
+    def test_batch_matches_frame_by_frame(self):
+        chroma = chroma_stream(5000)
+        batch = pitchflock.analyze(chroma)
+        analyzer = pitchflock.Analyzer()
+        single = [analyzer.analyze(array.array("H", [c]))[0] for c in chroma]
+        self.assertEqual(list(batch), single)
+
+        # in two calls, the second continuing from the first's context
+        analyzer = pitchflock.Analyzer()
+        first = analyzer.analyze(chroma[:1234])
+        second = analyzer.analyze(chroma[1234:])
+        self.assertEqual(list(first) + list(second), list(batch))
+        self.assertEqual(analyzer.encoded, batch[-1])
+
+    def test_context(self):
+        chroma = array.array("H", [0x91])
+        self.assertEqual(pitchflock.Analyzer().context, pitchflock.DEFAULT_CONTEXT)
+        # in the context of G (K = 1), C E G reads as IV
+        a = pitchflock.analyze(chroma, context=1 << 12)[0]
+        analyzer = pitchflock.Analyzer(context=1 << 12)
+        self.assertEqual(analyzer.analyze(chroma)[0], a)
+        self.assertEqual(a >> 24, 1)
+        self.assertEqual(analyzer.context, a >> 12)
+        analyzer.reset()
+        self.assertEqual(analyzer.context, pitchflock.DEFAULT_CONTEXT)
+        # 16-bit encodings with K above 11 are not contexts
+        for bad in (0xC000, 0xF000, 0xFFFF):
+            with self.assertRaises(ValueError):
+                pitchflock.Analyzer(context=bad)
+            with self.assertRaises(ValueError):
+                pitchflock.analyze(chroma, context=bad)
+            with self.assertRaises(ValueError):
+                analyzer.context = bad
+        self.assertEqual(analyzer.context, pitchflock.DEFAULT_CONTEXT)
+
+    def test_out_buffer(self):
+        chroma = chroma_stream(100)
+        out = array.array("I", [0] * 100)
+        result = pitchflock.analyze(chroma, out=out)
+        self.assertIs(result, out)
+        self.assertEqual(list(out), list(pitchflock.analyze(chroma)))
+        with self.assertRaises(ValueError):
+            pitchflock.analyze(chroma, out=array.array("I", [0] * 99))
+
+    def test_types(self):
+        with self.assertRaises(TypeError):
+            pitchflock.analyze(array.array("I", [0x91]))
+        with self.assertRaises(TypeError):
+            pitchflock.analyze([0x91])
+        self.assertEqual(len(pitchflock.analyze(array.array("H"))), 0)
+        self.assertEqual(pitchflock.analyze(array.array("H", [0x91])).format, "I")
+
+    def test_threads(self):
+        streams = [chroma_stream(20000, seed) for seed in range(4)]
+        expected = [list(pitchflock.analyze(s)) for s in streams]
+        results = [None] * 4
+
+        def run(i):
+            results[i] = list(pitchflock.Analyzer().analyze(streams[i]))
+
+        threads = [threading.Thread(target=run, args=(i,)) for i in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(results, expected)
+
+
+class CandidateTest(unittest.TestCase):
+    def test_bitsets_match_candidates(self):
+        chroma = array.array("H", range(4096))
+        bits = pitchflock.candidate_bitsets(chroma)
+        self.assertEqual(bits.shape, (4096, 2))
+        for c in range(1, 4096):
+            cells = [k * 7 + p for k in range(12) for p in range(7)
+                     if (bits[c, (k * 7 + p) >> 6] >> ((k * 7 + p) & 63)) & 1]
+            listed = [(kpdve >> 12) * 7 + ((kpdve >> 9) & 7) for kpdve, _, _ in pitchflock.candidates(c)]
+            self.assertEqual(cells, listed)
+        self.assertEqual(bin(bits[0, 0]).count("1") + bin(bits[0, 1]).count("1"), 84)
+
+
+class DecoderTest(unittest.TestCase):
+    def test_codec_round_trip(self):
+        states = pitchflock.analyze(chroma_stream(100000))
+        data = pitchflock.encode(states, chunk_frames=30000)
+        self.assertLess(len(data), len(states) * 4)
+        self.assertEqual(list(pitchflock.decode(data)), list(states))
+        self.assertEqual(len(pitchflock.decode(b"")), 0)
+        with self.assertRaises(ValueError):
+            pitchflock.decode(data[:len(data) // 2])
+        # a chunk longer than the input is one chunk of the input's length
+        short = states[:1000]
+        for chunk_frames in (2 ** 24, 2 ** 31):
+            self.assertEqual(pitchflock.encode(short, chunk_frames=chunk_frames), pitchflock.encode(short))
+        self.assertEqual(len(pitchflock.decode(pitchflock.encode(states[:0], chunk_frames=2 ** 31))), 0)
+
+    def test_store(self):
+        states = pitchflock.analyze(chroma_stream(10000))
+        with tempfile.TemporaryDirectory() as tmp:
+            path = os.path.join(tmp, "states.pfs")
+            pitchflock.write_store(path, states, block_frames=1024)
+            with pitchflock.Store(path) as store:
+                self.assertEqual(len(store), 10000)
+                column = memoryview(store)
+                self.assertTrue(column.readonly)
+                self.assertEqual(column.format, "I")
+                self.assertEqual(column.tolist(), list(states))
+                with self.assertRaises(BufferError):
+                    store.close()
+                column.release()
+
+                keys = [(s >> 24) & 0xF for s in states]
+                valid = [i for i, s in enumerate(states) if not s & pitchflock.INVALID]
+                changes = [b for a, b in zip(valid, valid[1:]) if keys[a] != keys[b]]
+                self.assertEqual(store.key_changes(), changes)
+                self.assertEqual(store.frame_at_time(5000), 5000)
+            with self.assertRaises(ValueError):
+                store.key_changes()
+            with self.assertRaises(OSError):
+                pitchflock.Store(os.path.join(tmp, "missing.pfs"))
+
+
+@unittest.skipIf(numpy is None, "NumPy is not installed")
+class NumpyTest(unittest.TestCase):
+    def test_zero_copy(self):
+        chroma = numpy.frombuffer(chroma_stream(1000).tobytes(), dtype=numpy.uint16)
+        states = numpy.asarray(pitchflock.analyze(chroma))
+        self.assertEqual(states.dtype, numpy.uint32)
+        out = numpy.zeros(1000, dtype=numpy.uint32)
+        self.assertIs(pitchflock.analyze(chroma, out=out), out)
+        self.assertTrue(numpy.array_equal(out, states))
+        bits = numpy.asarray(pitchflock.candidate_bitsets(chroma))
+        self.assertEqual((bits.dtype, bits.shape), (numpy.uint64, (1000, 2)))
+        with self.assertRaises(TypeError):
+            pitchflock.analyze(chroma.astype(numpy.int64))
+
+        with tempfile.TemporaryDirectory() as tmp:
+            path = os.path.join(tmp, "states.pfs")
+            pitchflock.write_store(path, states)
+            store = pitchflock.Store(path)
+            column = numpy.frombuffer(store, dtype=numpy.uint32)
+            self.assertTrue(numpy.array_equal(column, states))
+            del column
+            store.close()
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -9,7 +9,6 @@
 
 #include "../include/qdkpdve_analysis.h"
 #include "../include/qdkpdve.h"
-#include <stdio.h> // For printf
 
 
 // for constructing/comparing ve_values in a single loop.
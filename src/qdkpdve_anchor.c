@@ -0,0 +1,236 @@
+//
+//  qdkpdve_anchor.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_anchor.c
+ * @brief Decayed K x P distribution as a second context for the chooser (see
+ * qdkpdve_anchor.h).
+ *
+ * Everything after kpdve_anchor_init is RT-safe: integer updates, a rescale loop over
+ * 104 counters every 8 half-lives, and a choice that is kpdve_tables_choose plus one
+ * multiply-add per candidate.
+ */
+
+#include <float.h>
+
+#include "../include/qdkpdve_anchor.h"
+
+#define MAX_HALF_LIFE 1048576.0   /**< 2^20 frames: keeps every sum below 2^58 */
+#define RESCALE_SHIFT 8
+
+// 2^x - 1 for 0 < x <= 1, from the series of e^(x ln 2) (precise for small x, and no libm)
+static double exp2_minus_one(double x)
+{
+    double y = x * 0.69314718055994530942;
+    double term = 1.0;
+    double sum = 0.0;
+    for (int n = 1; n < 24; n++)
+    {
+        term *= y / n;
+        sum += term;
+    }
+    return sum;
+}
+
+static uint16_t to_fixed(float distance)
+{
+    return (uint16_t)(distance * KPDVE_ANCHOR_DISTANCE_ONE + 0.5f);
+}
+
+/**
+ * @brief Sets up an empty anchor. Not RT-safe: builds the tables on first use.
+ *
+ * @param anchor The anchor.
+ * @param tables The tables whose K and P distances measure the anchor (NULL: the
+ * built-in ones).
+ * @param half_life_frames Frames after which a frame counts half (clamped to 1 .. 2^20).
+ * @param weight Scale of the anchor term against the distance from the context.
+ */
+void kpdve_anchor_init(kpdve_anchor *anchor, const kpdve_tables *tables, double half_life_frames, float weight)
+{
+    if (tables == NULL)
+    {
+        tables = kpdve_tables_default();
+    }
+    if (!(half_life_frames >= 1.0))
+    {
+        half_life_frames = 1.0;
+    }
+    if (half_life_frames > MAX_HALF_LIFE)
+    {
+        half_life_frames = MAX_HALF_LIFE;
+    }
+    double growth = exp2_minus_one(1.0 / half_life_frames) * 4294967296.0;
+    anchor->growth = growth >= 4294967295.0 ? 0xFFFFFFFFu : (uint32_t)(growth + 0.5);
+    anchor->weight = weight;
+    for (int i = 0; i < 12 * 12; i++)
+    {
+        anchor->k_fixed[i] = to_fixed(tables->k_distance[i]);
+    }
+    for (int i = 0; i < 8 * 8; i++)
+    {
+        anchor->p_fixed[i] = to_fixed(tables->p_distance[i]);
+    }
+    kpdve_anchor_reset(anchor);
+}
+
+/**
+ * @brief Forgets every frame. RT-safe.
+ */
+void kpdve_anchor_reset(kpdve_anchor *anchor)
+{
+    anchor->increment = KPDVE_ANCHOR_ONE;
+    anchor->fraction = 0;
+    anchor->frames = 0;
+    anchor->total = 0;
+    for (int i = 0; i < KPDVE_TABLES_CELLS; i++)
+    {
+        anchor->cells[i] = 0;
+    }
+    for (int i = 0; i < 12; i++)
+    {
+        anchor->k_sum[i] = 0;
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        anchor->p_sum[i] = 0;
+    }
+}
+
+// scales every count down together, which leaves every share and mean as it was
+static void rescale(kpdve_anchor *anchor)
+{
+    anchor->fraction = anchor->fraction >> RESCALE_SHIFT | anchor->increment << (32 - RESCALE_SHIFT);
+    anchor->increment >>= RESCALE_SHIFT;
+    anchor->total >>= RESCALE_SHIFT;
+    for (int i = 0; i < KPDVE_TABLES_CELLS; i++)
+    {
+        anchor->cells[i] >>= RESCALE_SHIFT;
+    }
+    for (int i = 0; i < 12; i++)
+    {
+        anchor->k_sum[i] >>= RESCALE_SHIFT;
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        anchor->p_sum[i] >>= RESCALE_SHIFT;
+    }
+}
+
+/**
+ * @brief Adds an analyzed frame's K and P. RT-safe, O(1) (amortized over rescales).
+ *
+ * @param kpdve The KPDVE chosen for the frame (not one flagged invalid).
+ */
+void kpdve_anchor_update(kpdve_anchor *anchor, int kpdve)
+{
+    int k = (kpdve >> 12) & 0xF;
+    int p = (kpdve >> 9) & 0x7;
+    if (k >= 12 || p >= 7)
+    {
+        return;
+    }
+    uint64_t increment = anchor->increment;
+    anchor->cells[k * 7 + p] += increment;
+    anchor->total += increment;
+    const uint16_t *k_row = anchor->k_fixed + k * 12;
+    for (int j = 0; j < 12; j++)
+    {
+        anchor->k_sum[j] += increment * k_row[j];
+    }
+    const uint16_t *p_row = anchor->p_fixed + p * 8;
+    for (int j = 0; j < 8; j++)
+    {
+        anchor->p_sum[j] += increment * p_row[j];
+    }
+    anchor->frames++;
+
+    // the next frame weighs 2^(1 / half_life) times as much as this one, in 32.32
+    uint64_t step = increment * anchor->growth + (((uint64_t)anchor->fraction * anchor->growth) >> 32);
+    uint64_t fraction = (uint64_t)anchor->fraction + (uint32_t)step;
+    anchor->increment += (uint32_t)(step >> 32) + (uint32_t)(fraction >> 32);
+    anchor->fraction = (uint32_t)fraction;
+    if (anchor->increment >= KPDVE_ANCHOR_RESCALE)
+    {
+        rescale(anchor);
+    }
+}
+
+/**
+ * @brief The mean K distance plus the mean P distance from a KPDVE's K and P to the
+ * anchor's (0 while it is empty), before the weight.
+ */
+float kpdve_anchor_distance(const kpdve_anchor *anchor, int kpdve)
+{
+    int k = (kpdve >> 12) & 0xF;
+    if (anchor->total == 0 || k >= 12)
+    {
+        return 0.0f;
+    }
+    uint64_t sum = anchor->k_sum[k] + anchor->p_sum[(kpdve >> 9) & 0x7];
+    return (float)((double)sum / ((double)anchor->total * KPDVE_ANCHOR_DISTANCE_ONE));
+}
+
+/**
+ * @brief The share of the decayed frames in cell (k, p): 0 .. 1.
+ */
+float kpdve_anchor_share(const kpdve_anchor *anchor, int k, int p)
+{
+    if (anchor->total == 0 || k < 0 || k >= 12 || p < 0 || p >= 7)
+    {
+        return 0.0f;
+    }
+    return (float)((double)anchor->cells[k * 7 + p] / (double)anchor->total);
+}
+
+/**
+ * @brief kpdve_tables_choose with the anchor term added to each candidate's distance.
+ * RT-safe.
+ *
+ * @param chroma 1..4095.
+ * @param context The context KPDVE (K < 12).
+ * @return The chosen index into the chroma's candidates, or -1 if it has none.
+ */
+int kpdve_anchor_choose(const kpdve_tables *tables, const kpdve_anchor *anchor, int chroma, int context)
+{
+    int first = tables->offsets[chroma];
+    int count = tables->offsets[chroma + 1] - first;
+    if (count == 0)
+    {
+        return -1;
+    }
+
+    const uint32_t *list = tables->candidates + first;
+    int context_k = context >> 12;
+    int context_kp = (context >> 9) & 0x7F;
+    const float *k_row = tables->k_distance + context_k * 12;
+    const float *p_row = tables->p_distance + ((context >> 9) & 0x7) * 8;
+    const float *d_row = tables->d_distance + ((context >> 6) & 0x7) * 8;
+    float scale = anchor->total ? anchor->weight / ((float)anchor->total * KPDVE_ANCHOR_DISTANCE_ONE) : 0.0f;
+
+    float min_dist = FLT_MAX; // the anchor term is unbounded
+    int min_index = 0;
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t kpdve = list[i];
+        if (((kpdve >> 9) & 0x7F) == (uint32_t)context_kp)
+        {
+            return i;
+        }
+
+        float dist = 0;
+        dist += k_row[(kpdve >> 12) & 0xF];
+        dist += p_row[(kpdve >> 9) & 0x7];
+        dist += d_row[(kpdve >> 6) & 0x7];
+        dist += scale * (float)(anchor->k_sum[(kpdve >> 12) & 0xF] + anchor->p_sum[(kpdve >> 9) & 0x7]);
+
+        if (dist < min_dist)
+        {
+            min_dist = dist;
+            min_index = i;
+        }
+    }
+    return min_index;
+}
@@ -0,0 +1,428 @@
+//
+//  qdkpdve_blob.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_blob.c
+ * @brief Writer, mapper and validator of table blobs (see qdkpdve_blob.h).
+ *
+ * The candidate and name sections are copies of the built-in tables; the distances and
+ * decisions are computed for the blob's weights with the table engine itself, so a blob
+ * chooses exactly as kpdve_tables_choose does on tables with those distances.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_blob.h"
+#include "../include/qdkpdve_prior.h"
+#include "../include/qdkpdve_statemaker.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+static uint64_t align64(uint64_t offset)
+{
+    return (offset + 63) & ~(uint64_t)63;
+}
+
+// FNV-1a over 64-bit words (every section is padded to a multiple of 8 bytes)
+static uint64_t checksum_words(uint64_t hash, const void *bytes, size_t size)
+{
+    const uint64_t *words = bytes;
+    for (size_t i = 0; i < size / 8; i++)
+    {
+        hash = (hash ^ words[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t checksum(const void *map, size_t size)
+{
+    struct kpdve_blob_header header;
+    memcpy(&header, map, sizeof(header));
+    header.checksum = 0;
+    uint64_t hash = checksum_words(FNV_OFFSET, &header, sizeof(header));
+    return checksum_words(hash, (const char *)map + sizeof(header), size - sizeof(header));
+}
+
+// points the tables and names of the blob into its mapping
+static void attach(kpdve_blob *blob)
+{
+    const char *base = blob->map;
+    const struct kpdve_blob_section *s = blob->header->sections;
+    blob->tables.crystal_masks = (const uint16_t *)(base + s[KPDVE_BLOB_CRYSTAL_MASKS].offset);
+    blob->tables.minimized = (const uint32_t *)(base + s[KPDVE_BLOB_MINIMIZED].offset);
+    blob->tables.offsets = (const uint16_t *)(base + s[KPDVE_BLOB_OFFSETS].offset);
+    blob->tables.candidates = (const uint32_t *)(base + s[KPDVE_BLOB_CANDIDATES].offset);
+    blob->tables.k_distance = (const float *)(base + s[KPDVE_BLOB_K_DISTANCE].offset);
+    blob->tables.p_distance = (const float *)(base + s[KPDVE_BLOB_P_DISTANCE].offset);
+    blob->tables.d_distance = (const float *)(base + s[KPDVE_BLOB_D_DISTANCE].offset);
+    blob->decisions = (const uint8_t *)(base + s[KPDVE_BLOB_DECISIONS].offset);
+    blob->names.entries = (const struct kpdve_name_entry *)(base + s[KPDVE_BLOB_NAME_ENTRIES].offset);
+    blob->names.pool = base + s[KPDVE_BLOB_NAME_POOL].offset;
+    blob->names.pool_size = (size_t)s[KPDVE_BLOB_NAME_POOL].size;
+}
+
+// every value later used as an index stays inside its section, whatever the checksum says
+static int in_bounds(const kpdve_blob *blob)
+{
+    const uint16_t *offsets = blob->tables.offsets;
+    for (int chroma = 0; chroma < KPDVE_TABLES_CHROMA; chroma++)
+    {
+        if (offsets[chroma + 1] < offsets[chroma])
+        {
+            return 0;
+        }
+    }
+    if (offsets[KPDVE_TABLES_CHROMA] > KPDVE_TABLES_CANDIDATES)
+    {
+        return 0;
+    }
+
+    // the choosers index the K distances with the candidate's K (P and D fit their rows)
+    for (int i = 0; i < offsets[KPDVE_TABLES_CHROMA]; i++)
+    {
+        uint32_t c = blob->tables.candidates[i];
+        if ((c & 0xFFFF) != KPDVE_CANDIDATE_NONE && ((c >> 12) & 0xF) >= 12)
+        {
+            return 0;
+        }
+    }
+
+    for (int chroma = 0; chroma < KPDVE_TABLES_CHROMA; chroma++)
+    {
+        int count = offsets[chroma + 1] - offsets[chroma];
+        for (int row = 0; row < KPDVE_TABLES_CONTEXTS; row++)
+        {
+            int choice = blob->decisions[(size_t)row * KPDVE_TABLES_CHROMA + chroma];
+            if (choice != KPDVE_BLOB_NO_CHOICE && choice >= count)
+            {
+                return 0;
+            }
+        }
+    }
+
+    size_t pool_size = blob->names.pool_size;
+    if (blob->names.pool[pool_size - 1] != '\0')
+    {
+        return 0;
+    }
+    for (int i = 0; i < KPDVE_NAME_TABLE_SIZE; i++)
+    {
+        const struct kpdve_name_entry *e = &blob->names.entries[i];
+        if (e->tonic >= pool_size || e->scale >= pool_size || e->distortion >= pool_size || e->mode >= pool_size
+            || e->degree >= pool_size || e->root >= pool_size || e->chord >= pool_size)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Builds a whole blob in memory.
+ *
+ * @param axis_scale K, P, D, V, E weights, or NULL for the built-in ones.
+ * @param size Receives the size of the blob.
+ * @return The blob (free it), or NULL if out of memory.
+ */
+static void *build(const float *axis_scale, size_t *size)
+{
+    const kpdve_tables *tables = kpdve_tables_default();
+    kpdve_name_table_init();
+    const struct kpdve_name_table *names = kpdve_name_table();
+
+    struct kpdve_blob_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = KPDVE_BLOB_MAGIC;
+    header.version = KPDVE_BLOB_VERSION;
+    header.header_size = sizeof(header);
+    header.section_count = KPDVE_BLOB_SECTIONS;
+    if (axis_scale != NULL)
+    {
+        memcpy(header.axis_scale, axis_scale, sizeof(header.axis_scale));
+    }
+    else
+    {
+        kpdve_default_axis_scale(header.axis_scale);
+    }
+
+    const uint64_t sizes[KPDVE_BLOB_SECTIONS] = {
+        KPDVE_TABLES_CELLS * sizeof(uint16_t),
+        128 * sizeof(uint32_t),
+        (KPDVE_TABLES_CHROMA + 1) * sizeof(uint16_t),
+        KPDVE_TABLES_CANDIDATES * sizeof(uint32_t),
+        12 * 12 * sizeof(float),
+        8 * 8 * sizeof(float),
+        8 * 8 * sizeof(float),
+        (uint64_t)KPDVE_TABLES_CONTEXTS * KPDVE_TABLES_CHROMA,
+        KPDVE_NAME_TABLE_SIZE * sizeof(struct kpdve_name_entry),
+        names->pool_size,
+    };
+    uint64_t offset = align64(sizeof(header));
+    for (int i = 0; i < KPDVE_BLOB_SECTIONS; i++)
+    {
+        header.sections[i].offset = offset;
+        header.sections[i].size = sizes[i];
+        offset = align64(offset + sizes[i]);
+    }
+    header.file_size = offset;
+
+    char *map = calloc(1, (size_t)offset);
+    if (map == NULL)
+    {
+        return NULL;
+    }
+    memcpy(map, &header, sizeof(header));
+
+    kpdve_blob blob;
+    memset(&blob, 0, sizeof(blob));
+    blob.map = map;
+    blob.map_size = (size_t)offset;
+    blob.header = (const struct kpdve_blob_header *)map;
+    attach(&blob);
+
+    memcpy((void *)blob.tables.crystal_masks, tables->crystal_masks, sizes[KPDVE_BLOB_CRYSTAL_MASKS]);
+    memcpy((void *)blob.tables.minimized, tables->minimized, sizes[KPDVE_BLOB_MINIMIZED]);
+    memcpy((void *)blob.tables.offsets, tables->offsets, sizes[KPDVE_BLOB_OFFSETS]);
+    memcpy((void *)blob.tables.candidates, tables->candidates, sizes[KPDVE_BLOB_CANDIDATES]);
+    kpdve_tables_build_distances(header.axis_scale, (float *)blob.tables.k_distance,
+                                 (float *)blob.tables.p_distance, (float *)blob.tables.d_distance);
+    memcpy((void *)blob.names.entries, names->entries, sizes[KPDVE_BLOB_NAME_ENTRIES]);
+    memcpy((void *)blob.names.pool, names->pool, sizes[KPDVE_BLOB_NAME_POOL]);
+
+    // every context K, P, D against every chroma, on the blob's own distances
+    uint8_t *decisions = (uint8_t *)blob.decisions;
+    for (int k = 0; k < 12; k++)
+    for (int p = 0; p < 7; p++)
+    for (int d = 0; d < 7; d++)
+    {
+        int loc[] = { k, p, d, 0, 0 };
+        int context = KPDVEtoBinaryEncoding(loc);
+        uint8_t *row = decisions + (size_t)KPDVE_PRIOR_INDEX(context) * KPDVE_TABLES_CHROMA;
+        row[0] = KPDVE_BLOB_NO_CHOICE;
+        for (int chroma = 1; chroma < KPDVE_TABLES_CHROMA; chroma++)
+        {
+            int index = kpdve_tables_choose(&blob.tables, chroma, context);
+            row[chroma] = (index < 0) ? KPDVE_BLOB_NO_CHOICE : (uint8_t)index;
+        }
+    }
+
+    ((struct kpdve_blob_header *)map)->checksum = checksum(map, (size_t)offset);
+    *size = (size_t)offset;
+    return map;
+}
+
+/**
+ * @brief Writes a blob for the given axis weights.
+ *
+ * @param path Output file.
+ * @param axis_scale K, P, D, V, E weights (as kpdve_axis_scale), or NULL for the built-in
+ * ones. The tables depend on K, P and D only, so V and E must be the built-in ones.
+ * @return KPDVE_BLOB_OK, KPDVE_BLOB_ERR_WEIGHTS or another error code.
+ */
+int kpdve_blob_write(const char *path, const float *axis_scale)
+{
+    if (axis_scale != NULL)
+    {
+        float builtin[5];
+        kpdve_default_axis_scale(builtin);
+        if (axis_scale[3] != builtin[3] || axis_scale[4] != builtin[4])
+        {
+            return KPDVE_BLOB_ERR_WEIGHTS;
+        }
+    }
+
+    size_t size;
+    void *map = build(axis_scale, &size);
+    if (map == NULL)
+    {
+        return KPDVE_BLOB_ERR_MEMORY;
+    }
+
+    int err = KPDVE_BLOB_OK;
+    FILE *out = fopen(path, "wb");
+    if (out == NULL)
+    {
+        err = KPDVE_BLOB_ERR_IO;
+    }
+    else
+    {
+        if (fwrite(map, 1, size, out) != size)
+        {
+            err = KPDVE_BLOB_ERR_IO;
+        }
+        if (fclose(out) != 0)
+        {
+            err = KPDVE_BLOB_ERR_IO;
+        }
+    }
+    free(map);
+    return err;
+}
+
+/**
+ * @brief Maps a blob read-only and checks that its sections are where they belong and
+ * that every offset, candidate, decision and name in them is in bounds.
+ *
+ * @param blob Receives the mapping.
+ * @param path The blob file.
+ * @param flags KPDVE_BLOB_VERIFY to check the checksum too.
+ * @return KPDVE_BLOB_OK, KPDVE_BLOB_ERR_CONTENT for an index out of bounds, or another
+ * error code.
+ */
+int kpdve_blob_open(kpdve_blob *blob, const char *path, int flags)
+{
+    memset(blob, 0, sizeof(*blob));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return KPDVE_BLOB_ERR_IO;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct kpdve_blob_header))
+    {
+        close(fd);
+        return KPDVE_BLOB_ERR_FORMAT;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return KPDVE_BLOB_ERR_IO;
+    }
+
+    // the layout is fixed by the version: anything else is another format
+    const struct kpdve_blob_header *h = map;
+    uint64_t size = (uint64_t)st.st_size;
+    int ok = h->magic == KPDVE_BLOB_MAGIC
+        && h->version == KPDVE_BLOB_VERSION
+        && h->header_size == sizeof(struct kpdve_blob_header)
+        && h->section_count == KPDVE_BLOB_SECTIONS
+        && h->file_size == size
+        && h->sections[KPDVE_BLOB_CRYSTAL_MASKS].size == KPDVE_TABLES_CELLS * sizeof(uint16_t)
+        && h->sections[KPDVE_BLOB_MINIMIZED].size == 128 * sizeof(uint32_t)
+        && h->sections[KPDVE_BLOB_OFFSETS].size == (KPDVE_TABLES_CHROMA + 1) * sizeof(uint16_t)
+        && h->sections[KPDVE_BLOB_CANDIDATES].size == KPDVE_TABLES_CANDIDATES * sizeof(uint32_t)
+        && h->sections[KPDVE_BLOB_K_DISTANCE].size == 12 * 12 * sizeof(float)
+        && h->sections[KPDVE_BLOB_P_DISTANCE].size == 8 * 8 * sizeof(float)
+        && h->sections[KPDVE_BLOB_D_DISTANCE].size == 8 * 8 * sizeof(float)
+        && h->sections[KPDVE_BLOB_DECISIONS].size == (uint64_t)KPDVE_TABLES_CONTEXTS * KPDVE_TABLES_CHROMA
+        && h->sections[KPDVE_BLOB_NAME_ENTRIES].size == KPDVE_NAME_TABLE_SIZE * sizeof(struct kpdve_name_entry)
+        && h->sections[KPDVE_BLOB_NAME_POOL].size > 0;
+    uint64_t end = sizeof(struct kpdve_blob_header);
+    for (int i = 0; ok && i < KPDVE_BLOB_SECTIONS; i++)
+    {
+        ok = h->sections[i].offset % 64 == 0
+            && h->sections[i].offset >= end
+            && h->sections[i].offset + h->sections[i].size <= size;
+        end = h->sections[i].offset + h->sections[i].size;
+    }
+    if (!ok)
+    {
+        munmap(map, (size_t)st.st_size);
+        return KPDVE_BLOB_ERR_FORMAT;
+    }
+
+    blob->map = map;
+    blob->map_size = (size_t)st.st_size;
+    blob->header = h;
+    attach(blob);
+
+    if (!in_bounds(blob))
+    {
+        kpdve_blob_close(blob);
+        return KPDVE_BLOB_ERR_CONTENT;
+    }
+    if ((flags & KPDVE_BLOB_VERIFY) && kpdve_blob_verify(blob) != KPDVE_BLOB_OK)
+    {
+        kpdve_blob_close(blob);
+        return KPDVE_BLOB_ERR_CHECKSUM;
+    }
+    return KPDVE_BLOB_OK;
+}
+
+void kpdve_blob_close(kpdve_blob *blob)
+{
+    if (blob->map != NULL)
+    {
+        munmap(blob->map, blob->map_size);
+    }
+    memset(blob, 0, sizeof(*blob));
+}
+
+/**
+ * @brief Checks the checksum of a mapped blob (reads all of it).
+ *
+ * @return KPDVE_BLOB_OK or KPDVE_BLOB_ERR_CHECKSUM.
+ */
+int kpdve_blob_verify(const kpdve_blob *blob)
+{
+    return checksum(blob->map, blob->map_size) == blob->header->checksum ? KPDVE_BLOB_OK : KPDVE_BLOB_ERR_CHECKSUM;
+}
+
+/**
+ * @brief Checks a mapped blob against the tables this library builds for its weights:
+ * the checksum, then every section byte for byte.
+ *
+ * @param blob The blob.
+ * @param section Receives the first section that differs, or -1.
+ * @return KPDVE_BLOB_OK, KPDVE_BLOB_ERR_CHECKSUM, KPDVE_BLOB_ERR_CONTENT or KPDVE_BLOB_ERR_MEMORY.
+ */
+int kpdve_blob_validate(const kpdve_blob *blob, int *section)
+{
+    *section = -1;
+    if (kpdve_blob_verify(blob) != KPDVE_BLOB_OK)
+    {
+        return KPDVE_BLOB_ERR_CHECKSUM;
+    }
+
+    size_t size;
+    char *expected = build(blob->header->axis_scale, &size);
+    if (expected == NULL)
+    {
+        return KPDVE_BLOB_ERR_MEMORY;
+    }
+    const struct kpdve_blob_header *h = (const struct kpdve_blob_header *)expected;
+    int err = KPDVE_BLOB_OK;
+    for (int i = 0; i < KPDVE_BLOB_SECTIONS && err == KPDVE_BLOB_OK; i++)
+    {
+        const struct kpdve_blob_section *s = &blob->header->sections[i];
+        if (s->size != h->sections[i].size
+            || memcmp((const char *)blob->map + s->offset, expected + h->sections[i].offset, (size_t)s->size) != 0)
+        {
+            *section = i;
+            err = KPDVE_BLOB_ERR_CONTENT;
+        }
+    }
+    free(expected);
+    return err;
+}
+
+/**
+ * @brief Chooses as kpdve_tables_choose would on the blob's tables, with one load.
+ *
+ * @param blob The blob.
+ * @param chroma The chroma value (0..4095).
+ * @param context The context KPDVE value (V and E are ignored).
+ * @return The index into the chroma's candidates, or -1 if it has none or the context
+ * is outside the decision table (K of 12 or more, P or D of 7).
+ */
+int kpdve_blob_choose(const kpdve_blob *blob, int chroma, int context)
+{
+    if (((context >> 12) & 0xF) >= 12 || ((context >> 9) & 0x7) == 7 || ((context >> 6) & 0x7) == 7)
+    {
+        return -1;
+    }
+    int choice = blob->decisions[(size_t)KPDVE_PRIOR_INDEX(context) * KPDVE_TABLES_CHROMA + (chroma & 0xFFF)];
+    return choice == KPDVE_BLOB_NO_CHOICE ? -1 : choice;
+}
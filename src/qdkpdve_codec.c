@@ -0,0 +1,466 @@
+//
+//  qdkpdve_codec.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_codec.c
+ * @brief Run-length / KPD-delta / move-to-front coder for encoded_state sequences.
+ *
+ * The token layout is described in qdkpdve_codec.h. Everything is byte aligned so that
+ * the decoder is a single switch over the top two bits of each token, with no bit
+ * reader and no tables larger than the 15-entry chroma cache.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/qdkpdve_codec.h"
+
+#define OP_RUN     0x00
+#define OP_CHROMA  0x40
+#define OP_DELTA   0x80
+#define OP_LITERAL 0xC0
+
+#define MAX_RUN 64
+#define CACHE_SLOTS 15
+#define CACHE_MISS 15
+
+#define X_BIT (1u << 31)
+#define SPARE_BITS (7u << 28)
+
+// field extraction for x---KKKKPPPDDDVVVEEEb-a-g-fe-d-c
+#define STATE_K(s)     (((s) >> 24) & 0xF)
+#define STATE_P(s)     (((s) >> 21) & 0x7)
+#define STATE_D(s)     (((s) >> 18) & 0x7)
+#define STATE_VE(s)    (((s) >> 12) & 0x3F)
+#define STATE_CHROMA(s) ((s) & 0xFFF)
+
+struct chroma_cache {
+    uint16_t slot[CACHE_SLOTS];
+};
+
+static void cache_reset(struct chroma_cache *cache)
+{
+    for (int i = 0; i < CACHE_SLOTS; i++)
+    {
+        cache->slot[i] = 0xFFFF; // never a 12-bit chroma
+    }
+}
+
+// moves slot i to the front, shifting the more recent entries down by one
+static void cache_promote(struct chroma_cache *cache, int i, uint16_t chroma)
+{
+    while (i > 0)
+    {
+        cache->slot[i] = cache->slot[i - 1];
+        i--;
+    }
+    cache->slot[0] = chroma;
+}
+
+static int cache_find(const struct chroma_cache *cache, uint16_t chroma)
+{
+    for (int i = 0; i < CACHE_SLOTS; i++)
+    {
+        if (cache->slot[i] == chroma)
+        {
+            return i;
+        }
+    }
+    return CACHE_MISS;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// a state can be delta coded when its KPD fields are in range and the spare bits are clear
+static int delta_codable(uint32_t s)
+{
+    return (s & SPARE_BITS) == 0 && STATE_K(s) < 12 && STATE_P(s) < 7 && STATE_D(s) < 7;
+}
+
+/**
+ * @brief Worst-case encoded size of a chunk of count frames.
+ *
+ * The longest token is a DELTA with changed K/P and a chroma cache miss (6 bytes).
+ */
+size_t kpdve_codec_bound(size_t count)
+{
+    return KPDVE_CODEC_HEADER_SIZE + count * 6;
+}
+
+// writes the chroma byte (and the literal chroma if it was not cached). returns bytes written.
+static size_t emit_chroma(struct chroma_cache *cache, uint8_t *p, uint16_t chroma, uint8_t high_bits)
+{
+    int slot = cache_find(cache, chroma);
+    cache_promote(cache, (slot == CACHE_MISS) ? CACHE_SLOTS - 1 : slot, chroma);
+    p[0] = high_bits | (uint8_t)slot;
+    if (slot == CACHE_MISS)
+    {
+        p[1] = (uint8_t)chroma;
+        p[2] = (uint8_t)(chroma >> 8);
+        return 3;
+    }
+    return 1;
+}
+
+/**
+ * @brief Encodes one chunk of encoded_state values.
+ *
+ * @param states The encoded states to compress.
+ * @param count Number of states.
+ * @param out Output buffer.
+ * @param out_cap Capacity of the output buffer.
+ * @return Number of bytes written, or KPDVE_CODEC_ERR_SPACE.
+ */
+long kpdve_codec_encode_chunk(const int *states, size_t count, uint8_t *out, size_t out_cap)
+{
+    if (count > UINT32_MAX || out_cap < KPDVE_CODEC_HEADER_SIZE)
+    {
+        return KPDVE_CODEC_ERR_SPACE;
+    }
+
+    struct chroma_cache cache;
+    cache_reset(&cache);
+
+    uint8_t *p = out + KPDVE_CODEC_HEADER_SIZE;
+    uint8_t *end = out + out_cap;
+    uint32_t prev = 0;
+    size_t i = 0;
+
+    while (i < count)
+    {
+        // 6 bytes is the longest token
+        if (end - p < 6)
+        {
+            return KPDVE_CODEC_ERR_SPACE;
+        }
+
+        uint32_t s = (uint32_t)states[i];
+
+        if (s == prev)
+        {
+            size_t run = 1;
+            while (i + run < count && run < MAX_RUN && (uint32_t)states[i + run] == prev)
+            {
+                run++;
+            }
+            *p++ = OP_RUN | (uint8_t)(run - 1);
+            i += run;
+            continue;
+        }
+
+        uint8_t x = (s & X_BIT) ? 0x20 : 0;
+
+        if (((s ^ prev) & ~(X_BIT | 0xFFFu)) == 0)
+        {
+            // only the chroma (and possibly the validity bit) changed
+            p += emit_chroma(&cache, p, (uint16_t)STATE_CHROMA(s), OP_CHROMA | x);
+        }
+        else if (delta_codable(s) && delta_codable(prev))
+        {
+            int dk = (int)STATE_K(s) - (int)STATE_K(prev);
+            int dp = (int)STATE_P(s) - (int)STATE_P(prev);
+            int dd = (int)STATE_D(s) - (int)STATE_D(prev);
+            if (dk < 0) dk += 12;
+            if (dp < 0) dp += 7;
+            if (dd < 0) dd += 7;
+
+            uint8_t kflag = (dk | dp) ? 0x10 : 0;
+            *p++ = OP_DELTA | x | kflag | (uint8_t)(dd << 1);
+            if (kflag)
+            {
+                *p++ = (uint8_t)((dk << 3) | dp);
+            }
+            *p++ = (uint8_t)STATE_VE(s);
+            p += emit_chroma(&cache, p, (uint16_t)STATE_CHROMA(s), 0);
+        }
+        else
+        {
+            *p++ = OP_LITERAL;
+            put_u32(p, s);
+            p += 4;
+        }
+        prev = s;
+        i++;
+    }
+
+    size_t total = (size_t)(p - out);
+    put_u32(out, KPDVE_CODEC_MAGIC);
+    put_u32(out + 4, (uint32_t)count);
+    put_u32(out + 8, (uint32_t)(total - KPDVE_CODEC_HEADER_SIZE));
+    return (long)total;
+}
+
+/**
+ * @brief Reads the header of a chunk without decoding it.
+ */
+int kpdve_codec_chunk_info(const uint8_t *in, size_t in_len, size_t *frame_count, size_t *chunk_size)
+{
+    if (in_len < KPDVE_CODEC_HEADER_SIZE || get_u32(in) != KPDVE_CODEC_MAGIC)
+    {
+        return KPDVE_CODEC_ERR_CORRUPT;
+    }
+    size_t payload = get_u32(in + 8);
+    if (payload > in_len - KPDVE_CODEC_HEADER_SIZE)
+    {
+        return KPDVE_CODEC_ERR_CORRUPT;
+    }
+    *frame_count = get_u32(in + 4);
+    *chunk_size = KPDVE_CODEC_HEADER_SIZE + payload;
+    return KPDVE_CODEC_OK;
+}
+
+// reads the chroma byte (and literal) written by emit_chroma. returns NULL if truncated.
+static const uint8_t *take_chroma(struct chroma_cache *cache, const uint8_t *p, const uint8_t *end, uint32_t *chroma)
+{
+    int slot = *p++ & 0x0F;
+    uint16_t c;
+    if (slot == CACHE_MISS)
+    {
+        if (end - p < 2)
+        {
+            return NULL;
+        }
+        c = (uint16_t)(p[0] | ((p[1] & 0x0F) << 8));
+        p += 2;
+        cache_promote(cache, CACHE_SLOTS - 1, c);
+    }
+    else
+    {
+        c = cache->slot[slot];
+        if (c > 0xFFF)
+        {
+            return NULL; // refers to a slot that was never filled
+        }
+        cache_promote(cache, slot, c);
+    }
+    *chroma = c;
+    return p;
+}
+
+/**
+ * @brief Decodes one chunk.
+ *
+ * @param in Start of the chunk.
+ * @param in_len Bytes available.
+ * @param states Output array.
+ * @param states_cap Capacity of the output array.
+ * @param consumed Receives the size of the chunk in bytes (may be NULL).
+ * @return Number of frames decoded, or a negative KPDVE_CODEC_ERR value.
+ */
+long kpdve_codec_decode_chunk(const uint8_t *in, size_t in_len, int *states, size_t states_cap, size_t *consumed)
+{
+    size_t count, chunk_size;
+    if (kpdve_codec_chunk_info(in, in_len, &count, &chunk_size) != KPDVE_CODEC_OK)
+    {
+        return KPDVE_CODEC_ERR_CORRUPT;
+    }
+    if (count > states_cap)
+    {
+        return KPDVE_CODEC_ERR_SPACE;
+    }
+
+    struct chroma_cache cache;
+    cache_reset(&cache);
+
+    const uint8_t *p = in + KPDVE_CODEC_HEADER_SIZE;
+    const uint8_t *end = in + chunk_size;
+    uint32_t prev = 0;
+    size_t i = 0;
+
+    while (p < end)
+    {
+        uint8_t op = *p++;
+        uint32_t s;
+
+        switch (op & 0xC0)
+        {
+        case OP_RUN:
+        {
+            size_t run = (size_t)(op & 0x3F) + 1;
+            if (run > count - i)
+            {
+                return KPDVE_CODEC_ERR_CORRUPT;
+            }
+            for (size_t r = 0; r < run; r++)
+            {
+                states[i + r] = (int)prev;
+            }
+            i += run;
+            continue;
+        }
+        case OP_CHROMA:
+        {
+            uint32_t chroma;
+            p = take_chroma(&cache, p - 1, end, &chroma);
+            if (p == NULL)
+            {
+                return KPDVE_CODEC_ERR_CORRUPT;
+            }
+            s = (prev & ~(X_BIT | 0xFFFu)) | chroma;
+            if (op & 0x20)
+            {
+                s |= X_BIT;
+            }
+            break;
+        }
+        case OP_DELTA:
+        {
+            uint32_t k = STATE_K(prev);
+            uint32_t pt = STATE_P(prev);
+            uint32_t d = STATE_D(prev) + ((op >> 1) & 0x7);
+            if (d >= 7) d -= 7;
+            if (op & 0x10)
+            {
+                if (p >= end)
+                {
+                    return KPDVE_CODEC_ERR_CORRUPT;
+                }
+                k += *p >> 3;
+                pt += *p & 0x7;
+                p++;
+                if (k >= 12) k -= 12;
+                if (pt >= 7) pt -= 7;
+            }
+            if (end - p < 2)
+            {
+                return KPDVE_CODEC_ERR_CORRUPT;
+            }
+            uint32_t ve = *p++ & 0x3F;
+            uint32_t chroma;
+            p = take_chroma(&cache, p, end, &chroma);
+            if (p == NULL)
+            {
+                return KPDVE_CODEC_ERR_CORRUPT;
+            }
+            s = (k << 24) | (pt << 21) | (d << 18) | (ve << 12) | chroma;
+            if (op & 0x20)
+            {
+                s |= X_BIT;
+            }
+            break;
+        }
+        default:
+            if (end - p < 4)
+            {
+                return KPDVE_CODEC_ERR_CORRUPT;
+            }
+            s = get_u32(p);
+            p += 4;
+            break;
+        }
+
+        if (i >= count)
+        {
+            return KPDVE_CODEC_ERR_CORRUPT;
+        }
+        states[i++] = (int)s;
+        prev = s;
+    }
+
+    if (i != count)
+    {
+        return KPDVE_CODEC_ERR_CORRUPT;
+    }
+    if (consumed != NULL)
+    {
+        *consumed = chunk_size;
+    }
+    return (long)count;
+}
+
+//////////////////////////////////// streaming
+
+/**
+ * @brief Prepares a streaming encoder.
+ *
+ * @param enc The encoder to initialize.
+ * @param chunk_frames Frames per chunk (0 for KPDVE_CODEC_CHUNK_FRAMES).
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int kpdve_encoder_init(kpdve_encoder *enc, size_t chunk_frames)
+{
+    enc->chunk_frames = chunk_frames ? chunk_frames : KPDVE_CODEC_CHUNK_FRAMES;
+    enc->pending_count = 0;
+    enc->chunk_cap = kpdve_codec_bound(enc->chunk_frames);
+    enc->pending = malloc(enc->chunk_frames * sizeof(int));
+    enc->chunk = malloc(enc->chunk_cap);
+    if (enc->pending == NULL || enc->chunk == NULL)
+    {
+        kpdve_encoder_free(enc);
+        return -1;
+    }
+    return 0;
+}
+
+static int encoder_flush(kpdve_encoder *enc, kpdve_codec_sink sink, void *ctx)
+{
+    if (enc->pending_count == 0)
+    {
+        return 0;
+    }
+    long len = kpdve_codec_encode_chunk(enc->pending, enc->pending_count, enc->chunk, enc->chunk_cap);
+    enc->pending_count = 0;
+    if (len < 0)
+    {
+        return -1;
+    }
+    return sink(ctx, enc->chunk, (size_t)len);
+}
+
+/**
+ * @brief Adds frames to the stream, handing every completed chunk to the sink.
+ *
+ * @return 0 on success, otherwise the failing sink's return value (or -1).
+ */
+int kpdve_encoder_push(kpdve_encoder *enc, const int *states, size_t count, kpdve_codec_sink sink, void *ctx)
+{
+    while (count > 0)
+    {
+        size_t room = enc->chunk_frames - enc->pending_count;
+        size_t take = (count < room) ? count : room;
+        memcpy(enc->pending + enc->pending_count, states, take * sizeof(int));
+        enc->pending_count += take;
+        states += take;
+        count -= take;
+
+        if (enc->pending_count == enc->chunk_frames)
+        {
+            int err = encoder_flush(enc, sink, ctx);
+            if (err != 0)
+            {
+                return err;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Codes whatever is still buffered as a final (short) chunk.
+ */
+int kpdve_encoder_finish(kpdve_encoder *enc, kpdve_codec_sink sink, void *ctx)
+{
+    return encoder_flush(enc, sink, ctx);
+}
+
+void kpdve_encoder_free(kpdve_encoder *enc)
+{
+    free(enc->pending);
+    free(enc->chunk);
+    enc->pending = NULL;
+    enc->chunk = NULL;
+    enc->pending_count = 0;
+}
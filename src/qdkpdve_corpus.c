@@ -0,0 +1,695 @@
+//
+//  qdkpdve_corpus.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_corpus.c
+ * @brief Work-stealing corpus analysis (see qdkpdve_corpus.h).
+ *
+ * Input files are mapped read-only and split into segment tasks, numbered in input
+ * order. The tasks are dealt to the workers' deques round-robin, so every deque holds
+ * numbers near the merge's; a worker takes from the front of its own deque (the lowest
+ * numbers, which the merge waits for, go first) and a thief takes the back half of
+ * someone else's. The merge runs on the calling thread, task by task in order, and
+ * frees each segment once it is stored.
+ *
+ * A task may start only within a window of WINDOW_PER_WORKER tasks per worker past the
+ * merge, and its results (states, seam and end) live in one of that many slots, so the
+ * memory in use is bounded by the window whatever the size of the corpus. Frames are
+ * analyzed with the table engine (qdkpdve_tables.h), which chooses exactly as
+ * adjust_harmony_state_from_chroma does.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_corpus.h"
+#include "../include/qdkpdve_codec.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_store.h"
+#include "../include/qdkpdve_tables.h"
+
+#define MAX_THREADS 256
+#define WINDOW_PER_WORKER 4
+
+struct corpus_input {
+    const uint8_t *map;
+    size_t map_size;
+    int format;
+    size_t frames;
+};
+
+struct corpus_task {
+    size_t file;
+    size_t segment;          // within the file
+    size_t first;            // first frame stored
+    size_t count;
+    int done;
+};
+
+// the results of task t, in slot t % window until it is merged
+struct corpus_slot {
+    int *states;
+    harmony_state seam;      // after the warm-up, before the first stored frame
+    harmony_state end;       // after the last frame
+    int err;
+};
+
+struct corpus_deque {
+    pthread_mutex_t lock;
+    size_t *items;           // task numbers; [head, tail) are left
+    size_t head;
+    size_t tail;
+    size_t steals;
+};
+
+struct corpus_pool {
+    const struct corpus_input *inputs;
+    const kpdve_tables *tables;
+    struct corpus_task *tasks;
+    size_t task_count;
+    size_t warmup;
+    struct corpus_deque *deques;
+    int workers;
+    struct corpus_slot *slots;
+    size_t window;
+
+    pthread_mutex_t done_lock;
+    pthread_cond_t done_cond;  // a task done, the window moved, the tasks dealt, or stop
+    size_t limit;              // tasks below this may start
+    size_t held;               // tasks started and not yet merged
+    size_t peak_held;
+    int dealt;
+    int stop;
+};
+
+struct corpus_worker {
+    struct corpus_pool *pool;
+    int id;
+};
+
+void kpdve_corpus_default_options(struct kpdve_corpus_options *options)
+{
+    options->threads = 0;
+    options->segment_frames = 1 << 18;
+    options->warmup_frames = 1024;
+    options->block_frames = KPDVE_STORE_BLOCK_FRAMES;
+    options->frame_period = 1;
+}
+
+/**
+ * @brief The format of an input file: *.chroma files hold chroma, files starting with
+ * the codec magic are coded states, anything else is raw encoded states.
+ */
+int kpdve_corpus_format(const char *path, const uint8_t *bytes, size_t size)
+{
+    size_t len = strlen(path);
+    if (len >= 7 && strcmp(path + len - 7, ".chroma") == 0)
+    {
+        return KPDVE_CORPUS_CHROMA;
+    }
+    if (size >= 4 && (bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24) == KPDVE_CODEC_MAGIC)
+    {
+        return KPDVE_CORPUS_CODED;
+    }
+    return KPDVE_CORPUS_STATES;
+}
+
+// frames in a coded stream, from the chunk headers alone; 0 (and *err) if they are corrupt
+static size_t coded_frames(const uint8_t *bytes, size_t size, int *err)
+{
+    size_t frames = 0;
+    size_t pos = 0;
+    while (pos < size)
+    {
+        size_t count, chunk_size;
+        if (kpdve_codec_chunk_info(bytes + pos, size - pos, &count, &chunk_size) != KPDVE_CODEC_OK)
+        {
+            *err = 1;
+            return 0;
+        }
+        frames += count;
+        pos += chunk_size;
+    }
+    return frames;
+}
+
+static int open_input(const char *path, struct corpus_input *input)
+{
+    memset(input, 0, sizeof(*input));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    input->map_size = (size_t)st.st_size;
+    if (input->map_size > 0)
+    {
+        void *map = mmap(NULL, input->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            close(fd);
+            return -1;
+        }
+        input->map = map;
+    }
+    close(fd);
+
+    int err = 0;
+    input->format = kpdve_corpus_format(path, input->map, input->map_size);
+    switch (input->format)
+    {
+    case KPDVE_CORPUS_CHROMA:
+        input->frames = input->map_size / sizeof(uint16_t);
+        break;
+    case KPDVE_CORPUS_CODED:
+        input->frames = coded_frames(input->map, input->map_size, &err);
+        break;
+    default:
+        input->frames = input->map_size / sizeof(int);
+        break;
+    }
+    return err ? -1 : 0;
+}
+
+/**
+ * @brief Reads the chroma of frames [first, first + count) of an input.
+ *
+ * @return 0, or -1 if a coded chunk is corrupt.
+ */
+static int load_chroma(const struct corpus_input *input, size_t first, size_t count, int *chroma)
+{
+    if (input->format == KPDVE_CORPUS_CHROMA)
+    {
+        const uint16_t *frames = (const uint16_t *)input->map;
+        for (size_t i = 0; i < count; i++)
+        {
+            chroma[i] = frames[first + i] & 0xFFF;
+        }
+        return 0;
+    }
+    if (input->format == KPDVE_CORPUS_STATES)
+    {
+        const int *frames = (const int *)input->map;
+        for (size_t i = 0; i < count; i++)
+        {
+            chroma[i] = frames[first + i] & 0xFFF;
+        }
+        return 0;
+    }
+
+    // coded: decode the chunks that overlap the range
+    size_t end = first + count;
+    size_t frame = 0;
+    size_t pos = 0;
+    while (frame < end && pos < input->map_size)
+    {
+        size_t chunk_frames, chunk_size;
+        if (kpdve_codec_chunk_info(input->map + pos, input->map_size - pos, &chunk_frames, &chunk_size) != KPDVE_CODEC_OK)
+        {
+            return -1;
+        }
+        if (frame + chunk_frames > first && chunk_frames > 0)
+        {
+            int *states = malloc(chunk_frames * sizeof(int));
+            if (states == NULL
+                || kpdve_codec_decode_chunk(input->map + pos, chunk_size, states, chunk_frames, NULL) != (long)chunk_frames)
+            {
+                free(states);
+                return -1;
+            }
+            size_t from = (first > frame) ? first - frame : 0;
+            size_t to = (end < frame + chunk_frames) ? end - frame : chunk_frames;
+            for (size_t i = from; i < to; i++)
+            {
+                chroma[frame + i - first] = states[i] & 0xFFF;
+            }
+            free(states);
+        }
+        frame += chunk_frames;
+        pos += chunk_size;
+    }
+    return 0;
+}
+
+// adjust_harmony_state_from_chroma, through the tables
+static void analyze_frame(const kpdve_tables *tables, harmony_state *state, int chroma)
+{
+    state->chromatic_notes = chroma & 0xFFF;
+    set_kp_list_from_tables(tables, state);
+    set_min_index_from_tables(tables, state, state->kpdve);
+    state->kpdve = state->kpdve_list[state->kpdve_min_index];
+    state->dve = state->dve_list[state->kpdve_min_index];
+    state->ve = state->ve_list[state->kpdve_min_index];
+    encode_and_validate_state(state);
+}
+
+// analyzes frames [first, first + count) of an input, continuing from *state
+static int analyze_range(const kpdve_tables *tables, const struct corpus_input *input, size_t first, size_t count,
+                         harmony_state *state, int *states)
+{
+    int *chroma = malloc((count ? count : 1) * sizeof(int));
+    if (chroma == NULL || load_chroma(input, first, count, chroma) != 0)
+    {
+        free(chroma);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        analyze_frame(tables, state, chroma[i]);
+        if (states != NULL)
+        {
+            states[i] = state->encoded_state;
+        }
+    }
+    free(chroma);
+    return 0;
+}
+
+static void run_task(struct corpus_pool *pool, size_t t)
+{
+    const struct corpus_task *task = &pool->tasks[t];
+    struct corpus_slot *slot = &pool->slots[t % pool->window];
+    const struct corpus_input *input = &pool->inputs[task->file];
+    size_t warm_first = (task->segment == 0) ? task->first
+                      : (task->first > pool->warmup ? task->first - pool->warmup : 0);
+
+    harmony_state state = harmony_state_default();
+    slot->states = malloc((task->count ? task->count : 1) * sizeof(int));
+    slot->err = (slot->states == NULL)
+        || analyze_range(pool->tables, input, warm_first, task->first - warm_first, &state, NULL) != 0;
+    slot->seam = state;
+    if (!slot->err)
+    {
+        slot->err = analyze_range(pool->tables, input, task->first, task->count, &state, slot->states) != 0;
+    }
+    slot->end = state;
+}
+
+// takes the back half of another worker's deque into our own (empty) one
+static int steal(struct corpus_pool *pool, int self)
+{
+    struct corpus_deque *own = &pool->deques[self];
+    for (int off = 1; off < pool->workers; off++)
+    {
+        struct corpus_deque *victim = &pool->deques[(self + off) % pool->workers];
+        pthread_mutex_lock(&victim->lock);
+        size_t left = victim->tail - victim->head;
+        size_t take = (left + 1) / 2;
+        if (take > 0)
+        {
+            // nobody looks into an empty deque's items, so they can be filled before publishing
+            memcpy(own->items, victim->items + victim->tail - take, take * sizeof(size_t));
+            victim->tail -= take;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (take > 0)
+        {
+            pthread_mutex_lock(&own->lock);
+            own->head = 0;
+            own->tail = take;
+            own->steals++;
+            pthread_mutex_unlock(&own->lock);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *corpus_worker_main(void *arg)
+{
+    struct corpus_worker *worker = arg;
+    struct corpus_pool *pool = worker->pool;
+    struct corpus_deque *own = &pool->deques[worker->id];
+
+    pthread_mutex_lock(&pool->done_lock);
+    while (!pool->dealt)
+    {
+        pthread_cond_wait(&pool->done_cond, &pool->done_lock);
+    }
+    pthread_mutex_unlock(&pool->done_lock);
+
+    for (;;)
+    {
+        size_t limit = __atomic_load_n(&pool->limit, __ATOMIC_ACQUIRE);
+        pthread_mutex_lock(&own->lock);
+        int have = own->head < own->tail;
+        size_t t = have ? own->items[own->head] : 0;
+        int take = have && t < limit;
+        own->head += (size_t)take;
+        pthread_mutex_unlock(&own->lock);
+        if (take)
+        {
+            size_t held = __atomic_add_fetch(&pool->held, 1, __ATOMIC_RELAXED);
+            size_t peak = __atomic_load_n(&pool->peak_held, __ATOMIC_RELAXED);
+            while (held > peak
+                   && !__atomic_compare_exchange_n(&pool->peak_held, &peak, held, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+            }
+        }
+
+        if (!have)
+        {
+            // tasks never appear except by stealing, so all deques empty means done
+            if (!steal(pool, worker->id))
+            {
+                return NULL;
+            }
+            continue;
+        }
+        if (!take)
+        {
+            // ahead of the merge: wait for the window to reach the task (or a thief to take it)
+            pthread_mutex_lock(&pool->done_lock);
+            while (pool->limit <= t && !pool->stop)
+            {
+                pthread_cond_wait(&pool->done_cond, &pool->done_lock);
+            }
+            int stop = pool->stop;
+            pthread_mutex_unlock(&pool->done_lock);
+            if (stop)
+            {
+                return NULL;
+            }
+            continue;
+        }
+
+        run_task(pool, t);
+
+        pthread_mutex_lock(&pool->done_lock);
+        pool->tasks[t].done = 1;
+        pthread_cond_broadcast(&pool->done_cond);
+        pthread_mutex_unlock(&pool->done_lock);
+    }
+}
+
+// whether two states analyze every following frame alike
+static int same_continuation(const harmony_state *a, const harmony_state *b)
+{
+    if (a->encoded_state != b->encoded_state || a->chromatic_notes != b->chromatic_notes
+        || a->kpdve != b->kpdve || a->dve != b->dve || a->ve != b->ve
+        || a->kpdve_list_length != b->kpdve_list_length || a->kpdve_min_index != b->kpdve_min_index)
+    {
+        return 0;
+    }
+    // an empty list leaves its first entry from an earlier frame, and that entry is then chosen
+    size_t n = (size_t)(a->kpdve_list_length > 0 ? a->kpdve_list_length : 1);
+    return memcmp(a->kpdve_list, b->kpdve_list, n * sizeof(int)) == 0
+        && memcmp(a->dve_list, b->dve_list, n * sizeof(int)) == 0
+        && memcmp(a->ve_list, b->ve_list, n * sizeof(int)) == 0;
+}
+
+static size_t plan_tasks(const struct corpus_input *inputs, const struct kpdve_corpus_file *files, size_t count,
+                         size_t segment_frames, struct corpus_task *tasks)
+{
+    size_t n = 0;
+    for (size_t f = 0; f < count; f++)
+    {
+        if (files[f].err)
+        {
+            continue;
+        }
+        size_t first = 0;
+        size_t segment = 0;
+        do
+        {
+            size_t take = inputs[f].frames - first;
+            if (segment_frames > 0 && take > segment_frames)
+            {
+                take = segment_frames;
+            }
+            if (tasks != NULL)
+            {
+                memset(&tasks[n], 0, sizeof(tasks[n]));
+                tasks[n].file = f;
+                tasks[n].segment = segment;
+                tasks[n].first = first;
+                tasks[n].count = take;
+            }
+            n++;
+            segment++;
+            first += take;
+        } while (first < inputs[f].frames);
+    }
+    return n;
+}
+
+/**
+ * @brief Analyzes a list of input files into one store.
+ *
+ * @param paths The input files, in the order their frames are stored.
+ * @param count Number of input files.
+ * @param store_path The store to write.
+ * @param options Options; NULL for kpdve_corpus_default_options.
+ * @param files Receives one entry per input file (count of them).
+ * @param result Receives the totals (may be NULL).
+ * @return KPDVE_CORPUS_OK (files that could not be read are only reported in files),
+ *         or a negative KPDVE_CORPUS_ERR code.
+ */
+int kpdve_corpus_analyze(const char *const *paths, size_t count, const char *store_path,
+                         const struct kpdve_corpus_options *options,
+                         struct kpdve_corpus_file *files, struct kpdve_corpus_result *result)
+{
+    struct kpdve_corpus_options defaults;
+    if (options == NULL)
+    {
+        kpdve_corpus_default_options(&defaults);
+        options = &defaults;
+    }
+    int workers = options->threads > 0 ? options->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    workers = workers < 1 ? 1 : (workers > MAX_THREADS ? MAX_THREADS : workers);
+
+    struct corpus_input *inputs = calloc(count ? count : 1, sizeof(struct corpus_input));
+    if (inputs == NULL)
+    {
+        return KPDVE_CORPUS_ERR_MEMORY;
+    }
+    for (size_t f = 0; f < count; f++)
+    {
+        memset(&files[f], 0, sizeof(files[f]));
+        files[f].path = paths[f];
+        files[f].err = open_input(paths[f], &inputs[f]) != 0;
+        files[f].format = files[f].err ? 0 : inputs[f].format;
+    }
+
+    int status = KPDVE_CORPUS_OK;
+    struct corpus_pool pool = { 0 };
+    pool.inputs = inputs;
+    pool.tables = kpdve_tables_default();
+    pool.warmup = options->warmup_frames;
+    pool.workers = workers;
+    pool.task_count = plan_tasks(inputs, files, count, options->segment_frames, NULL);
+    pool.tasks = calloc(pool.task_count ? pool.task_count : 1, sizeof(struct corpus_task));
+    pool.deques = calloc((size_t)workers, sizeof(struct corpus_deque));
+    pool.window = (size_t)workers * WINDOW_PER_WORKER;
+    pool.limit = pool.window;
+    pool.slots = calloc(pool.window, sizeof(struct corpus_slot));
+
+    kpdve_store_writer writer;
+    int store_open = 0;
+    if (pool.tasks == NULL || pool.deques == NULL || pool.slots == NULL)
+    {
+        status = KPDVE_CORPUS_ERR_MEMORY;
+    }
+    else if (kpdve_store_writer_open(&writer, store_path, options->block_frames, options->frame_period) != KPDVE_STORE_OK)
+    {
+        status = KPDVE_CORPUS_ERR_IO;
+    }
+    else
+    {
+        store_open = 1;
+    }
+
+    int deques_ready = 0;
+    for (; status == KPDVE_CORPUS_OK && deques_ready < workers; deques_ready++)
+    {
+        struct corpus_deque *d = &pool.deques[deques_ready];
+        d->items = malloc((pool.task_count ? pool.task_count : 1) * sizeof(size_t));
+        if (d->items == NULL)
+        {
+            status = KPDVE_CORPUS_ERR_MEMORY;
+            break;
+        }
+        pthread_mutex_init(&d->lock, NULL);
+    }
+    if (status == KPDVE_CORPUS_OK)
+    {
+        plan_tasks(inputs, files, count, options->segment_frames, pool.tasks);
+    }
+
+    pthread_t ids[MAX_THREADS];
+    struct corpus_worker worker_args[MAX_THREADS];
+    int started = 0;
+    int pool_ready = (status == KPDVE_CORPUS_OK);
+    if (pool_ready)
+    {
+        pthread_mutex_init(&pool.done_lock, NULL);
+        pthread_cond_init(&pool.done_cond, NULL);
+        for (; started < workers; started++)
+        {
+            worker_args[started].pool = &pool;
+            worker_args[started].id = started;
+            if (pthread_create(&ids[started], NULL, corpus_worker_main, &worker_args[started]) != 0)
+            {
+                break;
+            }
+        }
+
+        // deal round-robin among the threads that did start; with none, the merge runs
+        // every task itself
+        pthread_mutex_lock(&pool.done_lock);
+        pool.workers = started;
+        for (size_t t = 0; t < pool.task_count && started > 0; t++)
+        {
+            struct corpus_deque *d = &pool.deques[t % (size_t)started];
+            d->items[d->tail++] = t;
+        }
+        pool.dealt = 1;
+        pthread_cond_broadcast(&pool.done_cond);
+        pthread_mutex_unlock(&pool.done_lock);
+    }
+
+    // merge in task order
+    size_t reanalyzed = 0;
+    harmony_state truth = harmony_state_default();
+    for (size_t t = 0; status == KPDVE_CORPUS_OK && t < pool.task_count; t++)
+    {
+        struct corpus_task *task = &pool.tasks[t];
+        struct corpus_slot *slot = &pool.slots[t % pool.window];
+        if (started == 0)
+        {
+            run_task(&pool, t);
+        }
+        else
+        {
+            pthread_mutex_lock(&pool.done_lock);
+            while (!task->done)
+            {
+                pthread_cond_wait(&pool.done_cond, &pool.done_lock);
+            }
+            pthread_mutex_unlock(&pool.done_lock);
+        }
+
+        struct kpdve_corpus_file *file = &files[task->file];
+        if (task->segment == 0)
+        {
+            file->first_frame = writer.header.frame_count;
+        }
+        else if (!file->err && !slot->err && !same_continuation(&slot->seam, &truth))
+        {
+            slot->end = truth;
+            slot->err = analyze_range(pool.tables, &inputs[task->file], task->first, task->count, &slot->end,
+                                      slot->states) != 0;
+            reanalyzed++;
+        }
+
+        if (slot->err)
+        {
+            file->err = 1;
+        }
+        if (!file->err)
+        {
+            if (kpdve_store_append(&writer, slot->states, task->count) != KPDVE_STORE_OK)
+            {
+                status = KPDVE_CORPUS_ERR_IO;
+            }
+            for (size_t i = 0; i < task->count; i++)
+            {
+                file->invalid += (slot->states[i] < 0);
+            }
+            file->frames += task->count;
+            file->segments++;
+        }
+        truth = slot->end;
+        free(slot->states);
+        slot->states = NULL;
+        if (started > 0)
+        {
+            __atomic_sub_fetch(&pool.held, 1, __ATOMIC_RELAXED);
+        }
+
+        // the slot is free: let the task that uses it next start
+        pthread_mutex_lock(&pool.done_lock);
+        __atomic_store_n(&pool.limit, t + 1 + pool.window, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&pool.done_cond);
+        pthread_mutex_unlock(&pool.done_lock);
+    }
+
+    // on an early error the workers stop at their next task; wait for them, then free
+    if (pool_ready)
+    {
+        pthread_mutex_lock(&pool.done_lock);
+        pool.stop = 1;
+        pthread_cond_broadcast(&pool.done_cond);
+        pthread_mutex_unlock(&pool.done_lock);
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(ids[i], NULL);
+    }
+    size_t steals = 0;
+    for (int w = 0; w < deques_ready; w++)
+    {
+        steals += pool.deques[w].steals;
+        free(pool.deques[w].items);
+        pthread_mutex_destroy(&pool.deques[w].lock);
+    }
+    if (pool.slots != NULL)
+    {
+        for (size_t i = 0; i < pool.window; i++)
+        {
+            free(pool.slots[i].states);
+        }
+    }
+    if (pool_ready)
+    {
+        pthread_mutex_destroy(&pool.done_lock);
+        pthread_cond_destroy(&pool.done_cond);
+    }
+
+    if (store_open && kpdve_store_writer_close(&writer) != KPDVE_STORE_OK && status == KPDVE_CORPUS_OK)
+    {
+        status = KPDVE_CORPUS_ERR_IO;
+    }
+
+    if (result != NULL)
+    {
+        memset(result, 0, sizeof(*result));
+        result->threads = started > 0 ? started : 1;
+        result->segments = pool.task_count;
+        result->reanalyzed = reanalyzed;
+        result->steals = steals;
+        result->peak_segments = started > 0 ? pool.peak_held : 1;
+        for (size_t f = 0; f < count; f++)
+        {
+            result->files += !files[f].err;
+            result->frames += files[f].frames;
+        }
+    }
+
+    for (size_t f = 0; f < count; f++)
+    {
+        if (inputs[f].map != NULL)
+        {
+            munmap((void *)inputs[f].map, inputs[f].map_size);
+        }
+    }
+    free(pool.tasks);
+    free(pool.slots);
+    free(pool.deques);
+    free(inputs);
+    return status;
+}
@@ -0,0 +1,375 @@
+//
+//  qdkpdve_crystal.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_crystal.c
+ * @brief The analysis for any harmony crystal (see qdkpdve_crystal.h).
+ *
+ * The general code follows set_kp_list, minimize_dve_value, minimize_ve_value and
+ * set_min_index step for step, on 64-bit note sets, so that on 12/7 it gives their
+ * results exactly; the 12/7 crystal normally skips it for the candidate tables.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/qdkpdve_crystal.h"
+#include "../include/qdkpdve_analysis.h"
+#include "../include/qdkpdve_statemaker.h"
+
+static uint64_t bunch(int breadth)
+{
+    return (breadth >= 64) ? ~0ull : (1ull << breadth) - 1;
+}
+
+// mod_rot on n bits
+static uint64_t rot(uint64_t val, int r, int n)
+{
+    r = loop_mod(r, n);
+    return (r == 0) ? (val & bunch(n)) : bunch(n) & ((val << r) | (val >> (n - r)));
+}
+
+// apply_p_filt: P moves one note of the mode by q circle positions
+static uint64_t p_filter(const kpdve_crystal_analyzer *a, uint64_t val, int p)
+{
+    if (p == 0)
+    {
+        return val;
+    }
+    int q = a->division;
+    int offset = (p <= (q - 1) / 2) ? p - 1 : p - q;
+    uint64_t filter = rot(1ull | (1ull << q), offset, a->notes);
+    return (filter & val) ? val ^ filter : val;
+}
+
+// bit i to bit i * multiplier mod q
+static uint32_t permute(uint32_t val, int multiplier, int q)
+{
+    uint32_t result = 0;
+    for (int i = 0; i < q; i++)
+    {
+        if (val & (1u << i))
+        {
+            result |= 1u << ((i * multiplier) % q);
+        }
+    }
+    return result;
+}
+
+// minimize_ve_value: the last V whose VE is no higher than the unpermuted value
+static void minimize_ve(const kpdve_crystal_analyzer *a, uint32_t val, kpdve_crystal_candidate *c)
+{
+    for (int i = 0; i < a->v_count; i++)
+    {
+        uint32_t test = permute(val, a->v_inverse[i], a->division);
+        if (val >= test)
+        {
+            c->ve = test;
+            c->v = 1 << i;
+            c->e = largest_bit((int)test);
+        }
+    }
+}
+
+// minimize_dve_value: the rotation (D) with the lowest VE, the last one on ties
+static void minimize_dve(const kpdve_crystal_analyzer *a, uint32_t val, kpdve_crystal_candidate *c)
+{
+    int q = a->division;
+    uint32_t slide = val;
+    uint32_t low = 1u << q;
+    c->dve = val;
+    for (int i = 0; i < q; i++)
+    {
+        if (slide & 1)
+        {
+            kpdve_crystal_candidate test;
+            minimize_ve(a, slide, &test);
+            if (low >= test.ve)
+            {
+                c->d = i;
+                c->v = test.v;
+                c->e = test.e;
+                c->ve = test.ve;
+                low = test.ve;
+            }
+        }
+        slide = (uint32_t)rot(slide, -1, q);
+    }
+}
+
+static int encode(const kpdve_crystal_candidate *c)
+{
+    int kpdve[] = { c->k, c->p, c->d, c->v, c->e };
+    return KPDVEtoBinaryEncoding(kpdve);
+}
+
+/**
+ * @brief Sets up an analyzer for the crystal at a multiple of 12 notes.
+ *
+ * @param analyzer The analyzer.
+ * @param twelvemult 1 (12 notes, 7-note patterns), 2 (24, 13), 3 (36, 19) or 5 (60, 31):
+ * the multiples whose divisions are twin primes and whose notes fit 64 bits.
+ * @return 0, or -1 if the crystal is not supported or memory ran out.
+ */
+int kpdve_crystal_init(kpdve_crystal_analyzer *analyzer, int twelvemult)
+{
+    memset(analyzer, 0, sizeof(*analyzer));
+    if (twelvemult < 1 || 12 * twelvemult > KPDVE_CRYSTAL_MAX_NOTES)
+    {
+        return -1;
+    }
+    harmonycrystal crystal = harmonycrystal_atmultiple(twelvemult);
+    if (!crystal.twinprimes)
+    {
+        return -1;
+    }
+
+    int n = 12 * twelvemult;
+    int q = crystal.divs[crystal.divindex];
+    analyzer->crystal = crystal;
+    analyzer->notes = n;
+    analyzer->division = q;
+    analyzer->cells = n * q;
+    analyzer->cell_masks = malloc((size_t)analyzer->cells * sizeof(uint64_t));
+    analyzer->circle_position = malloc((size_t)n * sizeof(int));
+    analyzer->v_inverse = malloc(8 * sizeof(int));
+    analyzer->candidates = malloc((size_t)analyzer->cells * sizeof(kpdve_crystal_candidate));
+    if (analyzer->cell_masks == NULL || analyzer->circle_position == NULL
+        || analyzer->v_inverse == NULL || analyzer->candidates == NULL)
+    {
+        kpdve_crystal_free(analyzer);
+        return -1;
+    }
+
+    // the circle steps by q notes (q = 7: fifths), with note 0 at position 1
+    for (int i = 0; i < n; i++)
+    {
+        analyzer->circle_position[i] = (q * i + 1) % n;
+    }
+    // V = 1, 2, 4.. below q, as the three unshuffles of minimize_ve_value for q = 7
+    for (int v = 1; v < q && analyzer->v_count < 8; v <<= 1)
+    {
+        int inverse = 1;
+        while ((inverse * v) % q != 1)
+        {
+            inverse++;
+        }
+        analyzer->v_inverse[analyzer->v_count++] = inverse;
+    }
+    for (int i = 0; i < analyzer->cells; i++)
+    {
+        analyzer->cell_masks[i] = rot(p_filter(analyzer, bunch(q), i % q), i / q, n);
+    }
+
+    if (twelvemult == 1)
+    {
+        analyzer->fast = 1;
+        analyzer->tables = kpdve_tables_default();
+        int loc[5];
+        binaryEncodingToKPDVE(harmony_state_default().kpdve, loc);
+        analyzer->context = (kpdve_crystal_candidate){ loc[0], loc[1], loc[2], loc[3], loc[4], 0, 0, -1 };
+        analyzer->context.kpdve = encode(&analyzer->context);
+    }
+    else
+    {
+        analyzer->context = (kpdve_crystal_candidate){ 0, 0, 0, 1, 0, 0, 0, -1 };
+    }
+    analyzer->min_index = -1;
+    return 0;
+}
+
+void kpdve_crystal_free(kpdve_crystal_analyzer *analyzer)
+{
+    free(analyzer->cell_masks);
+    free(analyzer->circle_position);
+    free(analyzer->v_inverse);
+    free(analyzer->candidates);
+    memset(analyzer, 0, sizeof(*analyzer));
+}
+
+/**
+ * @brief Chroma order (bit i is note i) to circle order (as chroma_to_circle for 12).
+ */
+uint64_t kpdve_crystal_chroma_to_circle(const kpdve_crystal_analyzer *analyzer, uint64_t chroma)
+{
+    uint64_t circle = 0;
+    for (int i = 0; i < analyzer->notes; i++)
+    {
+        if (chroma & (1ull << i))
+        {
+            circle |= 1ull << analyzer->circle_position[i];
+        }
+    }
+    return circle;
+}
+
+/**
+ * @brief Circle order to chroma order (as circle_to_chroma for 12).
+ */
+uint64_t kpdve_crystal_circle_to_chroma(const kpdve_crystal_analyzer *analyzer, uint64_t circle)
+{
+    uint64_t chroma = 0;
+    for (int i = 0; i < analyzer->notes; i++)
+    {
+        if (circle & (1ull << analyzer->circle_position[i]))
+        {
+            chroma |= 1ull << i;
+        }
+    }
+    return chroma;
+}
+
+/**
+ * @brief Lists the candidates for a chroma (as set_kp_list), in analyzer->candidates.
+ *
+ * The empty chroma has none (set_kp_list fills its list with placeholder -1s). Bits from
+ * the Nth up are ignored.
+ *
+ * @return The number of candidates.
+ */
+int kpdve_crystal_candidates(kpdve_crystal_analyzer *analyzer, uint64_t chroma)
+{
+    chroma &= bunch(analyzer->notes);
+    analyzer->count = 0;
+    if (chroma == 0)
+    {
+        return 0;
+    }
+
+    if (analyzer->fast)
+    {
+        const kpdve_tables *tables = analyzer->tables;
+        int first = tables->offsets[chroma];
+        int count = tables->offsets[chroma + 1] - first;
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t packed = tables->candidates[first + i];
+            int loc[5];
+            kpdve_crystal_candidate *c = &analyzer->candidates[i];
+            c->kpdve = KPDVE_CANDIDATE_KPDVE(packed);
+            binaryEncodingToKPDVE(c->kpdve, loc);
+            c->k = loc[0];
+            c->p = loc[1];
+            c->d = loc[2];
+            c->v = loc[3];
+            c->e = loc[4];
+            c->dve = (uint32_t)KPDVE_CANDIDATE_DVE(packed);
+            c->ve = (uint32_t)KPDVE_CANDIDATE_VE(packed);
+        }
+        analyzer->count = count;
+        return count;
+    }
+
+    int q = analyzer->division;
+    uint64_t circle = kpdve_crystal_chroma_to_circle(analyzer, chroma);
+    for (int i = 0; i < analyzer->cells; i++)
+    {
+        if ((analyzer->cell_masks[i] & circle) != circle)
+        {
+            continue;
+        }
+        kpdve_crystal_candidate *c = &analyzer->candidates[analyzer->count++];
+        c->k = i / q;
+        c->p = i % q;
+        // undo K and P: the notes as a subset of the q-note mode
+        minimize_dve(analyzer, (uint32_t)p_filter(analyzer, rot(circle, -c->k, analyzer->notes), c->p), c);
+        c->kpdve = (analyzer->notes == 12) ? encode(c) : -1;
+    }
+    return analyzer->count;
+}
+
+/**
+ * @brief KPD_distance in the crystal: K mod N, P and D mod q, weighted and summed as there.
+ */
+float kpdve_crystal_distance(const kpdve_crystal_analyzer *analyzer, const kpdve_crystal_candidate *a, const kpdve_crystal_candidate *b)
+{
+    float axis_scale[5];
+    kpdve_default_axis_scale(axis_scale);
+    const int mods[3] = { analyzer->notes, analyzer->division, analyzer->division };
+    const int from[3] = { a->k, a->p, a->d };
+    const int to[3] = { b->k, b->p, b->d };
+
+    float sum = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        float dist = modDistance(from[i], to[i], mods[i]);
+        dist *= axis_scale[i];
+        sum += dist;
+    }
+    return sum;
+}
+
+/**
+ * @brief Chooses among the candidates of the last kpdve_crystal_candidates call (for the
+ * same chroma), as set_min_index: the candidate in the context's K and P if there is
+ * one, otherwise the first with the smallest distance. Any context is accepted; those the
+ * 12/7 tables do not cover are ranked by the general code.
+ *
+ * @return The index, or -1 if there are no candidates.
+ */
+int kpdve_crystal_choose(const kpdve_crystal_analyzer *analyzer, uint64_t chroma, const kpdve_crystal_candidate *context)
+{
+    if (analyzer->count == 0)
+    {
+        return -1;
+    }
+    // the tables hold K 0..11 and 3-bit P and D; other contexts take the general loop
+    if (analyzer->fast && (unsigned int)context->k < 12 && (unsigned int)context->p < 8 && (unsigned int)context->d < 8
+        && (unsigned int)context->v < 8 && (unsigned int)context->e < 8)
+    {
+        return kpdve_tables_choose(analyzer->tables, (int)(chroma & 0xFFF), encode(context));
+    }
+
+    float min_dist = 100.0f;
+    int min_index = 0;
+    for (int i = 0; i < analyzer->count; i++)
+    {
+        const kpdve_crystal_candidate *c = &analyzer->candidates[i];
+        if (c->k == context->k && c->p == context->p)
+        {
+            return i;
+        }
+        float dist = kpdve_crystal_distance(analyzer, c, context);
+        if (dist < min_dist)
+        {
+            min_dist = dist;
+            min_index = i;
+        }
+    }
+    return min_index;
+}
+
+/**
+ * @brief Analyzes a chroma against the analyzer's context; the choice becomes the next
+ * context. A chroma without candidates keeps the context.
+ *
+ * @return The index of the choice in analyzer->candidates, or -1.
+ */
+int kpdve_crystal_analyze(kpdve_crystal_analyzer *analyzer, uint64_t chroma)
+{
+    kpdve_crystal_candidates(analyzer, chroma);
+    analyzer->min_index = kpdve_crystal_choose(analyzer, chroma, &analyzer->context);
+    if (analyzer->min_index >= 0)
+    {
+        analyzer->context = analyzer->candidates[analyzer->min_index];
+    }
+    return analyzer->min_index;
+}
+
+/**
+ * @brief The notes of a candidate's chord in chroma order: E + 1 notes V steps apart in
+ * the mode, from D, then P and K applied (kpdve_chord_val, then circle_to_chroma).
+ */
+uint64_t kpdve_crystal_chord(const kpdve_crystal_analyzer *analyzer, const kpdve_crystal_candidate *candidate)
+{
+    int q = analyzer->division;
+    uint64_t chord = 0;
+    for (int i = 0; i <= candidate->e; i++)
+    {
+        chord |= 1ull << loop_mod(candidate->d + candidate->v * i, q);
+    }
+    uint64_t circle = rot(p_filter(analyzer, chord, candidate->p), candidate->k, analyzer->notes);
+    return kpdve_crystal_circle_to_chroma(analyzer, circle);
+}
@@ -0,0 +1,1072 @@
+//
+//  qdkpdve_daemon.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_daemon.c
+ * @brief Unix socket analysis server and client (see qdkpdve_daemon.h).
+ *
+ * The event loop is the only thread that touches connections. A request becomes a job
+ * (header, chroma and room for the states in one allocation) that goes to its session's
+ * worker queue and comes back on the completion queue; the connection counts its jobs
+ * in flight, and a closed connection is only freed when the last one has come back.
+ * Workers take their whole queue at once and return it with one lock and one eventfd
+ * write, so a burst of pipelined requests costs a few syscalls, not a few per request.
+ *
+ * A connection is read while it has fewer than max_pending jobs in flight and less than
+ * OUTPUT_HIGH bytes of responses waiting, and written (EPOLLOUT) only while a write has
+ * been cut short; the epoll interest is updated whenever either changes.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_daemon.h"
+#include "../include/qdkpdve_rt.h"
+#include "../include/qdkpdve_tables.h"
+
+#define HEADER_SIZE ((size_t)sizeof(struct pf_daemon_header))
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* -------------------------------------------------------------------------- client */
+
+static int send_all(int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return PF_DAEMON_ERR_IO;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return PF_DAEMON_OK;
+}
+
+static int recv_all(int fd, void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n == 0)
+        {
+            errno = ECONNRESET;
+            return PF_DAEMON_ERR_IO;
+        }
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return PF_DAEMON_ERR_IO;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return PF_DAEMON_OK;
+}
+
+/**
+ * @brief Connects to a daemon.
+ *
+ * @return A blocking socket, or PF_DAEMON_ERR_IO.
+ */
+int pf_client_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return PF_DAEMON_ERR_IO;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return PF_DAEMON_ERR_IO;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return PF_DAEMON_ERR_IO;
+    }
+    return fd;
+}
+
+/**
+ * @brief Sends one request; for ANALYZE, header->count chroma values follow it.
+ *
+ * Requests may be sent ahead of their responses (pipelined).
+ *
+ * @return PF_DAEMON_OK or PF_DAEMON_ERR_IO.
+ */
+int pf_client_send(int fd, const struct pf_daemon_header *header, const uint16_t *chroma)
+{
+    if (header->op != PF_DAEMON_ANALYZE || header->count == 0)
+    {
+        return send_all(fd, header, HEADER_SIZE);
+    }
+    // one send for small requests, two for large ones (the copy would cost more)
+    size_t payload = (size_t)header->count * sizeof(uint16_t);
+    if (payload <= 4096)
+    {
+        uint8_t buf[HEADER_SIZE + 4096];
+        memcpy(buf, header, HEADER_SIZE);
+        memcpy(buf + HEADER_SIZE, chroma, payload);
+        return send_all(fd, buf, HEADER_SIZE + payload);
+    }
+    int err = send_all(fd, header, HEADER_SIZE);
+    return (err == PF_DAEMON_OK) ? send_all(fd, chroma, payload) : err;
+}
+
+/**
+ * @brief Receives one response, with its states (if any) into states[cap].
+ *
+ * A response with more states than cap is read to its end (so the stream stays in step)
+ * and reported as PF_DAEMON_ERR_PROTOCOL, with the first cap states stored.
+ *
+ * @return PF_DAEMON_OK, PF_DAEMON_ERR_IO or PF_DAEMON_ERR_PROTOCOL.
+ */
+int pf_client_recv(int fd, struct pf_daemon_header *header, uint32_t *states, size_t cap)
+{
+    int err = recv_all(fd, header, HEADER_SIZE);
+    if (err != PF_DAEMON_OK)
+    {
+        return err;
+    }
+    if (header->op != PF_DAEMON_ANALYZE || header->status != PF_DAEMON_STATUS_OK)
+    {
+        return PF_DAEMON_OK;
+    }
+    size_t count = header->count;
+    size_t stored = (count < cap) ? count : cap;
+    err = (stored > 0) ? recv_all(fd, states, stored * sizeof(uint32_t)) : PF_DAEMON_OK;
+    for (size_t left = count - stored; err == PF_DAEMON_OK && left > 0;)
+    {
+        uint32_t discard[256];
+        size_t n = (left < 256) ? left : 256;
+        err = recv_all(fd, discard, n * sizeof(uint32_t));
+        left -= n;
+    }
+    if (err == PF_DAEMON_OK && count > cap)
+    {
+        return PF_DAEMON_ERR_PROTOCOL;
+    }
+    return err;
+}
+
+/**
+ * @brief Analyzes a batch and waits for its states (no other request may be in flight
+ * on the socket).
+ *
+ * @return PF_DAEMON_OK, a negative PF_DAEMON_ERR_ value, or the response's (positive)
+ * PF_DAEMON_STATUS_ value.
+ */
+int pf_client_analyze(int fd, uint32_t session, const uint16_t *chroma, uint32_t count, uint32_t *states)
+{
+    struct pf_daemon_header header = { 0, session, PF_DAEMON_ANALYZE, 0, count };
+    int err = pf_client_send(fd, &header, chroma);
+    if (err == PF_DAEMON_OK)
+    {
+        err = pf_client_recv(fd, &header, states, count);
+    }
+    if (err != PF_DAEMON_OK)
+    {
+        return err;
+    }
+    if (header.session != session || header.op != PF_DAEMON_ANALYZE)
+    {
+        return PF_DAEMON_ERR_PROTOCOL;
+    }
+    return header.status;
+}
+
+/* -------------------------------------------------------------------------- server */
+
+void pf_daemon_default_options(struct pf_daemon_options *options)
+{
+    options->path = NULL;
+    options->workers = 2;
+    options->sessions = 1024;
+    options->max_frames = PF_DAEMON_MAX_FRAMES;
+    options->max_pending = 256;
+}
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+#define READ_CHUNK 65536
+#define OUTPUT_HIGH (1u << 20) /**< stop reading a connection whose responses pile up */
+#define EVENTS 64
+
+struct connection;
+
+struct job {
+    struct job *next;
+    struct connection *conn;
+    struct pf_daemon_header header;
+    uint32_t *states;   /**< [count] for ANALYZE */
+    uint16_t *chroma;   /**< [count] for ANALYZE */
+};
+
+struct job_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    struct job *head;
+    struct job *tail;
+};
+
+struct worker {
+    pf_daemon *daemon;
+    unsigned index;
+    pthread_t thread;
+    struct job_queue queue;
+    pf_rt_analyzer *analyzers;  /**< the sessions this worker owns, by session / workers */
+};
+
+struct connection {
+    int fd;
+    int closed;          /**< the socket is closed; freed when pending reaches 0 */
+    int eof;             /**< the client shut down its side: answer what is in flight, then close */
+    unsigned pending;    /**< jobs in flight */
+    uint32_t events;     /**< epoll interest now */
+    int dirty;           /**< on the list of connections with new responses */
+    struct connection *next_dirty;
+    struct connection *prev, *next;
+
+    uint8_t *in;
+    size_t in_len, in_cap;
+    uint8_t *out;
+    size_t out_start, out_len, out_cap;
+};
+
+struct pf_daemon {
+    struct pf_daemon_options options;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd;                 /**< eventfd: completions, or stop */
+    int stopping;
+    const kpdve_tables *tables;
+
+    struct worker *workers;
+    unsigned worker_count;
+    struct job_queue done;       /**< completed jobs, workers to the loop */
+
+    struct connection *connections;  /**< open and closing ones */
+    struct connection *freed;        /**< closed with nothing in flight: free after the event batch */
+    struct pf_daemon_stats stats;
+};
+
+static void queue_init(struct job_queue *q)
+{
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->ready, NULL);
+    q->head = NULL;
+    q->tail = NULL;
+}
+
+static void queue_destroy(struct job_queue *q)
+{
+    while (q->head != NULL)
+    {
+        struct job *next = q->head->next;
+        free(q->head);
+        q->head = next;
+    }
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->ready);
+}
+
+// appends a list of jobs; returns whether the queue was empty
+static int queue_append(struct job_queue *q, struct job *first, struct job *last)
+{
+    pthread_mutex_lock(&q->lock);
+    int was_empty = (q->head == NULL);
+    if (was_empty)
+    {
+        q->head = first;
+    }
+    else
+    {
+        q->tail->next = first;
+    }
+    q->tail = last;
+    pthread_mutex_unlock(&q->lock);
+    return was_empty;
+}
+
+static struct job *queue_take_all(struct job_queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    struct job *jobs = q->head;
+    q->head = NULL;
+    q->tail = NULL;
+    pthread_mutex_unlock(&q->lock);
+    return jobs;
+}
+
+static void wake(pf_daemon *daemon)
+{
+    uint64_t one = 1;
+    ssize_t n;
+    do
+    {
+        n = write(daemon->wake_fd, &one, sizeof(one));
+    } while (n < 0 && errno == EINTR);
+}
+
+static int is_stopping(pf_daemon *daemon)
+{
+    return __atomic_load_n(&daemon->stopping, __ATOMIC_ACQUIRE);
+}
+
+static void run_job(struct worker *w, struct job *job)
+{
+    struct pf_daemon_header *h = &job->header;
+    pf_rt_analyzer *analyzer = &w->analyzers[h->session / w->daemon->worker_count];
+    switch (h->op)
+    {
+    case PF_DAEMON_ANALYZE:
+        for (uint32_t i = 0; i < h->count; i++)
+        {
+            job->states[i] = (uint32_t)pf_rt_analyze_chroma(analyzer, job->chroma[i]);
+        }
+        __atomic_add_fetch(&w->daemon->stats.frames, h->count, __ATOMIC_RELAXED);
+        break;
+    case PF_DAEMON_RESET:
+        pf_rt_reset(analyzer);
+        break;
+    case PF_DAEMON_SET_CONTEXT:
+        if (pf_rt_set_context(analyzer, (int)h->count) != 0)
+        {
+            h->status = PF_DAEMON_STATUS_BAD_CONTEXT;
+        }
+        break;
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *w = arg;
+    pf_daemon *daemon = w->daemon;
+    pf_rt_prepare_thread();
+    for (;;)
+    {
+        pthread_mutex_lock(&w->queue.lock);
+        while (w->queue.head == NULL && !is_stopping(daemon))
+        {
+            pthread_cond_wait(&w->queue.ready, &w->queue.lock);
+        }
+        struct job *jobs = w->queue.head;
+        w->queue.head = NULL;
+        w->queue.tail = NULL;
+        pthread_mutex_unlock(&w->queue.lock);
+        if (jobs == NULL)
+        {
+            return NULL;
+        }
+
+        struct job *last = jobs;
+        for (struct job *job = jobs; job != NULL; job = job->next)
+        {
+            run_job(w, job);
+            last = job;
+        }
+        if (queue_append(&daemon->done, jobs, last))
+        {
+            wake(daemon);
+        }
+    }
+}
+
+/* ------------------------------------------------------------------ connections */
+
+static int grow(uint8_t **buf, size_t *cap, size_t need)
+{
+    if (need <= *cap)
+    {
+        return 0;
+    }
+    size_t new_cap = (*cap > 0) ? *cap : 4096;
+    while (new_cap < need)
+    {
+        new_cap *= 2;
+    }
+    uint8_t *p = realloc(*buf, new_cap);
+    if (p == NULL)
+    {
+        return -1;
+    }
+    *buf = p;
+    *cap = new_cap;
+    return 0;
+}
+
+static void free_connection(struct connection *conn)
+{
+    free(conn->in);
+    free(conn->out);
+    free(conn);
+}
+
+static void close_connection(pf_daemon *daemon, struct connection *conn)
+{
+    if (conn->closed)
+    {
+        return;
+    }
+    epoll_ctl(daemon->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conn->closed = 1;
+    if (conn->prev != NULL)
+    {
+        conn->prev->next = conn->next;
+    }
+    else
+    {
+        daemon->connections = conn->next;
+    }
+    if (conn->next != NULL)
+    {
+        conn->next->prev = conn->prev;
+    }
+    // freed once the event batch is done and nothing of it is in flight
+    if (conn->pending == 0)
+    {
+        conn->next = daemon->freed;
+        daemon->freed = conn;
+    }
+}
+
+// queues a response in the connection's output (written by flush_connection)
+static int append_response(struct connection *conn, const struct pf_daemon_header *header, const uint32_t *states)
+{
+    size_t payload = (header->op == PF_DAEMON_ANALYZE && header->status == PF_DAEMON_STATUS_OK)
+        ? (size_t)header->count * sizeof(uint32_t) : 0;
+    if (conn->out_start > 0 && conn->out_start + conn->out_len + HEADER_SIZE + payload > conn->out_cap)
+    {
+        memmove(conn->out, conn->out + conn->out_start, conn->out_len);
+        conn->out_start = 0;
+    }
+    if (grow(&conn->out, &conn->out_cap, conn->out_start + conn->out_len + HEADER_SIZE + payload) != 0)
+    {
+        return -1;
+    }
+    uint8_t *at = conn->out + conn->out_start + conn->out_len;
+    memcpy(at, header, HEADER_SIZE);
+    if (payload > 0)
+    {
+        memcpy(at + HEADER_SIZE, states, payload);
+    }
+    conn->out_len += HEADER_SIZE + payload;
+    return 0;
+}
+
+static void flush_connection(pf_daemon *daemon, struct connection *conn)
+{
+    while (!conn->closed && conn->out_len > 0)
+    {
+        ssize_t n = send(conn->fd, conn->out + conn->out_start, conn->out_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                close_connection(daemon, conn);
+            }
+            return;
+        }
+        conn->out_start += (size_t)n;
+        conn->out_len -= (size_t)n;
+    }
+    if (conn->out_len == 0)
+    {
+        conn->out_start = 0;
+    }
+}
+
+static void update_interest(pf_daemon *daemon, struct connection *conn)
+{
+    if (conn->closed)
+    {
+        return;
+    }
+    if (conn->eof && conn->pending == 0 && conn->out_len == 0)
+    {
+        close_connection(daemon, conn);
+        return;
+    }
+    uint32_t events = 0;
+    if (!conn->eof && conn->pending < daemon->options.max_pending && conn->out_len < OUTPUT_HIGH)
+    {
+        events |= EPOLLIN;
+    }
+    if (conn->out_len > 0)
+    {
+        events |= EPOLLOUT;
+    }
+    if (events != conn->events)
+    {
+        struct epoll_event ev = { .events = events, .data.ptr = conn };
+        epoll_ctl(daemon->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+        conn->events = events;
+    }
+}
+
+static void respond_now(pf_daemon *daemon, struct connection *conn, struct pf_daemon_header *header, uint16_t status)
+{
+    header->status = status;
+    if (append_response(conn, header, NULL) != 0)
+    {
+        close_connection(daemon, conn);
+    }
+}
+
+// hands one complete request to its worker (or answers it here if it is invalid)
+static void dispatch(pf_daemon *daemon, struct connection *conn, const uint8_t *request)
+{
+    struct pf_daemon_header header;
+    memcpy(&header, request, HEADER_SIZE);
+    __atomic_add_fetch(&daemon->stats.requests, 1, __ATOMIC_RELAXED);
+
+    if (header.session >= daemon->options.sessions)
+    {
+        respond_now(daemon, conn, &header, PF_DAEMON_STATUS_BAD_SESSION);
+        return;
+    }
+    if (header.op != PF_DAEMON_ANALYZE && header.op != PF_DAEMON_RESET && header.op != PF_DAEMON_SET_CONTEXT)
+    {
+        respond_now(daemon, conn, &header, PF_DAEMON_STATUS_BAD_OP);
+        return;
+    }
+
+    size_t count = (header.op == PF_DAEMON_ANALYZE) ? header.count : 0;
+    struct job *job = malloc(sizeof(struct job) + count * (sizeof(uint32_t) + sizeof(uint16_t)));
+    if (job == NULL)
+    {
+        close_connection(daemon, conn);
+        return;
+    }
+    job->next = NULL;
+    job->conn = conn;
+    job->header = header;
+    job->header.status = PF_DAEMON_STATUS_OK;
+    job->states = (uint32_t *)(job + 1);
+    job->chroma = (uint16_t *)(job->states + count);
+    memcpy(job->chroma, request + HEADER_SIZE, count * sizeof(uint16_t));
+    conn->pending++;
+
+    struct worker *w = &daemon->workers[header.session % daemon->worker_count];
+    if (queue_append(&w->queue, job, job))
+    {
+        pthread_cond_signal(&w->queue.ready);
+    }
+}
+
+// dispatches the complete requests in the input buffer, up to the pending limit
+static void parse_requests(pf_daemon *daemon, struct connection *conn)
+{
+    size_t at = 0;
+    while (!conn->closed && conn->pending < daemon->options.max_pending && conn->in_len - at >= HEADER_SIZE)
+    {
+        struct pf_daemon_header header;
+        memcpy(&header, conn->in + at, HEADER_SIZE);
+        size_t payload = 0;
+        if (header.op == PF_DAEMON_ANALYZE)
+        {
+            if (header.count > daemon->options.max_frames)
+            {
+                __atomic_add_fetch(&daemon->stats.errors, 1, __ATOMIC_RELAXED);
+                close_connection(daemon, conn);
+                return;
+            }
+            payload = (size_t)header.count * sizeof(uint16_t);
+        }
+        if (conn->in_len - at < HEADER_SIZE + payload)
+        {
+            break;
+        }
+        dispatch(daemon, conn, conn->in + at);
+        at += HEADER_SIZE + payload;
+    }
+    if (at > 0 && !conn->closed)
+    {
+        memmove(conn->in, conn->in + at, conn->in_len - at);
+        conn->in_len -= at;
+    }
+}
+
+static void read_connection(pf_daemon *daemon, struct connection *conn)
+{
+    while (!conn->closed && !conn->eof && conn->pending < daemon->options.max_pending)
+    {
+        if (grow(&conn->in, &conn->in_cap, conn->in_len + READ_CHUNK) != 0)
+        {
+            close_connection(daemon, conn);
+            return;
+        }
+        ssize_t n = recv(conn->fd, conn->in + conn->in_len, conn->in_cap - conn->in_len, MSG_DONTWAIT);
+        if (n == 0)
+        {
+            // a partial request left at the end is dropped
+            conn->eof = 1;
+            return;
+        }
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                close_connection(daemon, conn);
+            }
+            return;
+        }
+        conn->in_len += (size_t)n;
+        parse_requests(daemon, conn);
+    }
+}
+
+static void accept_connections(pf_daemon *daemon)
+{
+    for (;;)
+    {
+        int fd = accept(daemon->listen_fd, NULL, NULL);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return; // EAGAIN, or out of descriptors: the backlog waits
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        struct connection *conn = calloc(1, sizeof(struct connection));
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conn };
+        if (conn == NULL || epoll_ctl(daemon->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->events = EPOLLIN;
+        conn->next = daemon->connections;
+        if (daemon->connections != NULL)
+        {
+            daemon->connections->prev = conn;
+        }
+        daemon->connections = conn;
+        __atomic_add_fetch(&daemon->stats.connections, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// a job that will not be answered (shutdown)
+static void drop_job(pf_daemon *daemon, struct job *job)
+{
+    struct connection *conn = job->conn;
+    if (--conn->pending == 0 && conn->closed)
+    {
+        conn->next = daemon->freed;
+        daemon->freed = conn;
+    }
+    free(job);
+}
+
+// returns the completed jobs to their connections and writes the responses out
+static void drain_completions(pf_daemon *daemon)
+{
+    uint64_t count;
+    while (read(daemon->wake_fd, &count, sizeof(count)) < 0 && errno == EINTR)
+    {
+    }
+
+    struct connection *dirty = NULL;
+    struct job *job = queue_take_all(&daemon->done);
+    while (job != NULL)
+    {
+        struct job *next = job->next;
+        struct connection *conn = job->conn;
+        conn->pending--;
+        if (conn->closed)
+        {
+            if (conn->pending == 0)
+            {
+                conn->next = daemon->freed;
+                daemon->freed = conn;
+            }
+        }
+        else if (append_response(conn, &job->header, job->states) != 0)
+        {
+            close_connection(daemon, conn);
+        }
+        else if (!conn->dirty)
+        {
+            conn->dirty = 1;
+            conn->next_dirty = dirty;
+            dirty = conn;
+        }
+        free(job);
+        job = next;
+    }
+
+    for (struct connection *conn = dirty; conn != NULL; conn = conn->next_dirty)
+    {
+        conn->dirty = 0;
+        flush_connection(daemon, conn);
+        // requests held back by the pending limit
+        parse_requests(daemon, conn);
+        update_interest(daemon, conn);
+    }
+}
+
+/* ----------------------------------------------------------------------- daemon */
+
+static int listen_on(const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    // a stale socket from an earlier daemon is replaced; anything else there is not ours
+    struct stat st;
+    if (lstat(path, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            close(fd);
+            errno = EADDRINUSE;
+            return -1;
+        }
+        unlink(path);
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Creates a daemon: builds the tables, sets up every session's analyzer and
+ * listens on the socket. Nothing is served until pf_daemon_run.
+ *
+ * @param options The options (pf_daemon_default_options, then a path).
+ * @param error Receives a PF_DAEMON_ERR_ value on failure (may be NULL).
+ * @return The daemon, or NULL.
+ */
+pf_daemon *pf_daemon_create(const struct pf_daemon_options *options, int *error)
+{
+    int err = PF_DAEMON_ERR_MEMORY;
+    pf_daemon *daemon = calloc(1, sizeof(pf_daemon));
+    if (daemon == NULL)
+    {
+        goto fail;
+    }
+    daemon->options = *options;
+    daemon->listen_fd = daemon->epoll_fd = daemon->wake_fd = -1;
+    if (options->path == NULL || strlen(options->path) >= sizeof(daemon->path) || options->sessions == 0)
+    {
+        err = PF_DAEMON_ERR_IO;
+        errno = EINVAL;
+        goto fail;
+    }
+    strcpy(daemon->path, options->path);
+    daemon->options.path = daemon->path;
+    daemon->options.max_pending = options->max_pending ? options->max_pending : 1;
+    daemon->worker_count = options->workers ? options->workers : 1;
+    if (daemon->worker_count > options->sessions)
+    {
+        daemon->worker_count = options->sessions;
+    }
+
+    daemon->tables = kpdve_tables_default();
+    daemon->workers = calloc(daemon->worker_count, sizeof(struct worker));
+    if (daemon->workers == NULL)
+    {
+        goto fail;
+    }
+    queue_init(&daemon->done);
+    for (unsigned i = 0; i < daemon->worker_count; i++)
+    {
+        struct worker *w = &daemon->workers[i];
+        size_t owned = (options->sessions - i + daemon->worker_count - 1) / daemon->worker_count;
+        w->daemon = daemon;
+        w->index = i;
+        queue_init(&w->queue);
+        w->analyzers = malloc(owned * sizeof(pf_rt_analyzer));
+        if (w->analyzers == NULL)
+        {
+            goto fail;
+        }
+        for (size_t s = 0; s < owned; s++)
+        {
+            pf_rt_init(&w->analyzers[s], daemon->tables);
+        }
+    }
+
+    err = PF_DAEMON_ERR_IO;
+    daemon->listen_fd = listen_on(daemon->path);
+    daemon->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    daemon->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (daemon->listen_fd < 0 || daemon->epoll_fd < 0 || daemon->wake_fd < 0)
+    {
+        goto fail;
+    }
+    struct epoll_event listen_ev = { .events = EPOLLIN, .data.ptr = &daemon->listen_fd };
+    struct epoll_event wake_ev = { .events = EPOLLIN, .data.ptr = &daemon->wake_fd };
+    if (epoll_ctl(daemon->epoll_fd, EPOLL_CTL_ADD, daemon->listen_fd, &listen_ev) != 0
+        || epoll_ctl(daemon->epoll_fd, EPOLL_CTL_ADD, daemon->wake_fd, &wake_ev) != 0)
+    {
+        goto fail;
+    }
+    return daemon;
+
+fail:
+    if (error != NULL)
+    {
+        *error = err;
+    }
+    if (daemon != NULL)
+    {
+        int saved = errno;
+        pf_daemon_destroy(daemon);
+        errno = saved;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Serves on the calling thread until pf_daemon_stop; starts the workers first
+ * and joins them before returning. Connections still open are closed on the way out.
+ *
+ * @return PF_DAEMON_OK, or PF_DAEMON_ERR_IO if epoll failed.
+ */
+int pf_daemon_run(pf_daemon *daemon)
+{
+    unsigned started = 0;
+    for (; started < daemon->worker_count; started++)
+    {
+        struct worker *w = &daemon->workers[started];
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0)
+        {
+            break;
+        }
+    }
+    int result = (started == daemon->worker_count) ? PF_DAEMON_OK : PF_DAEMON_ERR_MEMORY;
+
+    struct epoll_event events[EVENTS];
+    while (result == PF_DAEMON_OK && !is_stopping(daemon))
+    {
+        int n = epoll_wait(daemon->epoll_fd, events, EVENTS, -1);
+        if (n < 0)
+        {
+            if (errno != EINTR)
+            {
+                result = PF_DAEMON_ERR_IO;
+            }
+            continue;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &daemon->listen_fd)
+            {
+                accept_connections(daemon);
+            }
+            else if (ptr == &daemon->wake_fd)
+            {
+                drain_completions(daemon);
+            }
+            else
+            {
+                // hung up both ways (or failed): nothing more can be delivered
+                struct connection *conn = ptr;
+                if (events[i].events & (EPOLLHUP | EPOLLERR))
+                {
+                    close_connection(daemon, conn);
+                }
+                if (!conn->closed && (events[i].events & EPOLLOUT))
+                {
+                    flush_connection(daemon, conn);
+                }
+                if (!conn->closed && (events[i].events & EPOLLIN))
+                {
+                    read_connection(daemon, conn);
+                }
+                update_interest(daemon, conn);
+            }
+        }
+        while (daemon->freed != NULL)
+        {
+            struct connection *next = daemon->freed->next;
+            free_connection(daemon->freed);
+            daemon->freed = next;
+        }
+    }
+
+    // stop the workers, then drop what they returned and every connection
+    __atomic_store_n(&daemon->stopping, 1, __ATOMIC_RELEASE);
+    for (unsigned i = 0; i < started; i++)
+    {
+        struct worker *w = &daemon->workers[i];
+        pthread_mutex_lock(&w->queue.lock);
+        pthread_cond_broadcast(&w->queue.ready);
+        pthread_mutex_unlock(&w->queue.lock);
+        pthread_join(w->thread, NULL);
+    }
+    for (unsigned i = 0; i <= daemon->worker_count; i++)
+    {
+        struct job_queue *q = (i < daemon->worker_count) ? &daemon->workers[i].queue : &daemon->done;
+        struct job *job = queue_take_all(q);
+        while (job != NULL)
+        {
+            struct job *next = job->next;
+            drop_job(daemon, job);
+            job = next;
+        }
+    }
+    while (daemon->connections != NULL)
+    {
+        close_connection(daemon, daemon->connections);
+    }
+    while (daemon->freed != NULL)
+    {
+        struct connection *next = daemon->freed->next;
+        free_connection(daemon->freed);
+        daemon->freed = next;
+    }
+    return result;
+}
+
+/**
+ * @brief Makes pf_daemon_run return. Safe from any thread and from signal handlers.
+ */
+void pf_daemon_stop(pf_daemon *daemon)
+{
+    __atomic_store_n(&daemon->stopping, 1, __ATOMIC_RELEASE);
+    wake(daemon);
+}
+
+/**
+ * @brief Closes the socket (removing its file) and frees the daemon; not while
+ * pf_daemon_run is running.
+ */
+void pf_daemon_destroy(pf_daemon *daemon)
+{
+    if (daemon->listen_fd >= 0)
+    {
+        close(daemon->listen_fd);
+        unlink(daemon->path);
+    }
+    if (daemon->epoll_fd >= 0)
+    {
+        close(daemon->epoll_fd);
+    }
+    if (daemon->wake_fd >= 0)
+    {
+        close(daemon->wake_fd);
+    }
+    if (daemon->workers != NULL)
+    {
+        for (unsigned i = 0; i < daemon->worker_count; i++)
+        {
+            if (daemon->workers[i].daemon != NULL)
+            {
+                queue_destroy(&daemon->workers[i].queue);
+            }
+            free(daemon->workers[i].analyzers);
+        }
+        free(daemon->workers);
+        queue_destroy(&daemon->done);
+    }
+    free(daemon);
+}
+
+void pf_daemon_get_stats(const pf_daemon *daemon, struct pf_daemon_stats *stats)
+{
+    stats->connections = __atomic_load_n(&daemon->stats.connections, __ATOMIC_RELAXED);
+    stats->requests = __atomic_load_n(&daemon->stats.requests, __ATOMIC_RELAXED);
+    stats->frames = __atomic_load_n(&daemon->stats.frames, __ATOMIC_RELAXED);
+    stats->errors = __atomic_load_n(&daemon->stats.errors, __ATOMIC_RELAXED);
+}
+
+#else /* !__linux__ */
+
+pf_daemon *pf_daemon_create(const struct pf_daemon_options *options, int *error)
+{
+    (void)options;
+    if (error != NULL)
+    {
+        *error = PF_DAEMON_ERR_UNSUPPORTED;
+    }
+    return NULL;
+}
+
+int pf_daemon_run(pf_daemon *daemon)
+{
+    (void)daemon;
+    return PF_DAEMON_ERR_UNSUPPORTED;
+}
+
+void pf_daemon_stop(pf_daemon *daemon)
+{
+    (void)daemon;
+}
+
+void pf_daemon_destroy(pf_daemon *daemon)
+{
+    (void)daemon;
+}
+
+void pf_daemon_get_stats(const pf_daemon *daemon, struct pf_daemon_stats *stats)
+{
+    (void)daemon;
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif /* __linux__ */
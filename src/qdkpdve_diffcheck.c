@@ -0,0 +1,492 @@
+//
+//  qdkpdve_diffcheck.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_diffcheck.c
+ * @brief Runs alternative engines against the reference analysis (see qdkpdve_diffcheck.h).
+ *
+ * Workers take blocks of units (a chroma, a KPDVE, a stream) from a shared counter. A
+ * worker that finds a divergence records it if it is the lowest so far; units whose cases
+ * all lie above the lowest recorded divergence are skipped. Units are handed out in
+ * increasing order, so every unit below the reported divergence has been checked.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_diffcheck.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_tables.h"
+#include "../include/qdkpdve_naming.h"
+
+#define EXHAUSTIVE_UNITS 4096
+#define ROUNDTRIP_UNITS (12 * 7 * 7 * 7 * 7)
+#define CONTEXTS (12 * 7 * 7)
+#define MAX_THREADS 256
+
+//////////////////////////////////// built-in engines
+
+static void tables_set_kp_list(harmony_state *a_state)
+{
+    set_kp_list_from_tables(kpdve_tables_default(), a_state);
+}
+
+static void tables_set_min_index(harmony_state *current_state, int context)
+{
+    set_min_index_from_tables(kpdve_tables_default(), current_state, context);
+}
+
+static const kpdve_engine engines[] = {
+    { "tables", tables_set_kp_list, tables_set_min_index },
+};
+
+/**
+ * @brief The alternative engines built into the library.
+ *
+ * @param count Receives the number of engines.
+ * @return The engines.
+ */
+const kpdve_engine *kpdve_diffcheck_engines(int *count)
+{
+    *count = (int)(sizeof(engines) / sizeof(engines[0]));
+    return engines;
+}
+
+void kpdve_diffcheck_default_options(struct kpdve_diffcheck_options *options)
+{
+    options->threads = 0;
+    options->stream_count = 64;
+    options->stream_length = 4096;
+    options->seed = 1;
+}
+
+//////////////////////////////////// the shared run
+
+struct run {
+    const kpdve_engine *engine;
+    const struct kpdve_diffcheck_options *options;
+    int suite;
+    long units;
+    long cases_per_unit;
+    int block;                         // units taken at a time
+
+    pthread_mutex_t lock;
+    long next_unit;
+    long cases;
+    struct kpdve_diffcheck_result first; // lowest divergence so far (first.diverged == 0: none)
+};
+
+// a worker's own divergence, before it is merged
+typedef struct kpdve_diffcheck_result divergence;
+
+static void record(struct run *run, const divergence *found)
+{
+    pthread_mutex_lock(&run->lock);
+    if (!run->first.diverged || found->case_index < run->first.case_index)
+    {
+        run->first = *found;
+    }
+    pthread_mutex_unlock(&run->lock);
+}
+
+// the next block of units, or 0 when there is nothing left worth checking
+static int take(struct run *run, long *begin, long *end)
+{
+    pthread_mutex_lock(&run->lock);
+    long limit = run->units;
+    if (run->first.diverged)
+    {
+        long unit_of_first = run->first.case_index / run->cases_per_unit;
+        limit = (unit_of_first < limit) ? unit_of_first : limit;
+    }
+    *begin = run->next_unit;
+    *end = (*begin + run->block < limit) ? *begin + run->block : limit;
+    if (*end > *begin)
+    {
+        run->next_unit = *end;
+    }
+    pthread_mutex_unlock(&run->lock);
+    return *end > *begin;
+}
+
+static int encode(int k, int p, int d, int v, int e)
+{
+    int kpdve[] = { k, p, d, v, e };
+    return KPDVEtoBinaryEncoding(kpdve);
+}
+
+static int differs(divergence *div, const char *field, int index, int expected, int actual)
+{
+    if (expected == actual)
+    {
+        return 0;
+    }
+    div->diverged = 1;
+    div->field = field;
+    div->field_index = index;
+    div->expected = expected;
+    div->actual = actual;
+    return 1;
+}
+
+static int lists_differ(divergence *div, const harmony_state *ref, const harmony_state *eng)
+{
+    if (differs(div, "kpdve_list_length", -1, ref->kpdve_list_length, eng->kpdve_list_length))
+    {
+        return 1;
+    }
+    for (int i = 0; i < ref->kpdve_list_length; i++)
+    {
+        if (differs(div, "kpdve_list", i, ref->kpdve_list[i], eng->kpdve_list[i])
+            || differs(div, "dve_list", i, ref->dve_list[i], eng->dve_list[i])
+            || differs(div, "ve_list", i, ref->ve_list[i], eng->ve_list[i]))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int choices_differ(divergence *div, const harmony_state *ref, const harmony_state *eng)
+{
+    return differs(div, "kpdve_min_index", -1, ref->kpdve_min_index, eng->kpdve_min_index)
+        || differs(div, "kpdve", -1, ref->kpdve, eng->kpdve)
+        || differs(div, "dve", -1, ref->dve, eng->dve)
+        || differs(div, "ve", -1, ref->ve, eng->ve)
+        || differs(div, "encoded_state", -1, ref->encoded_state, eng->encoded_state);
+}
+
+//////////////////////////////////// suites: each checks one unit, returns 1 and fills div on divergence
+
+// one chroma against every K, P, D context
+static int check_exhaustive(const kpdve_engine *engine, long unit, const struct kpdve_diffcheck_options *options, divergence *div)
+{
+    (void)options;
+    harmony_state ref, eng;
+    int chroma = (int)unit;
+
+    div->chroma = chroma;
+    div->case_index = unit * CONTEXTS;
+    div->context = -1;
+
+    ref.chromatic_notes = chroma;
+    eng.chromatic_notes = chroma;
+    set_kp_list(&ref);
+    engine->set_kp_list(&eng);
+    if (lists_differ(div, &ref, &eng))
+    {
+        return 1;
+    }
+
+    for (int c = 0; c < CONTEXTS; c++)
+    {
+        int context = encode(c / 49, (c / 7) % 7, c % 7, 0, 0);
+        set_min_index(&ref, context);
+        engine->set_min_index(&eng, context);
+        if (differs(div, "kpdve_min_index", -1, ref.kpdve_min_index, eng.kpdve_min_index))
+        {
+            div->case_index = unit * CONTEXTS + c;
+            div->context = context;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// one KPDVE through harmony_state_from_kpdve
+static int check_roundtrip(const kpdve_engine *engine, long unit, const struct kpdve_diffcheck_options *options, divergence *div)
+{
+    (void)options;
+    int v = (int)unit;
+    int kpdve = encode(v / 2401, (v / 343) % 7, (v / 49) % 7, (v / 7) % 7, v % 7);
+
+    div->case_index = unit;
+    div->kpdve = kpdve;
+
+    harmony_state ref = harmony_state_from_kpdve(kpdve);
+
+    // harmony_state_from_kpdve, with the engine's list and choice
+    harmony_state eng;
+    eng.kpdve = kpdve;
+    eng.chromatic_notes = circle_to_chroma(kpdve_chord_val(kpdve));
+    engine->set_kp_list(&eng);
+    engine->set_min_index(&eng, eng.kpdve);
+    eng.dve = eng.dve_list[eng.kpdve_min_index];
+    eng.ve = eng.ve_list[eng.kpdve_min_index];
+    eng.encoded_state = kpdve_chromatic_byte(eng.kpdve, eng.chromatic_notes);
+
+    div->chroma = ref.chromatic_notes;
+    return differs(div, "chromatic_notes", -1, ref.chromatic_notes, eng.chromatic_notes)
+        || lists_differ(div, &ref, &eng)
+        || choices_differ(div, &ref, &eng);
+}
+
+static uint32_t next_random(uint32_t *x)
+{
+    // xorshift32
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+static int random_chroma(uint32_t *x, int previous)
+{
+    uint32_t r = next_random(x);
+    switch (r & 3)
+    {
+    case 0: // three random notes (some may coincide)
+        return (1 << ((r >> 2) % 12)) | (1 << ((r >> 6) % 12)) | (1 << ((r >> 10) % 12));
+    case 1: // anything at all, most of it invalid
+        return (int)((r >> 2) & 0xFFF);
+    case 2: // a chord the system can name
+        return circle_to_chroma(kpdve_chord_val(encode((int)((r >> 2) % 12), (int)((r >> 6) % 7),
+                                                       (int)((r >> 9) % 7), (int)((r >> 12) % 7), (int)((r >> 15) % 7))));
+    default: // the previous chroma with one note changed
+        return previous ^ (1 << ((r >> 2) % 12));
+    }
+}
+
+// one random stream, as a caller feeding adjust_harmony_state_from_chroma_and_context would
+static int check_stream(const kpdve_engine *engine, long unit, const struct kpdve_diffcheck_options *options, divergence *div)
+{
+    uint32_t x = (options->seed + (uint32_t)unit) * 2654435761u;
+    x = x ? x : 1;
+
+    harmony_state ref = harmony_state_default();
+    harmony_state eng = ref;
+    int chroma = ref.chromatic_notes;
+
+    for (int f = 0; f < options->stream_length; f++)
+    {
+        chroma = random_chroma(&x, chroma);
+        // mostly the previous analysis; now and then any 16-bit value
+        int context = (next_random(&x) & 63) ? ref.kpdve : (int)(next_random(&x) & 0xFFFF);
+
+        adjust_harmony_state_from_chroma_and_context(&ref, chroma, context);
+
+        // adjust_harmony_state_from_chroma_and_context, with the engine's list and choice
+        eng.chromatic_notes = chroma & 0xFFF;
+        engine->set_kp_list(&eng);
+        engine->set_min_index(&eng, context);
+        eng.kpdve = eng.kpdve_list[eng.kpdve_min_index];
+        eng.dve = eng.dve_list[eng.kpdve_min_index];
+        eng.ve = eng.ve_list[eng.kpdve_min_index];
+        encode_and_validate_state(&eng);
+
+        if (lists_differ(div, &ref, &eng) || choices_differ(div, &ref, &eng))
+        {
+            div->case_index = unit * options->stream_length + f;
+            div->chroma = chroma & 0xFFF;
+            div->context = context;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+typedef int (*unit_check)(const kpdve_engine *engine, long unit, const struct kpdve_diffcheck_options *options, divergence *div);
+
+static const unit_check suite_checks[] = { check_exhaustive, check_roundtrip, check_stream };
+
+static void *worker(void *arg)
+{
+    struct run *run = arg;
+    unit_check check = suite_checks[run->suite];
+    long begin, end;
+    long cases = 0;
+
+    while (take(run, &begin, &end))
+    {
+        for (long unit = begin; unit < end; unit++)
+        {
+            divergence div = { 0 };
+            div.engine = run->engine->name;
+            div.suite = run->suite;
+            div.field_index = -1;
+            if (check(run->engine, unit, run->options, &div))
+            {
+                cases += div.case_index - unit * run->cases_per_unit + 1;
+                record(run, &div);
+                break; // the rest of this block comes later in case order
+            }
+            cases += run->cases_per_unit;
+        }
+    }
+
+    pthread_mutex_lock(&run->lock);
+    run->cases += cases;
+    pthread_mutex_unlock(&run->lock);
+    return NULL;
+}
+
+static int thread_count(const struct kpdve_diffcheck_options *options)
+{
+    long n = options->threads;
+    if (n <= 0)
+    {
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    return (int)(n < 1 ? 1 : (n > MAX_THREADS ? MAX_THREADS : n));
+}
+
+static int run_suite(struct run *run, int threads)
+{
+    pthread_t ids[MAX_THREADS];
+    int started = 0;
+
+    for (; started < threads - 1; started++)
+    {
+        if (pthread_create(&ids[started], NULL, worker, run) != 0)
+        {
+            break; // fewer threads is slower, not wrong
+        }
+    }
+    worker(run);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(ids[i], NULL);
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks one engine against the reference: exhaustive, round trips, then streams.
+ *
+ * Stops at the first suite with a divergence.
+ *
+ * @param engine The engine to check.
+ * @param options Threads and stream sizes (NULL for the defaults).
+ * @param result Receives the number of cases checked and the first divergence, if any.
+ * @return 0 if the engine matched the reference everywhere, 1 if it diverged.
+ */
+int kpdve_diffcheck_engine(const kpdve_engine *engine, const struct kpdve_diffcheck_options *options,
+                           struct kpdve_diffcheck_result *result)
+{
+    struct kpdve_diffcheck_options defaults;
+    if (options == NULL)
+    {
+        kpdve_diffcheck_default_options(&defaults);
+        options = &defaults;
+    }
+    int threads = thread_count(options);
+
+    // lets the engine build anything it builds lazily before the threads start
+    harmony_state warm_up = harmony_state_default();
+    engine->set_kp_list(&warm_up);
+    engine->set_min_index(&warm_up, warm_up.kpdve);
+
+    const long units[] = { EXHAUSTIVE_UNITS, ROUNDTRIP_UNITS, options->stream_count };
+    const long cases_per_unit[] = { CONTEXTS, 1, options->stream_length > 0 ? options->stream_length : 1 };
+    const int blocks[] = { 16, 256, 1 };
+
+    struct kpdve_diffcheck_result total = { 0 };
+    total.engine = engine->name;
+
+    for (int suite = KPDVE_DIFF_EXHAUSTIVE; suite <= KPDVE_DIFF_STREAM; suite++)
+    {
+        struct run run = { 0 };
+        run.engine = engine;
+        run.options = options;
+        run.suite = suite;
+        run.units = units[suite];
+        run.cases_per_unit = cases_per_unit[suite];
+        run.block = blocks[suite];
+        pthread_mutex_init(&run.lock, NULL);
+
+        run_suite(&run, threads);
+
+        pthread_mutex_destroy(&run.lock);
+        long cases = total.cases + run.cases;
+        if (run.first.diverged)
+        {
+            total = run.first;
+        }
+        total.cases = cases;
+        if (total.diverged)
+        {
+            break;
+        }
+    }
+
+    *result = total;
+    return total.diverged;
+}
+
+/**
+ * @brief Checks every built-in engine, stopping at the first that diverges.
+ *
+ * @return 0 if all engines matched the reference, 1 if one diverged (described in result).
+ */
+int kpdve_diffcheck_all(const struct kpdve_diffcheck_options *options, struct kpdve_diffcheck_result *result)
+{
+    int count;
+    const kpdve_engine *all = kpdve_diffcheck_engines(&count);
+    long cases = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (kpdve_diffcheck_engine(&all[i], options, result) != 0)
+        {
+            result->cases += cases;
+            return 1;
+        }
+        cases += result->cases;
+    }
+    result->cases = cases;
+    result->engine = count == 1 ? all[0].name : "all";
+    return 0;
+}
+
+static void print_chroma(FILE *out, int chroma)
+{
+    for (int i = 11; i >= 0; i--)
+    {
+        fputc('0' + ((chroma >> i) & 1), out);
+    }
+}
+
+/**
+ * @brief Prints a one-line summary of a result: the case count, or the first divergence.
+ */
+void kpdve_diffcheck_print(FILE *out, const struct kpdve_diffcheck_result *result)
+{
+    static const char *suites[] = { "exhaustive", "round trip", "stream" };
+    char kpdve[17];
+
+    if (!result->diverged)
+    {
+        fprintf(out, "engine %s: %ld cases, identical to the reference\n", result->engine, result->cases);
+        return;
+    }
+
+    fprintf(out, "engine %s diverges from the reference in %s case %ld: ",
+            result->engine, suites[result->suite], result->case_index);
+    if (result->suite == KPDVE_DIFF_ROUNDTRIP)
+    {
+        kpdveStringForKPDVE(result->kpdve, kpdve, sizeof(kpdve));
+        fprintf(out, "kpdve %s", kpdve);
+    }
+    else
+    {
+        fprintf(out, "chroma ");
+        print_chroma(out, result->chroma);
+        if (result->context >= 0)
+        {
+            kpdveStringForKPDVE(result->context, kpdve, sizeof(kpdve));
+            fprintf(out, ", context %s", kpdve);
+        }
+    }
+    if (result->field_index >= 0)
+    {
+        fprintf(out, ": %s[%d]", result->field, result->field_index);
+    }
+    else
+    {
+        fprintf(out, ": %s", result->field);
+    }
+    fprintf(out, " is %d in the reference, %d in the engine\n", result->expected, result->actual);
+}
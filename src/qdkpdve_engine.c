@@ -0,0 +1,192 @@
+//
+//  qdkpdve_engine.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_engine.c
+ * @brief Multi-session analysis over parallel arrays (see qdkpdve_engine.h).
+ *
+ * A tick makes three sequential passes over the batch: note which sessions it touches
+ * (and their state before the tick), analyze every update in order, then list the
+ * touched sessions whose state changed. Only the per-session words an update names are
+ * read or written; the analysis itself reads the shared tables.
+ */
+
+#include <stdlib.h>
+
+#include "../include/qdkpdve_engine.h"
+#include "../include/qdkpdve_statemaker.h"
+
+/**
+ * @brief Makes an engine with all sessions in the default state (F major, as harmony_state_default).
+ *
+ * @param sessions Number of sessions.
+ * @param tables The tables to analyze with; NULL for kpdve_tables_default().
+ * @return The engine, or NULL if memory could not be allocated.
+ */
+pf_engine *pf_engine_create(size_t sessions, const kpdve_tables *tables)
+{
+    pf_engine *engine = calloc(1, sizeof(pf_engine));
+    if (engine == NULL)
+    {
+        return NULL;
+    }
+    engine->sessions = sessions;
+    engine->tables = tables ? tables : kpdve_tables_default();
+
+    harmony_state start = harmony_state_default();
+    engine->default_kpdve = start.kpdve;
+    engine->default_chroma = start.chromatic_notes;
+
+    size_t n = sessions ? sessions : 1;
+    engine->context = malloc(n * sizeof(int));
+    engine->kpdve = malloc(n * sizeof(int));
+    engine->encoded = malloc(n * sizeof(int));
+    engine->chroma = malloc(n * sizeof(uint16_t));
+    engine->flags = malloc(n);
+    engine->tick_start = malloc(n * sizeof(int));
+    engine->touched = calloc(n, 1);
+
+    if (!engine->context || !engine->kpdve || !engine->encoded || !engine->chroma
+        || !engine->flags || !engine->tick_start || !engine->touched)
+    {
+        pf_engine_destroy(engine);
+        return NULL;
+    }
+    for (size_t s = 0; s < sessions; s++)
+    {
+        pf_engine_reset_session(engine, (uint32_t)s);
+    }
+    return engine;
+}
+
+void pf_engine_destroy(pf_engine *engine)
+{
+    if (engine == NULL)
+    {
+        return;
+    }
+    free(engine->context);
+    free(engine->kpdve);
+    free(engine->encoded);
+    free(engine->chroma);
+    free(engine->flags);
+    free(engine->tick_start);
+    free(engine->touched);
+    free(engine);
+}
+
+/**
+ * @brief Puts a session back in the default state.
+ */
+void pf_engine_reset_session(pf_engine *engine, uint32_t session)
+{
+    if (session >= engine->sessions)
+    {
+        return;
+    }
+    engine->context[session] = engine->default_kpdve;
+    engine->kpdve[session] = engine->default_kpdve;
+    engine->chroma[session] = (uint16_t)engine->default_chroma;
+    engine->encoded[session] = kpdve_chromatic_byte(engine->default_kpdve, engine->default_chroma);
+    engine->flags[session] = 0;
+}
+
+/**
+ * @brief Sets the context for a session's next frame (e.g. from another session or an anchor).
+ *
+ * @return 0, or -1 if the session does not exist or the context is not a KPDVE (K above 11).
+ */
+int pf_engine_set_context(pf_engine *engine, uint32_t session, int context)
+{
+    if (session >= engine->sessions || (unsigned int)context >= (12u << 12))
+    {
+        return -1;
+    }
+    engine->context[session] = context;
+    return 0;
+}
+
+/**
+ * @brief Analyzes a batch of updates and reports the sessions that changed.
+ *
+ * @param engine The engine.
+ * @param updates The updates, applied in order.
+ * @param count Number of updates.
+ * @param changes Receives one entry per changed session (room for count entries), in
+ *                the order of each session's first update.
+ * @return The number of changes, or -1 (and nothing applied) if an update names a
+ *         session that does not exist.
+ */
+long pf_engine_tick(pf_engine *engine, const struct pf_update *updates, size_t count, struct pf_change *changes)
+{
+    const kpdve_tables *tables = engine->tables;
+
+    // pass 1: check and mark the sessions, keeping the state each one started the tick in
+    for (size_t i = 0; i < count; i++)
+    {
+        if (updates[i].session >= engine->sessions)
+        {
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t s = updates[i].session;
+        if (!engine->touched[s])
+        {
+            engine->touched[s] = 1;
+            engine->tick_start[s] = engine->encoded[s];
+        }
+    }
+
+    // pass 2: analyze, in batch order, so repeated sessions chain their contexts
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t s = updates[i].session;
+        int chroma = updates[i].chroma & 0xFFF;
+        int index = (chroma != 0) ? kpdve_tables_choose(tables, chroma, engine->context[s]) : -1;
+
+        if (index >= 0)
+        {
+            int kpdve = KPDVE_CANDIDATE_KPDVE(tables->candidates[tables->offsets[chroma] + index]);
+            engine->kpdve[s] = kpdve;
+            engine->context[s] = kpdve;
+            engine->encoded[s] = kpdve_chromatic_byte(kpdve, chroma);
+            engine->flags[s] = 0;
+        }
+        else if (chroma == 0)
+        {
+            // silence: nothing to analyze, nothing wrong
+            engine->encoded[s] = kpdve_chromatic_byte(engine->kpdve[s], 0);
+            engine->flags[s] = 0;
+        }
+        else
+        {
+            engine->encoded[s] = (int)((unsigned int)kpdve_chromatic_byte(engine->kpdve[s], chroma) | 0x80000000u);
+            engine->flags[s] = PF_SESSION_INVALID;
+        }
+        engine->chroma[s] = (uint16_t)chroma;
+    }
+
+    // pass 3: report each touched session once
+    long changed = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t s = updates[i].session;
+        if (!engine->touched[s])
+        {
+            continue;
+        }
+        engine->touched[s] = 0;
+        if (engine->encoded[s] != engine->tick_start[s])
+        {
+            changes[changed].session = s;
+            changes[changed].previous = engine->tick_start[s];
+            changes[changed].encoded = engine->encoded[s];
+            changed++;
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,356 @@
+//
+//  qdkpdve_format.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_format.c
+ * @brief Bulk text/CSV/JSONL rendering of encoded_state arrays (see qdkpdve_format.h).
+ *
+ * The part of a line that depends only on the KPDVE (the names) is rendered once and
+ * reused for as long as the KPDVE stays the same, which in analyzed audio is most frames.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_format.h"
+#include "../include/qdkpdve_naming.h"
+#include "../include/qdkpdve_nametable.h"
+
+#define MAX_LINE 512       // longest possible line of any format
+#define NAMES_MAX 256      // longest names segment
+#define FD_SLICE 16384     // frames rendered per write in kpdve_format_to_fd
+#define MAX_IOV 64
+
+/**
+ * @brief Makes room for at least extra more bytes.
+ *
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int kpdve_textbuf_reserve(kpdve_textbuf *buf, size_t extra)
+{
+    if (buf->cap - buf->len >= extra)
+    {
+        return 0;
+    }
+    size_t cap = buf->cap ? buf->cap : 4096;
+    while (cap - buf->len < extra)
+    {
+        cap *= 2;
+    }
+    char *data = realloc(buf->data, cap);
+    if (data == NULL)
+    {
+        return -1;
+    }
+    buf->data = data;
+    buf->cap = cap;
+    return 0;
+}
+
+void kpdve_textbuf_clear(kpdve_textbuf *buf)
+{
+    buf->len = 0;
+}
+
+void kpdve_textbuf_free(kpdve_textbuf *buf)
+{
+    free(buf->data);
+    buf->data = NULL;
+    buf->len = 0;
+    buf->cap = 0;
+}
+
+/**
+ * @brief Writes several buffers to a file descriptor with as few writev calls as possible.
+ *
+ * Handles partial writes and EINTR.
+ *
+ * @return 0 on success, -1 on error (errno is set).
+ */
+int kpdve_textbuf_writev(int fd, const kpdve_textbuf *bufs, int count)
+{
+    struct iovec iov[MAX_IOV];
+    int first = 0;
+    size_t skip = 0; // bytes of bufs[first] already written
+
+    while (first < count)
+    {
+        int n = 0;
+        for (int i = first; i < count && n < MAX_IOV; i++)
+        {
+            size_t offset = (i == first) ? skip : 0;
+            if (bufs[i].len > offset)
+            {
+                iov[n].iov_base = bufs[i].data + offset;
+                iov[n].iov_len = bufs[i].len - offset;
+                n++;
+            }
+        }
+        if (n == 0)
+        {
+            return 0;
+        }
+
+        ssize_t written = writev(fd, iov, n);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        // advance past what was written
+        size_t left = (size_t)written;
+        while (first < count && left >= bufs[first].len - skip)
+        {
+            left -= bufs[first].len - skip;
+            skip = 0;
+            first++;
+        }
+        skip += left;
+    }
+    return 0;
+}
+
+//////////////////////////////////// appending
+
+static char *put_str(char *p, const char *s, size_t len)
+{
+    memcpy(p, s, len);
+    return p + len;
+}
+
+static char *put_uint(char *p, size_t value)
+{
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (n > 0)
+    {
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+// right-aligned in a field of width characters (as printf's %*s / %*zu)
+static char *put_padded(char *p, const char *s, size_t len, size_t width)
+{
+    for (size_t i = len; i < width; i++)
+    {
+        *p++ = ' ';
+    }
+    return put_str(p, s, len);
+}
+
+static char *put_bits(char *p, unsigned int value, int bits)
+{
+    for (int i = bits - 1; i >= 0; i--)
+    {
+        *p++ = (char)('0' + ((value >> i) & 1));
+    }
+    return p;
+}
+
+// length of a name without the trailing spaces the naming arrays use for alignment
+static size_t trimmed_len(const char *s)
+{
+    size_t len = strlen(s);
+    while (len > 0 && s[len - 1] == ' ')
+    {
+        len--;
+    }
+    return len;
+}
+
+//////////////////////////////////// names segment (depends only on the KPDVE)
+
+static size_t render_names(char *out, int format, int kpdve)
+{
+    const char *names[7] = {
+        kpdve_name_tonic(kpdve), kpdve_name_scale(kpdve), kpdve_name_distortion(kpdve),
+        kpdve_name_mode(kpdve), kpdve_name_degree(kpdve), kpdve_name_root(kpdve),
+        kpdve_name_chord(kpdve)
+    };
+    static const char *json_keys[7] = {
+        "\",\"tonic\":\"", "\",\"scale\":\"", "\",\"distortion\":\"", "\",\"mode\":\"",
+        "\",\"degree\":\"", "\",\"root\":\"", "\",\"chord\":\""
+    };
+    // the column widths of printAnalysisSummary in the test program
+    static const size_t text_widths[7] = { 3, 18, 3, 14, 4, 3, 25 };
+    static const char *text_after[7] = { "", " ", "", " ", " ", " ", "" };
+
+    char *p = out;
+    for (int i = 0; i < 7; i++)
+    {
+        switch (format)
+        {
+        case KPDVE_FORMAT_CSV:
+            *p++ = ',';
+            p = put_str(p, names[i], trimmed_len(names[i]));
+            break;
+        case KPDVE_FORMAT_JSONL:
+            p = put_str(p, json_keys[i], strlen(json_keys[i]));
+            p = put_str(p, names[i], trimmed_len(names[i]));
+            break;
+        default:
+            p = put_padded(p, names[i], strlen(names[i]), text_widths[i]);
+            p = put_str(p, text_after[i], strlen(text_after[i]));
+            break;
+        }
+    }
+    if (format == KPDVE_FORMAT_JSONL)
+    {
+        p = put_str(p, "\"}", 2);
+    }
+    *p++ = '\n';
+    return (size_t)(p - out);
+}
+
+/**
+ * @brief Appends the header line of a format (CSV only; the others have none).
+ *
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int kpdve_format_header(kpdve_textbuf *buf, int format)
+{
+    static const char csv_header[] = "frame,state,invalid,k,p,d,v,e,chroma,tonic,scale,distortion,mode,degree,root,chord\n";
+    if (format != KPDVE_FORMAT_CSV)
+    {
+        return 0;
+    }
+    if (kpdve_textbuf_reserve(buf, sizeof(csv_header)) != 0)
+    {
+        return -1;
+    }
+    memcpy(buf->data + buf->len, csv_header, sizeof(csv_header) - 1);
+    buf->len += sizeof(csv_header) - 1;
+    return 0;
+}
+
+/**
+ * @brief Appends one line per encoded state to the buffer.
+ *
+ * @param buf The buffer to append to.
+ * @param format KPDVE_FORMAT_TEXT, KPDVE_FORMAT_CSV or KPDVE_FORMAT_JSONL.
+ * @param states The encoded states.
+ * @param count Number of states.
+ * @param first_frame Frame index printed for states[0].
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int kpdve_format_states(kpdve_textbuf *buf, int format, const int *states, size_t count, size_t first_frame)
+{
+    char names[NAMES_MAX];
+    size_t names_len = 0;
+    int names_kpdve = -1;
+
+    kpdve_name_table_init();
+
+    if (kpdve_textbuf_reserve(buf, count < 1024 ? count * MAX_LINE : 1024 * MAX_LINE) != 0)
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (kpdve_textbuf_reserve(buf, MAX_LINE) != 0)
+        {
+            return -1;
+        }
+
+        unsigned int s = (unsigned int)states[i];
+        int kpdve = (int)((s >> 12) & 0xFFFF);
+        int invalid = (s >> 31) != 0;
+        char *p = buf->data + buf->len;
+
+        if (kpdve != names_kpdve)
+        {
+            names_len = render_names(names, format, kpdve);
+            names_kpdve = kpdve;
+        }
+
+        switch (format)
+        {
+        case KPDVE_FORMAT_CSV:
+        case KPDVE_FORMAT_JSONL:
+        {
+            int json = (format == KPDVE_FORMAT_JSONL);
+            static const char *json_keys[] = { ",\"invalid\":", ",\"k\":", ",\"p\":", ",\"d\":", ",\"v\":", ",\"e\":" };
+
+            p = json ? put_str(p, "{\"frame\":", 9) : p;
+            p = put_uint(p, first_frame + i);
+            p = json ? put_str(p, ",\"state\":", 9) : put_str(p, ",", 1);
+            p = put_uint(p, s);
+            p = json ? put_str(p, json_keys[0], strlen(json_keys[0])) : put_str(p, ",", 1);
+            p = json ? put_str(p, invalid ? "true" : "false", invalid ? 4 : 5) : put_uint(p, (size_t)invalid);
+            for (int f = 0; f < 5; f++)
+            {
+                int value = (kpdve >> (12 - 3 * f)) & (f == 0 ? 0xF : 0x7);
+                p = json ? put_str(p, json_keys[f + 1], strlen(json_keys[f + 1])) : put_str(p, ",", 1);
+                p = put_uint(p, (size_t)value);
+            }
+            p = json ? put_str(p, ",\"chroma\":\"", 11) : put_str(p, ",", 1);
+            p = put_bits(p, s & 0xFFF, 12);
+            break;
+        }
+        default:
+        {
+            char frame_digits[24];
+            size_t frame_len = (size_t)(put_uint(frame_digits, first_frame + i) - frame_digits);
+            p = put_padded(p, frame_digits, frame_len, 10);
+            *p++ = ' ';
+            p += kpdveStringForKPDVE(kpdve, p, 32);
+            *p++ = ' ';
+            p = put_bits(p, s, 32);
+            *p++ = ' ';
+            break;
+        }
+        }
+
+        // the JSON names segment opens with the closing quote of "chroma"
+        p = put_str(p, names, names_len);
+        buf->len = (size_t)(p - buf->data);
+    }
+    return 0;
+}
+
+/**
+ * @brief Renders states (with the format's header) straight to a file descriptor.
+ *
+ * Renders FD_SLICE frames at a time into one reused buffer and writes each slice as it is
+ * done, so memory stays bounded for corpus-sized inputs.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int kpdve_format_to_fd(int fd, int format, const int *states, size_t count)
+{
+    kpdve_textbuf buf = { NULL, 0, 0 };
+    int err = kpdve_format_header(&buf, format);
+
+    for (size_t first = 0; err == 0 && first < count; first += FD_SLICE)
+    {
+        size_t n = (count - first < FD_SLICE) ? count - first : FD_SLICE;
+        err = kpdve_format_states(&buf, format, states + first, n, first);
+        if (err == 0)
+        {
+            err = kpdve_textbuf_writev(fd, &buf, 1);
+        }
+        kpdve_textbuf_clear(&buf);
+    }
+    if (err == 0 && count == 0)
+    {
+        err = kpdve_textbuf_writev(fd, &buf, 1);
+    }
+
+    kpdve_textbuf_free(&buf);
+    return err;
+}
@@ -0,0 +1,31 @@
+//
+//  qdkpdve_init.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_init.c
+ * @brief One-time initialization of the shared tables (see qdkpdve_init.h).
+ */
+
+#include "../include/qdkpdve_init.h"
+#include "../include/qdkpdve_nametable.h"
+#include "../include/qdkpdve_tables.h"
+
+/**
+ * @brief Builds every shared table that is not built yet. Thread-safe; cheap once done.
+ */
+void pitchflock_init(void)
+{
+    kpdve_tables_init();
+    kpdve_name_table_init();
+}
+
+int pitchflock_tables_prebuilt(void)
+{
+#ifdef PITCHFLOCK_PREBUILT_TABLES
+    return 1;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,168 @@
+//
+//  qdkpdve_latency.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_latency.c
+ * @brief Latency histogram recording and percentiles (see qdkpdve_latency.h).
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "../include/qdkpdve_latency.h"
+#include "../include/qdkpdve_statemaker.h"
+
+// index of the highest set bit (value > 0)
+static int highest_bit(uint64_t value)
+{
+    return 63 - __builtin_clzll(value);
+}
+
+static int bucket_for(uint64_t ns)
+{
+    if (ns < KPDVE_LATENCY_SUB_BUCKETS)
+    {
+        return (int)ns;
+    }
+    int exponent = highest_bit(ns); // 5..63
+    int sub = (int)((ns >> (exponent - 5)) & (KPDVE_LATENCY_SUB_BUCKETS - 1));
+    return (exponent - 4) * KPDVE_LATENCY_SUB_BUCKETS + sub;
+}
+
+// the highest value that lands in a bucket
+static uint64_t bucket_top(int bucket)
+{
+    if (bucket < KPDVE_LATENCY_SUB_BUCKETS)
+    {
+        return (uint64_t)bucket;
+    }
+    int exponent = bucket / KPDVE_LATENCY_SUB_BUCKETS + 4;
+    uint64_t sub = (uint64_t)(bucket % KPDVE_LATENCY_SUB_BUCKETS);
+    uint64_t width = (uint64_t)1 << (exponent - 5);
+    return ((KPDVE_LATENCY_SUB_BUCKETS + sub) << (exponent - 5)) + (width - 1);
+}
+
+void kpdve_latency_init(kpdve_latency_histogram *histogram)
+{
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+uint64_t kpdve_latency_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Adds one sample. Safe to call while another thread reads the histogram.
+ *
+ * @param histogram The histogram.
+ * @param ns The latency in nanoseconds.
+ */
+void kpdve_latency_record(kpdve_latency_histogram *histogram, uint64_t ns)
+{
+    __atomic_fetch_add(&histogram->buckets[bucket_for(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->total_ns, ns, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&histogram->max_ns, __ATOMIC_RELAXED);
+    while (ns > max
+           && !__atomic_compare_exchange_n(&histogram->max_ns, &max, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        // max now holds the value that beat us; try again if ours is still larger
+    }
+}
+
+/**
+ * @brief Copies the histogram, and with reset, empties it in the same pass.
+ *
+ * Each bucket is read (or swapped with zero) atomically, so with reset every sample is
+ * in exactly one copy even while the recording thread goes on. copy->count is the total
+ * of the copied buckets.
+ *
+ * @param histogram The live histogram.
+ * @param copy Receives the copy (may not be the live histogram).
+ * @param reset Nonzero to reset the live histogram.
+ */
+void kpdve_latency_read(kpdve_latency_histogram *histogram, kpdve_latency_histogram *copy, int reset)
+{
+    uint64_t count = 0;
+    for (int i = 0; i < KPDVE_LATENCY_BUCKETS; i++)
+    {
+        copy->buckets[i] = reset ? __atomic_exchange_n(&histogram->buckets[i], 0, __ATOMIC_RELAXED)
+                                 : __atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED);
+        count += copy->buckets[i];
+    }
+    copy->total_ns = reset ? __atomic_exchange_n(&histogram->total_ns, 0, __ATOMIC_RELAXED)
+                           : __atomic_load_n(&histogram->total_ns, __ATOMIC_RELAXED);
+    copy->max_ns = reset ? __atomic_exchange_n(&histogram->max_ns, 0, __ATOMIC_RELAXED)
+                         : __atomic_load_n(&histogram->max_ns, __ATOMIC_RELAXED);
+    copy->count = count;
+}
+
+/**
+ * @brief The latency below which a given share of the samples of a copy fall.
+ *
+ * @param copy A copy made by kpdve_latency_read.
+ * @param percentile 0..100 (e.g. 99.9).
+ * @return The top of the bucket holding that sample, capped at the maximum; 0 if empty.
+ */
+uint64_t kpdve_latency_percentile(const kpdve_latency_histogram *copy, double percentile)
+{
+    if (copy->count == 0)
+    {
+        return 0;
+    }
+    // the rank of the sample, counting from 1
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)copy->count + 0.5);
+    rank = rank < 1 ? 1 : (rank > copy->count ? copy->count : rank);
+
+    uint64_t seen = 0;
+    for (int i = 0; i < KPDVE_LATENCY_BUCKETS; i++)
+    {
+        seen += copy->buckets[i];
+        if (seen >= rank)
+        {
+            uint64_t top = bucket_top(i);
+            return (copy->max_ns > 0 && top > copy->max_ns) ? copy->max_ns : top;
+        }
+    }
+    return copy->max_ns;
+}
+
+/**
+ * @brief p50, p99, p99.9, maximum and mean of the histogram, optionally resetting it.
+ */
+void kpdve_latency_summarize(kpdve_latency_histogram *histogram, struct kpdve_latency_summary *summary, int reset)
+{
+    kpdve_latency_histogram copy;
+    kpdve_latency_read(histogram, &copy, reset);
+
+    summary->count = copy.count;
+    summary->mean_ns = copy.count ? (double)copy.total_ns / (double)copy.count : 0.0;
+    summary->p50_ns = kpdve_latency_percentile(&copy, 50.0);
+    summary->p99_ns = kpdve_latency_percentile(&copy, 99.0);
+    summary->p999_ns = kpdve_latency_percentile(&copy, 99.9);
+    summary->max_ns = copy.max_ns;
+}
+
+/**
+ * @brief Adjusts a harmony state based on chroma AND context, recording how long it took.
+ *
+ * Same as adjust_harmony_state_from_chroma_and_context, plus two clock reads and one
+ * histogram sample.
+ *
+ * @param a_state Pointer to the harmony state to adjust.
+ * @param chroma_val The chroma value to analyze (12-bit integer).
+ * @param context The context KPDVE value to guide the adjustment.
+ * @param histogram Receives the latency of the call.
+ */
+void adjust_harmony_state_from_chroma_and_context_timed(harmony_state *a_state, int chroma_val, int context,
+                                                        kpdve_latency_histogram *histogram)
+{
+    uint64_t start = kpdve_latency_now_ns();
+    adjust_harmony_state_from_chroma_and_context(a_state, chroma_val, context);
+    kpdve_latency_record(histogram, kpdve_latency_now_ns() - start);
+}
@@ -0,0 +1,244 @@
+//
+//  qdkpdve_nametable.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_nametable.c
+ * @brief Builds the KPDVE name table from the reference naming functions.
+ *
+ * Each label depends on only a few of the five parameters, so the builder calls the
+ * reference functions once per distinct combination rather than once per entry:
+ * tonic (K, P), root (K, P, D), degree (P, D), scale and distortion (P), mode (D).
+ * The chord notes for E are the first E + 1 notes of the chord at E = 6, so each
+ * K, P, D, V combination is named once and stored as its seven prefixes.
+ *
+ * The table is built once, under pthread_once, and published with a release store of
+ * the ready flag, which kpdve_name_table and the lookups read with acquire; a lookup
+ * that finds it clear builds the table first. Built with
+ * PITCHFLOCK_PREBUILT_TABLES, the entries and the pool are compiled in instead (from
+ * the file pitchflock_gentables generates) and are ready before main.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "../include/qdkpdve_nametable.h"
+#include "../include/qdkpdve_naming.h"
+#include "../include/qdkpdve.h"
+
+#ifdef PITCHFLOCK_PREBUILT_TABLES
+
+// generated by pitchflock_gentables
+extern const struct kpdve_name_entry kpdve_prebuilt_name_entries[KPDVE_NAME_TABLE_SIZE];
+extern const char kpdve_prebuilt_name_pool[];
+extern const struct kpdve_name_table kpdve_prebuilt_name_table;
+
+static const struct kpdve_name_entry *const entries = kpdve_prebuilt_name_entries;
+static const char *const pool = kpdve_prebuilt_name_pool;
+
+// compiled in: nothing to build
+void kpdve_name_table_init(void)
+{
+}
+
+const struct kpdve_name_table *kpdve_name_table(void)
+{
+    return &kpdve_prebuilt_name_table;
+}
+
+#else
+
+static struct kpdve_name_entry entries[KPDVE_NAME_TABLE_SIZE];
+static char pool[KPDVE_NAME_POOL_SIZE];
+static struct kpdve_name_table table;
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+static int table_ready = 0;
+
+// interning of the short labels: every label is a pointer into one of the naming arrays,
+// so the pointer identifies the string.
+static const char *label_ptrs[128];
+static uint16_t label_offsets[128];
+static int label_count = 0;
+static size_t label_end = 1; // offset 0 is the empty string
+
+static uint16_t intern_label(const char *label)
+{
+    for (int i = 0; i < label_count; i++)
+    {
+        if (label_ptrs[i] == label)
+        {
+            return label_offsets[i];
+        }
+    }
+    size_t len = strlen(label);
+    if (label_count == 128 || label_end + len + 1 > KPDVE_NAME_LABEL_POOL_SIZE)
+    {
+        return 0; // cannot happen with the naming arrays as they are; degrade to ""
+    }
+    uint16_t offset = (uint16_t)label_end;
+    memcpy(pool + label_end, label, len + 1);
+    label_end += len + 1;
+    label_ptrs[label_count] = label;
+    label_offsets[label_count++] = offset;
+    return offset;
+}
+
+static int encode(int k, int p, int d, int v, int e)
+{
+    int kpdve[] = { k, p, d, v, e };
+    return KPDVEtoBinaryEncoding(kpdve);
+}
+
+static void build_table(void)
+{
+    uint16_t scale[7], distortion[7], mode[7], degree[7][7];
+    for (int i = 0; i < 7; i++)
+    {
+        scale[i] = intern_label(scaleNameForKPDVE(encode(0, i, 0, 0, 0)));
+        distortion[i] = intern_label(patternDistortionForKPDVE(encode(0, i, 0, 0, 0)));
+        mode[i] = intern_label(modeNameForKPDVE(encode(0, 0, i, 0, 0)));
+        for (int d = 0; d < 7; d++)
+        {
+            degree[i][d] = intern_label(conventionalDegreeStringForKPDVE(encode(0, i, d, 0, 0)));
+        }
+    }
+
+    size_t chord_end = KPDVE_NAME_LABEL_POOL_SIZE;
+    char notes[32];
+
+    for (int k = 0; k < 12; k++)
+    {
+        for (int p = 0; p < 7; p++)
+        {
+            uint16_t tonic = intern_label(conventionalTonicStringForKPDVE(encode(k, p, 0, 0, 0)));
+            for (int d = 0; d < 7; d++)
+            {
+                uint16_t root = intern_label(rootStringForKPDVE(encode(k, p, d, 0, 0)));
+                for (int v = 0; v < 7; v++)
+                {
+                    // all seven extensions at once; the chord at e is its first e + 1 notes
+                    chordNotesStringForKPDVE(encode(k, p, d, v, 6), notes, sizeof(notes));
+                    size_t note_width = strlen(notes) / 7;
+
+                    for (int e = 0; e < 7; e++)
+                    {
+                        struct kpdve_name_entry *entry = &entries[encode(k, p, d, v, e)];
+                        size_t len = note_width * (size_t)(e + 1);
+
+                        entry->tonic = tonic;
+                        entry->scale = scale[p];
+                        entry->distortion = distortion[p];
+                        entry->mode = mode[d];
+                        entry->degree = degree[p][d];
+                        entry->root = root;
+                        entry->chord = (uint32_t)chord_end;
+
+                        memcpy(pool + chord_end, notes, len);
+                        pool[chord_end + len] = '\0';
+                        chord_end += len + 1;
+                    }
+                }
+            }
+        }
+    }
+
+    table.entries = entries;
+    table.pool = pool;
+    table.pool_size = chord_end;
+    __atomic_store_n(&table_ready, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Builds the name table, once. Safe to call from any number of threads at once;
+ * every caller returns with the table complete.
+ */
+void kpdve_name_table_init(void)
+{
+    pthread_once(&table_once, build_table);
+}
+
+const struct kpdve_name_table *kpdve_name_table(void)
+{
+    return __atomic_load_n(&table_ready, __ATOMIC_ACQUIRE) ? &table : NULL;
+}
+
+#endif /* PITCHFLOCK_PREBUILT_TABLES */
+
+#ifdef PITCHFLOCK_EAGER_INIT
+// build the table when the program loads, before main and any threads
+__attribute__((constructor)) static void name_table_eager_init(void)
+{
+    kpdve_name_table_init();
+}
+#endif
+
+// entries for encodings outside the table (K > 11, or bits above 16) are all zero: "".
+// The first lookup builds the table if nothing has yet, as kpdve_tables_default does.
+static const struct kpdve_name_entry *entry_for(int kpdve)
+{
+    static const struct kpdve_name_entry empty = { 0, 0, 0, 0, 0, 0, 0 };
+#ifndef PITCHFLOCK_PREBUILT_TABLES
+    if (!__atomic_load_n(&table_ready, __ATOMIC_ACQUIRE))
+    {
+        kpdve_name_table_init();
+    }
+#endif
+    return ((unsigned int)kpdve < KPDVE_NAME_TABLE_SIZE) ? &entries[kpdve] : &empty;
+}
+
+/**
+ * @brief Conventional tonic of the pattern (as conventionalTonicStringForKPDVE).
+ */
+const char* kpdve_name_tonic(int kpdve)
+{
+    return pool + entry_for(kpdve)->tonic;
+}
+
+/**
+ * @brief Scale name (as scaleNameForKPDVE).
+ */
+const char* kpdve_name_scale(int kpdve)
+{
+    return pool + entry_for(kpdve)->scale;
+}
+
+/**
+ * @brief Pattern distortion (as patternDistortionForKPDVE).
+ */
+const char* kpdve_name_distortion(int kpdve)
+{
+    return pool + entry_for(kpdve)->distortion;
+}
+
+/**
+ * @brief Mode name (as modeNameForKPDVE).
+ */
+const char* kpdve_name_mode(int kpdve)
+{
+    return pool + entry_for(kpdve)->mode;
+}
+
+/**
+ * @brief Roman numeral of the chord in its pattern (as conventionalDegreeStringForKPDVE).
+ */
+const char* kpdve_name_degree(int kpdve)
+{
+    return pool + entry_for(kpdve)->degree;
+}
+
+/**
+ * @brief Root of the chord (as rootStringForKPDVE).
+ */
+const char* kpdve_name_root(int kpdve)
+{
+    return pool + entry_for(kpdve)->root;
+}
+
+/**
+ * @brief Notes of the chord (as chordNotesStringForKPDVE with a large enough buffer).
+ */
+const char* kpdve_name_chord(int kpdve)
+{
+    return pool + entry_for(kpdve)->chord;
+}
@@ -381,77 +381,84 @@ const char* conventionalDegreeStringForKPDVE(int kpdve)
 }
 
 /**
- * @brief Builds a string of chord notes for a given KPDVE.
- * 
- * @param kpdve The KPDVE value.
+ * @brief Writes the names of the notes at extensions 0...lastExt of a KPDVE location, each followed by a space.
+ *
+ * Keeps track of the length as it goes (no strlen/strcat on the growing buffer), so the cost
+ * is linear in the output. If the buffer is too small the string ends in (as much as fits of) "...".
+ *
+ * @param noteLoc The K, P, D and V values to use (the E value is ignored).
+ * @param lastExt The last extension to name.
  * @param stringBuf The buffer to store the resulting string.
  * @param bufSize The size of the provided buffer.
+ * @return size_t The length of the resulting string.
  */
-void chordNotesStringForKPDVE(int kpdve, char* stringBuf, size_t bufSize) {
-    int result[5];
-    binaryEncodingToKPDVE(kpdve, result);
+static size_t noteNamesStringForLocation(const int noteLoc[], int lastExt, char* stringBuf, size_t bufSize)
+{
+    if (bufSize == 0) {
+        return 0;
+    }
 
-    // set the extensions to 0, prepare to iterate through
-    int noteLoc[] = { result[0], result[1], result[2], result[3], 0 };
-    // set a variable for encoding the note location to get the name string
-    int enc_noteLoc;
+    int loc[] = { noteLoc[0], noteLoc[1], noteLoc[2], noteLoc[3], 0 };
+    size_t len = 0;
 
     // Start with an empty string
     stringBuf[0] = '\0';
 
-    for (int i = 0; i <= result[4]; i++) {
-        noteLoc[4] = i;
-        enc_noteLoc = KPDVEtoBinaryEncoding(noteLoc);
+    for (int i = 0; i <= lastExt; i++) {
+        loc[4] = i;
 
         // Get the name of the note
-        const char* noteName = nameStringForKPDVE(enc_noteLoc);
+        const char* noteName = noteStrings[nameIndexForKPDVE(KPDVEtoBinaryEncoding(loc))];
+        size_t nameLen = strlen(noteName);
 
         // Append the note name to the buffer
-        if (strlen(stringBuf) + strlen(noteName) + 2 < bufSize) { // +2 for space and null terminator
-            strcat(stringBuf, noteName);
-            strcat(stringBuf, " ");
+        if (len + nameLen + 2 < bufSize) { // +2 for space and null terminator
+            memcpy(stringBuf + len, noteName, nameLen);
+            len += nameLen;
+            stringBuf[len++] = ' ';
         } else {
             // Buffer is full, truncate the string
-            strncat(stringBuf, "...", bufSize - strlen(stringBuf) - 1);
+            size_t room = bufSize - len - 1;
+            size_t dots = (room < 3) ? room : 3;
+            memcpy(stringBuf + len, "...", dots);
+            len += dots;
             break;
         }
     }
+    stringBuf[len] = '\0';
+    return len;
 }
 
 /**
- * @brief Returns the mode notes for a given KPDVE as a string.
+ * @brief Builds a string of chord notes for a given KPDVE.
  * 
  * @param kpdve The KPDVE value.
  * @param stringBuf The buffer to store the resulting string.
  * @param bufSize The size of the provided buffer.
+ * @return size_t The length of the resulting string.
  */
-void modeNotesStringForKPDVE(int kpdve, char* stringBuf, size_t bufSize)
-{
+size_t chordNotesStringForKPDVE(int kpdve, char* stringBuf, size_t bufSize) {
     int result[5];
     binaryEncodingToKPDVE(kpdve, result);
-    
-    int noteLoc[] = { result[0], result[1], result[2], result[3], 0 };
-    int enc_noteLoc;
 
-    const char* noteName;   
-    // Start with an empty string
-    stringBuf[0] = '\0';
+    // iterate through the extensions of the chord, up to its own
+    return noteNamesStringForLocation(result, result[4], stringBuf, bufSize);
+}
 
-    for (int i = 0; i <= 6; i++)
-    {
-        noteLoc[4] = i;
-        enc_noteLoc = KPDVEtoBinaryEncoding(noteLoc);
+/**
+ * @brief Returns the mode notes for a given KPDVE as a string.
+ * 
+ * @param kpdve The KPDVE value.
+ * @param stringBuf The buffer to store the resulting string.
+ * @param bufSize The size of the provided buffer.
+ * @return size_t The length of the resulting string.
+ */
+size_t modeNotesStringForKPDVE(int kpdve, char* stringBuf, size_t bufSize)
+{
+    int result[5];
+    binaryEncodingToKPDVE(kpdve, result);
 
-        noteName = nameStringForKPDVE(enc_noteLoc);
-        if (strlen(stringBuf) + strlen(noteName) + 2 < bufSize) { // +2 for space and null terminator
-            strcat(stringBuf, noteName);
-            strcat(stringBuf, " ");
-        } else {
-            // Buffer is full, truncate the string
-            strncat(stringBuf, "...", bufSize - strlen(stringBuf) - 1);
-            break;
-        }
-    }
+    return noteNamesStringForLocation(result, 6, stringBuf, bufSize);
 }
 
 /**
@@ -460,35 +467,17 @@ void modeNotesStringForKPDVE(int kpdve, char* stringBuf, size_t bufSize)
  * @param kpdve The KPDVE value.
  * @param stringBuf The buffer to store the resulting string.
  * @param bufSize The size of the provided buffer.
+ * @return size_t The length of the resulting string.
  */
-void modeNotesScaleStringForKPDVE(int kpdve, char* stringBuf, size_t bufSize)
+size_t modeNotesScaleStringForKPDVE(int kpdve, char* stringBuf, size_t bufSize)
 {
     int result[5];
     binaryEncodingToKPDVE(kpdve, result);
     
     // set the voicing to 2 so that the notes are in scale order
     int noteLoc[] = { result[0], result[1], result[2], 2, 0 };
-    int enc_noteLoc;
 
-    const char* noteName;
-    // Start with an empty string
-    stringBuf[0] = '\0';
-
-    for (int i = 0; i <= 6; i++)
-    {
-        noteLoc[4] = i;
-        enc_noteLoc = KPDVEtoBinaryEncoding(noteLoc);
-
-        noteName = nameStringForKPDVE(enc_noteLoc);
-        if (strlen(stringBuf) + strlen(noteName) + 2 < bufSize) { // +2 for space and null terminator
-            strcat(stringBuf, noteName);
-            strcat(stringBuf, " ");
-        } else {
-            // Buffer is full, truncate the string
-            strncat(stringBuf, "...", bufSize - strlen(stringBuf) - 1);
-            break;
-        }
-    }
+    return noteNamesStringForLocation(noteLoc, 6, stringBuf, bufSize);
 }
 
 /**
@@ -497,35 +486,16 @@ void modeNotesScaleStringForKPDVE(int kpdve, char* stringBuf, size_t bufSize)
  * @param kpdve The KPDVE value.
  * @param stringBuf The buffer to store the resulting string.
  * @param bufSize The size of the provided buffer.
+ * @return size_t The length of the resulting string.
  */
-void modeNotesFifthsStringForKPDVE(int kpdve, char* stringBuf, size_t bufSize)
+size_t modeNotesFifthsStringForKPDVE(int kpdve, char* stringBuf, size_t bufSize)
 {
     int result[5];
     binaryEncodingToKPDVE(kpdve, result);
     
     int noteLoc[] = { result[0], result[1], 1, 1, 0 };
-    int enc_noteLoc;
-
-    const char* noteName;
 
-    // Start with an empty string
-     stringBuf[0] = '\0';
-
-    for (int i = 0; i <= 6; i++)
-    {
-        noteLoc[4] = i;
-        enc_noteLoc = KPDVEtoBinaryEncoding(noteLoc);
-
-        noteName = nameStringForKPDVE(enc_noteLoc);
-        if (strlen(stringBuf) + strlen(noteName) + 2 < bufSize) { // +2 for space and null terminator
-            strcat(stringBuf, noteName);
-            strcat(stringBuf, " ");
-        } else {
-            // Buffer is full, truncate the string
-            strncat(stringBuf, "...", bufSize - strlen(stringBuf) - 1);
-            break;
-        }
-    }
+    return noteNamesStringForLocation(noteLoc, 6, stringBuf, bufSize);
 }
 
 /**
@@ -572,20 +542,86 @@ const char* scaleNameForKPDVE(int kpdve)
     return basePatternConventionalNames[result[1]];
 }
 
+// writes an integer right-aligned in a field of at least 'width' characters (as printf's %2d). returns the length.
+static size_t paddedIntString(int value, int width, char* out)
+{
+    char digits[12];
+    int n = 0;
+    unsigned int magnitude = (value < 0) ? 0u - (unsigned int)value : (unsigned int)value;
+
+    do {
+        digits[n++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) {
+        digits[n++] = '-';
+    }
+
+    size_t len = 0;
+    for (int pad = n; pad < width; pad++) {
+        out[len++] = ' ';
+    }
+    while (n > 0) {
+        out[len++] = digits[--n];
+    }
+    return len;
+}
+
 /**
- * @brief Returns the KPDVE values as a string.
- * 
+ * @brief Writes the KPDVE values into a caller's buffer, formatted as "[ K. P. D. V. E]".
+ *
+ * Reentrant: nothing is shared between calls.
+ *
  * @param kpdve The KPDVE value.
- * @return const char* The string representation of KPDVE.
+ * @param stringBuf The buffer to store the resulting string (17 bytes hold any 16-bit KPDVE).
+ * @param bufSize The size of the provided buffer.
+ * @return size_t The length of the resulting string (truncated to fit the buffer).
  */
-const char* kpdve_as_string(int kpdve) {
-    static char kpdveString[17]; // Static buffer to hold the string representation
+size_t kpdveStringForKPDVE(int kpdve, char* stringBuf, size_t bufSize)
+{
+    if (bufSize == 0) {
+        return 0;
+    }
+
     int result[5];
     binaryEncodingToKPDVE(kpdve, result);
-    snprintf(kpdveString, sizeof(kpdveString), "[%2d.%2d.%2d.%2d.%2d]", result[0], result[1], result[2], result[3], result[4]);
-    return kpdveString;
-}
 
+    char formatted[64];
+    size_t len = 0;
+    formatted[len++] = '[';
+    for (int i = 0; i < 5; i++) {
+        if (i > 0) {
+            formatted[len++] = '.';
+        }
+        len += paddedIntString(result[i], 2, formatted + len);
+    }
+    formatted[len++] = ']';
 
+    if (len > bufSize - 1) {
+        len = bufSize - 1;
+    }
+    memcpy(stringBuf, formatted, len);
+    stringBuf[len] = '\0';
+    return len;
+}
 
+#if defined(_MSC_VER)
+#define NAMING_THREAD_LOCAL __declspec(thread)
+#else
+#define NAMING_THREAD_LOCAL __thread
+#endif
 
+/**
+ * @brief Returns the KPDVE values as a string.
+ * 
+ * The buffer is per thread, so the result stays valid until the same thread calls this again.
+ * Prefer kpdveStringForKPDVE when the string has to outlive the next call.
+ * 
+ * @param kpdve The KPDVE value.
+ * @return const char* The string representation of KPDVE.
+ */
+const char* kpdve_as_string(int kpdve) {
+    static NAMING_THREAD_LOCAL char kpdveString[17]; // per-thread buffer to hold the string representation
+    kpdveStringForKPDVE(kpdve, kpdveString, sizeof(kpdveString));
+    return kpdveString;
+}
@@ -0,0 +1,599 @@
+//
+//  qdkpdve_pipeline.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_pipeline.c
+ * @brief Threaded stage pipeline with lock-free batch queues (see qdkpdve_pipeline.h).
+ *
+ * With n stages there are n queues: queue i feeds stage i, and stage i pushes to queue
+ * (i + 1) mod n, so queue 0 is the recycle queue. The link queues hold queue_depth
+ * batches; the recycle queue holds every batch, so the last stage never blocks and the
+ * ring cannot deadlock. There are depth * (n - 1) + n batches: all queues full and one
+ * batch in every stage's hands.
+ *
+ * Each queue has exactly one producer and one consumer thread. head and tail only grow;
+ * the producer publishes a slot with a release store of tail, the consumer frees it
+ * with a release store of head, and each reads the other's index with acquire.
+ *
+ * A side that cannot go on yields for WAIT_SPIN_NS and then sleeps on its condition
+ * variable of the queue, in the pattern of qdkpdve_shmring.c: the waiter raises its
+ * sleeping flag under the queue's mutex, fences and checks the queue once more before it
+ * waits; the other side stores its index, fences and takes the mutex only if the flag is
+ * up. So the lock is never touched while both sides keep up, and a wake is never lost.
+ * Stopping wakes every queue under its mutex.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/qdkpdve_pipeline.h"
+#include "../include/qdkpdve_codec.h"
+#include "../include/qdkpdve_corpus.h"
+#include "../include/qdkpdve_latency.h"
+#include "../include/qdkpdve_statemaker.h"
+
+#define CACHE_LINE 64
+#define WAIT_SPIN_NS 50000   // yielding before a waiting stage sleeps
+
+struct batch_queue {
+    kpdve_batch **slots;
+    size_t cap;
+    pthread_mutex_t lock;    // only for sleeping and waking
+    pthread_cond_t moved[2]; // [0] tail moved (for the consumer), [1] head moved (for the producer)
+    int sleeping[2];         // the consumer, the producer is (about to be) waiting on its moved
+    char pad0[CACHE_LINE];
+    size_t head;             // next slot to pop (consumer)
+    char pad1[CACHE_LINE - sizeof(size_t)];
+    size_t tail;             // next slot to push (producer)
+    char pad2[CACHE_LINE - sizeof(size_t)];
+};
+
+struct pipeline_stage {
+    const char *name;
+    kpdve_stage_fn fn;
+    void *ctx;
+    kpdve_pipeline *pipeline;
+    int index;
+    pthread_t thread;
+    struct kpdve_stage_stats stats;
+};
+
+struct kpdve_pipeline {
+    size_t batch_frames;
+    size_t queue_depth;
+    int stage_count;
+    struct pipeline_stage stages[KPDVE_PIPELINE_MAX_STAGES];
+
+    // per run
+    struct batch_queue queues[KPDVE_PIPELINE_MAX_STAGES];
+    kpdve_batch *batches;
+    size_t batch_count;
+    uint64_t start_ns;
+    int error;               // first negative stage result, read and written atomically
+};
+
+static int queue_push(struct batch_queue *q, kpdve_batch *batch)
+{
+    size_t tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    if (tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == q->cap)
+    {
+        return 0;
+    }
+    q->slots[tail % q->cap] = batch;
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static kpdve_batch *queue_pop(struct batch_queue *q)
+{
+    size_t head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    if (head == __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+    kpdve_batch *batch = q->slots[head % q->cap];
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+    return batch;
+}
+
+static int stopped(kpdve_pipeline *pipeline)
+{
+    return __atomic_load_n(&pipeline->error, __ATOMIC_ACQUIRE) != 0;
+}
+
+// records the first error and wakes every waiting stage
+static void stop(kpdve_pipeline *pipeline, int error)
+{
+    int none = 0;
+    __atomic_compare_exchange_n(&pipeline->error, &none, error, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < pipeline->stage_count; i++)
+    {
+        struct batch_queue *q = &pipeline->queues[i];
+        pthread_mutex_lock(&q->lock);
+        pthread_cond_broadcast(&q->moved[0]);
+        pthread_cond_broadcast(&q->moved[1]);
+        pthread_mutex_unlock(&q->lock);
+    }
+}
+
+// after a push (side 0) or pop (side 1): wakes the other side if it has said it sleeps
+static void wake(struct batch_queue *q, int side)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&q->sleeping[side], __ATOMIC_RELAXED) == 0)
+    {
+        return;
+    }
+    pthread_mutex_lock(&q->lock);
+    pthread_cond_signal(&q->moved[side]);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// one round of waiting for the queue to become non-empty (for_room 0) or non-full (for_room 1):
+// a yield while the wait is young, then sleeps until the other side moves the queue
+static void wait_round(kpdve_pipeline *pipeline, struct batch_queue *q, int for_room, uint64_t start)
+{
+    if (kpdve_latency_now_ns() - start < WAIT_SPIN_NS)
+    {
+        sched_yield();
+        return;
+    }
+    pthread_mutex_lock(&q->lock);
+    __atomic_store_n(&q->sleeping[for_room], 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    size_t used = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    if ((for_room ? used == q->cap : used == 0) && !stopped(pipeline))
+    {
+        pthread_cond_wait(&q->moved[for_room], &q->lock);
+    }
+    __atomic_store_n(&q->sleeping[for_room], 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static kpdve_batch *pop_wait(struct pipeline_stage *stage, struct batch_queue *q)
+{
+    kpdve_batch *batch = queue_pop(q);
+    if (batch == NULL)
+    {
+        uint64_t start = kpdve_latency_now_ns();
+        stage->stats.starved_waits++;
+        while ((batch = queue_pop(q)) == NULL && !stopped(stage->pipeline))
+        {
+            wait_round(stage->pipeline, q, 0, start);
+        }
+        stage->stats.starved_ns += kpdve_latency_now_ns() - start;
+    }
+    if (batch != NULL)
+    {
+        wake(q, 1);
+    }
+    return batch;
+}
+
+static int push_wait(struct pipeline_stage *stage, struct batch_queue *q, kpdve_batch *batch)
+{
+    int pushed = queue_push(q, batch);
+    if (!pushed)
+    {
+        uint64_t start = kpdve_latency_now_ns();
+        stage->stats.blocked_waits++;
+        while (!(pushed = queue_push(q, batch)) && !stopped(stage->pipeline))
+        {
+            wait_round(stage->pipeline, q, 1, start);
+        }
+        stage->stats.blocked_ns += kpdve_latency_now_ns() - start;
+    }
+    if (pushed)
+    {
+        wake(q, 0);
+    }
+    return pushed;
+}
+
+static void *stage_main(void *arg)
+{
+    struct pipeline_stage *stage = arg;
+    kpdve_pipeline *pipeline = stage->pipeline;
+    struct batch_queue *in = &pipeline->queues[stage->index];
+    struct batch_queue *out = &pipeline->queues[(stage->index + 1) % pipeline->stage_count];
+    uint64_t sequence = 0;
+    uint64_t produced = 0;
+
+    for (;;)
+    {
+        kpdve_batch *batch = pop_wait(stage, in);
+        if (batch == NULL)
+        {
+            break; // stopped
+        }
+        if (stage->index == 0)
+        {
+            batch->sequence = sequence++;
+            batch->first_frame = produced;
+            batch->count = 0;
+            batch->last = 0;
+        }
+
+        uint64_t start = kpdve_latency_now_ns();
+        int result = stage->fn(stage->ctx, batch);
+        stage->stats.busy_ns += kpdve_latency_now_ns() - start;
+
+        if (result < 0)
+        {
+            stop(pipeline, result);
+            break;
+        }
+        if (stage->index == 0)
+        {
+            batch->last = (result == KPDVE_PIPELINE_END);
+            produced += batch->count;
+        }
+        stage->stats.batches++;
+        stage->stats.frames += batch->count;
+
+        int last = batch->last;
+        if (!push_wait(stage, out, batch) || last)
+        {
+            break;
+        }
+    }
+    stage->stats.wall_ns = kpdve_latency_now_ns() - pipeline->start_ns;
+    return NULL;
+}
+
+/**
+ * @brief Makes an empty pipeline.
+ *
+ * @param batch_frames Frames per batch (0 for 4096).
+ * @param queue_depth Batches each link queue holds (0 for 4).
+ * @return The pipeline, or NULL if memory could not be allocated.
+ */
+kpdve_pipeline *kpdve_pipeline_create(size_t batch_frames, size_t queue_depth)
+{
+    kpdve_pipeline *pipeline = calloc(1, sizeof(kpdve_pipeline));
+    if (pipeline == NULL)
+    {
+        return NULL;
+    }
+    pipeline->batch_frames = batch_frames ? batch_frames : 4096;
+    pipeline->queue_depth = queue_depth ? queue_depth : 4;
+    return pipeline;
+}
+
+void kpdve_pipeline_destroy(kpdve_pipeline *pipeline)
+{
+    free(pipeline);
+}
+
+/**
+ * @brief Appends a stage. The first stage added is the source.
+ *
+ * @return KPDVE_PIPELINE_OK, or KPDVE_PIPELINE_ERR_STAGES if there are already
+ *         KPDVE_PIPELINE_MAX_STAGES.
+ */
+int kpdve_pipeline_add_stage(kpdve_pipeline *pipeline, const char *name, kpdve_stage_fn fn, void *ctx)
+{
+    if (pipeline->stage_count == KPDVE_PIPELINE_MAX_STAGES)
+    {
+        return KPDVE_PIPELINE_ERR_STAGES;
+    }
+    struct pipeline_stage *stage = &pipeline->stages[pipeline->stage_count];
+    memset(stage, 0, sizeof(*stage));
+    stage->name = name;
+    stage->fn = fn;
+    stage->ctx = ctx;
+    stage->pipeline = pipeline;
+    stage->index = pipeline->stage_count++;
+    return KPDVE_PIPELINE_OK;
+}
+
+static void free_run(kpdve_pipeline *pipeline)
+{
+    for (int i = 0; i < pipeline->stage_count; i++)
+    {
+        free(pipeline->queues[i].slots);
+        pipeline->queues[i].slots = NULL;
+        pthread_mutex_destroy(&pipeline->queues[i].lock);
+        pthread_cond_destroy(&pipeline->queues[i].moved[0]);
+        pthread_cond_destroy(&pipeline->queues[i].moved[1]);
+    }
+    if (pipeline->batches != NULL)
+    {
+        for (size_t b = 0; b < pipeline->batch_count; b++)
+        {
+            free(pipeline->batches[b].words);
+            free(pipeline->batches[b].chroma);
+            free(pipeline->batches[b].states);
+            kpdve_textbuf_free(&pipeline->batches[b].text);
+        }
+    }
+    free(pipeline->batches);
+    pipeline->batches = NULL;
+}
+
+/**
+ * @brief Runs the stages, each on its own thread, until the source's last batch has
+ * passed through every stage or a stage fails.
+ *
+ * @return KPDVE_PIPELINE_OK, the first negative stage result, or a KPDVE_PIPELINE_ERR code.
+ */
+int kpdve_pipeline_run(kpdve_pipeline *pipeline)
+{
+    int n = pipeline->stage_count;
+    if (n == 0)
+    {
+        return KPDVE_PIPELINE_ERR_STAGES;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        struct batch_queue *q = &pipeline->queues[i];
+        pthread_mutex_init(&q->lock, NULL);
+        pthread_cond_init(&q->moved[0], NULL);
+        pthread_cond_init(&q->moved[1], NULL);
+        q->sleeping[0] = 0;
+        q->sleeping[1] = 0;
+    }
+    pipeline->batch_count = pipeline->queue_depth * (size_t)(n - 1) + (size_t)n;
+    pipeline->batches = calloc(pipeline->batch_count, sizeof(kpdve_batch));
+    int err = (pipeline->batches == NULL) ? KPDVE_PIPELINE_ERR_MEMORY : KPDVE_PIPELINE_OK;
+    for (int i = 0; err == KPDVE_PIPELINE_OK && i < n; i++)
+    {
+        struct batch_queue *q = &pipeline->queues[i];
+        q->cap = (i == 0) ? pipeline->batch_count : pipeline->queue_depth;
+        q->head = 0;
+        q->tail = 0;
+        q->slots = malloc(q->cap * sizeof(kpdve_batch *));
+        err = (q->slots == NULL) ? KPDVE_PIPELINE_ERR_MEMORY : err;
+    }
+    for (size_t b = 0; err == KPDVE_PIPELINE_OK && b < pipeline->batch_count; b++)
+    {
+        kpdve_batch *batch = &pipeline->batches[b];
+        batch->cap = pipeline->batch_frames;
+        batch->words = malloc(batch->cap * sizeof(uint32_t));
+        batch->chroma = malloc(batch->cap * sizeof(int));
+        batch->states = malloc(batch->cap * sizeof(int));
+        if (!batch->words || !batch->chroma || !batch->states)
+        {
+            err = KPDVE_PIPELINE_ERR_MEMORY;
+        }
+        else
+        {
+            queue_push(&pipeline->queues[0], batch);
+        }
+    }
+    if (err != KPDVE_PIPELINE_OK)
+    {
+        free_run(pipeline);
+        return err;
+    }
+
+    pipeline->error = 0;
+    pipeline->start_ns = kpdve_latency_now_ns();
+    int started = 0;
+    for (; started < n; started++)
+    {
+        struct pipeline_stage *stage = &pipeline->stages[started];
+        memset(&stage->stats, 0, sizeof(stage->stats));
+        stage->stats.name = stage->name;
+        if (pthread_create(&stage->thread, NULL, stage_main, stage) != 0)
+        {
+            stop(pipeline, KPDVE_PIPELINE_ERR_THREAD);
+            break;
+        }
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(pipeline->stages[i].thread, NULL);
+    }
+
+    free_run(pipeline);
+    return pipeline->error;
+}
+
+int kpdve_pipeline_stage_count(const kpdve_pipeline *pipeline)
+{
+    return pipeline->stage_count;
+}
+
+/**
+ * @brief Copies the counters of a stage from the last run.
+ */
+void kpdve_pipeline_stats(const kpdve_pipeline *pipeline, int stage, struct kpdve_stage_stats *stats)
+{
+    *stats = pipeline->stages[stage].stats;
+}
+
+/**
+ * @brief Prints one line per stage: work, throughput while working, and waits.
+ */
+void kpdve_pipeline_print(FILE *out, const kpdve_pipeline *pipeline)
+{
+    fprintf(out, "%-10s %10s %12s %10s %14s %18s %18s\n",
+            "stage", "batches", "frames", "busy ms", "frames/s busy", "starved ms (n)", "blocked ms (n)");
+    for (int i = 0; i < pipeline->stage_count; i++)
+    {
+        const struct kpdve_stage_stats *s = &pipeline->stages[i].stats;
+        double busy = 1e-9 * (double)s->busy_ns;
+        char starved[32], blocked[32];
+        snprintf(starved, sizeof(starved), "%.1f (%llu)", 1e-6 * (double)s->starved_ns, (unsigned long long)s->starved_waits);
+        snprintf(blocked, sizeof(blocked), "%.1f (%llu)", 1e-6 * (double)s->blocked_ns, (unsigned long long)s->blocked_waits);
+        fprintf(out, "%-10s %10llu %12llu %10.1f %14.0f %18s %18s\n",
+                s->name ? s->name : "-", (unsigned long long)s->batches, (unsigned long long)s->frames,
+                1e3 * busy, busy > 0 ? (double)s->frames / busy : 0.0, starved, blocked);
+    }
+}
+
+void kpdve_read_stage_init(struct kpdve_read_stage *stage, FILE *in, int format)
+{
+    memset(stage, 0, sizeof(*stage));
+    stage->in = in;
+    stage->format = format;
+}
+
+void kpdve_read_stage_free(struct kpdve_read_stage *stage)
+{
+    free(stage->chunk);
+    free(stage->decoded);
+    stage->chunk = NULL;
+    stage->decoded = NULL;
+}
+
+static int grow(void **buffer, size_t *cap, size_t need, size_t element)
+{
+    if (need <= *cap)
+    {
+        return 0;
+    }
+    void *p = realloc(*buffer, need * element);
+    if (p == NULL)
+    {
+        return -1;
+    }
+    *buffer = p;
+    *cap = need;
+    return 0;
+}
+
+// decodes the next codec chunk into stage->decoded; 0, 1 at the end of the input, or -1
+static int read_chunk(struct kpdve_read_stage *stage)
+{
+    uint8_t header[KPDVE_CODEC_HEADER_SIZE];
+    size_t got = fread(header, 1, sizeof(header), stage->in);
+    if (got == 0 && feof(stage->in))
+    {
+        return 1;
+    }
+    if (got != sizeof(header))
+    {
+        return -1;
+    }
+    size_t frames = header[4] | header[5] << 8 | header[6] << 16 | (size_t)header[7] << 24;
+    size_t payload = header[8] | header[9] << 8 | header[10] << 16 | (size_t)header[11] << 24;
+    if (grow((void **)&stage->chunk, &stage->chunk_cap, sizeof(header) + payload, 1) != 0
+        || grow((void **)&stage->decoded, &stage->decoded_cap, frames, sizeof(int)) != 0)
+    {
+        return -1;
+    }
+    memcpy(stage->chunk, header, sizeof(header));
+    if (fread(stage->chunk + sizeof(header), 1, payload, stage->in) != payload)
+    {
+        return -1;
+    }
+    long n = kpdve_codec_decode_chunk(stage->chunk, sizeof(header) + payload, stage->decoded, frames, NULL);
+    if (n < 0)
+    {
+        return -1;
+    }
+    stage->decoded_count = (size_t)n;
+    stage->decoded_pos = 0;
+    return 0;
+}
+
+/**
+ * @brief Source stage: fills the batch's words from the input file.
+ *
+ * @return 0, KPDVE_PIPELINE_END when the input is exhausted, or -1 on a read or decode error.
+ */
+int kpdve_stage_read(void *ctx, kpdve_batch *batch)
+{
+    struct kpdve_read_stage *stage = ctx;
+    batch->format = stage->format;
+
+    if (stage->format == KPDVE_CORPUS_CODED)
+    {
+        while (batch->count < batch->cap)
+        {
+            if (stage->decoded_pos == stage->decoded_count)
+            {
+                int r = read_chunk(stage);
+                if (r != 0)
+                {
+                    stage->frames += batch->count;
+                    return r < 0 ? -1 : KPDVE_PIPELINE_END;
+                }
+                continue;
+            }
+            batch->words[batch->count++] = (uint32_t)stage->decoded[stage->decoded_pos++];
+        }
+        stage->frames += batch->count;
+        return 0;
+    }
+
+    size_t n;
+    if (stage->format == KPDVE_CORPUS_CHROMA)
+    {
+        // read the uint16 values into the front of words, then widen from the back
+        uint16_t *narrow = (uint16_t *)batch->words;
+        n = fread(narrow, sizeof(uint16_t), batch->cap, stage->in);
+        for (size_t i = n; i-- > 0;)
+        {
+            batch->words[i] = narrow[i];
+        }
+    }
+    else
+    {
+        n = fread(batch->words, sizeof(uint32_t), batch->cap, stage->in);
+    }
+    batch->count = n;
+    stage->frames += n;
+    if (n < batch->cap)
+    {
+        return ferror(stage->in) ? -1 : KPDVE_PIPELINE_END;
+    }
+    return 0;
+}
+
+/**
+ * @brief Takes the chroma bits of each word (a chroma value, or an encoded state to re-analyze).
+ */
+int kpdve_stage_chroma(void *ctx, kpdve_batch *batch)
+{
+    (void)ctx;
+    for (size_t i = 0; i < batch->count; i++)
+    {
+        batch->chroma[i] = (int)(batch->words[i] & 0xFFF);
+    }
+    return 0;
+}
+
+/**
+ * @brief Analyzes each chroma with adjust_harmony_state_from_chroma, in stream order.
+ */
+int kpdve_stage_analyze(void *ctx, kpdve_batch *batch)
+{
+    harmony_state *state = ctx;
+    for (size_t i = 0; i < batch->count; i++)
+    {
+        adjust_harmony_state_from_chroma(state, batch->chroma[i]);
+        batch->states[i] = state->encoded_state;
+    }
+    return 0;
+}
+
+/**
+ * @brief Renders the batch's states into its text (with the CSV header before the first batch).
+ */
+int kpdve_stage_format(void *ctx, kpdve_batch *batch)
+{
+    int format = *(const int *)ctx;
+    kpdve_textbuf_clear(&batch->text);
+    if (batch->sequence == 0 && kpdve_format_header(&batch->text, format) != 0)
+    {
+        return -1;
+    }
+    return kpdve_format_states(&batch->text, format, batch->states, batch->count, (size_t)batch->first_frame);
+}
+
+/**
+ * @brief Writes the batch's text to a file descriptor.
+ */
+int kpdve_stage_write(void *ctx, kpdve_batch *batch)
+{
+    int fd = *(const int *)ctx;
+    return batch->text.len > 0 ? kpdve_textbuf_writev(fd, &batch->text, 1) : 0;
+}
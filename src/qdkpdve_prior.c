@@ -0,0 +1,382 @@
+//
+//  qdkpdve_prior.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_prior.c
+ * @brief Learned transition prior for the chooser (see qdkpdve_prior.h).
+ *
+ * Files are read and written a row at a time, through a buffer of one row's entries
+ * at most, so neither needs more memory than the prior itself.
+ */
+
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../include/qdkpdve_prior.h"
+
+#define LN2 0.69314718055994530942
+
+// log2(x) for x >= 1: the exponent by halving, then ln(m) = 2 atanh((m - 1) / (m + 1)) for
+// the mantissa in [1, 2) (no libm)
+static double log2_of(double x)
+{
+    int exponent = 0;
+    while (x >= 2.0)
+    {
+        x *= 0.5;
+        exponent++;
+    }
+    double t = (x - 1.0) / (x + 1.0);
+    double t2 = t * t;
+    double term = t;
+    double sum = 0.0;
+    for (int n = 1; n < 40; n += 2)
+    {
+        sum += term / n;
+        term *= t2;
+    }
+    return exponent + 2.0 * sum / LN2;
+}
+
+// the K, P, D index of a valid encoded state, or -1
+static int state_index(int state)
+{
+    if (state & 0x80000000)
+    {
+        return -1;
+    }
+    int kpdve = (state >> 12) & 0xFFFF;
+    if ((kpdve >> 12) >= 12 || ((kpdve >> 9) & 0x7) == 7 || ((kpdve >> 6) & 0x7) == 7)
+    {
+        return -1;
+    }
+    return KPDVE_PRIOR_INDEX(kpdve);
+}
+
+/**
+ * @brief Empties the counts.
+ */
+void kpdve_prior_counts_reset(kpdve_prior_counts *counts)
+{
+    counts->transitions = 0;
+    counts->last = -1;
+    memset(counts->counts, 0, sizeof(counts->counts));
+}
+
+/**
+ * @brief Counts the K/P changes in a run of encoded states (as a store holds them).
+ *
+ * Successive calls continue the same stream; call kpdve_prior_end_stream between
+ * streams so that the last frame of one does not count as the context of the next.
+ * Invalid frames are skipped: the transition is from the last valid frame before them.
+ */
+void kpdve_prior_count(kpdve_prior_counts *counts, const int *states, size_t count)
+{
+    int last = counts->last;
+    for (size_t i = 0; i < count; i++)
+    {
+        int index = state_index(states[i]);
+        if (index < 0)
+        {
+            continue;
+        }
+        // same K and P: indexes that differ in D only
+        if (last >= 0 && last / 7 != index / 7)
+        {
+            uint32_t *cell = &counts->counts[last * KPDVE_PRIOR_STATES + index];
+            if (*cell != UINT32_MAX)
+            {
+                (*cell)++;
+            }
+            counts->transitions++;
+        }
+        last = index;
+    }
+    counts->last = last;
+}
+
+/**
+ * @brief Ends the current stream.
+ */
+void kpdve_prior_end_stream(kpdve_prior_counts *counts)
+{
+    counts->last = -1;
+}
+
+/**
+ * @brief Sets up an empty prior (every level 0): it chooses as kpdve_tables_choose.
+ */
+void kpdve_prior_init(kpdve_prior *prior, float weight)
+{
+    prior->alpha = 1.0f;
+    prior->transitions = 0;
+    prior->entry_count = 0;
+    memset(prior->levels, 0, sizeof(prior->levels));
+    kpdve_prior_set_weight(prior, weight);
+}
+
+/**
+ * @brief Quantizes counts into a prior.
+ *
+ * @param prior Receives the levels.
+ * @param counts The counted transitions.
+ * @param alpha Additive smoothing: a transition seen n times gets log2((n + alpha) / alpha)
+ * bits over one never seen (values not above 0 are taken as 1).
+ * @param weight Distance units per bit.
+ */
+void kpdve_prior_build(kpdve_prior *prior, const kpdve_prior_counts *counts, float alpha, float weight)
+{
+    if (!(alpha > 0.0f))
+    {
+        alpha = 1.0f;
+    }
+    kpdve_prior_init(prior, weight);
+    prior->alpha = alpha;
+    prior->transitions = counts->transitions;
+    for (size_t i = 0; i < sizeof(prior->levels); i++)
+    {
+        uint32_t n = counts->counts[i];
+        if (n == 0)
+        {
+            continue;
+        }
+        double steps = log2_of(((double)n + alpha) / alpha) * KPDVE_PRIOR_STEPS + 0.5;
+        int level = steps >= KPDVE_PRIOR_MAX_LEVEL ? KPDVE_PRIOR_MAX_LEVEL : (int)steps;
+        prior->levels[i] = (uint8_t)level;
+        prior->entry_count += level > 0;
+    }
+}
+
+/**
+ * @brief Sets the distance units per bit of the prior (0: no effect on the choice).
+ */
+void kpdve_prior_set_weight(kpdve_prior *prior, float weight)
+{
+    prior->weight = weight;
+    for (int level = 0; level <= KPDVE_PRIOR_MAX_LEVEL; level++)
+    {
+        prior->bonus[level] = weight * (float)level / KPDVE_PRIOR_STEPS;
+    }
+    prior->bonus[0] = 0.0f;
+}
+
+/**
+ * @brief The level (steps of 1/KPDVE_PRIOR_STEPS bit) of a transition; 0 if either
+ * KPDVE has no K, P, D index.
+ */
+int kpdve_prior_level(const kpdve_prior *prior, int from_kpdve, int to_kpdve)
+{
+    int from = state_index((from_kpdve & 0xFFFF) << 12);
+    int to = state_index((to_kpdve & 0xFFFF) << 12);
+    if (from < 0 || to < 0)
+    {
+        return 0;
+    }
+    return prior->levels[from * KPDVE_PRIOR_STATES + to];
+}
+
+/**
+ * @brief Writes the prior's nonzero levels as a sparse file.
+ *
+ * @return KPDVE_PRIOR_OK or KPDVE_PRIOR_ERR_IO.
+ */
+int kpdve_prior_write(const kpdve_prior *prior, const char *path)
+{
+    struct kpdve_prior_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = KPDVE_PRIOR_MAGIC;
+    header.version = KPDVE_PRIOR_VERSION;
+    header.header_size = sizeof(header);
+    header.states = KPDVE_PRIOR_STATES;
+    header.steps = KPDVE_PRIOR_STEPS;
+    header.entry_count = prior->entry_count;
+    header.alpha = prior->alpha;
+    header.transitions = prior->transitions;
+    header.file_size = sizeof(header) + sizeof(uint32_t) * (KPDVE_PRIOR_STATES + 1 + (uint64_t)prior->entry_count);
+
+    uint32_t rows[KPDVE_PRIOR_STATES + 1];
+    uint32_t entries = 0;
+    for (int from = 0; from < KPDVE_PRIOR_STATES; from++)
+    {
+        rows[from] = entries;
+        const uint8_t *levels = prior->levels + from * KPDVE_PRIOR_STATES;
+        for (int to = 0; to < KPDVE_PRIOR_STATES; to++)
+        {
+            entries += levels[to] != 0;
+        }
+    }
+    rows[KPDVE_PRIOR_STATES] = entries;
+
+    FILE *out = fopen(path, "wb");
+    if (out == NULL)
+    {
+        return KPDVE_PRIOR_ERR_IO;
+    }
+    int ok = entries == prior->entry_count
+        && fwrite(&header, sizeof(header), 1, out) == 1
+        && fwrite(rows, sizeof(rows), 1, out) == 1;
+    uint32_t row[KPDVE_PRIOR_STATES];
+    for (int from = 0; ok && from < KPDVE_PRIOR_STATES; from++)
+    {
+        const uint8_t *levels = prior->levels + from * KPDVE_PRIOR_STATES;
+        size_t n = 0;
+        for (int to = 0; to < KPDVE_PRIOR_STATES; to++)
+        {
+            if (levels[to] != 0)
+            {
+                row[n++] = (uint32_t)to | (uint32_t)levels[to] << 16;
+            }
+        }
+        ok = n == 0 || fwrite(row, sizeof(uint32_t), n, out) == n;
+    }
+    ok = (fclose(out) == 0) && ok;
+    return ok ? KPDVE_PRIOR_OK : KPDVE_PRIOR_ERR_IO;
+}
+
+/**
+ * @brief Reads a sparse prior file into a dense prior.
+ *
+ * @param prior Receives the levels (left empty on an error).
+ * @param path The file.
+ * @param weight Distance units per bit.
+ * @return KPDVE_PRIOR_OK, KPDVE_PRIOR_ERR_IO if the file cannot be read, or
+ * KPDVE_PRIOR_ERR_FORMAT if it is not a version 1 prior.
+ */
+int kpdve_prior_read(kpdve_prior *prior, const char *path, float weight)
+{
+    kpdve_prior_init(prior, weight);
+    FILE *in = fopen(path, "rb");
+    if (in == NULL)
+    {
+        return KPDVE_PRIOR_ERR_IO;
+    }
+
+    struct kpdve_prior_header header;
+    uint32_t rows[KPDVE_PRIOR_STATES + 1];
+    int err = KPDVE_PRIOR_OK;
+    if (fread(&header, sizeof(header), 1, in) != 1
+        || header.magic != KPDVE_PRIOR_MAGIC
+        || header.version != KPDVE_PRIOR_VERSION
+        || header.header_size != sizeof(header)
+        || header.states != KPDVE_PRIOR_STATES
+        || header.steps != KPDVE_PRIOR_STEPS
+        || header.entry_count > (uint32_t)KPDVE_PRIOR_STATES * KPDVE_PRIOR_STATES
+        || header.file_size != sizeof(header) + sizeof(uint32_t) * (KPDVE_PRIOR_STATES + 1 + (uint64_t)header.entry_count)
+        || fread(rows, sizeof(rows), 1, in) != 1
+        || rows[0] != 0
+        || rows[KPDVE_PRIOR_STATES] != header.entry_count)
+    {
+        err = KPDVE_PRIOR_ERR_FORMAT;
+    }
+
+    // rows in order, each at most one entry per next state, ascending, with a level
+    uint32_t row[KPDVE_PRIOR_STATES];
+    for (int from = 0; err == KPDVE_PRIOR_OK && from < KPDVE_PRIOR_STATES; from++)
+    {
+        uint32_t n = rows[from + 1] - rows[from];
+        if (rows[from + 1] < rows[from] || n > KPDVE_PRIOR_STATES
+            || (n > 0 && fread(row, sizeof(uint32_t), n, in) != n))
+        {
+            err = KPDVE_PRIOR_ERR_FORMAT;
+            break;
+        }
+        int previous = -1;
+        for (uint32_t j = 0; j < n; j++)
+        {
+            int to = (int)(row[j] & 0xFFFF);
+            int level = (int)((row[j] >> 16) & 0xFF);
+            if (to <= previous || to >= KPDVE_PRIOR_STATES || level == 0 || (row[j] >> 24) != 0)
+            {
+                err = KPDVE_PRIOR_ERR_FORMAT;
+                break;
+            }
+            prior->levels[from * KPDVE_PRIOR_STATES + to] = (uint8_t)level;
+            previous = to;
+        }
+    }
+    if (err == KPDVE_PRIOR_OK && fgetc(in) != EOF)
+    {
+        err = KPDVE_PRIOR_ERR_FORMAT;
+    }
+    fclose(in);
+
+    if (err != KPDVE_PRIOR_OK)
+    {
+        kpdve_prior_init(prior, weight);
+        return err;
+    }
+    prior->alpha = header.alpha;
+    prior->transitions = header.transitions;
+    prior->entry_count = header.entry_count;
+    return KPDVE_PRIOR_OK;
+}
+
+/**
+ * @brief kpdve_tables_choose with the prior's bonus (and the anchor's term, if given)
+ * added to each candidate's distance. RT-safe.
+ *
+ * A context whose P or D is 7 (no K, P, D index) gets no bonus.
+ *
+ * @param chroma 1..4095.
+ * @param context The context KPDVE (K < 12).
+ * @return The chosen index into the chroma's candidates, or -1 if it has none.
+ */
+int kpdve_prior_choose(const kpdve_tables *tables, const kpdve_prior *prior, const kpdve_anchor *anchor,
+                       int chroma, int context)
+{
+    if (((context >> 9) & 0x7) == 7 || ((context >> 6) & 0x7) == 7)
+    {
+        return anchor != NULL ? kpdve_anchor_choose(tables, anchor, chroma, context)
+                              : kpdve_tables_choose(tables, chroma, context);
+    }
+    int first = tables->offsets[chroma];
+    int count = tables->offsets[chroma + 1] - first;
+    if (count == 0)
+    {
+        return -1;
+    }
+
+    const uint32_t *list = tables->candidates + first;
+    int context_k = context >> 12;
+    int context_kp = (context >> 9) & 0x7F;
+    const float *k_row = tables->k_distance + context_k * 12;
+    const float *p_row = tables->p_distance + ((context >> 9) & 0x7) * 8;
+    const float *d_row = tables->d_distance + ((context >> 6) & 0x7) * 8;
+    const uint8_t *levels = prior->levels + KPDVE_PRIOR_INDEX(context) * KPDVE_PRIOR_STATES;
+    float scale = 0.0f;
+    if (anchor != NULL && anchor->total != 0)
+    {
+        scale = anchor->weight / ((float)anchor->total * KPDVE_ANCHOR_DISTANCE_ONE);
+    }
+
+    float min_dist = FLT_MAX; // the anchor term is unbounded, and can outweigh any bonus
+    int min_index = 0;
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t kpdve = list[i];
+        if (((kpdve >> 9) & 0x7F) == (uint32_t)context_kp)
+        {
+            return i;
+        }
+
+        float dist = 0;
+        dist += k_row[(kpdve >> 12) & 0xF];
+        dist += p_row[(kpdve >> 9) & 0x7];
+        dist += d_row[(kpdve >> 6) & 0x7];
+        if (anchor != NULL)
+        {
+            dist += scale * (float)(anchor->k_sum[(kpdve >> 12) & 0xF] + anchor->p_sum[(kpdve >> 9) & 0x7]);
+        }
+        dist -= prior->bonus[levels[KPDVE_PRIOR_INDEX(kpdve)]];
+
+        if (dist < min_dist)
+        {
+            min_dist = dist;
+            min_index = i;
+        }
+    }
+    return min_index;
+}
@@ -0,0 +1,223 @@
+//
+//  qdkpdve_rt.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_rt.c
+ * @brief Analysis for real-time threads (see qdkpdve_rt.h).
+ *
+ * Nothing in this file may allocate, lock, or call stdio outside pf_rt_init and
+ * pf_rt_prepare_thread; test_rt_safety enforces it.
+ */
+
+#include "../include/qdkpdve_rt.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_stats.h"
+
+/**
+ * @brief Sets up an analyzer in the default state (F major, as harmony_state_default).
+ * Not RT-safe: builds the tables on first use.
+ *
+ * @param analyzer The analyzer.
+ * @param tables The tables to analyze with; NULL for kpdve_tables_default().
+ */
+void pf_rt_init(pf_rt_analyzer *analyzer, const kpdve_tables *tables)
+{
+    analyzer->tables = tables ? tables : kpdve_tables_default();
+    analyzer->default_kpdve = harmony_state_default().kpdve;
+    analyzer->anchor = NULL;
+    analyzer->prior = NULL;
+    pf_rt_reset(analyzer);
+}
+
+/**
+ * @brief Does the per-thread setup of the calling thread, so that its first RT-safe call
+ * does none. Not RT-safe; a no-op unless the library counts statistics.
+ */
+void pf_rt_prepare_thread(void)
+{
+#ifdef PITCHFLOCK_STATS
+    if (kpdve_stats_local == NULL)
+    {
+        kpdve_stats_register();
+    }
+#endif
+}
+
+/**
+ * @brief Releases all notes and returns to the default state, emptying the anchor if
+ * there is one. RT-safe.
+ */
+void pf_rt_reset(pf_rt_analyzer *analyzer)
+{
+    analyzer->context = analyzer->default_kpdve;
+    analyzer->kpdve = analyzer->default_kpdve;
+    analyzer->chroma = 0;
+    analyzer->flags = 0;
+    analyzer->encoded = kpdve_chromatic_byte(analyzer->default_kpdve, 0);
+    for (int i = 0; i < 12; i++)
+    {
+        analyzer->held[i] = 0;
+    }
+    if (analyzer->anchor != NULL)
+    {
+        kpdve_anchor_reset(analyzer->anchor);
+    }
+}
+
+/**
+ * @brief Sets the context for the next analysis. RT-safe.
+ *
+ * @return 0, or -1 (and nothing changed) if the context is not a KPDVE (K above 11).
+ */
+int pf_rt_set_context(pf_rt_analyzer *analyzer, int context)
+{
+    if ((unsigned int)context >= (12u << 12))
+    {
+        return -1;
+    }
+    analyzer->context = context;
+    return 0;
+}
+
+/**
+ * @brief Attaches a long-memory context (qdkpdve_anchor.h), initialized with the
+ * analyzer's tables, or detaches it (NULL). The anchor keeps what it holds. RT-safe.
+ */
+void pf_rt_set_anchor(pf_rt_analyzer *analyzer, kpdve_anchor *anchor)
+{
+    analyzer->anchor = anchor;
+}
+
+/**
+ * @brief Attaches a learned transition prior (qdkpdve_prior.h), or detaches it (NULL).
+ * The prior is only read, so analyzers may share one. RT-safe.
+ */
+void pf_rt_set_prior(pf_rt_analyzer *analyzer, const kpdve_prior *prior)
+{
+    analyzer->prior = prior;
+}
+
+/**
+ * @brief Registers a note-on (MIDI note number). RT-safe.
+ *
+ * @return The chroma of the notes now held, or -1 if the note is out of range.
+ */
+int pf_rt_note_on(pf_rt_analyzer *analyzer, int note)
+{
+    if (note < 0 || note > 127)
+    {
+        return -1;
+    }
+    int pc = note % 12;
+    if (analyzer->held[pc] < 255)
+    {
+        analyzer->held[pc]++;
+    }
+    analyzer->chroma |= 1 << pc;
+    return analyzer->chroma;
+}
+
+/**
+ * @brief Registers a note-off. A pitch class leaves the chroma when every note-on of it
+ * has had its note-off (stray note-offs are ignored). RT-safe.
+ *
+ * @return The chroma of the notes now held, or -1 if the note is out of range.
+ */
+int pf_rt_note_off(pf_rt_analyzer *analyzer, int note)
+{
+    if (note < 0 || note > 127)
+    {
+        return -1;
+    }
+    int pc = note % 12;
+    if (analyzer->held[pc] > 0 && --analyzer->held[pc] == 0)
+    {
+        analyzer->chroma &= ~(1 << pc);
+    }
+    return analyzer->chroma;
+}
+
+/**
+ * @brief Releases every note (without analyzing). RT-safe.
+ */
+void pf_rt_all_notes_off(pf_rt_analyzer *analyzer)
+{
+    for (int i = 0; i < 12; i++)
+    {
+        analyzer->held[i] = 0;
+    }
+    analyzer->chroma = 0;
+}
+
+/**
+ * @brief Analyzes a chroma against the current context. RT-safe.
+ *
+ * The chroma does not change the held notes. A KPDVE found becomes the next context.
+ *
+ * @return The encoded state.
+ */
+int pf_rt_analyze_chroma(pf_rt_analyzer *analyzer, int chroma)
+{
+    const kpdve_tables *tables = analyzer->tables;
+    chroma &= 0xFFF;
+    int index = -1;
+    if (chroma != 0)
+    {
+        if (analyzer->prior != NULL)
+        {
+            index = kpdve_prior_choose(tables, analyzer->prior, analyzer->anchor, chroma, analyzer->context);
+        }
+        else if (analyzer->anchor != NULL)
+        {
+            index = kpdve_anchor_choose(tables, analyzer->anchor, chroma, analyzer->context);
+        }
+        else
+        {
+            index = kpdve_tables_choose(tables, chroma, analyzer->context);
+        }
+    }
+
+    if (index >= 0)
+    {
+        int kpdve = KPDVE_CANDIDATE_KPDVE(tables->candidates[tables->offsets[chroma] + index]);
+        analyzer->kpdve = kpdve;
+        analyzer->context = kpdve;
+        analyzer->encoded = kpdve_chromatic_byte(kpdve, chroma);
+        analyzer->flags = 0;
+        if (analyzer->anchor != NULL)
+        {
+            kpdve_anchor_update(analyzer->anchor, kpdve);
+        }
+    }
+    else if (chroma == 0)
+    {
+        analyzer->encoded = kpdve_chromatic_byte(analyzer->kpdve, 0);
+        analyzer->flags = 0;
+    }
+    else
+    {
+        analyzer->encoded = (int)((unsigned int)kpdve_chromatic_byte(analyzer->kpdve, chroma) | 0x80000000u);
+        analyzer->flags = PF_RT_INVALID;
+    }
+    return analyzer->encoded;
+}
+
+/**
+ * @brief Analyzes the notes held now. RT-safe.
+ *
+ * @return The encoded state.
+ */
+int pf_rt_analyze(pf_rt_analyzer *analyzer)
+{
+    return pf_rt_analyze_chroma(analyzer, analyzer->chroma);
+}
+
+/**
+ * @brief The encoded state of the last analysis. RT-safe.
+ */
+int pf_rt_encoded(const pf_rt_analyzer *analyzer)
+{
+    return analyzer->encoded;
+}
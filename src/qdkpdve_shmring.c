@@ -0,0 +1,519 @@
+//
+//  qdkpdve_shmring.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_shmring.c
+ * @brief Shared-memory frame ring (see qdkpdve_shmring.h).
+ *
+ * The counters are 31-bit and wrap; a count of frames is the masked difference of two
+ * of them. The top bit of produced is the producer's "no more frames" flag, kept in the
+ * word the consumer sleeps on so that setting it is also a change the futex sees.
+ *
+ * Sleeping follows the usual pattern for futexes without a lock: the waiter raises its
+ * sleeping flag, fences, and checks the counter once more before it waits; the other
+ * side stores the counter, fences, and checks the flag. One of the two always sees the
+ * other's store, so a wake is never lost, and the futex itself rechecks the counter, so
+ * a store between the check and the wait only makes the wait return at once.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "../include/qdkpdve_latency.h"
+#include "../include/qdkpdve_shmring.h"
+
+#define RING_MAGIC 0x474E5246u    /* "FRNG" */
+#define RING_VERSION 1
+
+#define COUNT_MASK 0x7FFFFFFFu
+#define PRODUCED_CLOSED 0x80000000u
+
+#define PUBLISH_FRAMES 64             /**< the consumer publishes results at least this often */
+#define SERVE_POLL_NS 100000000       /**< longest wait in pf_ring_serve when it has a stop flag */
+#define POLL_SLEEP_NS 50000           /**< sleep between polls without futexes */
+
+// the start of the shared object; each side's words on their own cache line
+struct ring_shared {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t frame_size;
+    uint8_t pad0[48];
+
+    uint32_t produced;            /**< producer; PRODUCED_CLOSED once shut down */
+    uint32_t producer_sleeping;   /**< producer, waiting on analyzed */
+    uint8_t pad1[56];
+
+    uint32_t analyzed;            /**< consumer */
+    uint32_t consumer_sleeping;   /**< consumer, waiting on produced */
+    uint8_t pad2[56];
+
+    uint32_t collected;           /**< producer */
+    uint8_t pad3[60];
+};
+
+struct pf_ring {
+    struct ring_shared *shared;
+    struct pf_ring_frame *frames;
+    size_t size;
+    uint32_t mask;
+    struct pf_ring_stats stats;
+};
+
+static size_t ring_size(uint32_t capacity)
+{
+    return sizeof(struct ring_shared) + (size_t)capacity * sizeof(struct pf_ring_frame);
+}
+
+static void set_error(int *error, int value)
+{
+    if (error != NULL)
+    {
+        *error = value;
+    }
+}
+
+static pf_ring *attach(void *map, size_t size)
+{
+    pf_ring *ring = calloc(1, sizeof(*ring));
+    if (ring == NULL)
+    {
+        return NULL;
+    }
+    ring->shared = map;
+    ring->frames = (struct pf_ring_frame *)((char *)map + sizeof(struct ring_shared));
+    ring->size = size;
+    ring->mask = ring->shared->capacity - 1;
+    return ring;
+}
+
+/* -------------------------------------------------------------------------- waiting */
+
+// blocks while *word == seen, for at most timeout_ns (negative: no limit)
+static void sleep_on(uint32_t *word, uint32_t seen, int64_t timeout_ns)
+{
+#ifdef __linux__
+    struct timespec ts;
+    struct timespec *limit = NULL;
+    if (timeout_ns >= 0)
+    {
+        ts.tv_sec = (time_t)(timeout_ns / 1000000000);
+        ts.tv_nsec = (long)(timeout_ns % 1000000000);
+        limit = &ts;
+    }
+    // not FUTEX_PRIVATE_FLAG: the word is shared with another process
+    syscall(SYS_futex, word, FUTEX_WAIT, seen, limit, NULL, 0);
+#else
+    (void)word;
+    (void)seen;
+    struct timespec ts = { 0, POLL_SLEEP_NS };
+    if (timeout_ns >= 0 && timeout_ns < POLL_SLEEP_NS)
+    {
+        ts.tv_nsec = (long)timeout_ns;
+    }
+    nanosleep(&ts, NULL);
+#endif
+}
+
+// after a counter is published: wakes the other side if it has said it sleeps on it
+static void wake_sleeper(pf_ring *ring, uint32_t *word, uint32_t *sleeping)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(sleeping, __ATOMIC_RELAXED) == 0)
+    {
+        return;
+    }
+#ifdef __linux__
+    syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+#else
+    (void)word;
+#endif
+    ring->stats.wakes++;
+}
+
+// waits until *word differs from seen: spins for spin_ns, then sleeps; returns the word
+static uint32_t wait_for_change(pf_ring *ring, uint32_t *word, uint32_t seen, uint32_t *sleeping,
+                                uint64_t spin_ns, int64_t timeout_ns)
+{
+    uint32_t value = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+    if (value != seen || timeout_ns == 0)
+    {
+        return value;
+    }
+    uint64_t start = kpdve_latency_now_ns();
+    uint64_t elapsed = 0;
+    while (elapsed < spin_ns && (timeout_ns < 0 || elapsed < (uint64_t)timeout_ns))
+    {
+        value = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+        if (value != seen)
+        {
+            return value;
+        }
+        elapsed = kpdve_latency_now_ns() - start;
+    }
+    while (timeout_ns < 0 || elapsed < (uint64_t)timeout_ns)
+    {
+        __atomic_store_n(sleeping, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(word, __ATOMIC_RELAXED) == seen)
+        {
+            ring->stats.sleeps++;
+            sleep_on(word, seen, timeout_ns < 0 ? -1 : timeout_ns - (int64_t)elapsed);
+        }
+        __atomic_store_n(sleeping, 0, __ATOMIC_RELAXED);
+        value = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+        if (value != seen)
+        {
+            return value;
+        }
+        elapsed = kpdve_latency_now_ns() - start;
+    }
+    return value;
+}
+
+/* -------------------------------------------------------------------------- setup */
+
+/**
+ * @brief Creates a ring as a new shared memory object, replacing one of the same name.
+ *
+ * @param name The object's name ("/name", as shm_open).
+ * @param capacity Frame slots, rounded up to a power of two (at most PF_RING_MAX_CAPACITY).
+ * @param error Receives a PF_RING_ERR_ value on failure (may be NULL).
+ * @return The ring, or NULL.
+ */
+pf_ring *pf_ring_create(const char *name, uint32_t capacity, int *error)
+{
+    if (capacity == 0 || capacity > PF_RING_MAX_CAPACITY)
+    {
+        set_error(error, PF_RING_ERR_CAPACITY);
+        return NULL;
+    }
+    uint32_t slots = 1;
+    while (slots < capacity)
+    {
+        slots <<= 1;
+    }
+    size_t size = ring_size(slots);
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+    {
+        set_error(error, PF_RING_ERR_IO);
+        return NULL;
+    }
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0)
+    {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    int saved = errno;
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        shm_unlink(name);
+        errno = saved;
+        set_error(error, PF_RING_ERR_IO);
+        return NULL;
+    }
+
+    // the new object is zero-filled: every counter starts at 0
+    struct ring_shared *shared = map;
+    shared->version = RING_VERSION;
+    shared->capacity = slots;
+    shared->frame_size = sizeof(struct pf_ring_frame);
+    __atomic_store_n(&shared->magic, RING_MAGIC, __ATOMIC_RELEASE);
+
+    pf_ring *ring = attach(map, size);
+    if (ring == NULL)
+    {
+        munmap(map, size);
+        shm_unlink(name);
+        set_error(error, PF_RING_ERR_MEMORY);
+    }
+    return ring;
+}
+
+/**
+ * @brief Maps a ring created by another process, checking its layout.
+ *
+ * @param error Receives a PF_RING_ERR_ value on failure (may be NULL).
+ * @return The ring, or NULL.
+ */
+pf_ring *pf_ring_open(const char *name, int *error)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+    {
+        set_error(error, PF_RING_ERR_IO);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        set_error(error, PF_RING_ERR_IO);
+        return NULL;
+    }
+    if ((size_t)st.st_size < sizeof(struct ring_shared))
+    {
+        close(fd);
+        set_error(error, PF_RING_ERR_FORMAT);
+        return NULL;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int saved = errno;
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        errno = saved;
+        set_error(error, PF_RING_ERR_IO);
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size;
+    const struct ring_shared *shared = map;
+    uint32_t capacity = shared->capacity;
+    if (__atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE) != RING_MAGIC || shared->version != RING_VERSION
+        || shared->frame_size != sizeof(struct pf_ring_frame) || capacity == 0 || capacity > PF_RING_MAX_CAPACITY
+        || (capacity & (capacity - 1)) != 0 || size != ring_size(capacity))
+    {
+        munmap(map, size);
+        set_error(error, PF_RING_ERR_FORMAT);
+        return NULL;
+    }
+
+    pf_ring *ring = attach(map, size);
+    if (ring == NULL)
+    {
+        munmap(map, size);
+        set_error(error, PF_RING_ERR_MEMORY);
+    }
+    return ring;
+}
+
+/**
+ * @brief Unmaps the ring. The shared object stays until pf_ring_unlink.
+ */
+void pf_ring_close(pf_ring *ring)
+{
+    if (ring == NULL)
+    {
+        return;
+    }
+    munmap(ring->shared, ring->size);
+    free(ring);
+}
+
+/**
+ * @brief Removes the shared object's name; processes that have it mapped keep it.
+ *
+ * @return PF_RING_OK or PF_RING_ERR_IO.
+ */
+int pf_ring_unlink(const char *name)
+{
+    return shm_unlink(name) == 0 ? PF_RING_OK : PF_RING_ERR_IO;
+}
+
+uint32_t pf_ring_capacity(const pf_ring *ring)
+{
+    return ring->mask + 1;
+}
+
+void pf_ring_get_stats(const pf_ring *ring, struct pf_ring_stats *stats)
+{
+    *stats = ring->stats;
+}
+
+/* -------------------------------------------------------------------------- producer */
+
+/**
+ * @brief Finds free slots to fill. RT-safe.
+ *
+ * @param count Receives the number of free slots that follow one another from the
+ * returned one (0 when the ring is full; fewer than are free when they wrap around).
+ * @return The first free slot, or NULL when there is none.
+ */
+struct pf_ring_frame *pf_ring_reserve(pf_ring *ring, uint32_t *count)
+{
+    struct ring_shared *shared = ring->shared;
+    uint32_t produced = __atomic_load_n(&shared->produced, __ATOMIC_RELAXED) & COUNT_MASK;
+    uint32_t collected = __atomic_load_n(&shared->collected, __ATOMIC_RELAXED);
+    uint32_t start = produced & ring->mask;
+    uint32_t free_slots = ring->mask + 1 - ((produced - collected) & COUNT_MASK);
+    uint32_t run = ring->mask + 1 - start;
+    *count = free_slots < run ? free_slots : run;
+    return *count ? &ring->frames[start] : NULL;
+}
+
+/**
+ * @brief Hands the first count reserved slots to the consumer. RT-safe: a system call
+ * only if the consumer is asleep.
+ */
+void pf_ring_publish(pf_ring *ring, uint32_t count)
+{
+    struct ring_shared *shared = ring->shared;
+    uint32_t produced = __atomic_load_n(&shared->produced, __ATOMIC_RELAXED);
+    uint32_t next = ((produced + count) & COUNT_MASK) | (produced & PRODUCED_CLOSED);
+    __atomic_store_n(&shared->produced, next, __ATOMIC_RELEASE);
+    ring->stats.frames += count;
+    wake_sleeper(ring, &shared->produced, &shared->consumer_sleeping);
+}
+
+/**
+ * @brief Finds analyzed frames not yet released. RT-safe.
+ *
+ * @param count Receives the number of analyzed frames that follow one another from the
+ * returned one, in the order they were published.
+ * @return The oldest analyzed frame, or NULL when there is none.
+ */
+const struct pf_ring_frame *pf_ring_results(pf_ring *ring, uint32_t *count)
+{
+    struct ring_shared *shared = ring->shared;
+    uint32_t analyzed = __atomic_load_n(&shared->analyzed, __ATOMIC_ACQUIRE);
+    uint32_t collected = __atomic_load_n(&shared->collected, __ATOMIC_RELAXED);
+    uint32_t start = collected & ring->mask;
+    uint32_t ready = (analyzed - collected) & COUNT_MASK;
+    uint32_t run = ring->mask + 1 - start;
+    *count = ready < run ? ready : run;
+    return *count ? &ring->frames[start] : NULL;
+}
+
+/**
+ * @brief Frees the oldest count analyzed frames for reuse. RT-safe.
+ */
+void pf_ring_release(pf_ring *ring, uint32_t count)
+{
+    struct ring_shared *shared = ring->shared;
+    uint32_t collected = __atomic_load_n(&shared->collected, __ATOMIC_RELAXED);
+    __atomic_store_n(&shared->collected, (collected + count) & COUNT_MASK, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Waits for analyzed frames. Not RT-safe (it may sleep).
+ *
+ * @param spin_ns Time to poll before sleeping.
+ * @param timeout_ns Longest wait (0: just look; negative: no limit).
+ * @return Analyzed frames not yet released (0 on timeout).
+ */
+uint32_t pf_ring_wait_results(pf_ring *ring, uint64_t spin_ns, int64_t timeout_ns)
+{
+    struct ring_shared *shared = ring->shared;
+    uint32_t collected = __atomic_load_n(&shared->collected, __ATOMIC_RELAXED);
+    uint32_t analyzed = wait_for_change(ring, &shared->analyzed, collected, &shared->producer_sleeping, spin_ns,
+                                        timeout_ns);
+    return (analyzed - collected) & COUNT_MASK;
+}
+
+/**
+ * @brief Tells the consumer that no more frames will come; it finishes those published.
+ */
+void pf_ring_shutdown(pf_ring *ring)
+{
+    struct ring_shared *shared = ring->shared;
+    __atomic_or_fetch(&shared->produced, PRODUCED_CLOSED, __ATOMIC_RELEASE);
+    wake_sleeper(ring, &shared->produced, &shared->consumer_sleeping);
+}
+
+/* -------------------------------------------------------------------------- consumer */
+
+/**
+ * @brief Waits for frames to analyze.
+ *
+ * @param spin_ns Time to poll before sleeping.
+ * @param timeout_ns Longest wait (0: just look; negative: no limit).
+ * @return Frames published and not analyzed (0 on timeout, or once the producer has
+ * shut down and every frame is analyzed).
+ */
+uint32_t pf_ring_wait_input(pf_ring *ring, uint64_t spin_ns, int64_t timeout_ns)
+{
+    struct ring_shared *shared = ring->shared;
+    uint32_t analyzed = __atomic_load_n(&shared->analyzed, __ATOMIC_RELAXED);
+    uint32_t produced = wait_for_change(ring, &shared->produced, analyzed, &shared->consumer_sleeping, spin_ns,
+                                        timeout_ns);
+    return (produced - analyzed) & COUNT_MASK;
+}
+
+/**
+ * @brief Analyzes every published frame in place, in order, with one analyzer carried
+ * across calls, and publishes the states at least every PUBLISH_FRAMES frames.
+ *
+ * @return Frames analyzed.
+ */
+uint32_t pf_ring_analyze(pf_ring *ring, pf_rt_analyzer *analyzer)
+{
+    struct ring_shared *shared = ring->shared;
+    uint32_t produced = __atomic_load_n(&shared->produced, __ATOMIC_ACQUIRE) & COUNT_MASK;
+    uint32_t analyzed = __atomic_load_n(&shared->analyzed, __ATOMIC_RELAXED);
+    uint32_t count = (produced - analyzed) & COUNT_MASK;
+    if (count > ring->mask + 1)
+    {
+        count = ring->mask + 1; // a broken producer: never read past the ring
+    }
+    uint32_t done = 0;
+    while (done < count)
+    {
+        uint32_t end = done + PUBLISH_FRAMES < count ? done + PUBLISH_FRAMES : count;
+        for (; done < end; done++)
+        {
+            struct pf_ring_frame *frame = &ring->frames[(analyzed + done) & ring->mask];
+            if (frame->flags & PF_RING_FRAME_RESET)
+            {
+                pf_rt_reset(analyzer);
+            }
+            frame->state = (uint32_t)pf_rt_analyze_chroma(analyzer, frame->chroma & 0xFFF);
+        }
+        __atomic_store_n(&shared->analyzed, (analyzed + done) & COUNT_MASK, __ATOMIC_RELEASE);
+        wake_sleeper(ring, &shared->analyzed, &shared->producer_sleeping);
+    }
+    ring->stats.frames += count;
+    return count;
+}
+
+/**
+ * @brief Whether the producer has shut down and every frame it published is analyzed.
+ */
+int pf_ring_closed(const pf_ring *ring)
+{
+    const struct ring_shared *shared = ring->shared;
+    uint32_t produced = __atomic_load_n(&shared->produced, __ATOMIC_ACQUIRE);
+    uint32_t analyzed = __atomic_load_n(&shared->analyzed, __ATOMIC_RELAXED);
+    return (produced & PRODUCED_CLOSED) != 0 && (produced & COUNT_MASK) == analyzed;
+}
+
+/**
+ * @brief The consumer loop: analyzes frames as they come until the producer shuts down
+ * (or *stop is set, checked at least every 100 ms).
+ *
+ * @param stop A flag set by another thread or a signal handler (may be NULL).
+ * @return Frames analyzed.
+ */
+uint64_t pf_ring_serve(pf_ring *ring, pf_rt_analyzer *analyzer, uint64_t spin_ns, const int *stop)
+{
+    uint64_t frames = 0;
+    while (stop == NULL || !__atomic_load_n(stop, __ATOMIC_RELAXED))
+    {
+        frames += pf_ring_analyze(ring, analyzer);
+        if (pf_ring_closed(ring))
+        {
+            break;
+        }
+        pf_ring_wait_input(ring, spin_ns, stop != NULL ? SERVE_POLL_NS : -1);
+    }
+    return frames;
+}
@@ -0,0 +1,399 @@
+//
+//  qdkpdve_snapshot.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_snapshot.c
+ * @brief Seqlock-published stream snapshots in shared memory (see qdkpdve_snapshot.h).
+ *
+ * The writer keeps each stream's state in private memory, updates it there, and copies
+ * the whole state into the slot on every record. Both sides move the state as 32-bit
+ * words with relaxed atomic loads and stores, so a read that races a write is a retry,
+ * not a data race: the release fence after the odd sequence keeps the words from being
+ * stored before it, and the acquire fence before the second sequence load keeps them
+ * from being loaded after it.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_latency.h"
+#include "../include/qdkpdve_snapshot.h"
+
+#define SNAPSHOT_MAGIC 0x534E4650u    /* "PFNS" */
+#define SNAPSHOT_VERSION 1
+
+#define STATE_WORDS (sizeof(struct pf_snapshot_state) / sizeof(uint32_t))
+#define SLOT_STRIDE ((sizeof(struct slot_head) + sizeof(struct pf_snapshot_state) + 63) & ~(size_t)63)
+
+struct snapshot_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t streams;
+    uint32_t state_size;
+    uint8_t pad[48];
+};
+
+// a slot: the sequence, then the state as words (each slot starts a cache line)
+struct slot_head {
+    uint32_t sequence;
+    uint32_t reserved;
+};
+
+// the writer's copy of a stream's state, read as words when published
+union stream_copy {
+    struct pf_snapshot_state state;
+    uint32_t words[STATE_WORDS];
+};
+
+struct pf_snapshot {
+    void *map;
+    size_t size;
+    uint32_t streams;
+    const kpdve_tables *tables;    /**< writer only */
+    union stream_copy *local;      /**< writer only: [streams] */
+};
+
+static size_t snapshot_size(uint32_t streams)
+{
+    return sizeof(struct snapshot_header) + (size_t)streams * SLOT_STRIDE;
+}
+
+static struct slot_head *slot_at(const pf_snapshot *snapshot, uint32_t stream)
+{
+    return (struct slot_head *)((char *)snapshot->map + sizeof(struct snapshot_header) + (size_t)stream * SLOT_STRIDE);
+}
+
+static uint32_t *slot_words(struct slot_head *slot)
+{
+    return (uint32_t *)(slot + 1);
+}
+
+static void set_error(int *error, int value)
+{
+    if (error != NULL)
+    {
+        *error = value;
+    }
+}
+
+/* -------------------------------------------------------------------------- setup */
+
+/**
+ * @brief Creates a snapshot region with a slot per stream, replacing one of the same
+ * name, and becomes its writer.
+ *
+ * @param name The object's name ("/name", as shm_open).
+ * @param tables The tables the candidates are ranked with (NULL: the built-in ones).
+ * @param error Receives a PF_SNAPSHOT_ERR_ value on failure (may be NULL).
+ * @return The snapshot, or NULL.
+ */
+pf_snapshot *pf_snapshot_create(const char *name, uint32_t streams, const kpdve_tables *tables, int *error)
+{
+    if (streams == 0 || streams > (1u << 20))
+    {
+        set_error(error, PF_SNAPSHOT_ERR_RANGE);
+        return NULL;
+    }
+    pf_snapshot *snapshot = calloc(1, sizeof(*snapshot));
+    union stream_copy *local = calloc(streams, sizeof(*local));
+    if (snapshot == NULL || local == NULL)
+    {
+        free(snapshot);
+        free(local);
+        set_error(error, PF_SNAPSHOT_ERR_MEMORY);
+        return NULL;
+    }
+    size_t size = snapshot_size(streams);
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    void *map = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, (off_t)size) == 0)
+    {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    int saved = errno;
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    if (map == MAP_FAILED)
+    {
+        if (fd >= 0)
+        {
+            shm_unlink(name);
+        }
+        free(snapshot);
+        free(local);
+        errno = saved;
+        set_error(error, PF_SNAPSHOT_ERR_IO);
+        return NULL;
+    }
+
+    // the new object is zero-filled: every slot is at sequence 0, with no frames
+    struct snapshot_header *header = map;
+    header->version = SNAPSHOT_VERSION;
+    header->streams = streams;
+    header->state_size = sizeof(struct pf_snapshot_state);
+    __atomic_store_n(&header->magic, SNAPSHOT_MAGIC, __ATOMIC_RELEASE);
+
+    snapshot->map = map;
+    snapshot->size = size;
+    snapshot->streams = streams;
+    snapshot->tables = tables != NULL ? tables : kpdve_tables_default();
+    snapshot->local = local;
+    return snapshot;
+}
+
+/**
+ * @brief Maps a snapshot region read-only, as a reader.
+ *
+ * @param error Receives a PF_SNAPSHOT_ERR_ value on failure (may be NULL).
+ * @return The snapshot, or NULL.
+ */
+pf_snapshot *pf_snapshot_open(const char *name, int *error)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        set_error(error, PF_SNAPSHOT_ERR_IO);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        set_error(error, PF_SNAPSHOT_ERR_IO);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size < sizeof(struct snapshot_header))
+    {
+        close(fd);
+        set_error(error, PF_SNAPSHOT_ERR_FORMAT);
+        return NULL;
+    }
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    int saved = errno;
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        errno = saved;
+        set_error(error, PF_SNAPSHOT_ERR_IO);
+        return NULL;
+    }
+
+    const struct snapshot_header *header = map;
+    uint32_t streams = header->streams;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION
+        || header->state_size != sizeof(struct pf_snapshot_state) || streams == 0
+        || streams > (1u << 20) || size != snapshot_size(streams))
+    {
+        munmap(map, size);
+        set_error(error, PF_SNAPSHOT_ERR_FORMAT);
+        return NULL;
+    }
+    pf_snapshot *snapshot = calloc(1, sizeof(*snapshot));
+    if (snapshot == NULL)
+    {
+        munmap(map, size);
+        set_error(error, PF_SNAPSHOT_ERR_MEMORY);
+        return NULL;
+    }
+    snapshot->map = map;
+    snapshot->size = size;
+    snapshot->streams = streams;
+    return snapshot;
+}
+
+/**
+ * @brief Unmaps the region. The shared object stays until pf_snapshot_unlink.
+ */
+void pf_snapshot_close(pf_snapshot *snapshot)
+{
+    if (snapshot == NULL)
+    {
+        return;
+    }
+    munmap(snapshot->map, snapshot->size);
+    free(snapshot->local);
+    free(snapshot);
+}
+
+/**
+ * @brief Removes the region's name; processes that have it mapped keep it.
+ *
+ * @return PF_SNAPSHOT_OK or PF_SNAPSHOT_ERR_IO.
+ */
+int pf_snapshot_unlink(const char *name)
+{
+    return shm_unlink(name) == 0 ? PF_SNAPSHOT_OK : PF_SNAPSHOT_ERR_IO;
+}
+
+uint32_t pf_snapshot_streams(const pf_snapshot *snapshot)
+{
+    return snapshot->streams;
+}
+
+/* -------------------------------------------------------------------------- writer */
+
+// the chosen KPDVE, then the chroma's other candidates nearest the context, measured as
+// kpdve_tables_choose measures them (a stable insertion, so ties keep the table order). The
+// choice goes first even when an anchor or a prior made it over a nearer candidate.
+static void rank_candidates(const kpdve_tables *tables, struct pf_snapshot_state *state, int chroma, int context,
+                            uint32_t chosen)
+{
+    state->candidate_count = 0;
+    if (chroma == 0)
+    {
+        return;
+    }
+    int first = tables->offsets[chroma];
+    int count = tables->offsets[chroma + 1] - first;
+    const float *k_row = tables->k_distance + (context >> 12) * 12;
+    const float *p_row = tables->p_distance + ((context >> 9) & 0x7) * 8;
+    const float *d_row = tables->d_distance + ((context >> 6) & 0x7) * 8;
+    int context_kp = (context >> 9) & 0x7F;
+
+    float order[PF_SNAPSHOT_CANDIDATES]; // the distance, or -1 for the choice
+    int kept = 0;
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t kpdve = tables->candidates[first + i] & 0xFFFF;
+        float dist = 0;
+        if ((int)((kpdve >> 9) & 0x7F) != context_kp)
+        {
+            dist += k_row[(kpdve >> 12) & 0xF];
+            dist += p_row[(kpdve >> 9) & 0x7];
+            dist += d_row[(kpdve >> 6) & 0x7];
+        }
+        float key = (kpdve == chosen) ? -1.0f : dist;
+        int at = kept;
+        while (at > 0 && order[at - 1] > key)
+        {
+            at--;
+        }
+        if (at == PF_SNAPSHOT_CANDIDATES)
+        {
+            continue;
+        }
+        int last = kept < PF_SNAPSHOT_CANDIDATES ? kept : PF_SNAPSHOT_CANDIDATES - 1;
+        for (int j = last; j > at; j--)
+        {
+            state->candidates[j] = state->candidates[j - 1];
+            order[j] = order[j - 1];
+        }
+        state->candidates[at] = (struct pf_snapshot_candidate){ kpdve, dist };
+        order[at] = key;
+        kept += (kept < PF_SNAPSHOT_CANDIDATES);
+    }
+    state->candidate_count = (uint32_t)count;
+}
+
+// copies the writer's state into the slot under the seqlock
+static void publish(struct slot_head *slot, const union stream_copy *copy)
+{
+    uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    uint32_t *words = slot_words(slot);
+    for (size_t i = 0; i < STATE_WORDS; i++)
+    {
+        __atomic_store_n(&words[i], copy->words[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Records an analyzed frame of a stream and publishes the stream's state. RT-safe.
+ *
+ * @param encoded The frame's encoded state.
+ * @param context The KPDVE it was chosen in (the analyzer's context before the frame).
+ */
+void pf_snapshot_record(pf_snapshot *snapshot, uint32_t stream, int encoded, int context)
+{
+    if (snapshot->local == NULL || stream >= snapshot->streams)
+    {
+        return;
+    }
+    struct pf_snapshot_state *state = &snapshot->local[stream].state;
+    uint32_t word = (uint32_t)encoded;
+    uint32_t kpdve = (word >> 12) & 0xFFFF;
+
+    if (state->frames == 0 || (kpdve >> 9) != (state->history[0].kpdve >> 9))
+    {
+        state->kp_changes += (state->frames != 0);
+        int keep = state->history_count < PF_SNAPSHOT_HISTORY ? (int)state->history_count : PF_SNAPSHOT_HISTORY - 1;
+        memmove(&state->history[1], &state->history[0], (size_t)keep * sizeof(state->history[0]));
+        state->history[0] = (struct pf_snapshot_kp){ state->frames, kpdve, 0 };
+        state->history_count = (uint32_t)keep + 1;
+    }
+    state->invalid_frames += (word & 0x80000000u) != 0;
+    state->frames++;
+    state->encoded = word;
+    state->context = (uint32_t)context;
+    state->updated_ns = kpdve_latency_now_ns();
+    rank_candidates(snapshot->tables, state, (int)(word & 0xFFF), context, (word & 0x80000000u) ? 0xFFFFFFFFu : kpdve);
+
+    publish(slot_at(snapshot, stream), &snapshot->local[stream]);
+}
+
+/**
+ * @brief pf_rt_analyze_chroma, recorded into the stream's snapshot. RT-safe.
+ *
+ * @return The encoded state.
+ */
+int pf_snapshot_analyze(pf_snapshot *snapshot, uint32_t stream, pf_rt_analyzer *analyzer, int chroma)
+{
+    int context = analyzer->context;
+    int encoded = pf_rt_analyze_chroma(analyzer, chroma);
+    pf_snapshot_record(snapshot, stream, encoded, context);
+    return encoded;
+}
+
+/* -------------------------------------------------------------------------- reader */
+
+/**
+ * @brief Copies a stream's latest state. Never waits for the writer.
+ *
+ * @return PF_SNAPSHOT_OK, PF_SNAPSHOT_BUSY if every attempt overlapped a write, or
+ * PF_SNAPSHOT_ERR_RANGE.
+ */
+int pf_snapshot_read(const pf_snapshot *snapshot, uint32_t stream, struct pf_snapshot_state *state)
+{
+    if (stream >= snapshot->streams)
+    {
+        return PF_SNAPSHOT_ERR_RANGE;
+    }
+    struct slot_head *slot = slot_at(snapshot, stream);
+    const uint32_t *words = slot_words(slot);
+    union stream_copy copy;
+    for (int attempt = 0; attempt < PF_SNAPSHOT_READ_TRIES; attempt++)
+    {
+        uint32_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1)
+        {
+            continue;
+        }
+        for (size_t i = 0; i < STATE_WORDS; i++)
+        {
+            copy.words[i] = __atomic_load_n(&words[i], __ATOMIC_RELAXED);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == before)
+        {
+            *state = copy.state;
+            return PF_SNAPSHOT_OK;
+        }
+    }
+    return PF_SNAPSHOT_BUSY;
+}
@@ -19,6 +19,8 @@
 #include "../include/qdkpdve.h"
 #include "../include/qdkpdve_analysis.h"
 #include "../include/qdkpdve_harmonycrystal.h"
+#include "../include/qdkpdve_stats.h"
+#include "../include/qdkpdve_tables.h"
 
 // This is 12 * 7 --> if the system were to be expanded to other twin primes, this would become dynamic.
 static int MAXKPDVELIST = 84;
@@ -33,7 +35,7 @@ static int kpdve_mods[] = {12, 7, 7, 7, 7};
 // biases toward axes (used for P, mainly... to tend away from entropic patterns -- NOT IMPLEMENTED
 static float kpdve_axis_biases[] = {1.0, 1.0, 1.0, 1.0, 1.0};
 // dilates the axis so distances are greater for key and pattern (harder to change) than for degree.
-static float kpdve_axis_scale[] = {1.02, 1.01, 1.0, 1.0, 1.0};
+static float kpdve_axis_scale[] = KPDVE_AXIS_SCALE;
 
 /**
  * @brief Reduces an input value by applying modular rotation and compression.
@@ -114,6 +116,9 @@ void set_kp_list(harmony_state *a_state)
         }
     }
     a_state->kpdve_list_length = match_count;
+
+    KPDVE_STATS_ADD(kp_cells_tested, the_crystal.crystalsize);
+    KPDVE_STATS_LIST(match_count);
 }
 
 //////////////////////////////
@@ -167,6 +172,31 @@ float biasedModDistance(int val1, int val2, int mod, float bias)
  * @return The distance between the two KPDVE encodings.
  */
 double KPD_distance(int kpdve_1, int kpdve_2)
+{
+    return KPD_distance_weighted(kpdve_1, kpdve_2, kpdve_axis_scale);
+}
+
+/**
+ * @brief Copies the built-in axis weights (kpdve_axis_scale: K, P, D, V, E).
+ */
+void kpdve_default_axis_scale(float axis_scale[5])
+{
+    for (int i = 0; i < 5; i++)
+    {
+        axis_scale[i] = kpdve_axis_scale[i];
+    }
+}
+
+/**
+ * @brief KPD_distance with other axis weights, for tuning and for tables built for
+ * another configuration. With the built-in weights it is KPD_distance, to the bit.
+ *
+ * @param kpdve_1 The first KPDVE encoding.
+ * @param kpdve_2 The second KPDVE encoding.
+ * @param axis_scale Weights of K, P, D, V, E (only K, P, D enter the distance).
+ * @return The distance between the two KPDVE encodings.
+ */
+double KPD_distance_weighted(int kpdve_1, int kpdve_2, const float axis_scale[5])
 {
     float innerSum = 0;
     float dist = 0;
@@ -181,7 +211,7 @@ double KPD_distance(int kpdve_1, int kpdve_2)
     {
         dist = modDistance(temp1[i], temp2[i], kpdve_mods[i]);
 //        dist = biasedModDistance(temp1[i], temp2[i], kpdve_mods[i], kpdve_axis_biases[i]);
-        dist *= kpdve_axis_scale[i]; // scales distance for param priorities
+        dist *= axis_scale[i]; // scales distance for param priorities
 //        innerSum += dist * dist;
         innerSum += dist;
     }
@@ -211,6 +241,8 @@ void set_min_index(harmony_state *current_state, int context)
     //
     binaryEncodingToKPDVE(context, context_temp);
 
+    KPDVE_STATS_ADD(min_index_calls, 1);
+
     for (int i = 0; i < current_state->kpdve_list_length; i++)
     {
         binaryEncodingToKPDVE(current_state->kpdve_list[i], kpdve_temp);
@@ -219,6 +251,7 @@ void set_min_index(harmony_state *current_state, int context)
         if ((kpdve_temp[0] == context_temp[0]) && (kpdve_temp[1] == context_temp[1]))
         {
             min_index = i;
+            KPDVE_STATS_ADD(same_kp_hits, 1);
             break;
         }
         temp_dist = KPD_distance(current_state->kpdve_list[i], context);
@@ -253,6 +286,7 @@ harmony_state harmony_state_from_binary(int chroma_val)
 {
     harmony_state a_state;
 
+    a_state.kpdve = 0; // no choice yet (choose_kpdve_from_context compares against it)
     a_state.chromatic_notes = chroma_val & 0xFFF;
     set_kp_list(&a_state);
     
@@ -278,12 +312,21 @@ harmony_state harmony_state_from_binary(int chroma_val)
 void choose_kpdve_from_context(harmony_state *current_state, int context)
 // REGULAR
 {
+#ifdef PITCHFLOCK_STATS
+    int previous_kpdve = current_state->kpdve;
+#endif
     set_min_index(current_state, context);
     current_state->kpdve = current_state->kpdve_list[current_state->kpdve_min_index];
     current_state->dve = current_state->dve_list[current_state->kpdve_min_index];
     current_state->ve = current_state->ve_list[current_state->kpdve_min_index];
 
     encode_and_validate_state(current_state);
+
+#ifdef PITCHFLOCK_STATS
+    KPDVE_STATS_ADD(frames, 1);
+    KPDVE_STATS_ADD(key_changes, ((previous_kpdve ^ current_state->kpdve) & 0xF000) != 0);
+    KPDVE_STATS_ADD(pattern_changes, ((previous_kpdve ^ current_state->kpdve) & 0x0E00) != 0);
+#endif
 }
 
 
@@ -491,6 +534,7 @@ void encode_and_validate_state(harmony_state *a_state) {
     }
     if (isInvalid) {
         a_state -> encoded_state |= validity_bit;
+        KPDVE_STATS_ADD(invalid, 1);
     }
 //    else {
 //        // make a record that something happened, and what it was.
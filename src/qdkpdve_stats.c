@@ -0,0 +1,142 @@
+//
+//  qdkpdve_stats.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_stats.c
+ * @brief Registry and aggregation of the per-thread analysis counters (see qdkpdve_stats.h).
+ *
+ * A thread's block is claimed and linked into the registry on its first count, and stays
+ * there after the thread exits, so no counts are lost. Blocks are never freed.
+ *
+ * The first count can happen inside an RT-safe call (qdkpdve_rt.h), so registering takes
+ * no lock and allocates nothing: the block comes from a static slab (one atomic increment)
+ * and is pushed onto the registry with a compare-and-swap. Only threads beyond the slab's
+ * STATS_SLAB_BLOCKS allocate theirs.
+ */
+
+#include <string.h>
+
+#include "../include/qdkpdve_stats.h"
+
+#ifdef PITCHFLOCK_STATS
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#define COUNTERS (sizeof(struct kpdve_stats) / sizeof(uint64_t))
+#define STATS_SLAB_BLOCKS 256 // threads whose blocks need no allocation
+
+__thread struct kpdve_stats_block *kpdve_stats_local = NULL;
+
+static struct kpdve_stats_block slab[STATS_SLAB_BLOCKS];
+static uint32_t slab_claimed = 0;
+static struct kpdve_stats_block *registry = NULL;
+static pthread_mutex_t baseline_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct kpdve_stats baseline; // totals at the last reset
+
+/**
+ * @brief Claims and registers the calling thread's block (called by the hooks on first use).
+ *
+ * Lock-free, and allocation-free for the first STATS_SLAB_BLOCKS threads.
+ *
+ * @return The block, or NULL if it could not be allocated (the count is then dropped).
+ */
+struct kpdve_stats_block *kpdve_stats_register(void)
+{
+    struct kpdve_stats_block *block;
+    uint32_t index = __atomic_fetch_add(&slab_claimed, 1, __ATOMIC_RELAXED);
+    if (index < STATS_SLAB_BLOCKS)
+    {
+        block = &slab[index];
+    }
+    else
+    {
+        void *memory = NULL;
+        if (posix_memalign(&memory, 64, sizeof(struct kpdve_stats_block)) != 0)
+        {
+            return NULL;
+        }
+        block = memory;
+        memset(block, 0, sizeof(*block));
+    }
+
+    // the release publishes the link (and a fresh block's zeros) to sum_blocks
+    block->next = __atomic_load_n(&registry, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&registry, &block->next, block, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    {
+    }
+
+    kpdve_stats_local = block;
+    return block;
+}
+
+// sum of all blocks registered so far
+static void sum_blocks(struct kpdve_stats *out)
+{
+    uint64_t *total = (uint64_t *)out;
+    memset(out, 0, sizeof(*out));
+    for (struct kpdve_stats_block *block = __atomic_load_n(&registry, __ATOMIC_ACQUIRE); block != NULL; block = block->next)
+    {
+        uint64_t *counts = (uint64_t *)&block->counts;
+        for (size_t i = 0; i < COUNTERS; i++)
+        {
+            total[i] += __atomic_load_n(&counts[i], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+int kpdve_stats_enabled(void)
+{
+    return 1;
+}
+
+/**
+ * @brief Adds up the counters of all threads since the last reset.
+ *
+ * Counts made concurrently may or may not be included; each counter is read atomically.
+ *
+ * @param out Receives the totals.
+ */
+void kpdve_stats_snapshot(struct kpdve_stats *out)
+{
+    uint64_t *total = (uint64_t *)out;
+    const uint64_t *base = (const uint64_t *)&baseline;
+
+    pthread_mutex_lock(&baseline_lock);
+    sum_blocks(out);
+    for (size_t i = 0; i < COUNTERS; i++)
+    {
+        total[i] -= base[i];
+    }
+    pthread_mutex_unlock(&baseline_lock);
+}
+
+/**
+ * @brief Starts counting from zero again, for all threads.
+ */
+void kpdve_stats_reset(void)
+{
+    pthread_mutex_lock(&baseline_lock);
+    sum_blocks(&baseline);
+    pthread_mutex_unlock(&baseline_lock);
+}
+
+#else
+
+int kpdve_stats_enabled(void)
+{
+    return 0;
+}
+
+void kpdve_stats_snapshot(struct kpdve_stats *out)
+{
+    memset(out, 0, sizeof(*out));
+}
+
+void kpdve_stats_reset(void)
+{
+}
+
+#endif /* PITCHFLOCK_STATS */
@@ -0,0 +1,427 @@
+//
+//  qdkpdve_store.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_store.c
+ * @brief Writer and memory-mapped reader for the analysis store (see qdkpdve_store.h).
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_store.h"
+
+#define STATE_INVALID(s) ((s) < 0)          // the x bit is the sign bit
+#define STATE_K(s) (((s) >> 24) & 0xF)
+#define STATE_P(s) (((s) >> 21) & 0x7)
+
+static uint64_t align8(uint64_t offset)
+{
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+/**
+ * @brief Creates a store file and prepares to append frames to it.
+ *
+ * @param w The writer to initialize.
+ * @param path Output file.
+ * @param block_frames Frames per block (0 for KPDVE_STORE_BLOCK_FRAMES).
+ * @param frame_period Time units per frame, used to interpolate within a block.
+ * @return KPDVE_STORE_OK or an error code.
+ */
+int kpdve_store_writer_open(kpdve_store_writer *w, const char *path, uint32_t block_frames, uint64_t frame_period)
+{
+    memset(w, 0, sizeof(*w));
+    w->last_valid = -1;
+
+    w->header.magic = KPDVE_STORE_MAGIC;
+    w->header.version = KPDVE_STORE_VERSION;
+    w->header.block_frames = block_frames ? block_frames : KPDVE_STORE_BLOCK_FRAMES;
+    w->header.frame_period = frame_period;
+    w->header.states_offset = sizeof(struct kpdve_store_header);
+
+    w->file = fopen(path, "wb");
+    if (w->file == NULL)
+    {
+        return KPDVE_STORE_ERR_IO;
+    }
+    setvbuf(w->file, NULL, _IOFBF, 1 << 20);
+
+    // placeholder; the real header is written by kpdve_store_writer_close
+    if (fwrite(&w->header, sizeof(w->header), 1, w->file) != 1)
+    {
+        fclose(w->file);
+        w->file = NULL;
+        return KPDVE_STORE_ERR_IO;
+    }
+    return KPDVE_STORE_OK;
+}
+
+/**
+ * @brief Declares the time of the next appended frame (e.g. after a gap in the input).
+ *
+ * The time index only records the time of the first frame of each block, so a gap
+ * declared in the middle of a block is exact from the following block on.
+ */
+void kpdve_store_set_time(kpdve_store_writer *w, uint64_t time)
+{
+    w->next_time = time;
+}
+
+static int start_block(kpdve_store_writer *w)
+{
+    size_t b = (size_t)w->header.block_count;
+    if (b == w->blocks_cap)
+    {
+        size_t cap = w->blocks_cap ? w->blocks_cap * 2 : 64;
+        struct kpdve_store_block *blocks = realloc(w->blocks, cap * sizeof(*blocks));
+        if (blocks == NULL)
+        {
+            return KPDVE_STORE_ERR_MEMORY;
+        }
+        w->blocks = blocks;
+        uint64_t *times = realloc(w->times, cap * sizeof(*times));
+        if (times == NULL)
+        {
+            return KPDVE_STORE_ERR_MEMORY;
+        }
+        w->times = times;
+        w->blocks_cap = cap;
+    }
+
+    struct kpdve_store_block *block = &w->blocks[b];
+    memset(block, 0, sizeof(*block));
+    block->k_min = 0xFF;
+    block->p_min = 0xFF;
+    block->k_in = (w->last_valid < 0) ? 0xFF : (uint8_t)STATE_K(w->last_valid);
+    w->times[b] = w->next_time;
+    w->header.block_count++;
+    return KPDVE_STORE_OK;
+}
+
+static void summarize(kpdve_store_writer *w, struct kpdve_store_block *block, int state)
+{
+    if (STATE_INVALID(state))
+    {
+        return;
+    }
+    uint8_t k = (uint8_t)STATE_K(state);
+    uint8_t p = (uint8_t)STATE_P(state);
+
+    block->key_mask |= (uint16_t)(1 << k);
+    block->pattern_mask |= (uint8_t)(1 << p);
+    if (k < block->k_min) block->k_min = k;
+    if (k > block->k_max) block->k_max = k;
+    if (p < block->p_min) block->p_min = p;
+    if (p > block->p_max) block->p_max = p;
+
+    if (w->last_valid >= 0)
+    {
+        int k_changed = STATE_K(w->last_valid) != k;
+        block->k_changes += k_changed;
+        block->kp_changes += k_changed || STATE_P(w->last_valid) != p;
+    }
+    w->last_valid = state;
+}
+
+/**
+ * @brief Appends frames to the store.
+ *
+ * @return KPDVE_STORE_OK or an error code.
+ */
+int kpdve_store_append(kpdve_store_writer *w, const int *states, size_t count)
+{
+    uint32_t block_frames = w->header.block_frames;
+
+    while (count > 0)
+    {
+        size_t in_block = (size_t)(w->header.frame_count % block_frames);
+        if (in_block == 0)
+        {
+            int err = start_block(w);
+            if (err != KPDVE_STORE_OK)
+            {
+                return err;
+            }
+        }
+
+        size_t take = block_frames - in_block;
+        if (take > count)
+        {
+            take = count;
+        }
+
+        struct kpdve_store_block *block = &w->blocks[w->header.block_count - 1];
+        for (size_t i = 0; i < take; i++)
+        {
+            summarize(w, block, states[i]);
+        }
+        if (fwrite(states, sizeof(int), take, w->file) != take)
+        {
+            return KPDVE_STORE_ERR_IO;
+        }
+
+        w->header.frame_count += take;
+        w->next_time += take * w->header.frame_period;
+        states += take;
+        count -= take;
+    }
+    return KPDVE_STORE_OK;
+}
+
+/**
+ * @brief Writes the block summaries, time index and final header, and closes the file.
+ *
+ * @return KPDVE_STORE_OK or an error code. The writer is released either way.
+ */
+int kpdve_store_writer_close(kpdve_store_writer *w)
+{
+    int err = KPDVE_STORE_OK;
+    struct kpdve_store_header *h = &w->header;
+    static const uint8_t zeros[8] = { 0 };
+
+    uint64_t states_end = h->states_offset + h->frame_count * sizeof(int);
+    h->blocks_offset = align8(states_end);
+    h->times_offset = h->blocks_offset + h->block_count * sizeof(struct kpdve_store_block);
+
+    size_t pad = (size_t)(h->blocks_offset - states_end);
+    if (fwrite(zeros, 1, pad, w->file) != pad
+        || fwrite(w->blocks, sizeof(struct kpdve_store_block), (size_t)h->block_count, w->file) != h->block_count
+        || fwrite(w->times, sizeof(uint64_t), (size_t)h->block_count, w->file) != h->block_count
+        || fseek(w->file, 0, SEEK_SET) != 0
+        || fwrite(h, sizeof(*h), 1, w->file) != 1)
+    {
+        err = KPDVE_STORE_ERR_IO;
+    }
+    if (fclose(w->file) != 0)
+    {
+        err = KPDVE_STORE_ERR_IO;
+    }
+
+    free(w->blocks);
+    free(w->times);
+    w->blocks = NULL;
+    w->times = NULL;
+    w->file = NULL;
+    return err;
+}
+
+//////////////////////////////////// reading
+
+/**
+ * @brief Maps a store file read-only and checks that its sections fit the file.
+ *
+ * @param store Receives the mapping.
+ * @param path The store file.
+ * @return KPDVE_STORE_OK or an error code.
+ */
+int kpdve_store_open(kpdve_store *store, const char *path)
+{
+    memset(store, 0, sizeof(*store));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return KPDVE_STORE_ERR_IO;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct kpdve_store_header))
+    {
+        close(fd);
+        return KPDVE_STORE_ERR_FORMAT;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return KPDVE_STORE_ERR_IO;
+    }
+
+    const struct kpdve_store_header *h = map;
+    uint64_t size = (uint64_t)st.st_size;
+    // every section inside the file and after the one before it; each offset is checked
+    // against the size before anything is added to it, so no sum can wrap
+    int ok = h->magic == KPDVE_STORE_MAGIC
+        && h->version == KPDVE_STORE_VERSION
+        && h->block_frames > 0
+        && h->states_offset >= sizeof(struct kpdve_store_header)
+        && h->states_offset % sizeof(int) == 0
+        && h->states_offset <= size
+        && h->frame_count <= (size - h->states_offset) / sizeof(int)
+        && h->block_count == (h->frame_count + h->block_frames - 1) / h->block_frames
+        && h->blocks_offset <= size
+        && h->states_offset + h->frame_count * sizeof(int) <= h->blocks_offset
+        && h->blocks_offset % 8 == 0
+        && h->block_count <= (size - h->blocks_offset) / sizeof(struct kpdve_store_block)
+        && h->times_offset == h->blocks_offset + h->block_count * sizeof(struct kpdve_store_block)
+        && h->block_count <= (size - h->times_offset) / sizeof(uint64_t);
+    if (!ok)
+    {
+        munmap(map, (size_t)st.st_size);
+        return KPDVE_STORE_ERR_FORMAT;
+    }
+
+    store->map = map;
+    store->map_size = (size_t)st.st_size;
+    store->header = h;
+    store->states = (const int *)((const char *)map + h->states_offset);
+    store->blocks = (const struct kpdve_store_block *)((const char *)map + h->blocks_offset);
+    store->times = (const uint64_t *)((const char *)map + h->times_offset);
+    return KPDVE_STORE_OK;
+}
+
+void kpdve_store_close(kpdve_store *store)
+{
+    if (store->map != NULL)
+    {
+        munmap(store->map, store->map_size);
+    }
+    memset(store, 0, sizeof(*store));
+}
+
+size_t kpdve_store_frame_count(const kpdve_store *store)
+{
+    return (size_t)store->header->frame_count;
+}
+
+size_t kpdve_store_block_count(const kpdve_store *store)
+{
+    return (size_t)store->header->block_count;
+}
+
+/**
+ * @brief Returns the encoded_state of a frame (no bounds check beyond the caller's).
+ */
+int kpdve_store_frame(const kpdve_store *store, size_t frame)
+{
+    return store->states[frame];
+}
+
+/**
+ * @brief Finds the frame playing at a given time.
+ *
+ * Binary search over the per-block start times, then interpolation by the frame period.
+ *
+ * @return The frame index (clamped to the stored range), or 0 for an empty store.
+ */
+size_t kpdve_store_frame_at_time(const kpdve_store *store, uint64_t time)
+{
+    size_t count = (size_t)store->header->block_count;
+    if (count == 0 || time < store->times[0])
+    {
+        return 0;
+    }
+
+    // last block starting at or before time
+    size_t lo = 0, hi = count;
+    while (hi - lo > 1)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (store->times[mid] <= time)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    uint64_t block_frames = store->header->block_frames;
+    uint64_t period = store->header->frame_period;
+    uint64_t offset = period ? (time - store->times[lo]) / period : 0;
+    if (offset >= block_frames)
+    {
+        offset = block_frames - 1;
+    }
+    uint64_t frame = lo * block_frames + offset;
+    if (frame >= store->header->frame_count)
+    {
+        frame = store->header->frame_count - 1;
+    }
+    return (size_t)frame;
+}
+
+/**
+ * @brief Lists the frames in [first_frame, last_frame) where K changed.
+ *
+ * Blocks without a key change are skipped from their summary, so only the pages of
+ * blocks that actually modulate are touched.
+ *
+ * @param frames Receives up to cap frame indices.
+ * @return The number of key changes found (which may exceed cap).
+ */
+size_t kpdve_store_key_changes(const kpdve_store *store, size_t first_frame, size_t last_frame, size_t *frames, size_t cap)
+{
+    size_t found = 0;
+    size_t frame_count = (size_t)store->header->frame_count;
+    size_t block_frames = store->header->block_frames;
+    if (last_frame > frame_count)
+    {
+        last_frame = frame_count;
+    }
+
+    for (size_t b = first_frame / block_frames; b * block_frames < last_frame; b++)
+    {
+        const struct kpdve_store_block *block = &store->blocks[b];
+        if (block->k_changes == 0)
+        {
+            continue;
+        }
+
+        int k_prev = (block->k_in == 0xFF) ? -1 : block->k_in;
+        size_t end = (b + 1) * block_frames;
+        if (end > last_frame)
+        {
+            end = last_frame;
+        }
+        for (size_t i = b * block_frames; i < end; i++)
+        {
+            int s = store->states[i];
+            if (STATE_INVALID(s))
+            {
+                continue;
+            }
+            int k = STATE_K(s);
+            if (k_prev >= 0 && k != k_prev && i >= first_frame)
+            {
+                if (found < cap)
+                {
+                    frames[found] = i;
+                }
+                found++;
+            }
+            k_prev = k;
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief Finds the next block (at or after from_block) in which the given key occurs.
+ *
+ * @return The block index, or -1 if there is none (always for a key outside 0..11).
+ */
+long kpdve_store_next_block_with_key(const kpdve_store *store, int key, size_t from_block)
+{
+    if (key < 0 || key >= 12)
+    {
+        return -1;
+    }
+    uint16_t bit = (uint16_t)(1 << key);
+    for (size_t b = from_block; b < store->header->block_count; b++)
+    {
+        if (store->blocks[b].key_mask & bit)
+        {
+            return (long)b;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,193 @@
+//
+//  qdkpdve_sweep.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_sweep.c
+ * @brief Multithreaded exhaustive sweeps of the reference analysis (see qdkpdve_sweep.h).
+ *
+ * Threads take blocks of units (chroma values, KPDVE values) from a shared counter and
+ * write disjoint parts of the caller's arrays, so the output does not depend on the
+ * number of threads.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_sweep.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_tables.h"
+
+#define MAX_THREADS 256
+
+struct sweep_job {
+    void (*run_unit)(struct sweep_job *job, long unit);
+    long units;
+    long block;
+    int *states;
+    uint8_t *choices;
+    harmony_state start; // every unit starts from this state
+
+    pthread_mutex_t lock;
+    long next_unit;
+};
+
+static void *sweep_worker(void *arg)
+{
+    struct sweep_job *job = arg;
+    for (;;)
+    {
+        pthread_mutex_lock(&job->lock);
+        long begin = job->next_unit;
+        long end = (begin + job->block < job->units) ? begin + job->block : job->units;
+        job->next_unit = end;
+        pthread_mutex_unlock(&job->lock);
+
+        if (begin >= end)
+        {
+            return NULL;
+        }
+        for (long unit = begin; unit < end; unit++)
+        {
+            job->run_unit(job, unit);
+        }
+    }
+}
+
+static int run_job(struct sweep_job *job, int threads)
+{
+    pthread_t ids[MAX_THREADS];
+    int started = 0;
+
+    if (threads <= 0)
+    {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    threads = threads < 1 ? 1 : (threads > MAX_THREADS ? MAX_THREADS : threads);
+
+    job->start = harmony_state_default();
+    job->next_unit = 0;
+    pthread_mutex_init(&job->lock, NULL);
+
+    for (; started < threads - 1; started++)
+    {
+        if (pthread_create(&ids[started], NULL, sweep_worker, job) != 0)
+        {
+            break; // fewer threads is slower, not wrong
+        }
+    }
+    sweep_worker(job);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(ids[i], NULL);
+    }
+
+    pthread_mutex_destroy(&job->lock);
+    return 0;
+}
+
+/**
+ * @brief The context KPDVE (K, P, D, with V = E = 0) of a context index.
+ */
+int kpdve_sweep_context_kpdve(int context_index)
+{
+    int kpdve[] = { context_index / 49, (context_index / 7) % 7, context_index % 7, 0, 0 };
+    return KPDVEtoBinaryEncoding(kpdve);
+}
+
+static void context_unit(struct sweep_job *job, long unit)
+{
+    int chroma = (int)unit;
+    harmony_state state = job->start;
+
+    state.chromatic_notes = chroma;
+    set_kp_list(&state);
+
+    for (int c = 0; c < KPDVE_SWEEP_CONTEXTS; c++)
+    {
+        choose_kpdve_from_context(&state, kpdve_sweep_context_kpdve(c));
+        if (job->states != NULL)
+        {
+            job->states[c * KPDVE_SWEEP_CHROMA + chroma] = state.encoded_state;
+        }
+        if (job->choices != NULL)
+        {
+            job->choices[c * KPDVE_SWEEP_CHROMA + chroma] = (uint8_t)state.kpdve_min_index;
+        }
+    }
+}
+
+/**
+ * @brief Analyzes every chroma value in every K, P, D context.
+ *
+ * @param states Receives [KPDVE_SWEEP_CONTEXTS * KPDVE_SWEEP_CHROMA] encoded states, or NULL.
+ * @param choices Receives the chosen candidate index of each, or NULL.
+ * @param threads Worker threads; 0 for one per online CPU.
+ * @return 0.
+ */
+int kpdve_sweep_contexts(int *states, uint8_t *choices, int threads)
+{
+    struct sweep_job job = { 0 };
+    job.run_unit = context_unit;
+    job.units = KPDVE_SWEEP_CHROMA;
+    job.block = 16;
+    job.states = states;
+    job.choices = choices;
+    return run_job(&job, threads);
+}
+
+/**
+ * @brief The candidate lists of every chroma value, packed as in qdkpdve_tables.h.
+ *
+ * @param offsets Receives [KPDVE_SWEEP_CHROMA + 1] offsets into entries.
+ * @param entries Receives up to KPDVE_SWEEP_CANDIDATES packed candidates.
+ * @return The number of entries written.
+ */
+size_t kpdve_sweep_candidates(uint32_t *offsets, uint32_t *entries)
+{
+    harmony_state state;
+    size_t count = 0;
+
+    for (int chroma = 0; chroma < KPDVE_SWEEP_CHROMA; chroma++)
+    {
+        offsets[chroma] = (uint32_t)count;
+        state.chromatic_notes = chroma;
+        set_kp_list(&state);
+
+        for (int i = 0; i < state.kpdve_list_length && count < KPDVE_SWEEP_CANDIDATES; i++)
+        {
+            uint32_t kpdve = state.kpdve_list[i] < 0 ? KPDVE_CANDIDATE_NONE : (uint32_t)state.kpdve_list[i];
+            entries[count++] = kpdve | ((uint32_t)(state.dve_list[i] & 0x7F) << 16) | ((uint32_t)(state.ve_list[i] & 0x7F) << 23);
+        }
+    }
+    offsets[KPDVE_SWEEP_CHROMA] = (uint32_t)count;
+    return count;
+}
+
+static void kpdve_unit(struct sweep_job *job, long unit)
+{
+    int v = (int)unit;
+    int kpdve[] = { v / 2401, (v / 343) % 7, (v / 49) % 7, (v / 7) % 7, v % 7 };
+    harmony_state state = job->start;
+
+    adjust_harmony_state_from_kpdve(&state, KPDVEtoBinaryEncoding(kpdve));
+    job->states[unit] = state.encoded_state;
+}
+
+/**
+ * @brief Analyzes every KPDVE value with adjust_harmony_state_from_kpdve.
+ *
+ * @param states Receives [KPDVE_SWEEP_KPDVES] encoded states.
+ * @param threads Worker threads; 0 for one per online CPU.
+ * @return 0.
+ */
+int kpdve_sweep_kpdves(int *states, int threads)
+{
+    struct sweep_job job = { 0 };
+    job.run_unit = kpdve_unit;
+    job.units = KPDVE_SWEEP_KPDVES;
+    job.block = 256;
+    job.states = states;
+    return run_job(&job, threads);
+}
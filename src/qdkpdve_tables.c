@@ -0,0 +1,360 @@
+//
+//  qdkpdve_tables.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_tables.c
+ * @brief Builds the analysis tables and runs the table engine (see qdkpdve_tables.h).
+ *
+ * The tables are filled from the reference functions: the crystal masks from
+ * kp_for_harmonycrystal, the minimizer from minimize_dve_value, and the per-axis
+ * distances from KPD_distance itself (two encodings differing on one axis only), so the
+ * scale factors and float rounding are the reference's own.
+ *
+ * They are built once, under pthread_once; the ready flag is published with release
+ * order so kpdve_tables_default can skip pthread_once once it is set. Built with
+ * PITCHFLOCK_PREBUILT_TABLES, the same arrays come compiled in from the file
+ * pitchflock_gentables generates, and nothing is built at run time.
+ */
+
+#include <float.h>
+#include <pthread.h>
+
+#include "../include/qdkpdve_tables.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_stats.h"
+
+#ifdef PITCHFLOCK_PREBUILT_TABLES
+
+// generated by pitchflock_gentables
+extern const uint16_t kpdve_prebuilt_crystal_masks[KPDVE_TABLES_CELLS];
+extern const uint32_t kpdve_prebuilt_minimized[128];
+extern const uint16_t kpdve_prebuilt_offsets[KPDVE_TABLES_CHROMA + 1];
+extern const uint32_t kpdve_prebuilt_candidates[KPDVE_TABLES_CANDIDATES];
+extern const float kpdve_prebuilt_k_distance[12 * 12];
+extern const float kpdve_prebuilt_p_distance[8 * 8];
+extern const float kpdve_prebuilt_d_distance[8 * 8];
+
+static const kpdve_tables tables = {
+    kpdve_prebuilt_crystal_masks,
+    kpdve_prebuilt_minimized,
+    kpdve_prebuilt_offsets,
+    kpdve_prebuilt_candidates,
+    kpdve_prebuilt_k_distance,
+    kpdve_prebuilt_p_distance,
+    kpdve_prebuilt_d_distance,
+};
+
+// compiled in: nothing to build
+void kpdve_tables_init(void)
+{
+}
+
+const kpdve_tables *kpdve_tables_default(void)
+{
+    return &tables;
+}
+
+#else
+
+static uint16_t crystal_masks[KPDVE_TABLES_CELLS];
+static uint32_t minimized[128];
+static uint16_t offsets[KPDVE_TABLES_CHROMA + 1];
+static uint32_t candidates[KPDVE_TABLES_CANDIDATES];
+static float k_distance[12 * 12];
+static float p_distance[8 * 8];
+static float d_distance[8 * 8];
+
+static kpdve_tables tables;
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+static int tables_ready = 0;
+
+static int encode(int k, int p, int d, int v, int e)
+{
+    int kpdve[] = { k, p, d, v, e };
+    return KPDVEtoBinaryEncoding(kpdve);
+}
+
+static void build_distances(void)
+{
+    kpdve_tables_build_distances(NULL, k_distance, p_distance, d_distance);
+}
+
+static void build_candidates(void)
+{
+    harmonycrystal the_crystal = default_harmonycrystal();
+    for (int i = 0; i < KPDVE_TABLES_CELLS; i++)
+    {
+        crystal_masks[i] = (uint16_t)kp_for_harmonycrystal(the_crystal, i / 7, i % 7);
+    }
+
+    for (int i = 0; i < 128; i++)
+    {
+        struct dve_value dve = minimize_dve_value(make_dve(i));
+        minimized[i] = (uint32_t)(dve.d | (dve.ve_val.v << 3) | ((dve.ve_val.e & 0x7) << 6)
+                                  | ((dve.bin_val & 0x7F) << 9) | ((dve.ve_val.bin_val & 0x7F) << 16));
+    }
+
+    // as set_kp_list, for every chroma
+    int count = 0;
+    for (int chroma = 0; chroma < KPDVE_TABLES_CHROMA; chroma++)
+    {
+        offsets[chroma] = (uint16_t)count;
+        int circle_notes = chroma_to_circle(chroma);
+
+        for (int i = 0; i < KPDVE_TABLES_CELLS && count < KPDVE_TABLES_CANDIDATES; i++)
+        {
+            if ((crystal_masks[i] & circle_notes) != circle_notes)
+            {
+                continue;
+            }
+            int k = i / 7;
+            int p = i % 7;
+            uint32_t m = minimized[undo_kp_for_input_val(circle_notes, k, p) & 0x7F];
+            int kpdve = (circle_notes == 0)
+                ? KPDVE_CANDIDATE_NONE
+                : encode(k, p, KPDVE_MINIMIZED_D(m), KPDVE_MINIMIZED_V(m), KPDVE_MINIMIZED_E(m));
+
+            candidates[count++] = (uint32_t)kpdve
+                | ((uint32_t)KPDVE_MINIMIZED_DVE(m) << 16)
+                | ((uint32_t)KPDVE_MINIMIZED_VE(m) << 23);
+        }
+    }
+    offsets[KPDVE_TABLES_CHROMA] = (uint16_t)count;
+}
+
+static void build_tables(void)
+{
+    build_distances();
+    build_candidates();
+
+    tables.crystal_masks = crystal_masks;
+    tables.minimized = minimized;
+    tables.offsets = offsets;
+    tables.candidates = candidates;
+    tables.k_distance = k_distance;
+    tables.p_distance = p_distance;
+    tables.d_distance = d_distance;
+    __atomic_store_n(&tables_ready, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Builds the tables, once. Safe to call from any number of threads at once;
+ * every caller returns with the tables complete.
+ */
+void kpdve_tables_init(void)
+{
+    pthread_once(&tables_once, build_tables);
+}
+
+const kpdve_tables *kpdve_tables_default(void)
+{
+    if (!__atomic_load_n(&tables_ready, __ATOMIC_ACQUIRE))
+    {
+        kpdve_tables_init();
+    }
+    return &tables;
+}
+
+#endif /* PITCHFLOCK_PREBUILT_TABLES */
+
+#ifdef PITCHFLOCK_EAGER_INIT
+// build (or touch) the tables when the program loads, before main and any threads
+__attribute__((constructor)) static void tables_eager_init(void)
+{
+    kpdve_tables_init();
+}
+#endif
+
+static int encode_axes(int k, int p, int d)
+{
+    int kpdve[] = { k, p, d, 0, 0 };
+    return KPDVEtoBinaryEncoding(kpdve);
+}
+
+/**
+ * @brief Fills per-axis distance tables for the given axis weights.
+ *
+ * With NULL (the built-in weights) the tables are the ones kpdve_tables_default uses;
+ * with others, tables built on them choose as set_min_index would with KPD_distance
+ * weighted the same way.
+ *
+ * @param axis_scale Weights of K, P, D, V, E, or NULL for the built-in ones.
+ * @param k_distance Receives [12 * 12] K distances.
+ * @param p_distance Receives [8 * 8] P distances.
+ * @param d_distance Receives [8 * 8] D distances.
+ */
+void kpdve_tables_build_distances(const float *axis_scale, float *k_distance, float *p_distance, float *d_distance)
+{
+    float scale[5];
+    if (axis_scale == NULL)
+    {
+        kpdve_default_axis_scale(scale);
+        axis_scale = scale;
+    }
+    for (int a = 0; a < 12; a++)
+    {
+        for (int b = 0; b < 12; b++)
+        {
+            k_distance[a * 12 + b] = (float)KPD_distance_weighted(encode_axes(a, 0, 0), encode_axes(b, 0, 0), axis_scale);
+        }
+    }
+    for (int a = 0; a < 8; a++)
+    {
+        for (int b = 0; b < 8; b++)
+        {
+            p_distance[a * 8 + b] = (float)KPD_distance_weighted(encode_axes(0, a, 0), encode_axes(0, b, 0), axis_scale);
+            d_distance[a * 8 + b] = (float)KPD_distance_weighted(encode_axes(0, 0, a), encode_axes(0, 0, b), axis_scale);
+        }
+    }
+}
+
+/**
+ * @brief Fills the KPDVE, DVE and VE lists of the state from the candidate table.
+ *
+ * Same result as set_kp_list. Chroma values with bits above the twelfth (which no caller
+ * of the library produces) go to the reference.
+ *
+ * @param tables The tables to use.
+ * @param a_state Pointer to the harmony state to process.
+ */
+void set_kp_list_from_tables(const kpdve_tables *tables, harmony_state *a_state)
+{
+    unsigned int chroma = (unsigned int)a_state->chromatic_notes;
+    if (chroma >= KPDVE_TABLES_CHROMA)
+    {
+        set_kp_list(a_state);
+        return;
+    }
+
+    int first = tables->offsets[chroma];
+    int count = tables->offsets[chroma + 1] - first;
+    const uint32_t *list = tables->candidates + first;
+
+    for (int i = 0; i < count; i++)
+    {
+        a_state->kpdve_list[i] = KPDVE_CANDIDATE_KPDVE(list[i]);
+        a_state->dve_list[i] = KPDVE_CANDIDATE_DVE(list[i]);
+        a_state->ve_list[i] = KPDVE_CANDIDATE_VE(list[i]);
+    }
+    a_state->kpdve_list_length = count;
+
+    KPDVE_STATS_LIST(count);
+}
+
+/**
+ * @brief Chooses the candidate closest to the context, using the distance tables.
+ *
+ * Same result as set_min_index: the candidate in the context's K and P if there is one,
+ * otherwise the first candidate with the smallest distance. Contexts with a K outside
+ * 0..11 (or bits above the KPDVE), and the empty chroma's list of -1s, go to the reference.
+ *
+ * @param tables The tables to use.
+ * @param current_state Pointer to the current harmony state.
+ * @param context The context KPDVE value to compare against.
+ */
+void set_min_index_from_tables(const kpdve_tables *tables, harmony_state *current_state, int context)
+{
+    if ((unsigned int)context >= (12u << 12)
+        || (current_state->kpdve_list_length > 0 && current_state->kpdve_list[0] < 0))
+    {
+        set_min_index(current_state, context);
+        return;
+    }
+
+    int context_k = context >> 12;
+    int context_p = (context >> 9) & 0x7;
+    int context_d = (context >> 6) & 0x7;
+    const float *k_row = tables->k_distance + context_k * 12;
+    const float *p_row = tables->p_distance + context_p * 8;
+    const float *d_row = tables->d_distance + context_d * 8;
+
+    float min_dist = FLT_MAX; // set_min_index starts at 100, which custom tables can exceed
+    int min_index = 0;
+
+    KPDVE_STATS_ADD(min_index_calls, 1);
+
+    for (int i = 0; i < current_state->kpdve_list_length; i++)
+    {
+        int kpdve = current_state->kpdve_list[i];
+        int k = kpdve >> 12;
+        int p = (kpdve >> 9) & 0x7;
+
+        // STAY IN SAME KP IF AT ALL POSSIBLE
+        if (k == context_k && p == context_p)
+        {
+            min_index = i;
+            KPDVE_STATS_ADD(same_kp_hits, 1);
+            break;
+        }
+
+        // summed in KPD_distance's order, in float, so ties fall the same way
+        float dist = 0;
+        dist += k_row[k];
+        dist += p_row[p];
+        dist += d_row[(kpdve >> 6) & 0x7];
+
+        if (dist < min_dist)
+        {
+            min_dist = dist;
+            min_index = i;
+        }
+    }
+    current_state->kpdve_min_index = min_index;
+}
+
+/**
+ * @brief Chooses among the packed candidates of a chroma value without a harmony_state.
+ *
+ * Gives the index set_min_index would give for the chroma's list. The chroma must be
+ * 1..4095 (the empty chroma's candidates are -1s) and the context's K below 12.
+ *
+ * @param tables The tables to use.
+ * @param chroma The chroma value.
+ * @param context The context KPDVE value.
+ * @return The index into the chroma's candidates, or -1 if it has none.
+ */
+int kpdve_tables_choose(const kpdve_tables *tables, int chroma, int context)
+{
+    int first = tables->offsets[chroma];
+    int count = tables->offsets[chroma + 1] - first;
+    if (count == 0)
+    {
+        return -1;
+    }
+
+    const uint32_t *list = tables->candidates + first;
+    int context_k = context >> 12;
+    int context_kp = (context >> 9) & 0x7F;
+    const float *k_row = tables->k_distance + context_k * 12;
+    const float *p_row = tables->p_distance + ((context >> 9) & 0x7) * 8;
+    const float *d_row = tables->d_distance + ((context >> 6) & 0x7) * 8;
+
+    float min_dist = FLT_MAX; // set_min_index starts at 100, which custom tables can exceed
+    int min_index = 0;
+
+    KPDVE_STATS_ADD(min_index_calls, 1);
+
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t kpdve = list[i];
+        if (((kpdve >> 9) & 0x7F) == (uint32_t)context_kp)
+        {
+            KPDVE_STATS_ADD(same_kp_hits, 1);
+            return i;
+        }
+
+        float dist = 0;
+        dist += k_row[(kpdve >> 12) & 0xF];
+        dist += p_row[(kpdve >> 9) & 0x7];
+        dist += d_row[(kpdve >> 6) & 0x7];
+
+        if (dist < min_dist)
+        {
+            min_dist = dist;
+            min_index = i;
+        }
+    }
+    return min_index;
+}
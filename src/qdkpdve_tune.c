@@ -0,0 +1,532 @@
+//
+//  qdkpdve_tune.c
+//  pitchflock
+//
+
+/**
+ * @file qdkpdve_tune.c
+ * @brief One-pass evaluation of chooser configurations (see qdkpdve_tune.h).
+ *
+ * Configurations are padded to a multiple of KPDVE_TUNE_LANES (with copies of the last
+ * one, never scored) and kept as structures of vectors, one per group of lanes. Each
+ * lane keeps its own distance tables and, transposed into the group's row vectors, the
+ * rows for its current context; the rows are copied again only when that lane's
+ * context changes, so a candidate's distances are loads indexed by the candidate. Files
+ * are handed out to the workers one at a time from a shared counter; each worker
+ * scores into its own array, and the arrays are summed after the join.
+ */
+
+#include <fcntl.h>
+#include <float.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_tune.h"
+#include "../include/qdkpdve_codec.h"
+#include "../include/qdkpdve_corpus.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_store.h"
+
+#define MAX_THREADS 256
+
+typedef int32_t tune_vi __attribute__((vector_size(KPDVE_TUNE_LANES * sizeof(int32_t))));
+typedef float tune_vf __attribute__((vector_size(KPDVE_TUNE_LANES * sizeof(float))));
+
+// one group of configurations, and the context each is in
+struct tune_lanes {
+    tune_vf k_row[12];        // each lane's distance from its context's K to each K
+    tune_vf p_row[8];
+    tune_vf d_row[8];
+    tune_vf prior_weight;
+    tune_vi context;          // KPDVE
+    float k_distance[KPDVE_TUNE_LANES][12 * 12]; // each lane's tables (squared for L2)
+    float p_distance[KPDVE_TUNE_LANES][8 * 8];
+    float d_distance[KPDVE_TUNE_LANES][8 * 8];
+};
+
+// lane-wise mask ? a : b
+#define SELECT_I(mask, a, b) (((mask) & (a)) | (~(mask) & (b)))
+#define SELECT_F(mask, a, b) ((tune_vf)SELECT_I((mask), (tune_vi)(a), (tune_vi)(b)))
+
+// copies lane j's table rows for the context kpdve into the group's row vectors
+static void set_context(struct tune_lanes *group, int j, int kpdve)
+{
+    int k = (kpdve >> 12) & 0xF, p = (kpdve >> 9) & 0x7, d = (kpdve >> 6) & 0x7;
+    for (int i = 0; i < 12; i++)
+    {
+        group->k_row[i][j] = group->k_distance[j][k * 12 + i];
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        group->p_row[i][j] = group->p_distance[j][p * 8 + i];
+        group->d_row[i][j] = group->d_distance[j][d * 8 + i];
+    }
+    group->context[j] = kpdve;
+}
+
+/**
+ * @brief The built-in configuration: kpdve_axis_scale, KPD_distance's metric, no prior.
+ */
+void kpdve_tune_default_config(struct kpdve_tune_config *config)
+{
+    float scale[5];
+    kpdve_default_axis_scale(scale);
+    for (int i = 0; i < 3; i++)
+    {
+        config->axis_scale[i] = scale[i];
+    }
+    config->metric = KPDVE_TUNE_L1;
+    config->prior_weight = 0.0f;
+}
+
+/**
+ * @brief One thread per online CPU, the default tables, no prior.
+ */
+void kpdve_tune_default_options(struct kpdve_tune_options *options)
+{
+    options->threads = 0;
+    options->tables = NULL;
+    options->prior = NULL;
+}
+
+static struct tune_lanes *make_lanes(const struct kpdve_tune_config *configs, size_t config_count, size_t groups)
+{
+    void *memory = NULL;
+    if (posix_memalign(&memory, sizeof(tune_vf), groups * sizeof(struct tune_lanes)) != 0)
+    {
+        return NULL;
+    }
+    struct tune_lanes *lanes = memory;
+    int start = harmony_state_default().kpdve;
+    for (size_t g = 0; g < groups; g++)
+    {
+        for (int j = 0; j < KPDVE_TUNE_LANES; j++)
+        {
+            size_t c = g * KPDVE_TUNE_LANES + (size_t)j;
+            const struct kpdve_tune_config *config = &configs[c < config_count ? c : config_count - 1];
+            float scale[5] = { config->axis_scale[0], config->axis_scale[1], config->axis_scale[2], 1.0f, 1.0f };
+            float *k_distance = lanes[g].k_distance[j];
+            float *p_distance = lanes[g].p_distance[j];
+            float *d_distance = lanes[g].d_distance[j];
+            kpdve_tables_build_distances(scale, k_distance, p_distance, d_distance);
+            if (config->metric == KPDVE_TUNE_L2)
+            {
+                for (int i = 0; i < 12 * 12; i++)
+                {
+                    k_distance[i] *= k_distance[i];
+                }
+                for (int i = 0; i < 8 * 8; i++)
+                {
+                    p_distance[i] *= p_distance[i];
+                    d_distance[i] *= d_distance[i];
+                }
+            }
+            lanes[g].prior_weight[j] = config->prior_weight;
+            set_context(&lanes[g], j, start);
+        }
+    }
+    return lanes;
+}
+
+// the index of each lane's choice among count candidates (count > 0), as kpdve_prior_choose
+static void choose(const struct tune_lanes *group, const uint32_t *list, int count, const kpdve_prior *prior,
+                   tune_vi *choice)
+{
+    tune_vi context = group->context;
+    tune_vi context_kp = (context >> 9) & 0x7F;
+
+    // the prior row of each lane's context (none for a P or D of 7)
+    const uint8_t *rows[KPDVE_TUNE_LANES];
+    for (int j = 0; prior != NULL && j < KPDVE_TUNE_LANES; j++)
+    {
+        int c = context[j];
+        rows[j] = (((c >> 9) & 0x7) == 7 || ((c >> 6) & 0x7) == 7)
+            ? NULL
+            : prior->levels + KPDVE_PRIOR_INDEX(c) * KPDVE_PRIOR_STATES;
+    }
+
+    tune_vf min_dist = (tune_vf){ 0 } + FLT_MAX;
+    tune_vi min_index = { 0 };
+    tune_vi found = { 0 };
+    for (int i = 0; i < count; i++)
+    {
+        int kpdve = (int)(list[i] & 0xFFFF);
+        int k = (kpdve >> 12) & 0xF, p = (kpdve >> 9) & 0x7, d = (kpdve >> 6) & 0x7;
+
+        tune_vf dist = group->k_row[k] + group->p_row[p] + group->d_row[d];
+        if (prior != NULL)
+        {
+            tune_vf bonus;
+            int to = KPDVE_PRIOR_INDEX(kpdve);
+            for (int j = 0; j < KPDVE_TUNE_LANES; j++)
+            {
+                int level = rows[j] != NULL ? rows[j][to] : 0;
+                bonus[j] = group->prior_weight[j] * (float)level / KPDVE_PRIOR_STEPS;
+            }
+            dist -= bonus;
+        }
+
+        // the first candidate in the context's K and P; else the first nearest
+        tune_vi same = (context_kp == (kpdve >> 9)) & ~found;
+        min_index = SELECT_I(same, (tune_vi){ 0 } + i, min_index);
+        found |= same;
+        tune_vi nearer = (dist < min_dist) & ~found;
+        min_dist = SELECT_F(nearer, dist, min_dist);
+        min_index = SELECT_I(nearer, (tune_vi){ 0 } + i, min_index);
+    }
+    *choice = min_index;
+}
+
+/**
+ * @brief Analyzes one labeled stream with every configuration and adds up the scores.
+ *
+ * Each configuration starts from the default state (as pf_rt_init), independently of
+ * any earlier call.
+ *
+ * @param states Encoded states: chroma bits as input, KPDVE bits as label.
+ * @param configs The configurations.
+ * @param options Tables and prior (threads are not used); NULL for the defaults.
+ * @param scores Added to, one per configuration.
+ * @return KPDVE_TUNE_OK or KPDVE_TUNE_ERR_MEMORY.
+ */
+int kpdve_tune_evaluate_states(const int *states, size_t count,
+                               const struct kpdve_tune_config *configs, size_t config_count,
+                               const struct kpdve_tune_options *options, struct kpdve_tune_score *scores)
+{
+    if (config_count == 0)
+    {
+        return KPDVE_TUNE_OK;
+    }
+    const kpdve_tables *tables = options && options->tables ? options->tables : kpdve_tables_default();
+    const kpdve_prior *prior = options ? options->prior : NULL;
+    size_t groups = (config_count + KPDVE_TUNE_LANES - 1) / KPDVE_TUNE_LANES;
+    struct tune_lanes *lanes = make_lanes(configs, config_count, groups);
+    if (lanes == NULL)
+    {
+        return KPDVE_TUNE_ERR_MEMORY;
+    }
+
+    int last_label_k = -1;
+    for (size_t t = 0; t < count; t++)
+    {
+        int chroma = states[t] & 0xFFF;
+        int label = (states[t] >> 12) & 0xFFFF;
+        int scored = chroma != 0 && states[t] >= 0 && (label >> 12) < 12;
+        int label_change = scored && last_label_k >= 0 && (label >> 12) != last_label_k;
+        if (scored)
+        {
+            last_label_k = label >> 12;
+        }
+        int first = tables->offsets[chroma];
+        int candidates = chroma ? tables->offsets[chroma + 1] - first : 0;
+        const uint32_t *list = tables->candidates + first;
+
+        for (size_t g = 0; g < groups; g++)
+        {
+            struct tune_lanes *group = &lanes[g];
+            tune_vi chosen = group->context;
+            if (candidates > 0)
+            {
+                tune_vi index;
+                choose(group, list, candidates, prior, &index);
+                for (int j = 0; j < KPDVE_TUNE_LANES; j++)
+                {
+                    chosen[j] = KPDVE_CANDIDATE_KPDVE(list[index[j]]);
+                }
+            }
+
+            size_t lanes_used = config_count - g * KPDVE_TUNE_LANES;
+            lanes_used = lanes_used < KPDVE_TUNE_LANES ? lanes_used : KPDVE_TUNE_LANES;
+            for (size_t j = 0; j < lanes_used; j++)
+            {
+                struct kpdve_tune_score *s = &scores[g * KPDVE_TUNE_LANES + j];
+                int kpdve = chosen[j];
+                int k_change = (kpdve >> 12) != (group->context[j] >> 12);
+                s->k_changes += k_change;
+                s->kp_changes += (kpdve >> 9) != (group->context[j] >> 9);
+                if (scored)
+                {
+                    s->frames++;
+                    s->k_right += (kpdve >> 12) == (label >> 12);
+                    s->kp_right += (kpdve >> 9) == (label >> 9);
+                    s->kpdve_right += kpdve == label;
+                    s->label_k_changes += label_change;
+                    s->k_change_hits += label_change && k_change && (kpdve >> 12) == (label >> 12);
+                }
+            }
+            for (int j = 0; j < KPDVE_TUNE_LANES; j++)
+            {
+                if (chosen[j] != group->context[j])
+                {
+                    set_context(group, j, chosen[j]);
+                }
+            }
+        }
+    }
+    free(lanes);
+    return KPDVE_TUNE_OK;
+}
+
+/* ------------------------------------------------------------------ files and pool */
+
+struct tune_input {
+    const int *states;
+    size_t count;
+    void *map;
+    size_t map_size;
+    int *decoded;
+    kpdve_store store;
+    int is_store;
+};
+
+static void close_input(struct tune_input *input)
+{
+    if (input->is_store)
+    {
+        kpdve_store_close(&input->store);
+    }
+    if (input->map != NULL)
+    {
+        munmap(input->map, input->map_size);
+    }
+    free(input->decoded);
+}
+
+// a codec stream, decoded whole
+static int decode_input(struct tune_input *input)
+{
+    const uint8_t *bytes = input->map;
+    size_t frames = 0;
+    for (size_t pos = 0; pos < input->map_size;)
+    {
+        size_t chunk_frames, chunk_size;
+        if (kpdve_codec_chunk_info(bytes + pos, input->map_size - pos, &chunk_frames, &chunk_size) != KPDVE_CODEC_OK)
+        {
+            return KPDVE_TUNE_ERR_FORMAT;
+        }
+        frames += chunk_frames;
+        pos += chunk_size;
+    }
+    input->decoded = malloc((frames ? frames : 1) * sizeof(int));
+    if (input->decoded == NULL)
+    {
+        return KPDVE_TUNE_ERR_MEMORY;
+    }
+    size_t done = 0;
+    for (size_t pos = 0; pos < input->map_size;)
+    {
+        size_t consumed;
+        long n = kpdve_codec_decode_chunk(bytes + pos, input->map_size - pos, input->decoded + done, frames - done, &consumed);
+        if (n < 0)
+        {
+            return KPDVE_TUNE_ERR_FORMAT;
+        }
+        done += (size_t)n;
+        pos += consumed;
+    }
+    input->states = input->decoded;
+    input->count = done;
+    return KPDVE_TUNE_OK;
+}
+
+static int open_input(const char *path, struct tune_input *input)
+{
+    memset(input, 0, sizeof(*input));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return KPDVE_TUNE_ERR_IO;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return KPDVE_TUNE_ERR_IO;
+    }
+    input->map_size = (size_t)st.st_size;
+    if (input->map_size > 0)
+    {
+        void *map = mmap(NULL, input->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            close(fd);
+            return KPDVE_TUNE_ERR_IO;
+        }
+        input->map = map;
+    }
+    close(fd);
+
+    const uint8_t *bytes = input->map;
+    if (input->map_size >= sizeof(struct kpdve_store_header)
+        && ((const struct kpdve_store_header *)bytes)->magic == KPDVE_STORE_MAGIC)
+    {
+        munmap(input->map, input->map_size);
+        input->map = NULL;
+        if (kpdve_store_open(&input->store, path) != KPDVE_STORE_OK)
+        {
+            return KPDVE_TUNE_ERR_FORMAT;
+        }
+        input->is_store = 1;
+        input->states = input->store.states;
+        input->count = kpdve_store_frame_count(&input->store);
+        return KPDVE_TUNE_OK;
+    }
+    switch (kpdve_corpus_format(path, bytes, input->map_size))
+    {
+    case KPDVE_CORPUS_CODED:
+        return decode_input(input);
+    case KPDVE_CORPUS_STATES:
+        if (input->map_size % sizeof(int) != 0)
+        {
+            return KPDVE_TUNE_ERR_FORMAT;
+        }
+        input->states = (const int *)input->map;
+        input->count = input->map_size / sizeof(int);
+        return KPDVE_TUNE_OK;
+    default:
+        return KPDVE_TUNE_ERR_FORMAT; // chroma only: nothing to score against
+    }
+}
+
+struct tune_pool {
+    const char *const *paths;
+    size_t count;
+    const struct kpdve_tune_config *configs;
+    size_t config_count;
+    const struct kpdve_tune_options *options;
+    struct kpdve_tune_file *files;
+    size_t next_file;
+};
+
+struct tune_worker {
+    struct tune_pool *pool;
+    struct kpdve_tune_score *scores;
+    int err;
+};
+
+static void *tune_worker_main(void *arg)
+{
+    struct tune_worker *worker = arg;
+    struct tune_pool *pool = worker->pool;
+    size_t f;
+    while (worker->err == KPDVE_TUNE_OK
+           && (f = __atomic_fetch_add(&pool->next_file, 1, __ATOMIC_RELAXED)) < pool->count)
+    {
+        struct kpdve_tune_file *file = &pool->files[f];
+        struct tune_input input;
+        file->err = open_input(pool->paths[f], &input);
+        if (file->err == KPDVE_TUNE_OK)
+        {
+            uint64_t before = worker->scores[0].frames;
+            file->err = kpdve_tune_evaluate_states(input.states, input.count, pool->configs, pool->config_count,
+                                                   pool->options, worker->scores);
+            file->frames = input.count;
+            file->labeled = (size_t)(worker->scores[0].frames - before);
+        }
+        close_input(&input);
+        if (file->err == KPDVE_TUNE_ERR_MEMORY)
+        {
+            worker->err = KPDVE_TUNE_ERR_MEMORY;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Evaluates every configuration on every file, files in parallel.
+ *
+ * A file that cannot be read or holds no labels is skipped, with its error in files[];
+ * the others are scored.
+ *
+ * @param paths The labeled files.
+ * @param configs The configurations (at least one).
+ * @param options Threads, tables and prior; NULL for the defaults.
+ * @param files Receives what became of each file.
+ * @param scores Receives the totals, one per configuration.
+ * @return KPDVE_TUNE_OK (whatever the files), or KPDVE_TUNE_ERR_MEMORY.
+ */
+int kpdve_tune_evaluate(const char *const *paths, size_t count,
+                        const struct kpdve_tune_config *configs, size_t config_count,
+                        const struct kpdve_tune_options *options,
+                        struct kpdve_tune_file *files, struct kpdve_tune_score *scores)
+{
+    struct kpdve_tune_options defaults;
+    if (options == NULL)
+    {
+        kpdve_tune_default_options(&defaults);
+        options = &defaults;
+    }
+    memset(scores, 0, config_count * sizeof(*scores));
+    for (size_t f = 0; f < count; f++)
+    {
+        memset(&files[f], 0, sizeof(files[f]));
+        files[f].path = paths[f];
+    }
+    if (config_count == 0)
+    {
+        return KPDVE_TUNE_OK;
+    }
+    kpdve_tables_default(); // build before the workers race to
+
+    int threads = options->threads > 0 ? options->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    threads = threads < 1 ? 1 : (threads > MAX_THREADS ? MAX_THREADS : threads);
+    threads = (size_t)threads > count ? (int)(count ? count : 1) : threads;
+
+    struct tune_pool pool = { paths, count, configs, config_count, options, files, 0 };
+    struct tune_worker workers[MAX_THREADS];
+    int ready = 0;
+    for (; ready < threads; ready++)
+    {
+        workers[ready].pool = &pool;
+        workers[ready].err = KPDVE_TUNE_OK;
+        workers[ready].scores = calloc(config_count, sizeof(struct kpdve_tune_score));
+        if (workers[ready].scores == NULL)
+        {
+            break;
+        }
+    }
+    int err = ready == 0 ? KPDVE_TUNE_ERR_MEMORY : KPDVE_TUNE_OK;
+
+    // the calling thread is worker 0
+    pthread_t ids[MAX_THREADS];
+    int started = 1;
+    for (; err == KPDVE_TUNE_OK && started < ready; started++)
+    {
+        if (pthread_create(&ids[started], NULL, tune_worker_main, &workers[started]) != 0)
+        {
+            break; // fewer threads is slower, not wrong
+        }
+    }
+    if (err == KPDVE_TUNE_OK)
+    {
+        tune_worker_main(&workers[0]);
+    }
+    for (int w = 1; err == KPDVE_TUNE_OK && w < started; w++)
+    {
+        pthread_join(ids[w], NULL);
+    }
+
+    for (int w = 0; w < ready; w++)
+    {
+        err = workers[w].err != KPDVE_TUNE_OK ? workers[w].err : err;
+        for (size_t c = 0; c < config_count; c++)
+        {
+            struct kpdve_tune_score *to = &scores[c];
+            const struct kpdve_tune_score *from = &workers[w].scores[c];
+            to->frames += from->frames;
+            to->k_right += from->k_right;
+            to->kp_right += from->kp_right;
+            to->kpdve_right += from->kpdve_right;
+            to->k_changes += from->k_changes;
+            to->kp_changes += from->kp_changes;
+            to->label_k_changes += from->label_k_changes;
+            to->k_change_hits += from->k_change_hits;
+        }
+        free(workers[w].scores);
+    }
+    return err;
+}
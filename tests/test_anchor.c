@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/qdkpdve_anchor.h"
+#include "../include/qdkpdve_rt.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_tables.h"
+
+#define HALF_LIFE 50.0
+#define UPDATES 5000
+#define FRAMES 100000
+
+static int failures = 0;
+
+static void fail(const char *what)
+{
+    if (failures++ < 10)
+    {
+        printf("%s\n", what);
+    }
+}
+
+static double absolute(double x)
+{
+    return x < 0 ? -x : x;
+}
+
+static int random_kpdve(void)
+{
+    return (rand() % 12) << 12 | (rand() % 7) << 9 | (rand() % 7) << 6;
+}
+
+// the decayed distribution kept in doubles, every cell decayed every frame, against the
+// anchor's O(1) integer version across many rescales
+static void check_distribution(const kpdve_tables *tables)
+{
+    kpdve_anchor anchor;
+    kpdve_anchor_init(&anchor, tables, HALF_LIFE, 1.0f);
+    double cells[84] = { 0 };
+
+    // the per-frame decay 2^(-1 / HALF_LIFE), by bisection on x^HALF_LIFE = 1/2
+    double lo = 0.5, hi = 1.0;
+    for (int i = 0; i < 100; i++)
+    {
+        double mid = (lo + hi) / 2, power = 1.0;
+        for (int j = 0; j < (int)HALF_LIFE; j++)
+        {
+            power *= mid;
+        }
+        *(power < 0.5 ? &lo : &hi) = mid;
+    }
+    double step = lo;
+
+    // runs of one cell, so the distribution keeps moving
+    int kpdve = random_kpdve();
+    for (int i = 0; i < UPDATES; i++)
+    {
+        if (rand() % 40 == 0)
+        {
+            kpdve = random_kpdve();
+        }
+        for (int c = 0; c < 84; c++)
+        {
+            cells[c] *= step;
+        }
+        cells[(kpdve >> 12) * 7 + ((kpdve >> 9) & 7)] += 1.0;
+        kpdve_anchor_update(&anchor, kpdve);
+    }
+    if (anchor.frames != UPDATES)
+    {
+        fail("frames miscounted");
+    }
+
+    double total = 0;
+    for (int c = 0; c < 84; c++)
+    {
+        total += cells[c];
+    }
+    for (int k = 0; k < 12; k++)
+    {
+        for (int p = 0; p < 7; p++)
+        {
+            double share = cells[k * 7 + p] / total;
+            if (absolute(kpdve_anchor_share(&anchor, k, p) - share) > 1e-3)
+            {
+                fail("cell share differs from the decayed distribution");
+            }
+            double mean = 0;
+            for (int c = 0; c < 84; c++)
+            {
+                mean += cells[c] / total
+                        * (tables->k_distance[(c / 7) * 12 + k] + tables->p_distance[(c % 7) * 8 + p]);
+            }
+            double got = kpdve_anchor_distance(&anchor, k << 12 | p << 9);
+            if (absolute(got - mean) > 2e-3 * (1.0 + mean))
+            {
+                printf("K %d P %d: mean distance %f, expected %f\n", k, p, got, mean);
+                fail("mean distance differs");
+            }
+        }
+    }
+    kpdve_anchor_reset(&anchor);
+    if (anchor.total != 0 || kpdve_anchor_distance(&anchor, 0) != 0.0f || kpdve_anchor_share(&anchor, 0, 0) != 0.0f)
+    {
+        fail("reset left weight behind");
+    }
+}
+
+// the choice with and without weight, for every chroma in many contexts
+static void check_choice(const kpdve_tables *tables)
+{
+    kpdve_anchor anchor;
+    kpdve_anchor_init(&anchor, tables, HALF_LIFE, 0.0f);
+    int home = 5 << 12; // a long stay in one key, then a step away
+    for (int i = 0; i < 200; i++)
+    {
+        kpdve_anchor_update(&anchor, home);
+    }
+    for (int i = 0; i < 20; i++)
+    {
+        kpdve_anchor_update(&anchor, 9 << 12 | 1 << 9);
+    }
+
+    int moved = 0;
+    for (int trial = 0; trial < 40; trial++)
+    {
+        int context = random_kpdve();
+        for (int chroma = 1; chroma < 4096; chroma++)
+        {
+            anchor.weight = 0.0f;
+            if (kpdve_anchor_choose(tables, &anchor, chroma, context) != kpdve_tables_choose(tables, chroma, context))
+            {
+                fail("weight 0 changes the choice");
+                return;
+            }
+            anchor.weight = 0.8f;
+            int index = kpdve_anchor_choose(tables, &anchor, chroma, context);
+            int plain = kpdve_tables_choose(tables, chroma, context);
+            if (index < 0)
+            {
+                continue;
+            }
+            moved += index != plain;
+
+            // the anchored choice is a same-K/P candidate if there is one, and else the
+            // nearest by context distance plus the weighted anchor distance
+            const uint32_t *list = tables->candidates + tables->offsets[chroma];
+            int count = tables->offsets[chroma + 1] - tables->offsets[chroma];
+            int same = -1;
+            double best = 1e9, chosen = 0;
+            for (int j = 0; j < count; j++)
+            {
+                int kpdve = (int)(list[j] & 0xFFFF);
+                if (same < 0 && (kpdve >> 9) == ((context >> 9) & 0x7F))
+                {
+                    same = j;
+                }
+                double d = KPD_distance(kpdve, context) + 0.8 * kpdve_anchor_distance(&anchor, kpdve);
+                best = d < best ? d : best;
+                chosen = j == index ? d : chosen;
+            }
+            if ((same >= 0 && index != same) || (same < 0 && chosen > best + 1e-3))
+            {
+                fail("anchored choice is not the nearest");
+                return;
+            }
+        }
+    }
+    printf("the anchor moved %d of %d choices\n", moved, 40 * 4095);
+    if (moved == 0)
+    {
+        fail("the anchor never changed a choice");
+    }
+}
+
+// 2^(1 / h), from the series of e^x (the library does not link libm, and neither do tests)
+static double growth_for(double h)
+{
+    double x = 0.69314718055994530942 / h, term = 1.0, sum = 1.0;
+    for (int n = 1; n < 24; n++)
+    {
+        term *= x / n;
+        sum += term;
+    }
+    return sum;
+}
+
+// half-lives long enough that the increment grows by less than 1 per frame: an early run
+// of one cell must still fade as a directly decayed one does
+static void check_half_lives(const kpdve_tables *tables)
+{
+    static const double half_lives[] = { 10000.0, 65536.0, 1048576.0 };
+    static kpdve_anchor anchor;
+    for (int h = 0; h < 3; h++)
+    {
+        double half_life = half_lives[h];
+        kpdve_anchor_init(&anchor, tables, half_life, 1.0f);
+        double step = growth_for(half_life), weight = 1.0, early = 0.0, total = 0.0;
+        long first = (long)(half_life / 4), frames = first + (long)(2 * half_life);
+        for (long i = 0; i < frames; i++)
+        {
+            int kpdve = i < first ? 2 << 12 | 1 << 9 : 7 << 12 | 3 << 9;
+            kpdve_anchor_update(&anchor, kpdve);
+            early += i < first ? weight : 0.0;
+            total += weight;
+            weight *= step;
+        }
+        double expected = early / total;
+        double share = kpdve_anchor_share(&anchor, 2, 1);
+        if (absolute(share - expected) > 0.01 * expected)
+        {
+            printf("half-life %.0f: early share %f, expected %f\n", half_life, share, expected);
+            fail("long half-life does not decay");
+        }
+    }
+}
+
+// a weight large enough that every anchored distance is far above any context distance
+static void check_heavy_weight(const kpdve_tables *tables)
+{
+    kpdve_anchor anchor;
+    kpdve_anchor_init(&anchor, tables, HALF_LIFE, 1000.0f);
+    for (int i = 0; i < 200; i++)
+    {
+        kpdve_anchor_update(&anchor, 4 << 12 | 2 << 9);
+    }
+    int context = 10 << 12 | 5 << 9 | 3 << 6;
+    for (int chroma = 1; chroma < 4096; chroma++)
+    {
+        int index = kpdve_anchor_choose(tables, &anchor, chroma, context);
+        if (index <= 0)
+        {
+            continue;
+        }
+        const uint32_t *list = tables->candidates + tables->offsets[chroma];
+        int count = tables->offsets[chroma + 1] - tables->offsets[chroma];
+        double best = 1e30, chosen = 0;
+        for (int j = 0; j < count; j++)
+        {
+            int kpdve = (int)(list[j] & 0xFFFF);
+            if ((kpdve >> 9) == (context >> 9))
+            {
+                best = chosen = 0; // taken first, whatever the distances
+                break;
+            }
+            double d = KPD_distance(kpdve, context) + 1000.0 * kpdve_anchor_distance(&anchor, kpdve);
+            best = d < best ? d : best;
+            chosen = j == index ? d : chosen;
+        }
+        if (chosen > best * (1.0 + 1e-5))
+        {
+            fail("heavy anchor choice is not the nearest");
+            return;
+        }
+    }
+    // and where the first candidate is not the nearest, it is not returned
+    int moved = 0;
+    for (int chroma = 1; chroma < 4096; chroma++)
+    {
+        moved += kpdve_anchor_choose(tables, &anchor, chroma, context) > 0;
+    }
+    if (moved == 0)
+    {
+        fail("heavy anchor always takes the first candidate");
+    }
+}
+
+// pf_rt with an anchor: weight 0 analyzes as without; otherwise as choose-and-update by hand
+static void check_rt(const kpdve_tables *tables)
+{
+    static int chroma[FRAMES];
+    static const int chords[] = { 0x91, 0x221, 0x84, 0x109, 0x412, 0x8A, 0x891, 0xA4, 0x0 };
+    for (int i = 0; i < FRAMES; i++)
+    {
+        chroma[i] = rand() % 10 < 8 ? chords[rand() % 9] : rand() % 4096;
+    }
+
+    pf_rt_analyzer plain, zero, anchored;
+    kpdve_anchor zero_anchor, anchor, by_hand;
+    pf_rt_init(&plain, tables);
+    pf_rt_init(&zero, tables);
+    pf_rt_init(&anchored, tables);
+    kpdve_anchor_init(&zero_anchor, tables, 500.0, 0.0f);
+    kpdve_anchor_init(&anchor, tables, 500.0, 1.5f);
+    kpdve_anchor_init(&by_hand, tables, 500.0, 1.5f);
+    pf_rt_set_anchor(&zero, &zero_anchor);
+    pf_rt_set_anchor(&anchored, &anchor);
+
+    int context = plain.context;
+    int differ = 0;
+    for (int i = 0; i < FRAMES; i++)
+    {
+        int a = pf_rt_analyze_chroma(&plain, chroma[i]);
+        if (pf_rt_analyze_chroma(&zero, chroma[i]) != a)
+        {
+            fail("an anchor of weight 0 changed the analysis");
+            return;
+        }
+        int b = pf_rt_analyze_chroma(&anchored, chroma[i]);
+        int index = chroma[i] ? kpdve_anchor_choose(tables, &by_hand, chroma[i], context) : -1;
+        if (index >= 0)
+        {
+            context = KPDVE_CANDIDATE_KPDVE(tables->candidates[tables->offsets[chroma[i]] + index]);
+            kpdve_anchor_update(&by_hand, context);
+        }
+        if (((b >> 12) & 0xFFFF) != context)
+        {
+            fail("anchored analyzer differs from choosing by hand");
+            return;
+        }
+        differ += a != b;
+    }
+    printf("%d of %d frames analyzed differently with the anchor\n", differ, FRAMES);
+    if (zero_anchor.frames == 0 || anchor.frames != by_hand.frames)
+    {
+        fail("anchor not updated by the analyzer");
+    }
+    pf_rt_reset(&anchored);
+    if (anchor.total != 0 || anchored.anchor != &anchor)
+    {
+        fail("reset did not empty the anchor");
+    }
+}
+
+/**
+ * @brief Checks the O(1) decayed distribution against a direct one, the anchored choice
+ * against a brute-force one, and pf_rt with an anchor attached.
+ */
+int main(void)
+{
+    srand(48);
+    const kpdve_tables *tables = kpdve_tables_default();
+    check_distribution(tables);
+    check_choice(tables);
+    check_half_lives(tables);
+    check_heavy_weight(tables);
+    check_rt(tables);
+
+    printf("%d failures\n", failures);
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures != 0;
+}
@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/qdkpdve.h"
+#include "../include/qdkpdve_blob.h"
+#include "../include/qdkpdve_nametable.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_tables.h"
+
+static const char *default_path = "test_blob_default.pfb";
+static const char *weighted_path = "test_blob_weighted.pfb";
+static const char *broken_path = "test_blob_broken.pfb";
+
+// set_min_index's rule, on KPD_distance_weighted
+static int reference_choice(const kpdve_tables *tables, int chroma, int context, const float *weights)
+{
+    int first = tables->offsets[chroma];
+    int count = tables->offsets[chroma + 1] - first;
+    float min_dist = 100.0f;
+    int min_index = count ? 0 : -1;
+    for (int i = 0; i < count; i++)
+    {
+        int kpdve = KPDVE_CANDIDATE_KPDVE(tables->candidates[first + i]);
+        if ((kpdve >> 9) == (context >> 9))
+        {
+            return i;
+        }
+        float dist = (float)KPD_distance_weighted(kpdve, context, weights);
+        if (dist < min_dist)
+        {
+            min_dist = dist;
+            min_index = i;
+        }
+    }
+    return min_index;
+}
+
+static int copy_with(const char *from, const char *to, long flip, long keep)
+{
+    FILE *in = fopen(from, "rb");
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    rewind(in);
+    char *bytes = malloc((size_t)size);
+    size_t got = fread(bytes, 1, (size_t)size, in);
+    fclose(in);
+    if (flip >= 0)
+    {
+        bytes[flip] ^= 0x10;
+    }
+    FILE *out = fopen(to, "wb");
+    fwrite(bytes, 1, (keep >= 0) ? (size_t)keep : got, out);
+    fclose(out);
+    free(bytes);
+    return 0;
+}
+
+// a copy with len bytes at offset replaced (the checksum goes stale, so open it without verifying)
+static int copy_patched(const char *from, const char *to, long offset, const void *patch, size_t len)
+{
+    FILE *in = fopen(from, "rb");
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    rewind(in);
+    char *bytes = malloc((size_t)size);
+    size_t got = fread(bytes, 1, (size_t)size, in);
+    fclose(in);
+    memcpy(bytes + offset, patch, len);
+    FILE *out = fopen(to, "wb");
+    fwrite(bytes, 1, got, out);
+    fclose(out);
+    free(bytes);
+    return 0;
+}
+
+/**
+ * @brief Writes blobs for the built-in and for other weights, maps them, and checks the
+ * tables, decisions and names in them; then checks that damaged blobs, indexes out of
+ * bounds and contexts outside the decision table are refused.
+ */
+int main(void)
+{
+    int failed = 0;
+    const kpdve_tables *tables = kpdve_tables_default();
+    kpdve_name_table_init();
+
+    float weights[5] = { 1.6f, 1.0f, 1.3f, 1.0f, 1.0f };
+    if (kpdve_blob_write(default_path, NULL) != KPDVE_BLOB_OK
+        || kpdve_blob_write(weighted_path, weights) != KPDVE_BLOB_OK)
+    {
+        printf("cannot write blobs\n");
+        return 1;
+    }
+
+    kpdve_blob blob;
+    int section;
+    if (kpdve_blob_open(&blob, default_path, KPDVE_BLOB_VERIFY) != KPDVE_BLOB_OK
+        || kpdve_blob_validate(&blob, &section) != KPDVE_BLOB_OK)
+    {
+        printf("default blob refused\n");
+        return 1;
+    }
+
+    // the built-in weights: the same tables as kpdve_tables_default, to the bit
+    if (memcmp(blob.tables.candidates, tables->candidates, KPDVE_TABLES_CANDIDATES * sizeof(uint32_t)) != 0
+        || memcmp(blob.tables.offsets, tables->offsets, (KPDVE_TABLES_CHROMA + 1) * sizeof(uint16_t)) != 0
+        || memcmp(blob.tables.k_distance, tables->k_distance, 12 * 12 * sizeof(float)) != 0
+        || memcmp(blob.tables.d_distance, tables->d_distance, 8 * 8 * sizeof(float)) != 0)
+    {
+        printf("default blob tables differ from the built ones\n");
+        failed = 1;
+    }
+    int mismatches = 0;
+    for (int context_index = 0; context_index < KPDVE_TABLES_CONTEXTS; context_index++)
+    {
+        int loc[] = { context_index / 49, context_index / 7 % 7, context_index % 7, 0, 0 };
+        int context = KPDVEtoBinaryEncoding(loc);
+        for (int chroma = 1; chroma < KPDVE_TABLES_CHROMA; chroma++)
+        {
+            mismatches += kpdve_blob_choose(&blob, chroma, context) != kpdve_tables_choose(tables, chroma, context);
+        }
+    }
+    for (int kpdve = 0; kpdve < KPDVE_NAME_TABLE_SIZE; kpdve += 7)
+    {
+        const struct kpdve_name_entry *e = &blob.names.entries[kpdve];
+        mismatches += strcmp(blob.names.pool + e->chord, kpdve_name_chord(kpdve)) != 0;
+        mismatches += strcmp(blob.names.pool + e->mode, kpdve_name_mode(kpdve)) != 0;
+    }
+    if (mismatches != 0)
+    {
+        printf("default blob: %d decisions or names differ\n", mismatches);
+        failed = 1;
+    }
+
+    // P or D of 7, or K of 12 or more, have no row
+    int outside[] = { 7 << 9, 7 << 6, 12 << 12, 15 << 12 | 7 << 9 | 7 << 6 };
+    for (int i = 0; i < 4; i++)
+    {
+        if (kpdve_blob_choose(&blob, 0xFFF, outside[i]) != -1 || kpdve_blob_choose(&blob, 1, outside[i]) != -1)
+        {
+            printf("context 0x%x outside the decision table not refused\n", outside[i]);
+            failed = 1;
+        }
+    }
+    struct kpdve_blob_header header = *blob.header;
+    int first = blob.tables.offsets[1];
+    kpdve_blob_close(&blob);
+
+    // other weights: the decisions follow KPD_distance_weighted
+    mismatches = 0;
+    if (kpdve_blob_open(&blob, weighted_path, KPDVE_BLOB_VERIFY) != KPDVE_BLOB_OK
+        || kpdve_blob_validate(&blob, &section) != KPDVE_BLOB_OK
+        || memcmp(blob.header->axis_scale, weights, sizeof(weights)) != 0)
+    {
+        printf("weighted blob refused\n");
+        return 1;
+    }
+    int changed = 0;
+    for (int context_index = 0; context_index < KPDVE_TABLES_CONTEXTS; context_index += 5)
+    {
+        int loc[] = { context_index / 49, context_index / 7 % 7, context_index % 7, 0, 0 };
+        int context = KPDVEtoBinaryEncoding(loc);
+        for (int chroma = 1; chroma < KPDVE_TABLES_CHROMA; chroma++)
+        {
+            int choice = kpdve_blob_choose(&blob, chroma, context);
+            mismatches += choice != reference_choice(tables, chroma, context, weights);
+            changed += choice != kpdve_tables_choose(tables, chroma, context);
+        }
+    }
+    if (mismatches != 0 || changed == 0)
+    {
+        printf("weighted blob: %d decisions differ from the weighted reference, %d from the default\n", mismatches, changed);
+        failed = 1;
+    }
+    printf("weighted blob: %d of the sampled decisions differ from the built-in weights\n", changed);
+    size_t size = blob.map_size;
+    kpdve_blob_close(&blob);
+
+    // V and E enter no table
+    float v_weighted[5] = { 1.6f, 1.0f, 1.3f, 2.0f, 1.0f };
+    if (kpdve_blob_write(broken_path, v_weighted) != KPDVE_BLOB_ERR_WEIGHTS)
+    {
+        printf("V weight not refused\n");
+        failed = 1;
+    }
+
+    // damage: a flipped bit fails the checksum, a short file the layout check
+    copy_with(default_path, broken_path, (long)header.sections[KPDVE_BLOB_K_DISTANCE].offset + 1, -1);
+    if (kpdve_blob_open(&blob, broken_path, 0) != KPDVE_BLOB_OK
+        || kpdve_blob_validate(&blob, &section) != KPDVE_BLOB_ERR_CHECKSUM)
+    {
+        printf("flipped bit not caught by validation\n");
+        failed = 1;
+    }
+    kpdve_blob_close(&blob);
+    if (kpdve_blob_open(&blob, broken_path, KPDVE_BLOB_VERIFY) != KPDVE_BLOB_ERR_CHECKSUM)
+    {
+        printf("flipped bit not caught on open\n");
+        failed = 1;
+    }
+    copy_with(default_path, broken_path, -1, (long)size - 64);
+    if (kpdve_blob_open(&blob, broken_path, 0) != KPDVE_BLOB_ERR_FORMAT)
+    {
+        printf("truncated blob not refused\n");
+        failed = 1;
+    }
+
+    // indexes out of bounds are refused at open, checksum or not
+    const struct kpdve_blob_section *sections = header.sections;
+    uint16_t big_offset = 0xFFFF;
+    uint32_t far_k = 0x0000F001u;
+    uint8_t far_choice = 200;
+    uint32_t far_name = (uint32_t)sections[KPDVE_BLOB_NAME_POOL].size;
+    char unterminated = 'x';
+    struct {
+        const char *what;
+        long offset;
+        const void *patch;
+        size_t len;
+    } damage[] = {
+        { "offsets out of order", (long)sections[KPDVE_BLOB_OFFSETS].offset + 100 * 2, &big_offset, 2 },
+        { "last offset past the candidates", (long)sections[KPDVE_BLOB_OFFSETS].offset + KPDVE_TABLES_CHROMA * 2, &big_offset, 2 },
+        { "candidate K of 15", (long)sections[KPDVE_BLOB_CANDIDATES].offset + first * 4, &far_k, 4 },
+        { "decision past the candidates", (long)sections[KPDVE_BLOB_DECISIONS].offset + 1, &far_choice, 1 },
+        { "chord name past the pool", (long)sections[KPDVE_BLOB_NAME_ENTRIES].offset + 12, &far_name, 4 },
+        { "unterminated pool", (long)(sections[KPDVE_BLOB_NAME_POOL].offset + sections[KPDVE_BLOB_NAME_POOL].size - 1), &unterminated, 1 },
+    };
+    for (size_t i = 0; i < sizeof(damage) / sizeof(damage[0]); i++)
+    {
+        copy_patched(default_path, broken_path, damage[i].offset, damage[i].patch, damage[i].len);
+        int err = kpdve_blob_open(&blob, broken_path, 0);
+        if (err != KPDVE_BLOB_ERR_CONTENT)
+        {
+            printf("%s not refused (%d)\n", damage[i].what, err);
+            failed = 1;
+            kpdve_blob_close(&blob);
+        }
+    }
+
+    remove(default_path);
+    remove(weighted_path);
+    remove(broken_path);
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/harmony_state.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_codec.h"
+
+#define FRAMES 200000
+#define CM 0b10010001
+
+/**
+ * @brief Builds a stream that looks like analyzed audio: diatonic chords held for a few
+ * dozen frames, the occasional random triad, modulation and invalid cluster.
+ */
+static void make_stream(int *states, int count)
+{
+    srand(1234);
+    harmony_state state = harmony_state_default();
+    int context = 35;
+    int key = 0;
+    int chroma = CM;
+    // roots of the diatonic triads of C major, by semitone, with their quality
+    int roots[] = { 0, 2, 4, 5, 7, 9 };
+    int minor[] = { 0, 1, 1, 0, 0, 1 };
+
+    for (int i = 0; i < count; i++)
+    {
+        int r = rand() % 1000;
+        if (r < 40)
+        {
+            int deg = rand() % 6;
+            int triad = minor[deg] ? 0b10001001 : CM;
+            chroma = mod_rot(triad, (roots[deg] + key) % 12, 12);
+        }
+        else if (r < 45)
+        {
+            chroma = 0;
+            for (int b = 0; b < 3; b++)
+            {
+                chroma |= 1 << (rand() % 12);
+            }
+        }
+        else if (r < 47)
+        {
+            key = (key + 7) % 12;
+        }
+        else if (r < 48)
+        {
+            chroma = 0xFFF; // cluster: flagged invalid
+        }
+
+        adjust_harmony_state_from_chroma_and_context(&state, chroma, context);
+        context = state.kpdve;
+        states[i] = state.encoded_state;
+    }
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+// decodes a chunk made of a consistent header and the given payload
+static long decode_payload(uint32_t count, const uint8_t *payload, size_t size, int *states)
+{
+    uint8_t *chunk = malloc(KPDVE_CODEC_HEADER_SIZE + size);
+    put_u32(chunk, KPDVE_CODEC_MAGIC);
+    put_u32(chunk + 4, count);
+    put_u32(chunk + 8, (uint32_t)size);
+    memcpy(chunk + KPDVE_CODEC_HEADER_SIZE, payload, size);
+    long n = kpdve_codec_decode_chunk(chunk, KPDVE_CODEC_HEADER_SIZE + size, states, 16, NULL);
+    free(chunk);
+    return n;
+}
+
+/**
+ * @brief Hand-made payloads whose header is consistent but whose tokens are cut short,
+ * refer to nothing, or do not add up to the frame count.
+ */
+static int check_corrupt_tokens(void)
+{
+    struct {
+        const char *what;
+        uint32_t count;
+        uint8_t payload[8];
+        size_t size;
+    } cases[] = {
+        { "literal cut short", 1, { 0xC0, 0x91, 0x00, 0x00 }, 4 },
+        { "delta without its K/P byte", 1, { 0x90 }, 1 },
+        { "delta without its VE byte", 1, { 0x80, 0x02 }, 2 },
+        { "chroma miss cut short", 1, { 0x4F, 0x91 }, 2 },
+        { "chroma from a slot never filled", 1, { 0x43 }, 1 },
+        { "delta chroma from a slot never filled", 1, { 0x80, 0x02, 0x07 }, 3 },
+        { "run past the frame count", 3, { 0x03 }, 1 },
+        { "token past the frame count", 1, { 0x00, 0x4F, 0x91, 0x00 }, 4 },
+        { "fewer frames than the count", 5, { 0x01 }, 1 },
+    };
+    int states[16];
+    int failed = 0;
+
+    // the well-formed chunk the cases are made from: a literal and a run of two
+    uint8_t good[] = { 0xC0, 0x91, 0x00, 0x00, 0x00, 0x01 };
+    if (decode_payload(3, good, sizeof(good), states) != 3 || states[0] != 0x91 || states[2] != 0x91)
+    {
+        printf("hand-made chunk not decoded\n");
+        failed = 1;
+    }
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        long n = decode_payload(cases[i].count, cases[i].payload, cases[i].size, states);
+        if (n != KPDVE_CODEC_ERR_CORRUPT)
+        {
+            printf("%s: decoded as %ld\n", cases[i].what, n);
+            failed = 1;
+        }
+    }
+    return failed;
+}
+
+static int check_roundtrip(const int *states, size_t count, size_t *coded_size)
+{
+    uint8_t *coded = malloc(kpdve_codec_bound(count));
+    int *decoded = malloc((count + 1) * sizeof(int));
+    int failed = 0;
+
+    long len = kpdve_codec_encode_chunk(states, count, coded, kpdve_codec_bound(count));
+    if (len < 0)
+    {
+        printf("encode failed: %ld\n", len);
+        failed = 1;
+    }
+    else
+    {
+        size_t consumed = 0;
+        long n = kpdve_codec_decode_chunk(coded, (size_t)len, decoded, count + 1, &consumed);
+        if (n != (long)count || consumed != (size_t)len || memcmp(states, decoded, count * sizeof(int)) != 0)
+        {
+            printf("roundtrip mismatch (%ld of %zu frames)\n", n, count);
+            failed = 1;
+        }
+        // every truncation must be detected, never read out of bounds
+        for (long cut = 1; cut < len && cut < 64; cut++)
+        {
+            if (kpdve_codec_decode_chunk(coded, (size_t)(len - cut), decoded, count + 1, NULL) >= 0)
+            {
+                printf("truncated chunk (-%ld bytes) was accepted\n", cut);
+                failed = 1;
+                break;
+            }
+        }
+        // the same with the payload size rewritten to match, so the tokens themselves are cut
+        for (long cut = 1; cut <= len - KPDVE_CODEC_HEADER_SIZE && cut < 64; cut++)
+        {
+            uint8_t *short_chunk = malloc((size_t)(len - cut));
+            memcpy(short_chunk, coded, (size_t)(len - cut));
+            put_u32(short_chunk + 8, (uint32_t)(len - cut - KPDVE_CODEC_HEADER_SIZE));
+            if (kpdve_codec_decode_chunk(short_chunk, (size_t)(len - cut), decoded, count + 1, NULL) >= 0)
+            {
+                printf("chunk with %ld payload bytes cut was accepted\n", cut);
+                failed = 1;
+                cut = 64;
+            }
+            free(short_chunk);
+        }
+        *coded_size = (size_t)len;
+    }
+
+    free(coded);
+    free(decoded);
+    return failed;
+}
+
+int main(void)
+{
+    int *states = malloc(FRAMES * sizeof(int));
+    size_t coded_size = 0;
+    int failed = 0;
+
+    make_stream(states, FRAMES);
+    failed |= check_roundtrip(states, FRAMES, &coded_size);
+    printf("analyzed stream: %d frames, %zu bytes raw, %zu bytes coded (%.2f bits/frame)\n",
+           FRAMES, FRAMES * sizeof(int), coded_size, 8.0 * coded_size / FRAMES);
+    if (coded_size * 10 > FRAMES * sizeof(int))
+    {
+        printf("expected at least 10x compression\n");
+        failed = 1;
+    }
+
+    // arbitrary words (spare bits, out of range fields) must survive as literals
+    for (int i = 0; i < FRAMES; i++)
+    {
+        states[i] = (int)(((unsigned)rand() << 16) ^ (unsigned)rand());
+    }
+    failed |= check_roundtrip(states, FRAMES, &coded_size);
+    failed |= check_roundtrip(states, 0, &coded_size);
+    failed |= check_corrupt_tokens();
+
+    free(states);
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/harmony_state.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_codec.h"
+#include "../include/qdkpdve_corpus.h"
+#include "../include/qdkpdve_store.h"
+
+#define CM 0b10010001
+#define CHROMA_FRAMES 20000
+#define STATE_FRAMES 5000
+#define CODED_FRAMES 10000
+#define CODED_CHUNK 3000
+
+static const char *store_path = "test_corpus.pfs";
+static const char *inputs[] = { "test_corpus.chroma", "test_corpus.missing", "test_corpus.raw", "test_corpus.pfc" };
+#define INPUTS 4
+
+// progressions in changing keys, with the odd cluster
+static int next_chroma(int chroma)
+{
+    int r = rand() % 1000;
+    if (r < 3)
+    {
+        return mod_rot(CM, rand() % 12, 12);
+    }
+    if (r < 5)
+    {
+        return 0xFFF;
+    }
+    if (r < 60)
+    {
+        return mod_rot(CM, (rand() % 3) * 5, 12);
+    }
+    return chroma;
+}
+
+static int write_file(const char *path, const void *data, size_t size)
+{
+    FILE *out = fopen(path, "wb");
+    int ok = out != NULL && fwrite(data, 1, size, out) == size;
+    return (out != NULL && fclose(out) == 0 && ok) ? 0 : -1;
+}
+
+// what one sequential pass gives for a file's chroma
+static void analyze(const int *chroma, size_t count, int *states)
+{
+    harmony_state state = harmony_state_default();
+    for (size_t i = 0; i < count; i++)
+    {
+        adjust_harmony_state_from_chroma(&state, chroma[i]);
+        states[i] = state.encoded_state;
+    }
+}
+
+static int check(const struct kpdve_corpus_options *options, int *const expected[], const size_t frames[])
+{
+    struct kpdve_corpus_file files[INPUTS];
+    struct kpdve_corpus_result result;
+    int failed = 0;
+
+    if (kpdve_corpus_analyze(inputs, INPUTS, store_path, options, files, &result) != KPDVE_CORPUS_OK)
+    {
+        printf("analysis failed\n");
+        return 1;
+    }
+    if (!files[1].err || files[0].err || files[2].err || files[3].err || result.files != 3)
+    {
+        printf("wrong files reported unreadable\n");
+        failed = 1;
+    }
+    if (files[0].format != KPDVE_CORPUS_CHROMA || files[2].format != KPDVE_CORPUS_STATES
+        || files[3].format != KPDVE_CORPUS_CODED)
+    {
+        printf("formats not recognised\n");
+        failed = 1;
+    }
+
+    kpdve_store store;
+    if (kpdve_store_open(&store, store_path) != KPDVE_STORE_OK)
+    {
+        printf("cannot open %s\n", store_path);
+        return 1;
+    }
+    size_t position = 0;
+    for (int f = 0; f < INPUTS && !failed; f++)
+    {
+        if (files[f].frames != frames[f] || (frames[f] > 0 && files[f].first_frame != position))
+        {
+            printf("%s: %zu frames at %llu, expected %zu at %zu\n", inputs[f], files[f].frames,
+                   (unsigned long long)files[f].first_frame, frames[f], position);
+            failed = 1;
+            break;
+        }
+        for (size_t i = 0; i < frames[f]; i++)
+        {
+            if (kpdve_store_frame(&store, position + i) != expected[f][i])
+            {
+                printf("%s, frame %zu: %08x, expected %08x (%d threads, warm-up %zu)\n", inputs[f], i,
+                       kpdve_store_frame(&store, position + i), expected[f][i], options->threads, options->warmup_frames);
+                failed = 1;
+                break;
+            }
+        }
+        position += frames[f];
+    }
+    if (kpdve_store_frame_count(&store) != position)
+    {
+        printf("store holds %zu frames, expected %zu\n", kpdve_store_frame_count(&store), position);
+        failed = 1;
+    }
+    kpdve_store_close(&store);
+
+    printf("%d threads, segments of %zu, warm-up %zu: %zu segments, %zu re-analyzed, %zu steals, at most %zu held\n",
+           options->threads, options->segment_frames, options->warmup_frames,
+           result.segments, result.reanalyzed, result.steals, result.peak_segments);
+    if (result.peak_segments == 0 || result.peak_segments > 4 * (size_t)result.threads)
+    {
+        printf("more segments held than the window allows\n");
+        failed = 1;
+    }
+    return failed;
+}
+
+/**
+ * @brief Analyzes split files on several threads and checks the store against sequential passes.
+ */
+int main(void)
+{
+    int failed = 0;
+    srand(37);
+
+    // the inputs: chroma, raw states, coded states (several chunks)
+    uint16_t *chroma_file = malloc(CHROMA_FRAMES * sizeof(uint16_t));
+    int *chroma = malloc(CHROMA_FRAMES * sizeof(int));
+    int c = CM;
+    for (int i = 0; i < CHROMA_FRAMES; i++)
+    {
+        c = next_chroma(c);
+        chroma[i] = c;
+        chroma_file[i] = (uint16_t)c;
+    }
+
+    int *raw = malloc(STATE_FRAMES * sizeof(int));
+    int *raw_chroma = malloc(STATE_FRAMES * sizeof(int));
+    for (int i = 0; i < STATE_FRAMES; i++)
+    {
+        c = next_chroma(c);
+        raw_chroma[i] = c;
+        raw[i] = (rand() << 12) | c; // only the chroma bits count
+    }
+
+    int *coded_states = malloc(CODED_FRAMES * sizeof(int));
+    int *coded_chroma = malloc(CODED_FRAMES * sizeof(int));
+    for (int i = 0; i < CODED_FRAMES; i++)
+    {
+        c = next_chroma(c);
+        coded_chroma[i] = c;
+    }
+    analyze(coded_chroma, CODED_FRAMES, coded_states);
+    size_t coded_cap = 0;
+    for (int first = 0; first < CODED_FRAMES; first += CODED_CHUNK)
+    {
+        coded_cap += kpdve_codec_bound(CODED_CHUNK);
+    }
+    uint8_t *coded = malloc(coded_cap);
+    size_t coded_size = 0;
+    for (int first = 0; first < CODED_FRAMES; first += CODED_CHUNK)
+    {
+        int n = (CODED_FRAMES - first < CODED_CHUNK) ? CODED_FRAMES - first : CODED_CHUNK;
+        coded_size += (size_t)kpdve_codec_encode_chunk(coded_states + first, (size_t)n, coded + coded_size,
+                                                       coded_cap - coded_size);
+    }
+
+    remove(inputs[1]);
+    if (write_file(inputs[0], chroma_file, CHROMA_FRAMES * sizeof(uint16_t)) != 0
+        || write_file(inputs[2], raw, STATE_FRAMES * sizeof(int)) != 0
+        || write_file(inputs[3], coded, coded_size) != 0)
+    {
+        printf("cannot write the inputs\n");
+        return 1;
+    }
+
+    int *expected[INPUTS] = { malloc(CHROMA_FRAMES * sizeof(int)), NULL, malloc(STATE_FRAMES * sizeof(int)), coded_states };
+    size_t frames[INPUTS] = { CHROMA_FRAMES, 0, STATE_FRAMES, CODED_FRAMES };
+    analyze(chroma, CHROMA_FRAMES, expected[0]);
+    analyze(raw_chroma, STATE_FRAMES, expected[2]);
+
+    struct kpdve_corpus_options options;
+    kpdve_corpus_default_options(&options);
+    options.block_frames = 512;
+
+    // whole files, one thread
+    options.threads = 1;
+    options.segment_frames = 0;
+    failed |= check(&options, expected, frames);
+
+    // small segments (not aligned to coded chunks) on more threads than cores
+    options.threads = 4;
+    options.segment_frames = 1700;
+    options.warmup_frames = 256;
+    failed |= check(&options, expected, frames);
+
+    // no warm-up: every seam relies on the merge's fallback
+    options.warmup_frames = 0;
+    failed |= check(&options, expected, frames);
+
+    // many more segments than the window: no more than four per thread are held at once
+    options.threads = 3;
+    options.segment_frames = 97;
+    options.warmup_frames = 64;
+    failed |= check(&options, expected, frames);
+
+    for (int f = 0; f < INPUTS; f++)
+    {
+        remove(inputs[f]);
+    }
+    remove(store_path);
+    free(chroma_file);
+    free(chroma);
+    free(raw);
+    free(raw_chroma);
+    free(coded_states);
+    free(coded_chroma);
+    free(coded);
+    free(expected[0]);
+    free(expected[2]);
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
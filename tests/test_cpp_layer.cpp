@@ -0,0 +1,184 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../include/pitchflock.hpp"
+#include "../include/qdkpdve.h"
+#include "../include/qdkpdve_statemaker.h"
+
+using namespace pitchflock;
+
+// evaluated by the compiler: the encoding, the crystal masks, a C major triad
+static_assert(kpdve(0, 0, 0, 1, 2).encode() == 10, "encoding");
+static_assert(kpdve::decode(kpdve(11, 6, 5, 4, 3).encode()) == kpdve(11, 6, 5, 4, 3), "decoding");
+static_assert(crystal12::masks[0] == 0x7F && crystal12::cells == 84 && crystal24::division == 13, "crystal");
+static_assert(crystal12::chroma_to_circle(0x91) == 0x26 && crystal12::circle_to_chroma(0x26) == 0x91, "circle order");
+
+constexpr kpdve c_major_triad()
+{
+    candidate list[analyzer<crystal12>::max_candidates]{};
+    int count = analyzer<crystal12>::candidates(0x91, list);
+    return list[analyzer<crystal12>::choose(list, count, kpdve(0, 0, 0, 1, 0))].location;
+}
+static_assert(c_major_triad().same_kp(kpdve(0, 0, 0, 0, 0)), "C E G in the C context");
+
+static int failures = 0;
+
+static void fail(const char *what, unsigned long long chroma)
+{
+    if (failures++ < 10)
+    {
+        std::printf("%s (chroma %llx)\n", what, chroma);
+    }
+}
+
+// the compile-time tables against the ones the library builds
+static void check_tables()
+{
+    const kpdve_tables *c = kpdve_tables_default();
+    kpdve_tables cpp = tables12::view();
+    if (std::memcmp(c->crystal_masks, cpp.crystal_masks, KPDVE_TABLES_CELLS * sizeof(uint16_t)) != 0
+        || std::memcmp(c->minimized, cpp.minimized, 128 * sizeof(uint32_t)) != 0
+        || std::memcmp(c->offsets, cpp.offsets, (KPDVE_TABLES_CHROMA + 1) * sizeof(uint16_t)) != 0
+        || std::memcmp(c->candidates, cpp.candidates, KPDVE_TABLES_CANDIDATES * sizeof(uint32_t)) != 0
+        || std::memcmp(c->k_distance, cpp.k_distance, 12 * 12 * sizeof(float)) != 0
+        || std::memcmp(c->p_distance, cpp.p_distance, 8 * 8 * sizeof(float)) != 0
+        || std::memcmp(c->d_distance, cpp.d_distance, 8 * 8 * sizeof(float)) != 0)
+    {
+        fail("compile-time tables differ from kpdve_tables_default", 0);
+    }
+}
+
+// analyzer<crystal12> against set_kp_list and set_min_index
+static void check_reference()
+{
+    harmony_state state = harmony_state_default();
+    harmony_state filled = harmony_state_default();
+    static candidate list[analyzer<crystal12>::max_candidates];
+
+    // silence: no candidates, but set_kp_list lists every cell with placeholders
+    state.chromatic_notes = 0;
+    set_kp_list(&state);
+    choose_kpdve_from_context(&state, 34);
+    filled.chromatic_notes = 0;
+    analyzer<crystal12>::fill(filled, 34);
+    if (analyzer<crystal12>::candidates(0, list) != 0 || filled.kpdve_list_length != state.kpdve_list_length
+        || std::memcmp(filled.kpdve_list, state.kpdve_list, sizeof(state.kpdve_list)) != 0
+        || std::memcmp(filled.dve_list, state.dve_list, sizeof(state.dve_list)) != 0
+        || std::memcmp(filled.ve_list, state.ve_list, sizeof(state.ve_list)) != 0
+        || filled.kpdve_min_index != state.kpdve_min_index || filled.kpdve != state.kpdve || filled.dve != state.dve
+        || filled.ve != state.ve || filled.encoded_state != state.encoded_state)
+    {
+        fail("filled silence differs", 0);
+    }
+
+    for (int chroma = 1; chroma < 4096; chroma++)
+    {
+        state.chromatic_notes = chroma;
+        set_kp_list(&state);
+        int count = analyzer<crystal12>::candidates((chroma_t)chroma, list);
+        if (count != state.kpdve_list_length)
+        {
+            fail("candidate count differs", (unsigned long long)chroma);
+            continue;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            if (list[i].location.encode() != state.kpdve_list[i] || (int)list[i].dve != state.dve_list[i]
+                || (int)list[i].ve != state.ve_list[i])
+            {
+                fail("candidate differs", (unsigned long long)chroma);
+            }
+        }
+        for (int j = 0; j < 4 && count > 0; j++)
+        {
+            kpdve context(std::rand() % 12, std::rand() % 7, std::rand() % 7, 0, 0);
+            set_min_index(&state, context.encode());
+            if (analyzer<crystal12>::choose(list, count, context) != state.kpdve_min_index)
+            {
+                fail("choice differs", (unsigned long long)chroma);
+            }
+            filled.chromatic_notes = chroma;
+            analyzer<crystal12>::fill(filled, context.encode());
+            if (filled.kpdve_min_index != state.kpdve_min_index || filled.kpdve_list_length != count
+                || filled.kpdve != state.kpdve_list[state.kpdve_min_index])
+            {
+                fail("filled state differs", (unsigned long long)chroma);
+            }
+        }
+    }
+}
+
+// fill against choose_kpdve_from_context on a stream with silence and clusters, each
+// frame in the context of the one before (after silence, the KPDVE -1)
+static void check_fill_stream()
+{
+    harmony_state state = harmony_state_default();
+    harmony_state filled = harmony_state_default();
+    int fixed[] = { 0, 0x91, 0xFFF, 0x91, 0, 0xFFF, 0x89, 0 };
+    for (int i = 0; i < 20000; i++)
+    {
+        int r = std::rand() % 10;
+        int chroma = i < 8 ? fixed[i] : r == 0 ? 0 : r == 1 ? (std::rand() | 0xFF) & 0xFFF : std::rand() & 0xFFF;
+        state.chromatic_notes = chroma;
+        set_kp_list(&state);
+        choose_kpdve_from_context(&state, state.kpdve);
+        filled.chromatic_notes = chroma;
+        analyzer<crystal12>::fill(filled, filled.kpdve);
+        if (filled.kpdve_list_length != state.kpdve_list_length || filled.kpdve_min_index != state.kpdve_min_index
+            || filled.kpdve != state.kpdve || filled.dve != state.dve || filled.ve != state.ve
+            || filled.encoded_state != state.encoded_state)
+        {
+            fail("filled stream differs", (unsigned long long)chroma);
+        }
+    }
+}
+
+// analyzer<crystal24> against kpdve_crystal's general code, on one stream
+static void check_quarter_tones()
+{
+    kpdve_crystal_analyzer c;
+    if (kpdve_crystal_init(&c, 2) != 0)
+    {
+        fail("24-note crystal not set up", 0);
+        return;
+    }
+    static analyzer<crystal24> cpp;
+    for (int i = 0; i < 2000; i++)
+    {
+        uint64_t chroma = (uint64_t)(std::rand() & 0xFFFFFF) & ((i % 4 == 0) ? 0xFFFFFF : 0x5A5A5A);
+        int index = kpdve_crystal_analyze(&c, chroma);
+        if (cpp.analyze(chroma) != index || cpp.count() != c.count)
+        {
+            fail("24-note analysis differs", (unsigned long long)chroma);
+            continue;
+        }
+        for (int j = 0; j < c.count; j++)
+        {
+            if (kpdve::from_c(c.candidates[j]) != cpp[j].location || c.candidates[j].dve != cpp[j].dve
+                || c.candidates[j].ve != cpp[j].ve)
+            {
+                fail("24-note candidate differs", (unsigned long long)chroma);
+            }
+        }
+    }
+    kpdve_crystal_free(&c);
+}
+
+/**
+ * @brief Checks the C++ layer: its compile-time 12/7 tables against the library's, its
+ * analyzer and fill against the reference on 12/7, and the analyzer against kpdve_crystal
+ * on 24/13.
+ */
+int main()
+{
+    std::srand(42);
+    check_tables();
+    check_reference();
+    check_fill_stream();
+    check_quarter_tones();
+
+    std::printf("%d mismatches\n", failures);
+    std::printf(failures ? "FAILED\n" : "OK\n");
+    return failures != 0;
+}
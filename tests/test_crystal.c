@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/harmony_state.h"
+#include "../include/qdkpdve.h"
+#include "../include/qdkpdve_crystal.h"
+#include "../include/qdkpdve_statemaker.h"
+
+static int failures = 0;
+
+static void fail(const char *what, unsigned long long chroma)
+{
+    if (failures++ < 10)
+    {
+        printf("%s (chroma %llx)\n", what, chroma);
+    }
+}
+
+// the general code on 12/7 against set_kp_list, set_min_index and kpdve_chord_val
+static void check_reference(kpdve_crystal_analyzer *fast, kpdve_crystal_analyzer *general)
+{
+    harmony_state state = harmony_state_default();
+    for (int chroma = 1; chroma < 4096; chroma++)
+    {
+        state.chromatic_notes = chroma;
+        set_kp_list(&state);
+        int count = kpdve_crystal_candidates(general, (uint64_t)chroma);
+        if (count != state.kpdve_list_length || kpdve_crystal_candidates(fast, (uint64_t)chroma) != count)
+        {
+            fail("candidate count differs", (unsigned long long)chroma);
+            continue;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            const kpdve_crystal_candidate *g = &general->candidates[i];
+            const kpdve_crystal_candidate *f = &fast->candidates[i];
+            if (g->kpdve != state.kpdve_list[i] || (int)g->dve != state.dve_list[i] || (int)g->ve != state.ve_list[i]
+                || f->kpdve != g->kpdve || f->k != g->k || f->p != g->p || f->d != g->d || f->v != g->v
+                || f->e != g->e || f->dve != g->dve || f->ve != g->ve)
+            {
+                fail("candidate differs", (unsigned long long)chroma);
+            }
+            if (kpdve_crystal_chord(general, g) != (uint64_t)circle_to_chroma(kpdve_chord_val(g->kpdve)))
+            {
+                fail("chord differs", (unsigned long long)chroma);
+            }
+        }
+
+        // against a few contexts, including ones in no candidate's K and P
+        for (int j = 0; j < 6 && count > 0; j++)
+        {
+            int loc[] = { rand() % 12, rand() % 7, rand() % 7, 0, 0 };
+            int context = KPDVEtoBinaryEncoding(loc);
+            kpdve_crystal_candidate c = { loc[0], loc[1], loc[2], 0, 0, 0, 0, context };
+            set_min_index(&state, context);
+            if (kpdve_crystal_choose(general, (uint64_t)chroma, &c) != state.kpdve_min_index
+                || kpdve_crystal_choose(fast, (uint64_t)chroma, &c) != state.kpdve_min_index)
+            {
+                fail("choice differs", (unsigned long long)chroma);
+            }
+        }
+
+        // contexts outside the tables (a caller-filled K of 12 or more, or negative)
+        kpdve_crystal_candidate outside[] = {
+            { 12, 0, 0, 0, 0, 0, 0, 0 }, { 15, 7, 7, 7, 7, 0, 0, 0 }, { 40, 3, 2, 0, 0, 0, 0, 0 },
+            { -1, 7, 7, 7, 7, 0, 0, 0 }, { 5, 9, 0, 0, 0, 0, 0, 0 },
+        };
+        for (int j = 0; j < 5 && count > 0; j++)
+        {
+            if (kpdve_crystal_choose(fast, (uint64_t)chroma, &outside[j]) != kpdve_crystal_choose(general, (uint64_t)chroma, &outside[j]))
+            {
+                fail("choice outside the tables differs", (unsigned long long)chroma);
+            }
+        }
+    }
+}
+
+// 24 notes: every candidate's chord holds the notes, and a stream follows its context
+static void check_quarter_tones(void)
+{
+    kpdve_crystal_analyzer a;
+    if (kpdve_crystal_init(&a, 2) != 0 || a.notes != 24 || a.division != 13 || a.cells != 312 || a.fast)
+    {
+        fail("24-note crystal not set up", 0);
+        return;
+    }
+    uint64_t triad = (1ull << 0) | (1ull << 8) | (1ull << 14);   // C E G in quarter tones
+    uint64_t neutral = (1ull << 0) | (1ull << 7) | (1ull << 14); // C, neutral third, G
+
+    long candidates = 0;
+    for (int i = 0; i < 2000; i++)
+    {
+        uint64_t chroma = (i == 0) ? triad : (i == 1) ? neutral : (uint64_t)(rand() & 0xFFFFFF);
+        chroma &= (rand() % 4 == 0) ? 0xFFFFFF : 0x5A5A5A; // mostly sparse sets
+        int count = kpdve_crystal_candidates(&a, chroma);
+        candidates += count;
+        for (int j = 0; j < count; j++)
+        {
+            const kpdve_crystal_candidate *c = &a.candidates[j];
+            if ((kpdve_crystal_chord(&a, c) & chroma) != chroma || c->kpdve != -1
+                || c->k >= 24 || c->p >= 13 || c->d >= 13 || c->e >= 13)
+            {
+                fail("24-note candidate does not hold its notes", (unsigned long long)chroma);
+            }
+        }
+        int before_k = a.context.k, before_p = a.context.p;
+        int index = kpdve_crystal_analyze(&a, chroma);
+        if (index < 0 && (count != 0 || a.context.k != before_k || a.context.p != before_p))
+        {
+            fail("context not kept without candidates", (unsigned long long)chroma);
+        }
+    }
+    if (kpdve_crystal_candidates(&a, triad) == 0 || kpdve_crystal_candidates(&a, neutral) == 0)
+    {
+        fail("no 24-note candidates for a triad", (unsigned long long)triad);
+    }
+    printf("24 notes: %ld candidates over 2000 chroma values\n", candidates);
+    kpdve_crystal_free(&a);
+}
+
+/**
+ * @brief Checks the crystal analyzer on 12/7 against the reference, with and without the
+ * tables, then runs it on the 24-note crystal.
+ */
+int main(void)
+{
+    srand(42);
+    kpdve_crystal_analyzer fast, general;
+    if (kpdve_crystal_init(&fast, 1) != 0 || kpdve_crystal_init(&general, 1) != 0 || !fast.fast
+        || fast.cells != 84)
+    {
+        printf("12/7 crystal not set up\nFAILED\n");
+        return 1;
+    }
+    general.fast = 0;
+    check_reference(&fast, &general);
+    kpdve_crystal_free(&fast);
+    kpdve_crystal_free(&general);
+
+    check_quarter_tones();
+
+    kpdve_crystal_analyzer unsupported;
+    if (kpdve_crystal_init(&unsupported, 4) == 0 || kpdve_crystal_init(&unsupported, 6) == 0)
+    {
+        fail("crystal without twin primes accepted", 0);
+    }
+
+    printf("%d mismatches\n", failures);
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures != 0;
+}
@@ -0,0 +1,308 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_daemon.h"
+#include "../include/qdkpdve_rt.h"
+#include "../include/qdkpdve_tables.h"
+
+#define CLIENTS 4
+#define SESSIONS_PER_CLIENT 6
+#define SESSIONS (CLIENTS * SESSIONS_PER_CLIENT)
+#define FRAMES 30000
+#define MAX_BATCH 3000
+#define MAX_REQUESTS (SESSIONS_PER_CLIENT * FRAMES)
+
+static char socket_path[64];
+static uint16_t chroma[SESSIONS][FRAMES];
+static uint32_t expected[SESSIONS][FRAMES];
+static int failures = 0;
+
+static void fail(const char *what)
+{
+    if (__atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED) < 10)
+    {
+        printf("%s\n", what);
+    }
+}
+
+static unsigned next_random(unsigned *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+    return (*seed >> 8) & 0xFFFFFF;
+}
+
+// every session's stream, and its states from a local pf_rt analyzer
+static void make_streams(void)
+{
+    static const uint16_t chords[] = { 0x91, 0x221, 0x84, 0x109, 0x412, 0x8A, 0x891, 0xA4, 0x0 };
+    unsigned seed = 7;
+    for (int s = 0; s < SESSIONS; s++)
+    {
+        pf_rt_analyzer local;
+        pf_rt_init(&local, kpdve_tables_default());
+        for (int i = 0; i < FRAMES; i++)
+        {
+            unsigned r = next_random(&seed);
+            chroma[s][i] = (r % 10 < 8) ? chords[r % 9] : (uint16_t)(r & 0xFFF);
+            expected[s][i] = (uint32_t)pf_rt_analyze_chroma(&local, chroma[s][i]);
+        }
+    }
+}
+
+struct request_record {
+    uint32_t session;
+    uint32_t first;
+    uint32_t count;
+};
+
+struct client {
+    int index;
+    int fd;
+    struct request_record requests[MAX_REQUESTS];
+    uint32_t request_count;
+};
+
+// sends every session's stream in random batches, interleaving sessions, without waiting
+static void *client_send(void *arg)
+{
+    struct client *c = arg;
+    unsigned seed = 100 + (unsigned)c->index;
+    uint32_t sent[SESSIONS_PER_CLIENT] = { 0 };
+    int remaining = SESSIONS_PER_CLIENT;
+    while (remaining > 0)
+    {
+        int local = (int)(next_random(&seed) % SESSIONS_PER_CLIENT);
+        if (sent[local] == FRAMES)
+        {
+            continue;
+        }
+        uint32_t session = (uint32_t)(c->index + CLIENTS * local);
+        uint32_t count = 1 + next_random(&seed) % MAX_BATCH;
+        if (count > FRAMES - sent[local])
+        {
+            count = FRAMES - sent[local];
+        }
+        uint32_t tag = c->request_count;
+        c->requests[tag] = (struct request_record){ session, sent[local], count };
+        __atomic_store_n(&c->request_count, tag + 1, __ATOMIC_RELEASE);
+
+        struct pf_daemon_header h = { tag, session, PF_DAEMON_ANALYZE, 0, count };
+        if (pf_client_send(c->fd, &h, &chroma[session][sent[local]]) != PF_DAEMON_OK)
+        {
+            fail("send failed");
+            return NULL;
+        }
+        sent[local] += count;
+        remaining -= (sent[local] == FRAMES);
+    }
+    shutdown(c->fd, SHUT_WR);
+    return NULL;
+}
+
+// receives until the daemon closes, checking each response and the per-session order
+static void *client_receive(void *arg)
+{
+    struct client *c = arg;
+    static __thread uint32_t states[MAX_BATCH];
+    uint32_t next[SESSIONS] = { 0 };
+    uint32_t frames = 0;
+    struct pf_daemon_header h;
+    while (pf_client_recv(c->fd, &h, states, MAX_BATCH) == PF_DAEMON_OK)
+    {
+        if (h.tag >= __atomic_load_n(&c->request_count, __ATOMIC_ACQUIRE) || h.status != PF_DAEMON_STATUS_OK)
+        {
+            fail("unexpected response");
+            break;
+        }
+        struct request_record *r = &c->requests[h.tag];
+        if (h.session != r->session || h.count != r->count || next[r->session] != r->first)
+        {
+            fail("response out of order or mismatched");
+            break;
+        }
+        if (memcmp(states, &expected[r->session][r->first], r->count * sizeof(uint32_t)) != 0)
+        {
+            fail("states differ from the local analyzer");
+        }
+        next[r->session] += r->count;
+        frames += r->count;
+    }
+    if (frames != SESSIONS_PER_CLIENT * FRAMES)
+    {
+        fail("not every frame was answered");
+    }
+    return NULL;
+}
+
+static void *serve(void *arg)
+{
+    if (pf_daemon_run(arg) != PF_DAEMON_OK)
+    {
+        fail("daemon loop failed");
+    }
+    return NULL;
+}
+
+// control requests, bad requests and an oversized batch on one connection
+static void check_requests(void)
+{
+    int fd = pf_client_connect(socket_path);
+    if (fd < 0)
+    {
+        fail("connect failed");
+        return;
+    }
+    uint16_t triad = 0x91;
+    uint32_t state;
+    struct pf_daemon_header h;
+
+    // G major as context: C E G is IV (K = 1), and RESET returns to the default
+    pf_rt_analyzer local;
+    pf_rt_init(&local, kpdve_tables_default());
+    pf_rt_set_context(&local, 1 << 12);
+    h = (struct pf_daemon_header){ 1, 0, PF_DAEMON_SET_CONTEXT, 0, 1 << 12 };
+    if (pf_client_send(fd, &h, NULL) != 0 || pf_client_recv(fd, &h, NULL, 0) != 0 || h.status != 0
+        || pf_client_analyze(fd, 0, &triad, 1, &state) != 0 || state != (uint32_t)pf_rt_analyze_chroma(&local, triad))
+    {
+        fail("SET_CONTEXT not applied");
+    }
+    pf_rt_reset(&local);
+    h = (struct pf_daemon_header){ 2, 0, PF_DAEMON_RESET, 0, 0 };
+    if (pf_client_send(fd, &h, NULL) != 0 || pf_client_recv(fd, &h, NULL, 0) != 0 || h.status != 0
+        || pf_client_analyze(fd, 0, &triad, 1, &state) != 0 || state != (uint32_t)pf_rt_analyze_chroma(&local, triad))
+    {
+        fail("RESET not applied");
+    }
+
+    if (pf_client_analyze(fd, SESSIONS, &triad, 1, &state) != PF_DAEMON_STATUS_BAD_SESSION)
+    {
+        fail("bad session accepted");
+    }
+    h = (struct pf_daemon_header){ 3, 0, 99, 0, 0 };
+    if (pf_client_send(fd, &h, NULL) != 0 || pf_client_recv(fd, &h, NULL, 0) != 0 || h.status != PF_DAEMON_STATUS_BAD_OP)
+    {
+        fail("bad op accepted");
+    }
+    h = (struct pf_daemon_header){ 4, 0, PF_DAEMON_SET_CONTEXT, 0, 12 << 12 };
+    if (pf_client_send(fd, &h, NULL) != 0 || pf_client_recv(fd, &h, NULL, 0) != 0 || h.status != PF_DAEMON_STATUS_BAD_CONTEXT)
+    {
+        fail("bad context accepted");
+    }
+
+    // a batch over max_frames closes the connection as soon as its header arrives
+    h = (struct pf_daemon_header){ 5, 0, PF_DAEMON_ANALYZE, 0, 1000000 };
+    if (send(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || pf_client_recv(fd, &h, NULL, 0) != PF_DAEMON_ERR_IO)
+    {
+        fail("oversized batch not refused");
+    }
+    close(fd);
+}
+
+/**
+ * @brief Runs a daemon with several clients pipelining interleaved sessions and checks
+ * every state against a local analyzer, then the control and error paths.
+ */
+int main(void)
+{
+    snprintf(socket_path, sizeof(socket_path), "/tmp/pitchflock_test_%d.sock", (int)getpid());
+    struct pf_daemon_options options;
+    pf_daemon_default_options(&options);
+    options.path = socket_path;
+    options.workers = 3;
+    options.sessions = SESSIONS;
+    options.max_frames = MAX_BATCH;
+    options.max_pending = 8; // small, so throttling is exercised
+
+    int err = 0;
+    pf_daemon *daemon = pf_daemon_create(&options, &err);
+    if (daemon == NULL && err == PF_DAEMON_ERR_UNSUPPORTED)
+    {
+        printf("daemon not supported on this platform, skipped\nOK\n");
+        return 0;
+    }
+    if (daemon == NULL)
+    {
+        printf("daemon not created (%d, %s)\nFAILED\n", err, strerror(errno));
+        return 1;
+    }
+    make_streams();
+    pthread_t server;
+    pthread_create(&server, NULL, serve, daemon);
+
+    static struct client clients[CLIENTS];
+    pthread_t senders[CLIENTS], receivers[CLIENTS];
+    for (int i = 0; i < CLIENTS; i++)
+    {
+        clients[i].index = i;
+        clients[i].fd = pf_client_connect(socket_path);
+        if (clients[i].fd < 0)
+        {
+            printf("connect failed\nFAILED\n");
+            return 1;
+        }
+        pthread_create(&senders[i], NULL, client_send, &clients[i]);
+        pthread_create(&receivers[i], NULL, client_receive, &clients[i]);
+    }
+    for (int i = 0; i < CLIENTS; i++)
+    {
+        pthread_join(senders[i], NULL);
+        pthread_join(receivers[i], NULL);
+        close(clients[i].fd);
+    }
+
+    check_requests();
+
+    struct pf_daemon_stats stats;
+    pf_daemon_get_stats(daemon, &stats);
+    printf("%llu connections, %llu requests, %llu frames, %llu errors\n", (unsigned long long)stats.connections,
+           (unsigned long long)stats.requests, (unsigned long long)stats.frames, (unsigned long long)stats.errors);
+    if (stats.frames != (uint64_t)SESSIONS * FRAMES + 2 || stats.errors != 1 || stats.connections != CLIENTS + 1)
+    {
+        fail("counters wrong");
+    }
+
+    pf_daemon_stop(daemon);
+    pthread_join(server, NULL);
+    pf_daemon_destroy(daemon);
+    if (access(socket_path, F_OK) == 0)
+    {
+        fail("socket file left behind");
+    }
+
+    // a file that is not a socket is left alone; a stale socket is replaced
+    FILE *file = fopen(socket_path, "w");
+    fputs("not a socket\n", file);
+    fclose(file);
+    errno = 0;
+    if (pf_daemon_create(&options, &err) != NULL || err != PF_DAEMON_ERR_IO || errno != EADDRINUSE
+        || access(socket_path, F_OK) != 0)
+    {
+        fail("a regular file at the socket path was not left alone");
+    }
+    remove(socket_path);
+    int stale = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strcpy(addr.sun_path, socket_path);
+    bind(stale, (struct sockaddr *)&addr, sizeof(addr));
+    close(stale);
+    daemon = pf_daemon_create(&options, &err);
+    if (daemon == NULL)
+    {
+        fail("a stale socket was not replaced");
+    }
+    else
+    {
+        pf_daemon_destroy(daemon);
+    }
+    remove(socket_path);
+
+    printf("%d failures\n", failures);
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures != 0;
+}
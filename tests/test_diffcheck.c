@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/harmony_state.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_diffcheck.h"
+
+#define CM 0b10010001
+#define DEG 0b10010100
+#define BROKEN_CONTEXT_INDEX (3 * 49 + 2 * 7 + 1) // context [3.2.1.0.0]
+
+static int broken_context(void)
+{
+    int loc[] = { 3, 2, 1, 0, 0 };
+    return KPDVEtoBinaryEncoding(loc);
+}
+
+// the reference, except for a wrong choice for C major in one context, and for D-E-G in every context
+static void broken_set_min_index(harmony_state *current_state, int context)
+{
+    set_min_index(current_state, context);
+    int n = current_state->kpdve_list_length;
+    if (n > 1 && ((current_state->chromatic_notes == CM && context == broken_context())
+                  || current_state->chromatic_notes == DEG))
+    {
+        current_state->kpdve_min_index = (current_state->kpdve_min_index + 1) % n;
+    }
+}
+
+/**
+ * @brief Runs every built-in engine through the differential checker, then checks that a
+ * deliberately broken engine is caught at its first divergence, with several threads.
+ */
+int main(void)
+{
+    int failed = 0;
+    struct kpdve_diffcheck_options options;
+    struct kpdve_diffcheck_result result;
+
+    kpdve_diffcheck_default_options(&options);
+    if (kpdve_diffcheck_all(&options, &result) != 0)
+    {
+        failed = 1;
+    }
+    kpdve_diffcheck_print(stdout, &result);
+
+    kpdve_engine broken = { "broken", set_kp_list, broken_set_min_index };
+    options.threads = 4;
+    for (int run = 0; run < 3; run++)
+    {
+        if (kpdve_diffcheck_engine(&broken, &options, &result) != 1)
+        {
+            printf("broken engine not caught\n");
+            failed = 1;
+            break;
+        }
+        kpdve_diffcheck_print(stdout, &result);
+
+        long expected_case = (long)CM * (12 * 7 * 7) + BROKEN_CONTEXT_INDEX;
+        if (result.suite != KPDVE_DIFF_EXHAUSTIVE || result.case_index != expected_case
+            || result.chroma != CM || result.context != broken_context()
+            || strcmp(result.field, "kpdve_min_index") != 0)
+        {
+            printf("expected the first divergence at exhaustive case %ld\n", expected_case);
+            failed = 1;
+        }
+    }
+
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
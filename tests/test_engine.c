@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/harmony_state.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_engine.h"
+
+#define SESSIONS 64
+#define TICKS 500
+#define BATCH 96 // more than SESSIONS, so some sessions repeat within a tick
+
+static int failed = 0;
+
+static int random_chord(void)
+{
+    int loc[] = { rand() % 12, rand() % 7, rand() % 7, 1 + rand() % 6, rand() % 7 };
+    return circle_to_chroma(kpdve_chord_val(KPDVEtoBinaryEncoding(loc)));
+}
+
+/**
+ * @brief Runs many sessions through the engine and through one harmony_state each.
+ */
+int main(void)
+{
+    pf_engine *engine = pf_engine_create(SESSIONS, NULL);
+    harmony_state mirrors[SESSIONS];
+    struct pf_update updates[BATCH];
+    struct pf_change changes[BATCH];
+
+    for (int s = 0; s < SESSIONS; s++)
+    {
+        mirrors[s] = harmony_state_default();
+    }
+
+    srand(36);
+    long total_changes = 0;
+    for (int t = 0; t < TICKS && !failed; t++)
+    {
+        int before[SESSIONS];
+        int touched[SESSIONS] = { 0 };
+        for (int s = 0; s < SESSIONS; s++)
+        {
+            before[s] = mirrors[s].encoded_state;
+        }
+
+        int n = rand() % BATCH;
+        for (int i = 0; i < n; i++)
+        {
+            updates[i].session = (uint32_t)(rand() % SESSIONS);
+            updates[i].chroma = (uint16_t)random_chord();
+
+            // the reference, one frame at a time, with the session's previous KPDVE as context
+            adjust_harmony_state_from_chroma(&mirrors[updates[i].session], updates[i].chroma);
+            touched[updates[i].session] = 1;
+        }
+
+        long changed = pf_engine_tick(engine, updates, (size_t)n, changes);
+
+        long expected = 0;
+        for (int s = 0; s < SESSIONS; s++)
+        {
+            if (engine->encoded[s] != mirrors[s].encoded_state)
+            {
+                printf("tick %d, session %d: %08x, reference %08x\n", t, s, engine->encoded[s], mirrors[s].encoded_state);
+                failed = 1;
+                break;
+            }
+            expected += touched[s] && mirrors[s].encoded_state != before[s];
+        }
+        for (long c = 0; c < changed; c++)
+        {
+            uint32_t s = changes[c].session;
+            if (changes[c].previous != before[s] || changes[c].encoded != mirrors[s].encoded_state)
+            {
+                printf("tick %d: wrong change record for session %u\n", t, s);
+                failed = 1;
+            }
+        }
+        if (changed != expected)
+        {
+            printf("tick %d: %ld changes, expected %ld\n", t, changed, expected);
+            failed = 1;
+        }
+        total_changes += changed;
+    }
+
+    // an invalid frame keeps the KPDVE and flags the session; silence keeps it quietly
+    int kept = engine->kpdve[5];
+    struct pf_update odd[] = { { 5, 0xFFF }, { 6, 0 } };
+    pf_engine_tick(engine, odd, 2, changes);
+    if (engine->kpdve[5] != kept || !(engine->flags[5] & PF_SESSION_INVALID) || engine->encoded[5] >= 0
+        || (engine->flags[6] & PF_SESSION_INVALID) || (engine->encoded[6] & 0xFFF) != 0)
+    {
+        printf("invalid or silent frame handled wrongly\n");
+        failed = 1;
+    }
+
+    // a bad session id applies nothing
+    struct pf_update bad[] = { { 1, 0x91 }, { SESSIONS, 0x91 } };
+    int session_1 = engine->encoded[1];
+    if (pf_engine_tick(engine, bad, 2, changes) != -1 || engine->encoded[1] != session_1)
+    {
+        printf("bad session id not rejected\n");
+        failed = 1;
+    }
+
+    printf("%d ticks, %ld changes\n", TICKS, total_changes);
+    pf_engine_destroy(engine);
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
@@ -0,0 +1,179 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve.h"
+#include "../include/qdkpdve_format.h"
+
+static const char *out_path = "test_format.out";
+
+static const char *golden[3] = {
+    // KPDVE_FORMAT_TEXT
+    "     99998 [ 0. 0. 0. 0. 2] 00000000000000000010000010010001  C  Tonic Major              Lydian      IV   F                  F  F  F  \n"
+    "     99999 [ 5. 1. 4. 2. 6] 00000101001100010110111111111111  F# Dominant Major     #1    Aeolian     II   G#     G# A# B  C# D# E# F# \n"
+    "    100000 [11. 6. 6. 6. 0] 10001011110110110000000000000000  Bb Subdominant Major  b4    Locrian     IV   Eb                       Eb \n"
+    "    100001 [15. 0. 0. 0. 0] 00001111000000000000000000000001                                                                           \n",
+    // KPDVE_FORMAT_CSV
+    "frame,state,invalid,k,p,d,v,e,chroma,tonic,scale,distortion,mode,degree,root,chord\n"
+    "99998,8337,0,0,0,0,0,2,000010010001,C,Tonic Major,,Lydian,IV,F,F  F  F\n"
+    "99999,87126015,0,5,1,4,2,6,111111111111,F#,Dominant Major,#1,Aeolian,II,G#,G# A# B  C# D# E# F#\n"
+    "100000,2346385408,1,11,6,6,6,0,000000000000,Bb,Subdominant Major,b4,Locrian,IV,Eb,Eb\n"
+    "100001,251658241,0,15,0,0,0,0,000000000001,,,,,,,\n",
+    // KPDVE_FORMAT_JSONL
+    "{\"frame\":99998,\"state\":8337,\"invalid\":false,\"k\":0,\"p\":0,\"d\":0,\"v\":0,\"e\":2,\"chroma\":\"000010010001\",\"tonic\":\"C\",\"scale\":\"Tonic Major\",\"distortion\":\"\",\"mode\":\"Lydian\",\"degree\":\"IV\",\"root\":\"F\",\"chord\":\"F  F  F\"}\n"
+    "{\"frame\":99999,\"state\":87126015,\"invalid\":false,\"k\":5,\"p\":1,\"d\":4,\"v\":2,\"e\":6,\"chroma\":\"111111111111\",\"tonic\":\"F#\",\"scale\":\"Dominant Major\",\"distortion\":\"#1\",\"mode\":\"Aeolian\",\"degree\":\"II\",\"root\":\"G#\",\"chord\":\"G# A# B  C# D# E# F#\"}\n"
+    "{\"frame\":100000,\"state\":2346385408,\"invalid\":true,\"k\":11,\"p\":6,\"d\":6,\"v\":6,\"e\":0,\"chroma\":\"000000000000\",\"tonic\":\"Bb\",\"scale\":\"Subdominant Major\",\"distortion\":\"b4\",\"mode\":\"Locrian\",\"degree\":\"IV\",\"root\":\"Eb\",\"chord\":\"Eb\"}\n"
+    "{\"frame\":100001,\"state\":251658241,\"invalid\":false,\"k\":15,\"p\":0,\"d\":0,\"v\":0,\"e\":0,\"chroma\":\"000000000001\",\"tonic\":\"\",\"scale\":\"\",\"distortion\":\"\",\"mode\":\"\",\"degree\":\"\",\"root\":\"\",\"chord\":\"\"}\n",
+};
+
+// writev as a slow pipe would do it: every fifth call is interrupted, the others write
+// an uneven share of the bytes asked for, across buffer boundaries
+static int writev_calls = 0;
+static int partial_writes = 0;
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    int call = writev_calls++;
+    if (call % 5 == 2)
+    {
+        errno = EINTR;
+        return -1;
+    }
+
+    char chunk[4096];
+    size_t limit = 1 + (size_t)call * 997 % sizeof(chunk);
+    size_t asked = 0, n = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        asked += iov[i].iov_len;
+        size_t take = iov[i].iov_len < limit - n ? iov[i].iov_len : limit - n;
+        memcpy(chunk + n, iov[i].iov_base, take);
+        n += take;
+    }
+    partial_writes += n < asked;
+    return write(fd, chunk, n);
+}
+
+static char *read_back(int fd, size_t *size)
+{
+    off_t end = lseek(fd, 0, SEEK_END);
+    char *bytes = malloc((size_t)end + 1);
+    *size = (size_t)pread(fd, bytes, (size_t)end, 0);
+    bytes[*size] = '\0';
+    return bytes;
+}
+
+static int reopen(void)
+{
+    return open(out_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+}
+
+static int encode(int k, int p, int d, int v, int e)
+{
+    int loc[] = { k, p, d, v, e };
+    return KPDVEtoBinaryEncoding(loc);
+}
+
+/**
+ * @brief Checks each format against known output line for line, then writes a corpus
+ * larger than one slice through kpdve_format_to_fd and several buffers through
+ * kpdve_textbuf_writev while every write comes back short or interrupted.
+ */
+int main(void)
+{
+    int failed = 0;
+
+    // a chord in C, a full extension, an invalid frame and a K outside the name table
+    int states[4] = {
+        encode(0, 0, 0, 0, 2) << 12 | 0x091,
+        encode(5, 1, 4, 2, 6) << 12 | 0xFFF,
+        (int)(0x80000000u | (unsigned int)encode(11, 6, 6, 6, 0) << 12),
+        0xF000 << 12 | 0x001,
+    };
+    for (int format = KPDVE_FORMAT_TEXT; format <= KPDVE_FORMAT_JSONL; format++)
+    {
+        kpdve_textbuf buf = { NULL, 0, 0 };
+        if (kpdve_format_header(&buf, format) != 0 || kpdve_format_states(&buf, format, states, 4, 99998) != 0
+            || buf.len != strlen(golden[format]) || memcmp(buf.data, golden[format], buf.len) != 0)
+        {
+            printf("format %d differs from the known output:\n%.*s", format, (int)buf.len, buf.data);
+            failed = 1;
+        }
+        kpdve_textbuf_free(&buf);
+    }
+
+    // two and a half slices, with the KPDVE changing every few frames
+    size_t count = 40000;
+    int *corpus = malloc(count * sizeof(int));
+    for (size_t i = 0; i < count; i++)
+    {
+        corpus[i] = encode((int)(i / 7 % 12), (int)(i / 3 % 7), (int)(i % 7), 2, (int)(i / 11 % 7)) << 12 | (int)(i & 0xFFF);
+    }
+    for (int format = KPDVE_FORMAT_TEXT; format <= KPDVE_FORMAT_JSONL; format++)
+    {
+        kpdve_textbuf expected = { NULL, 0, 0 };
+        kpdve_format_header(&expected, format);
+        kpdve_format_states(&expected, format, corpus, count, 0);
+
+        int fd = reopen();
+        writev_calls = 0;
+        partial_writes = 0;
+        int err = kpdve_format_to_fd(fd, format, corpus, count);
+        size_t size;
+        char *written = read_back(fd, &size);
+        close(fd);
+        if (err != 0 || size != expected.len || memcmp(written, expected.data, size) != 0 || partial_writes == 0)
+        {
+            printf("format %d to fd: %zu bytes of %zu, %d short writes, err %d\n", format, size, expected.len,
+                   partial_writes, err);
+            failed = 1;
+        }
+        printf("format %d: %zu bytes in %d writev calls, %d short\n", format, size, writev_calls, partial_writes);
+        free(written);
+        kpdve_textbuf_free(&expected);
+    }
+
+    // nothing to format: only the CSV header is written
+    int fd = reopen();
+    size_t size;
+    kpdve_format_to_fd(fd, KPDVE_FORMAT_CSV, corpus, 0);
+    kpdve_format_to_fd(fd, KPDVE_FORMAT_JSONL, corpus, 0);
+    char *written = read_back(fd, &size);
+    close(fd);
+    if (strcmp(written, "frame,state,invalid,k,p,d,v,e,chroma,tonic,scale,distortion,mode,degree,root,chord\n") != 0)
+    {
+        printf("empty input wrote \"%s\"\n", written);
+        failed = 1;
+    }
+    free(written);
+
+    // several buffers, one empty, resumed in the middle of each
+    kpdve_textbuf bufs[3] = { { NULL, 0, 0 }, { NULL, 0, 0 }, { NULL, 0, 0 } };
+    kpdve_format_states(&bufs[0], KPDVE_FORMAT_CSV, corpus, 500, 0);
+    kpdve_format_states(&bufs[2], KPDVE_FORMAT_JSONL, corpus + 500, 700, 500);
+    fd = reopen();
+    partial_writes = 0;
+    int err = kpdve_textbuf_writev(fd, bufs, 3);
+    written = read_back(fd, &size);
+    close(fd);
+    if (err != 0 || size != bufs[0].len + bufs[2].len || memcmp(written, bufs[0].data, bufs[0].len) != 0
+        || memcmp(written + bufs[0].len, bufs[2].data, bufs[2].len) != 0 || partial_writes == 0)
+    {
+        printf("writev of three buffers: %zu bytes of %zu, err %d\n", size, bufs[0].len + bufs[2].len, err);
+        failed = 1;
+    }
+    free(written);
+    for (int i = 0; i < 3; i++)
+    {
+        kpdve_textbuf_free(&bufs[i]);
+    }
+
+    free(corpus);
+    remove(out_path);
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
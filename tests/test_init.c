@@ -0,0 +1,139 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../include/harmony_state.h"
+#include "../include/qdkpdve.h"
+#include "../include/qdkpdve_init.h"
+#include "../include/qdkpdve_naming.h"
+#include "../include/qdkpdve_nametable.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_tables.h"
+
+#define THREADS 8
+#define ROUNDS 20
+
+struct racer {
+    int which;                              // what the thread touches first
+    const kpdve_tables *tables;
+    const struct kpdve_name_table *names;
+    const char *degree;                     // kpdve_name_degree(0), read at once
+    const char *first_degree;               // the same, as the first touch
+    int chosen;                             // kpdve_tables_choose of CM in C major
+};
+
+static volatile int go = 0;
+
+// every thread starts on a different entry point, as soon as go is set
+static void *race(void *arg)
+{
+    struct racer *r = arg;
+    while (!go)
+    {
+    }
+    switch (r->which % 4)
+    {
+    case 0: pitchflock_init(); break;
+    case 1: kpdve_tables_init(); break;
+    case 2: kpdve_name_table_init(); break;
+    default: r->first_degree = kpdve_name_degree(0); break; // a lookup before any init
+    }
+    r->tables = kpdve_tables_default();
+    r->chosen = kpdve_tables_choose(r->tables, 0b10010001, 0);
+    kpdve_name_table_init();
+    r->names = kpdve_name_table();
+    r->degree = kpdve_name_degree(0);
+    return NULL;
+}
+
+/**
+ * @brief Races the first use of the shared tables from several threads, then checks
+ * that every thread saw the same, complete tables.
+ */
+int main(void)
+{
+    int failed = 0;
+    printf("tables %s\n", pitchflock_tables_prebuilt() ? "compiled in" : "built at run time");
+
+    struct racer racers[THREADS];
+    pthread_t threads[THREADS];
+    memset(racers, 0, sizeof(racers));
+    for (int i = 0; i < THREADS; i++)
+    {
+        racers[i].which = i;
+        pthread_create(&threads[i], NULL, race, &racers[i]);
+    }
+    go = 1;
+    for (int i = 0; i < THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    const kpdve_tables *tables = kpdve_tables_default();
+    const struct kpdve_name_table *names = kpdve_name_table();
+    for (int i = 0; i < THREADS; i++)
+    {
+        if (racers[i].tables != tables || racers[i].names != names || racers[i].names == NULL
+            || racers[i].chosen != racers[0].chosen
+            || strcmp(racers[i].degree, conventionalDegreeStringForKPDVE(0)) != 0
+            || (racers[i].first_degree != NULL
+                && strcmp(racers[i].first_degree, conventionalDegreeStringForKPDVE(0)) != 0))
+        {
+            printf("thread %d saw different or incomplete tables\n", i);
+            failed = 1;
+        }
+    }
+
+    // later calls are cheap and change nothing
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        pitchflock_init();
+        if (kpdve_tables_default() != tables || kpdve_name_table() != names)
+        {
+            printf("tables moved after init\n");
+            failed = 1;
+            break;
+        }
+    }
+
+    // the content is the reference's, whichever way it was made
+    int mismatches = 0;
+    harmony_state reference = harmony_state_default();
+    harmony_state table_state = reference;
+    for (int chroma = 0; chroma < 4096; chroma++)
+    {
+        reference.chromatic_notes = chroma;
+        table_state.chromatic_notes = chroma;
+        set_kp_list(&reference);
+        set_kp_list_from_tables(tables, &table_state);
+        if (reference.kpdve_list_length != table_state.kpdve_list_length
+            || memcmp(reference.kpdve_list, table_state.kpdve_list,
+                      (size_t)reference.kpdve_list_length * sizeof(int)) != 0)
+        {
+            mismatches++;
+        }
+    }
+    char notes[32];
+    for (int k = 0; k < 12; k++)
+    for (int p = 0; p < 7; p++)
+    for (int d = 0; d < 7; d++)
+    {
+        int loc[] = { k, p, d, 0, 6 };
+        int kpdve = KPDVEtoBinaryEncoding(loc);
+        chordNotesStringForKPDVE(kpdve, notes, sizeof(notes));
+        if (strcmp(kpdve_name_root(kpdve), rootStringForKPDVE(kpdve)) != 0
+            || strcmp(kpdve_name_chord(kpdve), notes) != 0)
+        {
+            mismatches++;
+        }
+    }
+    if (mismatches != 0)
+    {
+        printf("%d table entries differ from the reference\n", mismatches);
+        failed = 1;
+    }
+
+    printf("%d threads raced the first use\n", THREADS);
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
@@ -0,0 +1,116 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/harmony_state.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_latency.h"
+
+#define WRITES 200000
+
+static int failed = 0;
+static kpdve_latency_histogram shared;
+
+static void expect_near(const char *what, uint64_t actual, uint64_t expected)
+{
+    // within the 1/32 bucket width, and never above the true value by more than that
+    double error = ((double)actual - (double)expected) / (double)expected;
+    if (error < -1.0 / 32 || error > 1.0 / 32)
+    {
+        printf("%s: %llu, expected about %llu\n", what, (unsigned long long)actual, (unsigned long long)expected);
+        failed = 1;
+    }
+}
+
+static void *writer(void *arg)
+{
+    (void)arg;
+    for (uint64_t i = 0; i < WRITES; i++)
+    {
+        kpdve_latency_record(&shared, 100 + i % 5000);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Checks percentiles against known distributions, reset-on-read with a concurrent
+ * writer, and the timed analysis wrapper.
+ */
+int main(void)
+{
+    kpdve_latency_histogram histogram;
+    struct kpdve_latency_summary summary;
+
+    // 1..100000 ns, once each
+    kpdve_latency_init(&histogram);
+    for (uint64_t ns = 1; ns <= 100000; ns++)
+    {
+        kpdve_latency_record(&histogram, ns);
+    }
+    kpdve_latency_summarize(&histogram, &summary, 1);
+    if (summary.count != 100000 || summary.max_ns != 100000)
+    {
+        printf("count %llu, max %llu\n", (unsigned long long)summary.count, (unsigned long long)summary.max_ns);
+        failed = 1;
+    }
+    expect_near("p50", summary.p50_ns, 50000);
+    expect_near("p99", summary.p99_ns, 99000);
+    expect_near("p99.9", summary.p999_ns, 99900);
+    expect_near("mean", (uint64_t)summary.mean_ns, 50000);
+
+    // reset on read
+    kpdve_latency_summarize(&histogram, &summary, 0);
+    if (summary.count != 0 || summary.max_ns != 0)
+    {
+        printf("not empty after reset: %llu samples\n", (unsigned long long)summary.count);
+        failed = 1;
+    }
+
+    // small values are exact; huge ones do not overflow
+    kpdve_latency_record(&histogram, 7);
+    kpdve_latency_record(&histogram, UINT64_MAX);
+    kpdve_latency_summarize(&histogram, &summary, 1);
+    if (summary.p50_ns != 7 || summary.max_ns != UINT64_MAX || summary.p999_ns != UINT64_MAX)
+    {
+        printf("extremes: p50 %llu, p99.9 %llu\n", (unsigned long long)summary.p50_ns, (unsigned long long)summary.p999_ns);
+        failed = 1;
+    }
+
+    // a reader resetting while a writer records: every sample lands in exactly one read
+    kpdve_latency_init(&shared);
+    pthread_t thread;
+    pthread_create(&thread, NULL, writer, NULL);
+    uint64_t total = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        kpdve_latency_summarize(&shared, &summary, 1);
+        total += summary.count;
+    }
+    pthread_join(thread, NULL);
+    kpdve_latency_summarize(&shared, &summary, 1);
+    total += summary.count;
+    if (total != WRITES)
+    {
+        printf("concurrent reads saw %llu of %d samples\n", (unsigned long long)total, WRITES);
+        failed = 1;
+    }
+
+    // the timed analysis call
+    harmony_state state = harmony_state_default();
+    for (int i = 0; i < 5000; i++)
+    {
+        adjust_harmony_state_from_chroma_and_context_timed(&state, mod_rot(0b10010001, (i * 7) % 12, 12), state.kpdve, &histogram);
+    }
+    kpdve_latency_summarize(&histogram, &summary, 1);
+    printf("analysis latency over %llu frames: p50 %llu ns, p99 %llu ns, p99.9 %llu ns, max %llu ns\n",
+           (unsigned long long)summary.count, (unsigned long long)summary.p50_ns, (unsigned long long)summary.p99_ns,
+           (unsigned long long)summary.p999_ns, (unsigned long long)summary.max_ns);
+    if (summary.count != 5000 || summary.p50_ns == 0 || summary.p50_ns > summary.p99_ns
+        || summary.p99_ns > summary.p999_ns || summary.p999_ns > summary.max_ns)
+    {
+        failed = 1;
+    }
+
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/qdkpdve.h"
+#include "../include/qdkpdve_naming.h"
+#include "../include/qdkpdve_nametable.h"
+
+static int failures = 0;
+
+static void expect_same(const char *what, int kpdve, const char *table_value, const char *reference)
+{
+    if (strcmp(table_value, reference) != 0)
+    {
+        if (failures < 10)
+        {
+            printf("%s %s: table \"%s\", reference \"%s\"\n", what, kpdve_as_string(kpdve), table_value, reference);
+        }
+        failures++;
+    }
+}
+
+/**
+ * @brief Compares every label of every KPDVE value (12 x 7 x 7 x 7 x 7 = 28812) with the naming functions,
+ * starting with a lookup made before anything initialized the table.
+ */
+int main(void)
+{
+    // no kpdve_name_table_init yet: the lookup builds the table itself
+    clock_t start = clock();
+    expect_same("first lookup", 0, kpdve_name_degree(0), conventionalDegreeStringForKPDVE(0));
+    double ms = 1000.0 * (double)(clock() - start) / CLOCKS_PER_SEC;
+    kpdve_name_table_init();
+
+    const struct kpdve_name_table *table = kpdve_name_table();
+    printf("name table built in %.2f ms (%zu pool bytes)\n", ms, table->pool_size);
+
+    char notes[32];
+    int checked = 0;
+    for (int k = 0; k < 12; k++)
+    for (int p = 0; p < 7; p++)
+    for (int d = 0; d < 7; d++)
+    for (int v = 0; v < 7; v++)
+    for (int e = 0; e < 7; e++)
+    {
+        int loc[] = { k, p, d, v, e };
+        int kpdve = KPDVEtoBinaryEncoding(loc);
+
+        expect_same("tonic", kpdve, kpdve_name_tonic(kpdve), conventionalTonicStringForKPDVE(kpdve));
+        expect_same("scale", kpdve, kpdve_name_scale(kpdve), scaleNameForKPDVE(kpdve));
+        expect_same("distortion", kpdve, kpdve_name_distortion(kpdve), patternDistortionForKPDVE(kpdve));
+        expect_same("mode", kpdve, kpdve_name_mode(kpdve), modeNameForKPDVE(kpdve));
+        expect_same("degree", kpdve, kpdve_name_degree(kpdve), conventionalDegreeStringForKPDVE(kpdve));
+        expect_same("root", kpdve, kpdve_name_root(kpdve), rootStringForKPDVE(kpdve));
+        chordNotesStringForKPDVE(kpdve, notes, sizeof(notes));
+        expect_same("chord", kpdve, kpdve_name_chord(kpdve), notes);
+        checked++;
+    }
+
+    // outside the table: empty, never out of bounds
+    expect_same("out of range", 0xFFFF, kpdve_name_chord(0xFFFF), "");
+    expect_same("out of range", -1, kpdve_name_root(-1), "");
+
+    printf("%d KPDVE values checked, %d mismatches\n", checked, failures);
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures != 0;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../include/qdkpdve.h"
+#include "../include/qdkpdve_naming.h"
+
+static int failures = 0;
+
+// the string functions as they were before they tracked the length (strcat, snprintf)
+static void reference_notes(int kpdve, int voicing, int fifths, int last_ext, char *stringBuf, size_t bufSize)
+{
+    int result[5];
+    binaryEncodingToKPDVE(kpdve, result);
+    int noteLoc[] = { result[0], result[1], fifths ? 1 : result[2], voicing >= 0 ? voicing : result[3], 0 };
+    stringBuf[0] = '\0';
+    for (int i = 0; i <= last_ext; i++)
+    {
+        noteLoc[4] = i;
+        const char *noteName = nameStringForKPDVE(KPDVEtoBinaryEncoding(noteLoc));
+        if (strlen(stringBuf) + strlen(noteName) + 2 < bufSize)
+        {
+            strcat(stringBuf, noteName);
+            strcat(stringBuf, " ");
+        }
+        else
+        {
+            strncat(stringBuf, "...", bufSize - strlen(stringBuf) - 1);
+            break;
+        }
+    }
+}
+
+static void reference_kpdve(int kpdve, char *stringBuf, size_t bufSize)
+{
+    int result[5];
+    binaryEncodingToKPDVE(kpdve, result);
+    snprintf(stringBuf, bufSize, "[%2d.%2d.%2d.%2d.%2d]", result[0], result[1], result[2], result[3], result[4]);
+}
+
+static void expect_same(const char *what, int kpdve, size_t bufSize, const char *got, size_t got_len, const char *want)
+{
+    if (strcmp(got, want) != 0 || got_len != strlen(want))
+    {
+        if (failures < 10)
+        {
+            printf("%s 0x%04x, %zu bytes: \"%s\" (%zu), reference \"%s\"\n", what, kpdve, bufSize, got, got_len, want);
+        }
+        failures++;
+    }
+}
+
+/**
+ * @brief Compares the chord and mode note strings and the KPDVE strings with the former
+ * implementation, for every 16-bit KPDVE with K < 12 and buffers from 1 byte (only the
+ * terminator fits) through sizes that truncate mid-name and in the "..." to ones that
+ * hold everything; a buffer of 0 bytes is left untouched.
+ */
+int main(void)
+{
+    static const size_t sizes[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 16, 17, 18, 20, 22, 25, 32, 64 };
+    const int size_count = (int)(sizeof(sizes) / sizeof(sizes[0]));
+    char got[64], want[64];
+    int checked = 0;
+
+    for (int kpdve = 0; kpdve < (12 << 12); kpdve++)
+    {
+        int result[5];
+        binaryEncodingToKPDVE(kpdve, result);
+        for (int s = 0; s < size_count; s++)
+        {
+            size_t size = sizes[s];
+            size_t len;
+
+            len = chordNotesStringForKPDVE(kpdve, got, size);
+            reference_notes(kpdve, -1, 0, result[4], want, size);
+            expect_same("chord notes", kpdve, size, got, len, want);
+
+            len = modeNotesStringForKPDVE(kpdve, got, size);
+            reference_notes(kpdve, -1, 0, 6, want, size);
+            expect_same("mode notes", kpdve, size, got, len, want);
+
+            len = modeNotesScaleStringForKPDVE(kpdve, got, size);
+            reference_notes(kpdve, 2, 0, 6, want, size);
+            expect_same("mode notes (scale)", kpdve, size, got, len, want);
+
+            len = modeNotesFifthsStringForKPDVE(kpdve, got, size);
+            reference_notes(kpdve, 1, 1, 6, want, size);
+            expect_same("mode notes (fifths)", kpdve, size, got, len, want);
+
+            len = kpdveStringForKPDVE(kpdve, got, size);
+            reference_kpdve(kpdve, want, size);
+            expect_same("kpdve string", kpdve, size, got, len, want);
+        }
+
+        reference_kpdve(kpdve, want, 17);
+        expect_same("kpdve_as_string", kpdve, 17, kpdve_as_string(kpdve), strlen(kpdve_as_string(kpdve)), want);
+        checked++;
+    }
+
+    // nothing fits in no buffer: nothing is written
+    got[0] = 'x';
+    if (chordNotesStringForKPDVE(0, got, 0) != 0 || kpdveStringForKPDVE(0, got, 0) != 0 || got[0] != 'x')
+    {
+        printf("a 0-byte buffer was written to\n");
+        failures++;
+    }
+
+    printf("%d KPDVE values at %d buffer sizes checked, %d mismatches\n", checked, size_count, failures);
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures != 0;
+}
@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/harmony_state.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_codec.h"
+#include "../include/qdkpdve_corpus.h"
+#include "../include/qdkpdve_nametable.h"
+#include "../include/qdkpdve_pipeline.h"
+
+#define FRAMES 30000
+#define CM 0b10010001
+
+static const char *chroma_path = "test_pipeline.chroma";
+static const char *coded_path = "test_pipeline.pfc";
+
+// collects the formatted text of every batch
+static int collect(void *ctx, kpdve_batch *batch)
+{
+    kpdve_textbuf *all = ctx;
+    if (kpdve_textbuf_reserve(all, batch->text.len) != 0)
+    {
+        return -1;
+    }
+    memcpy(all->data + all->len, batch->text.data, batch->text.len);
+    all->len += batch->text.len;
+    return 0;
+}
+
+static int fail_at_third(void *ctx, kpdve_batch *batch)
+{
+    (void)ctx;
+    return batch->sequence == 2 ? -7 : 0;
+}
+
+static void sleep_ms(int ms)
+{
+    struct timespec ts = { 0, ms * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+// takes *ctx ms per batch, of one frame each, and ends with the eighth
+static int paced_source(void *ctx, kpdve_batch *batch)
+{
+    sleep_ms(*(const int *)ctx);
+    batch->count = 1;
+    return batch->sequence == 7 ? KPDVE_PIPELINE_END : 0;
+}
+
+static int paced_sink(void *ctx, kpdve_batch *batch)
+{
+    (void)batch;
+    sleep_ms(*(const int *)ctx);
+    return 0;
+}
+
+static int pass(void *ctx, kpdve_batch *batch)
+{
+    (void)ctx;
+    (void)batch;
+    return 0;
+}
+
+static double seconds(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+// the stages waiting on a slow one (starved behind it, or blocked before it) must sleep
+static int check_idle(int source_ms, int sink_ms)
+{
+    kpdve_pipeline *pipeline = kpdve_pipeline_create(1, 1);
+    kpdve_pipeline_add_stage(pipeline, "source", paced_source, &source_ms);
+    kpdve_pipeline_add_stage(pipeline, "a", pass, NULL);
+    kpdve_pipeline_add_stage(pipeline, "b", pass, NULL);
+    kpdve_pipeline_add_stage(pipeline, "sink", paced_sink, &sink_ms);
+
+    double wall = seconds(CLOCK_MONOTONIC);
+    double cpu = seconds(CLOCK_PROCESS_CPUTIME_ID);
+    int err = kpdve_pipeline_run(pipeline);
+    wall = seconds(CLOCK_MONOTONIC) - wall;
+    cpu = seconds(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+    kpdve_pipeline_destroy(pipeline);
+
+    printf("source %d ms, sink %d ms per batch: %.1f ms CPU in %.1f ms\n", source_ms, sink_ms, 1e3 * cpu, 1e3 * wall);
+    if (err != KPDVE_PIPELINE_OK || cpu > 0.25 * wall)
+    {
+        printf("idle stages kept the CPU busy (err %d)\n", err);
+        return 1;
+    }
+    return 0;
+}
+
+static int run(const char *path, int format, size_t batch_frames, const kpdve_textbuf *expected)
+{
+    FILE *in = fopen(path, "rb");
+    struct kpdve_read_stage reader;
+    harmony_state state = harmony_state_default();
+    int text_format = KPDVE_FORMAT_CSV;
+    kpdve_textbuf all = { 0 };
+    int failed = 0;
+
+    kpdve_read_stage_init(&reader, in, format);
+    kpdve_pipeline *pipeline = kpdve_pipeline_create(batch_frames, 2);
+    kpdve_pipeline_add_stage(pipeline, "read", kpdve_stage_read, &reader);
+    kpdve_pipeline_add_stage(pipeline, "chroma", kpdve_stage_chroma, NULL);
+    kpdve_pipeline_add_stage(pipeline, "analyze", kpdve_stage_analyze, &state);
+    kpdve_pipeline_add_stage(pipeline, "format", kpdve_stage_format, &text_format);
+    kpdve_pipeline_add_stage(pipeline, "collect", collect, &all);
+
+    if (kpdve_pipeline_run(pipeline) != KPDVE_PIPELINE_OK)
+    {
+        printf("%s: pipeline failed\n", path);
+        failed = 1;
+    }
+    else if (all.len != expected->len || memcmp(all.data, expected->data, all.len) != 0)
+    {
+        printf("%s: output differs from the sequential analysis\n", path);
+        failed = 1;
+    }
+
+    uint64_t batches = (FRAMES + batch_frames) / batch_frames; // the last one may be empty
+    for (int i = 0; i < kpdve_pipeline_stage_count(pipeline); i++)
+    {
+        struct kpdve_stage_stats stats;
+        kpdve_pipeline_stats(pipeline, i, &stats);
+        if (stats.frames != FRAMES || stats.batches != batches)
+        {
+            printf("%s: stage %s saw %llu frames in %llu batches\n", path, stats.name,
+                   (unsigned long long)stats.frames, (unsigned long long)stats.batches);
+            failed = 1;
+        }
+    }
+    kpdve_pipeline_print(stdout, pipeline);
+
+    kpdve_pipeline_destroy(pipeline);
+    kpdve_read_stage_free(&reader);
+    kpdve_textbuf_free(&all);
+    fclose(in);
+    return failed;
+}
+
+/**
+ * @brief Runs read -> chroma -> analyze -> format through the pipeline and compares the
+ * text with a sequential analysis of the whole stream, then that stages waiting on a slow
+ * one sleep instead of spinning.
+ */
+int main(void)
+{
+    int failed = 0;
+    uint16_t *chroma = malloc(FRAMES * sizeof(uint16_t));
+    int *states = malloc(FRAMES * sizeof(int));
+
+    srand(38);
+    harmony_state state = harmony_state_default();
+    int c = CM;
+    for (int i = 0; i < FRAMES; i++)
+    {
+        int r = rand() % 100;
+        c = (r < 1) ? mod_rot(CM, rand() % 12, 12) : (r < 10) ? mod_rot(CM, (rand() % 3) * 5, 12) : c;
+        chroma[i] = (uint16_t)c;
+        adjust_harmony_state_from_chroma(&state, c);
+        states[i] = state.encoded_state;
+    }
+
+    kpdve_name_table_init();
+    kpdve_textbuf expected = { 0 };
+    kpdve_format_header(&expected, KPDVE_FORMAT_CSV);
+    kpdve_format_states(&expected, KPDVE_FORMAT_CSV, states, FRAMES, 0);
+
+    FILE *out = fopen(chroma_path, "wb");
+    fwrite(chroma, sizeof(uint16_t), FRAMES, out);
+    fclose(out);
+
+    size_t cap = kpdve_codec_bound(FRAMES);
+    uint8_t *coded = malloc(cap);
+    out = fopen(coded_path, "wb");
+    for (int first = 0; first < FRAMES; first += 7000) // several chunks, cut across batches
+    {
+        int n = (FRAMES - first < 7000) ? FRAMES - first : 7000;
+        long size = kpdve_codec_encode_chunk(states + first, (size_t)n, coded, cap);
+        fwrite(coded, 1, (size_t)size, out);
+    }
+    fclose(out);
+
+    failed |= run(chroma_path, KPDVE_CORPUS_CHROMA, 1024, &expected);
+    failed |= run(chroma_path, KPDVE_CORPUS_CHROMA, 3000, &expected); // FRAMES a multiple: empty last batch
+    failed |= run(coded_path, KPDVE_CORPUS_CODED, 4096, &expected);
+
+    // a failing stage stops everything and its error comes back
+    FILE *in = fopen(chroma_path, "rb");
+    struct kpdve_read_stage reader;
+    kpdve_read_stage_init(&reader, in, KPDVE_CORPUS_CHROMA);
+    kpdve_pipeline *pipeline = kpdve_pipeline_create(256, 2);
+    kpdve_pipeline_add_stage(pipeline, "read", kpdve_stage_read, &reader);
+    kpdve_pipeline_add_stage(pipeline, "chroma", kpdve_stage_chroma, NULL);
+    kpdve_pipeline_add_stage(pipeline, "fail", fail_at_third, NULL);
+    if (kpdve_pipeline_run(pipeline) != -7)
+    {
+        printf("stage error not returned\n");
+        failed = 1;
+    }
+    kpdve_pipeline_destroy(pipeline);
+    kpdve_read_stage_free(&reader);
+    fclose(in);
+
+    failed |= check_idle(20, 0);
+    failed |= check_idle(0, 20);
+
+    remove(chroma_path);
+    remove(coded_path);
+    kpdve_textbuf_free(&expected);
+    free(chroma);
+    free(states);
+    free(coded);
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
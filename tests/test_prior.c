@@ -0,0 +1,392 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve.h"
+#include "../include/qdkpdve_prior.h"
+#include "../include/qdkpdve_rt.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_tables.h"
+
+#define WALK 200000
+#define FRAMES 100000
+
+static kpdve_prior_counts counts;
+static kpdve_prior prior, reread;
+static int failures = 0;
+
+static void fail(const char *what)
+{
+    if (failures++ < 10)
+    {
+        printf("%s\n", what);
+    }
+}
+
+static int kpd(int k, int p, int d)
+{
+    return k << 12 | p << 9 | d << 6;
+}
+
+static int random_kpdve(void)
+{
+    return kpd(rand() % 12, rand() % 7, rand() % 7);
+}
+
+// log2((n + 1) / 1) in sixteenths of a bit, from the ones that are exact
+static int expected_level(int n)
+{
+    static const int powers[] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+    for (int i = 0; i < 8; i++)
+    {
+        if (n + 1 == powers[i])
+        {
+            return i * KPDVE_PRIOR_STEPS;
+        }
+    }
+    return -1;
+}
+
+// counting: K/P changes only, invalid frames skipped, streams kept apart
+static void check_counting(void)
+{
+    kpdve_prior_counts_reset(&counts);
+    int a = kpd(0, 1, 2), a2 = kpd(0, 1, 4), b = kpd(7, 3, 0), c = kpd(2, 1, 2);
+    int states[] = { a << 12, a2 << 12, b << 12 | 0x91, (int)(0x80000000u | (unsigned)c << 12), c << 12, b << 12 };
+    kpdve_prior_count(&counts, states, 6);
+    int more[] = { a << 12 };
+    kpdve_prior_count(&counts, more, 1);   // b -> a, the same stream
+    kpdve_prior_end_stream(&counts);
+    kpdve_prior_count(&counts, more, 1);   // a new stream: nothing to count
+    kpdve_prior_end_stream(&counts);
+    for (int i = 0; i < 6; i++)
+    {
+        kpdve_prior_count(&counts, states + 2, 1); // b -> b: not a change
+    }
+
+    const uint32_t *n = counts.counts;
+    int ia2 = KPDVE_PRIOR_INDEX(a2), ib = KPDVE_PRIOR_INDEX(b), ic = KPDVE_PRIOR_INDEX(c), ia = KPDVE_PRIOR_INDEX(a);
+    if (counts.transitions != 4 || n[ia2 * 588 + ib] != 1 || n[ib * 588 + ic] != 1 || n[ic * 588 + ib] != 1
+        || n[ib * 588 + ia] != 1 || n[ia * 588 + ia2] != 0)
+    {
+        fail("transitions miscounted");
+    }
+
+    // levels for counts 1, 3, 7 ... 127 are whole bits
+    kpdve_prior_counts_reset(&counts);
+    for (int i = 0; i < 8; i++)
+    {
+        counts.counts[i * 588 + 100] = (1u << i) - 1;
+    }
+    counts.counts[3 * 588 + 5] = UINT32_MAX;
+    kpdve_prior_build(&prior, &counts, 1.0f, 1.0f);
+    for (int i = 0; i < 8; i++)
+    {
+        if (prior.levels[i * 588 + 100] != expected_level((1 << i) - 1))
+        {
+            printf("count %d: level %d\n", (1 << i) - 1, prior.levels[i * 588 + 100]);
+            fail("level not log2((n + alpha) / alpha)");
+        }
+    }
+    if (prior.levels[3 * 588 + 5] != KPDVE_PRIOR_MAX_LEVEL || prior.entry_count != 8)
+    {
+        fail("levels not capped, or entries miscounted");
+    }
+}
+
+// a random sparse prior survives the file; damaged files are refused
+static void check_file(void)
+{
+    kpdve_prior_counts_reset(&counts);
+    for (int i = 0; i < 20000; i++)
+    {
+        counts.counts[rand() % (588 * 588)] += 1 + rand() % 3000;
+    }
+    counts.transitions = 12345;
+    kpdve_prior_build(&prior, &counts, 0.5f, 0.25f);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/pitchflock_prior_%d.pfp", (int)getpid());
+    if (kpdve_prior_write(&prior, path) != KPDVE_PRIOR_OK || kpdve_prior_read(&reread, path, 0.25f) != KPDVE_PRIOR_OK)
+    {
+        fail("prior not written or read");
+        return;
+    }
+    int same = reread.entry_count == prior.entry_count && reread.transitions == 12345 && reread.alpha == 0.5f;
+    for (int i = 0; same && i < 588 * 588; i++)
+    {
+        same = reread.levels[i] == prior.levels[i];
+    }
+    for (int i = 0; same && i <= KPDVE_PRIOR_MAX_LEVEL; i++)
+    {
+        same = reread.bonus[i] == prior.bonus[i];
+    }
+    if (!same)
+    {
+        fail("prior changed through the file");
+    }
+    printf("%u transitions with a level; file of %zu bytes for a dense table of %zu\n", prior.entry_count,
+           sizeof(struct kpdve_prior_header) + 4 * (589 + (size_t)prior.entry_count), sizeof(prior.levels));
+
+    // a level of 0 is never stored, so flipping one level's byte to 0 breaks the file
+    FILE *f = fopen(path, "r+b");
+    fseek(f, (long)(sizeof(struct kpdve_prior_header) + 4 * 589 + 2), SEEK_SET);
+    fputc(0, f);
+    fclose(f);
+    if (kpdve_prior_read(&reread, path, 0.25f) != KPDVE_PRIOR_ERR_FORMAT || reread.entry_count != 0)
+    {
+        fail("damaged prior accepted");
+    }
+    unlink(path);
+    if (kpdve_prior_read(&reread, path, 0.25f) != KPDVE_PRIOR_ERR_IO)
+    {
+        fail("missing prior not reported");
+    }
+}
+
+// with no levels the choice is kpdve_tables_choose's; with levels, the brute-force one
+static void check_choice(const kpdve_tables *tables)
+{
+    kpdve_anchor anchor;
+    kpdve_anchor_init(&anchor, tables, 100.0, 0.7f);
+    for (int i = 0; i < 300; i++)
+    {
+        kpdve_anchor_update(&anchor, i < 250 ? kpd(4, 2, 0) : kpd(8, 0, 3));
+    }
+    kpdve_prior_init(&reread, 2.0f);
+
+    int moved = 0;
+    for (int trial = 0; trial < 40; trial++)
+    {
+        int context = random_kpdve();
+        for (int chroma = 1; chroma < 4096; chroma++)
+        {
+            int plain = kpdve_tables_choose(tables, chroma, context);
+            int index = kpdve_prior_choose(tables, &prior, NULL, chroma, context);
+            if (kpdve_prior_choose(tables, &reread, NULL, chroma, context) != plain
+                || kpdve_prior_choose(tables, &reread, &anchor, chroma, context)
+                       != kpdve_anchor_choose(tables, &anchor, chroma, context))
+            {
+                fail("an empty prior changes the choice");
+                return;
+            }
+            if (index < 0)
+            {
+                continue;
+            }
+            moved += index != plain;
+
+            const uint32_t *list = tables->candidates + tables->offsets[chroma];
+            int count = tables->offsets[chroma + 1] - tables->offsets[chroma];
+            int same = -1;
+            double best = 1e9, chosen = 0;
+            for (int j = 0; j < count; j++)
+            {
+                int kpdve = (int)(list[j] & 0xFFFF);
+                if (same < 0 && (kpdve >> 9) == (context >> 9))
+                {
+                    same = j;
+                }
+                double d = KPD_distance(kpdve, context) - 0.25 * kpdve_prior_level(&prior, context, kpdve) / 16.0;
+                best = d < best ? d : best;
+                chosen = j == index ? d : chosen;
+            }
+            if ((same >= 0 && index != same) || (same < 0 && chosen > best + 1e-3))
+            {
+                fail("prior choice is not the nearest");
+                return;
+            }
+        }
+    }
+    printf("the prior moved %d of %d choices\n", moved, 40 * 4095);
+    if (moved == 0)
+    {
+        fail("the prior never changed a choice");
+    }
+}
+
+// a prior with a heavy anchor: every anchored distance is far above any context distance
+static void check_anchored(const kpdve_tables *tables)
+{
+    kpdve_anchor anchor;
+    kpdve_anchor_init(&anchor, tables, 100.0, 1000.0f);
+    for (int i = 0; i < 300; i++)
+    {
+        kpdve_anchor_update(&anchor, kpd(4, 2, 0));
+    }
+    int context = kpd(10, 5, 3), moved = 0;
+    for (int chroma = 1; chroma < 4096; chroma++)
+    {
+        int index = kpdve_prior_choose(tables, &prior, &anchor, chroma, context);
+        if (index < 0)
+        {
+            continue;
+        }
+        moved += index > 0;
+        const uint32_t *list = tables->candidates + tables->offsets[chroma];
+        int count = tables->offsets[chroma + 1] - tables->offsets[chroma];
+        double best = 1e30, chosen = 0;
+        for (int j = 0; j < count; j++)
+        {
+            int kpdve = (int)(list[j] & 0xFFFF);
+            if ((kpdve >> 9) == (context >> 9))
+            {
+                best = chosen = 0; // taken first, whatever the distances
+                break;
+            }
+            double d = KPD_distance(kpdve, context) + 1000.0 * kpdve_anchor_distance(&anchor, kpdve)
+                       - 0.25 * kpdve_prior_level(&prior, context, kpdve) / 16.0;
+            best = d < best ? d : best;
+            chosen = j == index ? d : chosen;
+        }
+        if (chosen > best * (1.0 + 1e-5))
+        {
+            fail("prior choice with a heavy anchor is not the nearest");
+            return;
+        }
+    }
+    if (moved == 0)
+    {
+        fail("prior with a heavy anchor always takes the first candidate");
+    }
+}
+
+/*
+ * Labeled streams from a walk whose key changes go up a minor third (which the
+ * distance alone does not prefer), heard as the chord of each state only. Learned
+ * from one half of the walk, the prior must recognize more of the other half's K/P
+ * changes -- those the chooser scores, that is, where no candidate is in the context's
+ * K and P (the others go to that candidate whatever the scores).
+ */
+static int walk_states[WALK];
+
+// the candidate of the chroma in the K and P of kpdve (the label as the tables spell it), or -1
+static int label(const kpdve_tables *tables, int kpdve, int chroma)
+{
+    const uint32_t *list = tables->candidates + tables->offsets[chroma];
+    int count = tables->offsets[chroma + 1] - tables->offsets[chroma];
+    for (int j = 0; j < count; j++)
+    {
+        if ((KPDVE_CANDIDATE_KPDVE(list[j]) >> 9) == (kpdve >> 9))
+        {
+            return KPDVE_CANDIDATE_KPDVE(list[j]);
+        }
+    }
+    return -1;
+}
+
+static void make_walk(const kpdve_tables *tables)
+{
+    int kpdve = kpd(0, 1, 0);
+    for (int i = 0; i < WALK; i++)
+    {
+        int r = rand() % 16;
+        if (r == 0)
+        {
+            // a chord of the new key that the old one does not hold, where there is one
+            int old = i > 0 ? (walk_states[i - 1] >> 12) & 0xFFFF : kpdve;
+            int d = rand() % 7;
+            for (int tries = 0; tries < 7; tries++, d = (d + 1) % 7)
+            {
+                kpdve = kpd(((old >> 12) + 3) % 12, (old >> 9) & 7, d);
+                if (label(tables, old, chroma_chord_from_kpdve(kpdve)) < 0)
+                {
+                    break;
+                }
+            }
+        }
+        else if (r < 4)
+        {
+            kpdve = kpd(kpdve >> 12, (kpdve >> 9) & 7, rand() % 7);
+        }
+        int chroma = chroma_chord_from_kpdve(kpdve);
+        walk_states[i] = kpdve_chromatic_byte(label(tables, kpdve, chroma), chroma);
+    }
+}
+
+static int recognized(const kpdve_tables *tables, const kpdve_prior *with, int first, int last, int *scored)
+{
+    int right = 0;
+    *scored = 0;
+    for (int i = first + 1; i < last; i++)
+    {
+        int context = (walk_states[i - 1] >> 12) & 0xFFFF;
+        int truth = (walk_states[i] >> 12) & 0xFFFF;
+        int chroma = walk_states[i] & 0xFFF;
+        if ((truth >> 9) == (context >> 9) || label(tables, context, chroma) >= 0)
+        {
+            continue;
+        }
+        (*scored)++;
+        int index = with ? kpdve_prior_choose(tables, with, NULL, chroma, context) : kpdve_tables_choose(tables, chroma, context);
+        int chosen = index < 0 ? -1 : KPDVE_CANDIDATE_KPDVE(tables->candidates[tables->offsets[chroma] + index]);
+        right += chosen >= 0 && (chosen >> 9) == (truth >> 9);
+    }
+    return right;
+}
+
+static void check_learned(const kpdve_tables *tables)
+{
+    make_walk(tables);
+    kpdve_prior_counts_reset(&counts);
+    kpdve_prior_count(&counts, walk_states, WALK / 2);
+    kpdve_prior_build(&prior, &counts, 1.0f, 1.0f);
+
+    int scored;
+    int plain = recognized(tables, NULL, WALK / 2, WALK, &scored);
+    int learned = recognized(tables, &prior, WALK / 2, WALK, &scored);
+    printf("scored K/P changes recognized: %d of %d by distance, %d with the learned prior\n", plain, scored, learned);
+    if (learned <= plain || learned < scored * 9 / 10)
+    {
+        fail("the learned prior did not recognize more changes");
+    }
+}
+
+// pf_rt with the prior: as choosing by hand
+static void check_rt(const kpdve_tables *tables)
+{
+    pf_rt_analyzer analyzer;
+    pf_rt_init(&analyzer, tables);
+    pf_rt_set_prior(&analyzer, &prior);
+    int context = analyzer.context;
+    for (int i = 0; i < FRAMES; i++)
+    {
+        int chroma = rand() % 4 ? walk_states[i] & 0xFFF : rand() % 4096;
+        int encoded = pf_rt_analyze_chroma(&analyzer, chroma);
+        int index = chroma ? kpdve_prior_choose(tables, &prior, NULL, chroma, context) : -1;
+        if (index >= 0)
+        {
+            context = KPDVE_CANDIDATE_KPDVE(tables->candidates[tables->offsets[chroma] + index]);
+        }
+        if (((encoded >> 12) & 0xFFFF) != context)
+        {
+            fail("analyzer with a prior differs from choosing by hand");
+            return;
+        }
+    }
+    pf_rt_set_prior(&analyzer, NULL);
+    if (analyzer.prior != NULL)
+    {
+        fail("prior not detached");
+    }
+}
+
+/**
+ * @brief Checks counting, quantization and the sparse file, the prior's choice against
+ * a brute-force one, and that a prior learned from labeled streams improves on distance.
+ */
+int main(void)
+{
+    srand(49);
+    const kpdve_tables *tables = kpdve_tables_default();
+    check_counting();
+    check_file();
+    check_choice(tables);
+    check_anchored(tables);
+    check_learned(tables);
+    check_rt(tables);
+
+    printf("%d failures\n", failures);
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures != 0;
+}
@@ -0,0 +1,241 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_latency.h"
+#include "../include/qdkpdve_rt.h"
+#include "../include/qdkpdve_shmring.h"
+#include "../include/qdkpdve_tables.h"
+
+#define FRAMES 200000
+#define RESET_AT 123457
+#define MAX_BATCH 256
+#define PACED 2000
+#define CAPACITY 1000 // rounded up to 1024
+#define SPIN_NS 20000
+
+static char ring_name[64];
+static uint16_t chroma[FRAMES + PACED];
+static uint32_t expected[FRAMES + PACED];
+static uint64_t sent_at[FRAMES + PACED];
+static int failures = 0;
+
+static void fail(const char *what)
+{
+    if (failures++ < 10)
+    {
+        printf("%s\n", what);
+    }
+}
+
+static unsigned next_random(unsigned *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+    return (*seed >> 8) & 0xFFFFFF;
+}
+
+// the stream, and its states from a local analyzer (reset once, as the ring is told to)
+static void make_stream(void)
+{
+    static const uint16_t chords[] = { 0x91, 0x221, 0x84, 0x109, 0x412, 0x8A, 0x891, 0xA4, 0x0 };
+    unsigned seed = 11;
+    pf_rt_analyzer local;
+    pf_rt_init(&local, kpdve_tables_default());
+    for (int i = 0; i < FRAMES + PACED; i++)
+    {
+        unsigned r = next_random(&seed);
+        chroma[i] = (r % 10 < 8) ? chords[r % 9] : (uint16_t)(r & 0xFFF);
+        if (i == RESET_AT)
+        {
+            pf_rt_reset(&local);
+        }
+        expected[i] = (uint32_t)pf_rt_analyze_chroma(&local, chroma[i]);
+    }
+}
+
+// the consumer process: opens the ring by name and serves it until the producer shuts down
+static int consume(void)
+{
+    int err = 0;
+    pf_ring *ring = pf_ring_open(ring_name, &err);
+    if (ring == NULL)
+    {
+        return 1;
+    }
+    pf_rt_analyzer analyzer;
+    pf_rt_init(&analyzer, kpdve_tables_default());
+    uint64_t frames = pf_ring_serve(ring, &analyzer, SPIN_NS, NULL);
+    pf_ring_close(ring);
+    return frames == FRAMES + PACED ? 0 : 2;
+}
+
+// takes every result there is, checking it against the frame sent at that position
+static int collect(pf_ring *ring, int *received, kpdve_latency_histogram *latency)
+{
+    int taken = 0;
+    const struct pf_ring_frame *f;
+    uint32_t count;
+    while ((f = pf_ring_results(ring, &count)) != NULL)
+    {
+        uint64_t now = kpdve_latency_now_ns();
+        for (uint32_t j = 0; j < count; j++, (*received)++)
+        {
+            int i = *received;
+            if (f[j].timestamp_ns != sent_at[i] || f[j].chroma != chroma[i])
+            {
+                fail("result out of order");
+            }
+            else if (f[j].state != expected[i])
+            {
+                fail("state differs from the local analyzer");
+            }
+            kpdve_latency_record(latency, now - f[j].timestamp_ns);
+        }
+        pf_ring_release(ring, count);
+        taken += (int)count;
+    }
+    return taken;
+}
+
+static int publish(pf_ring *ring, int *sent, int want)
+{
+    uint32_t room;
+    struct pf_ring_frame *f = pf_ring_reserve(ring, &room);
+    uint32_t n = (uint32_t)want < room ? (uint32_t)want : room;
+    uint64_t now = kpdve_latency_now_ns();
+    for (uint32_t j = 0; j < n; j++, (*sent)++)
+    {
+        sent_at[*sent] = now;
+        f[j] = (struct pf_ring_frame){ now, chroma[*sent], *sent == RESET_AT ? PF_RING_FRAME_RESET : 0, 0 };
+    }
+    if (n > 0)
+    {
+        pf_ring_publish(ring, n);
+    }
+    return (int)n;
+}
+
+static void print_latency(const char *what, kpdve_latency_histogram *latency)
+{
+    struct kpdve_latency_summary s;
+    kpdve_latency_summarize(latency, &s, 1);
+    printf("%s: %llu frames, p50 %llu ns, p99 %llu ns, max %llu ns\n", what, (unsigned long long)s.count,
+           (unsigned long long)s.p50_ns, (unsigned long long)s.p99_ns, (unsigned long long)s.max_ns);
+}
+
+// opening what is not there, or not a ring, and capacities out of range
+static void check_setup(void)
+{
+    int err = 0;
+    if (pf_ring_open(ring_name, &err) != NULL || err != PF_RING_ERR_IO)
+    {
+        fail("missing ring opened");
+    }
+    if (pf_ring_create(ring_name, 0, &err) != NULL || err != PF_RING_ERR_CAPACITY
+        || pf_ring_create(ring_name, PF_RING_MAX_CAPACITY + 1, &err) != NULL || err != PF_RING_ERR_CAPACITY)
+    {
+        fail("bad capacity accepted");
+    }
+    int fd = shm_open(ring_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 || ftruncate(fd, 4096) != 0)
+    {
+        fail("shm_open failed");
+    }
+    close(fd);
+    if (pf_ring_open(ring_name, &err) != NULL || err != PF_RING_ERR_FORMAT)
+    {
+        fail("foreign object opened as a ring");
+    }
+    pf_ring_unlink(ring_name);
+}
+
+/**
+ * @brief Feeds a stream through a ring to a consumer process, in bursts and then one
+ * frame at a time, checking every state against a local analyzer and reporting the
+ * round-trip latency of both.
+ */
+int main(void)
+{
+    snprintf(ring_name, sizeof(ring_name), "/pitchflock_test_%d", (int)getpid());
+    check_setup();
+    make_stream();
+
+    int err = 0;
+    pf_ring *ring = pf_ring_create(ring_name, CAPACITY, &err);
+    if (ring == NULL)
+    {
+        printf("ring not created (%d)\nFAILED\n", err);
+        return 1;
+    }
+    if (pf_ring_capacity(ring) != 1024)
+    {
+        fail("capacity not rounded up");
+    }
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        _exit(consume());
+    }
+
+    kpdve_latency_histogram latency;
+    kpdve_latency_init(&latency);
+    unsigned seed = 5;
+    int sent = 0;
+    int received = 0;
+
+    // bursts of up to MAX_BATCH frames, as an audio callback would send, without waiting
+    while (received < FRAMES && failures == 0)
+    {
+        int taken = collect(ring, &received, &latency);
+        int want = 1 + (int)(next_random(&seed) % MAX_BATCH);
+        int pushed = publish(ring, &sent, want < FRAMES - sent ? want : FRAMES - sent);
+        if (taken == 0 && pushed == 0 && received < FRAMES && pf_ring_wait_results(ring, SPIN_NS, 1000000000) == 0)
+        {
+            fail("no results within a second");
+        }
+    }
+    print_latency("bursts", &latency);
+
+    // one frame at a time, each waited for: the wake-up latency across processes
+    while (received < FRAMES + PACED && failures == 0)
+    {
+        publish(ring, &sent, 1);
+        if (pf_ring_wait_results(ring, SPIN_NS, 1000000000) == 0)
+        {
+            fail("no result within a second");
+        }
+        collect(ring, &received, &latency);
+    }
+    print_latency("one at a time", &latency);
+
+    pf_ring_shutdown(ring);
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fail("consumer process failed");
+    }
+
+    struct pf_ring_stats stats;
+    pf_ring_get_stats(ring, &stats);
+    printf("producer: %llu frames, %llu sleeps, %llu wakes\n", (unsigned long long)stats.frames,
+           (unsigned long long)stats.sleeps, (unsigned long long)stats.wakes);
+    if (stats.frames != FRAMES + PACED)
+    {
+        fail("frames published miscounted");
+    }
+
+    pf_ring_close(ring);
+    if (pf_ring_unlink(ring_name) != PF_RING_OK || pf_ring_open(ring_name, &err) != NULL)
+    {
+        fail("ring not removed");
+    }
+
+    printf("%d failures\n", failures);
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures != 0;
+}
@@ -0,0 +1,284 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_rt.h"
+#include "../include/qdkpdve_snapshot.h"
+#include "../include/qdkpdve_tables.h"
+
+#define STREAMS 2
+#define FRAMES 300000
+
+static char snapshot_name[64];
+static uint16_t chroma[STREAMS][FRAMES];
+static uint32_t expected[STREAMS][FRAMES];
+static uint32_t invalid_before[STREAMS][FRAMES + 1];  // invalid frames among the first i
+static uint32_t changes_before[STREAMS][FRAMES + 1];  // K/P changes among the first i
+static int writer_done = 0;
+static int failures = 0;
+
+static void fail(const char *what)
+{
+    if (__atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED) < 10)
+    {
+        printf("%s\n", what);
+    }
+}
+
+static unsigned next_random(unsigned *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+    return (*seed >> 8) & 0xFFFFFF;
+}
+
+// each stream's frames, states (from a local analyzer) and running counts
+static void make_streams(void)
+{
+    static const uint16_t chords[] = { 0x91, 0x221, 0x84, 0x109, 0x412, 0x8A, 0x891, 0xA4, 0x0 };
+    unsigned seed = 3;
+    for (int s = 0; s < STREAMS; s++)
+    {
+        pf_rt_analyzer local;
+        pf_rt_init(&local, kpdve_tables_default());
+        for (int i = 0; i < FRAMES; i++)
+        {
+            unsigned r = next_random(&seed);
+            chroma[s][i] = (r % 10 < 8) ? chords[r % 9] : (uint16_t)(r & 0xFFF);
+            expected[s][i] = (uint32_t)pf_rt_analyze_chroma(&local, chroma[s][i]);
+            invalid_before[s][i + 1] = invalid_before[s][i] + ((expected[s][i] & 0x80000000u) != 0);
+            int changed = i > 0 && (expected[s][i] >> 21 & 0x7F) != (expected[s][i - 1] >> 21 & 0x7F);
+            changes_before[s][i + 1] = changes_before[s][i] + changed;
+        }
+    }
+}
+
+static void *write_streams(void *arg)
+{
+    pf_snapshot *snapshot = arg;
+    pf_rt_analyzer analyzers[STREAMS];
+    for (int s = 0; s < STREAMS; s++)
+    {
+        pf_rt_init(&analyzers[s], kpdve_tables_default());
+    }
+    for (int i = 0; i < FRAMES; i++)
+    {
+        for (int s = 0; s < STREAMS; s++)
+        {
+            pf_snapshot_analyze(snapshot, (uint32_t)s, &analyzers[s], chroma[s][i]);
+        }
+    }
+    __atomic_store_n(&writer_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// a copy that mixes two records shows up as counts that do not belong to its state
+static int consistent(int s, const struct pf_snapshot_state *state)
+{
+    uint64_t n = state->frames;
+    if (n == 0)
+    {
+        return state->history_count == 0;
+    }
+    if (n > FRAMES)
+    {
+        return 0;
+    }
+    uint32_t last = expected[s][n - 1];
+    return state->encoded == last && state->invalid_frames == invalid_before[s][n]
+           && state->kp_changes == changes_before[s][n] && state->history_count > 0
+           && state->history[0].frame < n && (state->history[0].kpdve >> 9) == ((last >> 21) & 0x7F);
+}
+
+// polls every stream, as a renderer would, through its own read-only mapping
+static void *read_streams(void *arg)
+{
+    (void)arg;
+    int err = 0;
+    pf_snapshot *snapshot = pf_snapshot_open(snapshot_name, &err);
+    if (snapshot == NULL)
+    {
+        fail("reader could not open the region");
+        return NULL;
+    }
+    uint64_t reads = 0, busy = 0;
+    uint64_t seen[STREAMS] = { 0 };
+    struct pf_snapshot_state state;
+    while (!__atomic_load_n(&writer_done, __ATOMIC_ACQUIRE))
+    {
+        for (uint32_t s = 0; s < STREAMS; s++)
+        {
+            int result = pf_snapshot_read(snapshot, s, &state);
+            if (result == PF_SNAPSHOT_BUSY)
+            {
+                busy++;
+                continue;
+            }
+            reads++;
+            if (result != PF_SNAPSHOT_OK || !consistent((int)s, &state))
+            {
+                fail("torn or wrong snapshot");
+            }
+            if (state.frames < seen[s])
+            {
+                fail("snapshot went backwards");
+            }
+            seen[s] = state.frames;
+        }
+    }
+    printf("%llu reads, %llu busy\n", (unsigned long long)reads, (unsigned long long)busy);
+    if (reads == 0)
+    {
+        fail("reader never got a snapshot");
+    }
+    pf_snapshot_close(snapshot);
+    return NULL;
+}
+
+// the final state of a stream in full: candidates as the tables rank them, and history
+static void check_final(const pf_snapshot *snapshot, int s)
+{
+    struct pf_snapshot_state state;
+    if (pf_snapshot_read(snapshot, (uint32_t)s, &state) != PF_SNAPSHOT_OK || state.frames != FRAMES
+        || !consistent(s, &state))
+    {
+        fail("final snapshot wrong");
+        return;
+    }
+    const kpdve_tables *tables = kpdve_tables_default();
+    int c = chroma[s][FRAMES - 1];
+    uint32_t count = c ? (uint32_t)(tables->offsets[c + 1] - tables->offsets[c]) : 0;
+    if (state.candidate_count != count || state.context != ((expected[s][FRAMES - 2] >> 12) & 0xFFFF))
+    {
+        fail("candidate count or context wrong");
+    }
+    uint32_t kept = count < PF_SNAPSHOT_CANDIDATES ? count : PF_SNAPSHOT_CANDIDATES;
+    for (uint32_t j = 2; j < kept; j++)
+    {
+        if (state.candidates[j].distance < state.candidates[j - 1].distance)
+        {
+            fail("candidates after the choice not nearest first");
+        }
+    }
+    if (kept > 0 && !(state.encoded & 0x80000000u) && state.candidates[0].kpdve != ((state.encoded >> 12) & 0xFFFF))
+    {
+        fail("first candidate is not the choice");
+    }
+
+    uint32_t entries = 0;
+    for (int i = FRAMES - 1; i >= 0 && entries < PF_SNAPSHOT_HISTORY; i--)
+    {
+        if (i == 0 || (expected[s][i] >> 21 & 0x7F) != (expected[s][i - 1] >> 21 & 0x7F))
+        {
+            const struct pf_snapshot_kp *h = &state.history[entries++];
+            if (h->frame != (uint64_t)i || h->kpdve != ((expected[s][i] >> 12) & 0xFFFF))
+            {
+                fail("K/P history wrong");
+                break;
+            }
+        }
+    }
+    if (state.history_count != entries)
+    {
+        fail("K/P history length wrong");
+    }
+}
+
+// with an anchor the choice is not always the nearest candidate; it is still listed first
+static void check_anchored(void)
+{
+    char name[80];
+    snprintf(name, sizeof(name), "%s_anchored", snapshot_name);
+    pf_snapshot *snapshot = pf_snapshot_create(name, 1, NULL, NULL);
+    if (snapshot == NULL)
+    {
+        fail("anchored region not created");
+        return;
+    }
+    const kpdve_tables *tables = kpdve_tables_default();
+    pf_rt_analyzer analyzer;
+    kpdve_anchor anchor;
+    pf_rt_init(&analyzer, tables);
+    kpdve_anchor_init(&anchor, tables, 256.0, 4.0f);
+    pf_rt_set_anchor(&analyzer, &anchor);
+
+    int not_nearest = 0;
+    for (int i = 0; i < FRAMES; i++)
+    {
+        int c = chroma[0][i];
+        int context = analyzer.context;
+        int encoded = pf_snapshot_analyze(snapshot, 0, &analyzer, c);
+        struct pf_snapshot_state state;
+        pf_snapshot_read(snapshot, 0, &state);
+        if (state.candidate_count == 0 || (encoded & 0x80000000))
+        {
+            continue;
+        }
+        if (state.candidates[0].kpdve != (((uint32_t)encoded >> 12) & 0xFFFF))
+        {
+            fail("anchored choice not listed first");
+            break;
+        }
+        int nearest = kpdve_tables_choose(tables, c, context);
+        not_nearest += KPDVE_CANDIDATE_KPDVE(tables->candidates[tables->offsets[c] + nearest]) != (int)state.candidates[0].kpdve;
+    }
+    if (not_nearest == 0)
+    {
+        fail("the anchor never chose other than the nearest candidate");
+    }
+    printf("anchored stream: %d choices other than the nearest candidate\n", not_nearest);
+    pf_snapshot_close(snapshot);
+    pf_snapshot_unlink(name);
+}
+
+/**
+ * @brief Records streams on one thread while another polls them through its own
+ * read-only mapping, checking that no read is ever torn, then checks the final states
+ * and, with an anchored analyzer, that the choice is listed first.
+ */
+int main(void)
+{
+    snprintf(snapshot_name, sizeof(snapshot_name), "/pitchflock_snapshot_%d", (int)getpid());
+    make_streams();
+
+    int err = 0;
+    if (pf_snapshot_open(snapshot_name, &err) != NULL || err != PF_SNAPSHOT_ERR_IO
+        || pf_snapshot_create(snapshot_name, 0, NULL, &err) != NULL || err != PF_SNAPSHOT_ERR_RANGE)
+    {
+        fail("bad region accepted");
+    }
+    pf_snapshot *snapshot = pf_snapshot_create(snapshot_name, STREAMS, NULL, &err);
+    if (snapshot == NULL)
+    {
+        printf("region not created (%d)\nFAILED\n", err);
+        return 1;
+    }
+    struct pf_snapshot_state state;
+    if (pf_snapshot_read(snapshot, 0, &state) != PF_SNAPSHOT_OK || state.frames != 0
+        || pf_snapshot_read(snapshot, STREAMS, &state) != PF_SNAPSHOT_ERR_RANGE)
+    {
+        fail("fresh region wrong");
+    }
+
+    pthread_t writer, reader;
+    pthread_create(&reader, NULL, read_streams, NULL);
+    pthread_create(&writer, NULL, write_streams, snapshot);
+    pthread_join(writer, NULL);
+    pthread_join(reader, NULL);
+
+    for (int s = 0; s < STREAMS; s++)
+    {
+        check_final(snapshot, s);
+    }
+    check_anchored();
+    pf_snapshot_close(snapshot);
+    if (pf_snapshot_unlink(snapshot_name) != PF_SNAPSHOT_OK || pf_snapshot_open(snapshot_name, &err) != NULL)
+    {
+        fail("region not removed");
+    }
+
+    printf("%d failures\n", failures);
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures != 0;
+}
@@ -0,0 +1,119 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/harmony_state.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_stats.h"
+
+#define FRAMES 2000
+#define CM 0b10010001
+
+static int failed = 0;
+
+static void expect(const char *what, uint64_t actual, uint64_t expected)
+{
+    if (actual != expected)
+    {
+        printf("%s: %llu, expected %llu\n", what, (unsigned long long)actual, (unsigned long long)expected);
+        failed = 1;
+    }
+}
+
+// a stream with modulations and some invalid frames; counts what the hooks should count
+static void analyze_stream(harmony_state *state, unsigned int seed, uint64_t *invalid, uint64_t *key_changes, uint64_t *pattern_changes)
+{
+    for (int i = 0; i < FRAMES; i++)
+    {
+        int r = rand_r(&seed) % 100;
+        int chroma = (r < 5) ? (rand_r(&seed) & 0xFFF) : mod_rot(CM, rand_r(&seed) % 12, 12);
+        int previous = state->kpdve;
+
+        adjust_harmony_state_from_chroma_and_context(state, chroma, state->kpdve);
+
+        *invalid += (state->encoded_state < 0);
+        *key_changes += ((previous ^ state->kpdve) & 0xF000) != 0;
+        *pattern_changes += ((previous ^ state->kpdve) & 0x0E00) != 0;
+    }
+}
+
+static void *thread_stream(void *arg)
+{
+    uint64_t ignored[3] = { 0, 0, 0 };
+    harmony_state state = harmony_state_default();
+    analyze_stream(&state, (unsigned int)(size_t)arg, &ignored[0], &ignored[1], &ignored[2]);
+    return NULL;
+}
+
+/**
+ * @brief Checks the analysis counters against counts taken from the analyzed states.
+ */
+int main(void)
+{
+    struct kpdve_stats stats;
+    harmony_state state = harmony_state_default();
+
+    if (!kpdve_stats_enabled())
+    {
+        uint64_t ignored[3] = { 0, 0, 0 };
+        analyze_stream(&state, 1, &ignored[0], &ignored[1], &ignored[2]);
+        kpdve_stats_snapshot(&stats);
+        expect("frames (stats not compiled in)", stats.frames, 0);
+        printf("PITCHFLOCK_STATS is off: %s\n", failed ? "FAILED" : "OK");
+        return failed;
+    }
+
+    // one thread
+    uint64_t invalid = 0, key_changes = 0, pattern_changes = 0;
+    kpdve_stats_reset();
+    analyze_stream(&state, 1, &invalid, &key_changes, &pattern_changes);
+    kpdve_stats_snapshot(&stats);
+
+    expect("frames", stats.frames, FRAMES);
+    expect("kp_lists", stats.kp_lists, FRAMES);
+    expect("kp_cells_tested", stats.kp_cells_tested, 84 * FRAMES);
+    expect("min_index_calls", stats.min_index_calls, FRAMES);
+    expect("invalid", stats.invalid, invalid);
+    expect("key_changes", stats.key_changes, key_changes);
+    expect("pattern_changes", stats.pattern_changes, pattern_changes);
+
+    uint64_t lists = 0, candidates = 0;
+    for (int i = 0; i < KPDVE_STATS_LIST_LENGTHS; i++)
+    {
+        lists += stats.list_lengths[i];
+        candidates += (uint64_t)i * stats.list_lengths[i];
+    }
+    expect("list length histogram total", lists, stats.kp_lists);
+    expect("candidates", stats.candidates, candidates);
+    if (stats.same_kp_hits == 0 || stats.same_kp_hits > stats.min_index_calls)
+    {
+        printf("same_kp_hits: %llu of %llu\n", (unsigned long long)stats.same_kp_hits, (unsigned long long)stats.min_index_calls);
+        failed = 1;
+    }
+    printf("%llu frames: %llu candidates, %llu same-KP hits, %llu key changes, %llu invalid\n",
+           (unsigned long long)stats.frames, (unsigned long long)stats.candidates,
+           (unsigned long long)stats.same_kp_hits, (unsigned long long)stats.key_changes,
+           (unsigned long long)stats.invalid);
+
+    // several threads (each also makes its default state), counted after they have exited
+    kpdve_stats_reset();
+    pthread_t threads[4];
+    for (size_t t = 0; t < 4; t++)
+    {
+        pthread_create(&threads[t], NULL, thread_stream, (void *)(t + 2));
+    }
+    for (int t = 0; t < 4; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+    kpdve_stats_snapshot(&stats);
+    expect("frames over 4 threads", stats.frames, 4 * FRAMES);
+    expect("kp_lists over 4 threads", stats.kp_lists, 4 * (FRAMES + 1));
+
+    kpdve_stats_reset();
+    kpdve_stats_snapshot(&stats);
+    expect("frames after reset", stats.frames, 0);
+
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
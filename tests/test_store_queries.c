@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/harmony_state.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_store.h"
+
+#define FRAMES 100000
+#define BLOCK 1024
+#define PERIOD 512 // samples per frame
+#define CM 0b10010001
+
+static const char *path = "test_store_queries.pfs";
+static const char *corrupt_path = "test_store_corrupt.pfs";
+
+// a copy of the store with its states offset replaced; 0 if it opens
+static int refuses_states_offset(uint64_t states_offset)
+{
+    FILE *in = fopen(path, "rb");
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    rewind(in);
+    char *bytes = malloc((size_t)size);
+    size_t got = fread(bytes, 1, (size_t)size, in);
+    fclose(in);
+    struct kpdve_store_header header;
+    memcpy(&header, bytes, sizeof(header));
+    header.states_offset = states_offset;
+    memcpy(bytes, &header, sizeof(header));
+    FILE *out = fopen(corrupt_path, "wb");
+    fwrite(bytes, 1, got, out);
+    fclose(out);
+    free(bytes);
+
+    kpdve_store store;
+    int err = kpdve_store_open(&store, corrupt_path);
+    kpdve_store_close(&store);
+    remove(corrupt_path);
+    return err == KPDVE_STORE_ERR_FORMAT;
+}
+
+/**
+ * @brief Checks the mapped store against a brute-force scan of the frames it was written
+ * from, then that headers whose states would overlap the header, sit unaligned or wrap
+ * around the end of the file are refused.
+ */
+int main(void)
+{
+    int *states = malloc(FRAMES * sizeof(int));
+    int failed = 0;
+
+    srand(99);
+    harmony_state state = harmony_state_default();
+    int context = 35;
+    int chroma = CM;
+    for (int i = 0; i < FRAMES; i++)
+    {
+        int r = rand() % 1000;
+        if (r < 2)
+        {
+            chroma = mod_rot(CM, rand() % 12, 12); // modulation
+        }
+        else if (r < 3)
+        {
+            chroma = 0xFFF; // invalid
+        }
+        else if (r < 30)
+        {
+            chroma = mod_rot(CM, (rand() % 3) * 5, 12); // I, IV, V of the current area
+        }
+        adjust_harmony_state_from_chroma_and_context(&state, chroma, context);
+        context = state.kpdve;
+        states[i] = state.encoded_state;
+    }
+
+    // write in uneven pieces, with a gap in time at the start of block 10
+    kpdve_store_writer w;
+    if (kpdve_store_writer_open(&w, path, BLOCK, PERIOD) != KPDVE_STORE_OK)
+    {
+        printf("cannot create %s\n", path);
+        return 1;
+    }
+    for (int i = 0; i < FRAMES; )
+    {
+        int n = 1 + rand() % 3000;
+        if (n > FRAMES - i) n = FRAMES - i;
+        if (i < 10 * BLOCK && i + n > 10 * BLOCK)
+        {
+            n = 10 * BLOCK - i;
+        }
+        if (i == 10 * BLOCK)
+        {
+            kpdve_store_set_time(&w, (uint64_t)10 * BLOCK * PERIOD + 1000000);
+        }
+        failed |= kpdve_store_append(&w, states + i, (size_t)n) != KPDVE_STORE_OK;
+        i += n;
+    }
+    failed |= kpdve_store_writer_close(&w) != KPDVE_STORE_OK;
+
+    kpdve_store store;
+    if (kpdve_store_open(&store, path) != KPDVE_STORE_OK)
+    {
+        printf("cannot open %s\n", path);
+        return 1;
+    }
+
+    if (kpdve_store_frame_count(&store) != FRAMES || kpdve_store_block_count(&store) != (FRAMES + BLOCK - 1) / BLOCK)
+    {
+        printf("wrong frame/block count\n");
+        failed = 1;
+    }
+    for (int i = 0; i < FRAMES; i++)
+    {
+        if (kpdve_store_frame(&store, i) != states[i])
+        {
+            printf("frame %d differs\n", i);
+            failed = 1;
+            break;
+        }
+    }
+
+    // key changes, brute force
+    size_t *expected = malloc(FRAMES * sizeof(size_t));
+    size_t *found = malloc(FRAMES * sizeof(size_t));
+    size_t n_expected = 0;
+    int k_prev = -1;
+    for (int i = 0; i < FRAMES; i++)
+    {
+        if (states[i] < 0) continue;
+        int k = (states[i] >> 24) & 0xF;
+        if (k_prev >= 0 && k != k_prev) expected[n_expected++] = (size_t)i;
+        k_prev = k;
+    }
+    size_t first = 12345, last = 87654;
+    size_t n_found = kpdve_store_key_changes(&store, first, last, found, FRAMES);
+    size_t j = 0;
+    for (size_t i = 0; i < n_expected; i++)
+    {
+        if (expected[i] < first || expected[i] >= last) continue;
+        if (j >= n_found || found[j] != expected[i])
+        {
+            printf("key change %zu missing\n", expected[i]);
+            failed = 1;
+            break;
+        }
+        j++;
+    }
+    failed |= j != n_found;
+    printf("%zu key changes in [%zu, %zu)\n", n_found, first, last);
+
+    // time lookups: before and after the gap
+    failed |= kpdve_store_frame_at_time(&store, 5 * PERIOD + 3) != 5;
+    failed |= kpdve_store_frame_at_time(&store, (uint64_t)10 * BLOCK * PERIOD + 1000000 + 7 * PERIOD) != 10 * BLOCK + 7;
+    failed |= kpdve_store_frame_at_time(&store, UINT64_MAX) != FRAMES - 1;
+
+    long b = kpdve_store_next_block_with_key(&store, (states[FRAMES - 1] >> 24) & 0xF, 0);
+    failed |= b < 0;
+    // no key outside 0..11 is found (1 << key would be undefined or wrap to another key)
+    failed |= kpdve_store_next_block_with_key(&store, -1, 0) != -1 || kpdve_store_next_block_with_key(&store, 12, 0) != -1
+              || kpdve_store_next_block_with_key(&store, 16, 0) != -1 || kpdve_store_next_block_with_key(&store, 32, 0) != -1;
+
+    kpdve_store_close(&store);
+
+    // states over the header, unaligned, or so far out that the end of the column wraps
+    uint64_t bad_offsets[] = { 0, 32, 66, UINT64_MAX - 3, UINT64_MAX - (uint64_t)FRAMES * 4 + 1 };
+    for (int i = 0; i < 5; i++)
+    {
+        if (!refuses_states_offset(bad_offsets[i]))
+        {
+            printf("states offset %llu not refused\n", (unsigned long long)bad_offsets[i]);
+            failed = 1;
+        }
+    }
+    remove(path);
+    free(states);
+    free(expected);
+    free(found);
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
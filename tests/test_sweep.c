@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/harmony_state.h"
+#include "../include/qdkpdve_statemaker.h"
+#include "../include/qdkpdve_sweep.h"
+#include "../include/qdkpdve_tables.h"
+
+#define CONTEXT_CELLS (KPDVE_SWEEP_CONTEXTS * KPDVE_SWEEP_CHROMA)
+
+/**
+ * @brief Checks the sweeps against direct calls to the reference, and that the output does
+ * not depend on the number of threads.
+ */
+int main(void)
+{
+    int failed = 0;
+    int *one = malloc(sizeof(int) * CONTEXT_CELLS);
+    int *four = malloc(sizeof(int) * CONTEXT_CELLS);
+    uint8_t *choices = malloc(CONTEXT_CELLS);
+
+    kpdve_sweep_contexts(one, choices, 1);
+    kpdve_sweep_contexts(four, NULL, 4);
+    if (memcmp(one, four, sizeof(int) * CONTEXT_CELLS) != 0)
+    {
+        printf("context sweep differs between 1 and 4 threads\n");
+        failed = 1;
+    }
+
+    // every 37th cell against adjust_harmony_state_from_chroma_and_context
+    for (int cell = 0; cell < CONTEXT_CELLS; cell += 37)
+    {
+        int c = cell / KPDVE_SWEEP_CHROMA;
+        int chroma = cell % KPDVE_SWEEP_CHROMA;
+        harmony_state state = harmony_state_default();
+        adjust_harmony_state_from_chroma_and_context(&state, chroma, kpdve_sweep_context_kpdve(c));
+        if (state.encoded_state != one[cell] || state.kpdve_min_index != choices[cell])
+        {
+            printf("context %d, chroma %d: %08x/%d, expected %08x/%d\n", c, chroma, one[cell], choices[cell],
+                   state.encoded_state, state.kpdve_min_index);
+            failed = 1;
+            break;
+        }
+    }
+
+    // candidate lists against set_kp_list
+    uint32_t *offsets = malloc(sizeof(uint32_t) * (KPDVE_SWEEP_CHROMA + 1));
+    uint32_t *entries = malloc(sizeof(uint32_t) * KPDVE_SWEEP_CANDIDATES);
+    size_t count = kpdve_sweep_candidates(offsets, entries);
+    if (count != KPDVE_SWEEP_CANDIDATES)
+    {
+        printf("%zu candidates, expected %d\n", count, KPDVE_SWEEP_CANDIDATES);
+        failed = 1;
+    }
+    for (int chroma = 0; chroma < KPDVE_SWEEP_CHROMA && !failed; chroma++)
+    {
+        harmony_state state;
+        state.chromatic_notes = chroma;
+        set_kp_list(&state);
+        if ((int)(offsets[chroma + 1] - offsets[chroma]) != state.kpdve_list_length)
+        {
+            printf("chroma %d: list length differs\n", chroma);
+            failed = 1;
+        }
+        for (int i = 0; i < state.kpdve_list_length && !failed; i++)
+        {
+            uint32_t e = entries[offsets[chroma] + i];
+            if (KPDVE_CANDIDATE_KPDVE(e) != state.kpdve_list[i] || KPDVE_CANDIDATE_DVE(e) != state.dve_list[i]
+                || KPDVE_CANDIDATE_VE(e) != state.ve_list[i])
+            {
+                printf("chroma %d: candidate %d differs\n", chroma, i);
+                failed = 1;
+            }
+        }
+    }
+
+    // every KPDVE value against adjust_harmony_state_from_kpdve
+    int *kpdves = malloc(sizeof(int) * KPDVE_SWEEP_KPDVES);
+    kpdve_sweep_kpdves(kpdves, 3);
+    harmony_state state = harmony_state_default();
+    int i = 0;
+    for (int k = 0; k < 12; k++)
+    for (int p = 0; p < 7; p++)
+    for (int d = 0; d < 7; d++)
+    for (int v = 0; v < 7; v++)
+    for (int e = 0; e < 7; e++, i++)
+    {
+        int loc[] = { k, p, d, v, e };
+        adjust_harmony_state_from_kpdve(&state, KPDVEtoBinaryEncoding(loc));
+        if (state.encoded_state != kpdves[i] && !failed)
+        {
+            printf("kpdve %d: %08x, expected %08x\n", i, kpdves[i], state.encoded_state);
+            failed = 1;
+        }
+    }
+
+    free(one);
+    free(four);
+    free(choices);
+    free(offsets);
+    free(entries);
+    free(kpdves);
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
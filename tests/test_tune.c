@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_codec.h"
+#include "../include/qdkpdve_prior.h"
+#include "../include/qdkpdve_rt.h"
+#include "../include/qdkpdve_store.h"
+#include "../include/qdkpdve_tune.h"
+
+#define FRAMES 60000
+#define CONFIGS 21   // not a multiple of the lanes
+
+static int labels[FRAMES];
+static kpdve_prior_counts counts;
+static kpdve_prior prior;
+static struct kpdve_tune_config configs[CONFIGS];
+static struct kpdve_tune_score scores[CONFIGS];
+static int failures = 0;
+
+static void fail(const char *what)
+{
+    if (failures++ < 10)
+    {
+        printf("%s\n", what);
+    }
+}
+
+static float random_weight(void)
+{
+    return 0.25f + (float)(rand() % 1000) / 400.0f;
+}
+
+// labels: a default analysis of chords (with key changes), noise and silence, then
+// one frame in eight relabeled to another key (so no configuration is right everywhere)
+static void make_labels(void)
+{
+    static const int chords[] = { 0x91, 0x221, 0x84, 0x109, 0x412, 0x8A, 0x891, 0xA4 };
+    pf_rt_analyzer analyzer;
+    pf_rt_init(&analyzer, NULL);
+    int shift = 0;
+    for (int i = 0; i < FRAMES; i++)
+    {
+        if (rand() % 200 == 0)
+        {
+            shift = rand() % 12;
+        }
+        int r = rand() % 20;
+        int chord = chords[rand() % 8];
+        int chroma = r == 0 ? 0 : r == 1 ? rand() % 4096 : ((chord << shift) | (chord >> (12 - shift))) & 0xFFF;
+        labels[i] = pf_rt_analyze_chroma(&analyzer, chroma);
+        if (rand() % 8 == 0 && labels[i] >= 0)
+        {
+            labels[i] = (labels[i] & ~(0xF << 24)) | (((labels[i] >> 24) + 5) % 12) << 24;
+        }
+    }
+}
+
+static void make_configs(void)
+{
+    kpdve_tune_default_config(&configs[0]);
+    for (int c = 1; c < CONFIGS; c++)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            configs[c].axis_scale[a] = random_weight();
+        }
+        configs[c].metric = c % 3 == 0 ? KPDVE_TUNE_L2 : KPDVE_TUNE_L1;
+        configs[c].prior_weight = c % 2 ? 0.0f : random_weight() / 2;
+    }
+    configs[1] = configs[0];
+    configs[1].prior_weight = 0.6f; // the built-in weights, with the prior
+}
+
+// the scores of one configuration the slow way: pf_rt on tables with the configuration's
+// distances (squared for L2), with the prior attached at the configuration's weight
+static void reference_score(const struct kpdve_tune_config *config, const kpdve_prior *with,
+                            struct kpdve_tune_score *s)
+{
+    static float k_distance[12 * 12], p_distance[8 * 8], d_distance[8 * 8];
+    static kpdve_prior weighted;
+    float scale[5] = { config->axis_scale[0], config->axis_scale[1], config->axis_scale[2], 1.0f, 1.0f };
+    kpdve_tables_build_distances(scale, k_distance, p_distance, d_distance);
+    if (config->metric == KPDVE_TUNE_L2)
+    {
+        for (int i = 0; i < 144; i++)
+        {
+            k_distance[i] *= k_distance[i];
+        }
+        for (int i = 0; i < 64; i++)
+        {
+            p_distance[i] *= p_distance[i];
+            d_distance[i] *= d_distance[i];
+        }
+    }
+    kpdve_tables tables = *kpdve_tables_default();
+    tables.k_distance = k_distance;
+    tables.p_distance = p_distance;
+    tables.d_distance = d_distance;
+
+    pf_rt_analyzer analyzer;
+    pf_rt_init(&analyzer, &tables);
+    if (with != NULL)
+    {
+        weighted = *with;
+        kpdve_prior_set_weight(&weighted, config->prior_weight);
+        pf_rt_set_prior(&analyzer, &weighted);
+    }
+
+    memset(s, 0, sizeof(*s));
+    int last_label_k = -1;
+    for (int i = 0; i < FRAMES; i++)
+    {
+        int before = analyzer.kpdve;
+        int chroma = labels[i] & 0xFFF;
+        int kpdve = (pf_rt_analyze_chroma(&analyzer, chroma) >> 12) & 0xFFFF;
+        int label = (labels[i] >> 12) & 0xFFFF;
+        int k_change = (kpdve >> 12) != (before >> 12);
+        s->k_changes += k_change;
+        s->kp_changes += (kpdve >> 9) != (before >> 9);
+        if (chroma != 0 && labels[i] >= 0)
+        {
+            int label_change = last_label_k >= 0 && (label >> 12) != last_label_k;
+            last_label_k = label >> 12;
+            s->frames++;
+            s->k_right += (kpdve >> 12) == (label >> 12);
+            s->kp_right += (kpdve >> 9) == (label >> 9);
+            s->kpdve_right += kpdve == label;
+            s->label_k_changes += label_change;
+            s->k_change_hits += label_change && k_change && (kpdve >> 12) == (label >> 12);
+        }
+    }
+}
+
+static int same_score(const struct kpdve_tune_score *a, const struct kpdve_tune_score *b)
+{
+    return memcmp(a, b, sizeof(*a)) == 0;
+}
+
+// every configuration against its own slow analysis, with and without a prior
+static void check_lanes(void)
+{
+    kpdve_prior_counts_reset(&counts);
+    kpdve_prior_count(&counts, labels, FRAMES);
+    kpdve_prior_build(&prior, &counts, 1.0f, 0.0f);
+
+    struct kpdve_tune_options options;
+    kpdve_tune_default_options(&options);
+    for (int with_prior = 0; with_prior < 2; with_prior++)
+    {
+        options.prior = with_prior ? &prior : NULL;
+        memset(scores, 0, sizeof(scores));
+        if (kpdve_tune_evaluate_states(labels, FRAMES, configs, CONFIGS, &options, scores) != KPDVE_TUNE_OK)
+        {
+            fail("evaluation failed");
+            return;
+        }
+        for (int c = 0; c < CONFIGS; c++)
+        {
+            struct kpdve_tune_score expected;
+            reference_score(&configs[c], options.prior, &expected);
+            if (!same_score(&scores[c], &expected))
+            {
+                printf("config %d (prior %d): kp right %llu, expected %llu; k changes %llu, expected %llu\n", c,
+                       with_prior, (unsigned long long)scores[c].kp_right, (unsigned long long)expected.kp_right,
+                       (unsigned long long)scores[c].k_changes, (unsigned long long)expected.k_changes);
+                fail("configuration scored differently from its own analysis");
+            }
+        }
+    }
+
+    // the built-in configuration is right wherever the labels are its own
+    const struct kpdve_tune_score *s = &scores[0];
+    printf("built-in weights: %llu of %llu frames in the label's K and P, %llu of %llu key changes\n",
+           (unsigned long long)s->kp_right, (unsigned long long)s->frames,
+           (unsigned long long)s->k_change_hits, (unsigned long long)s->label_k_changes);
+    if (s->frames == 0 || s->kpdve_right < s->frames * 3 / 4 || s->kpdve_right == s->frames)
+    {
+        fail("built-in configuration scored wrong");
+    }
+    int differ = 0;
+    for (int c = 1; c < CONFIGS; c++)
+    {
+        differ += !same_score(&scores[c], s);
+    }
+    if (differ == 0)
+    {
+        fail("no configuration made a difference");
+    }
+}
+
+static int write_file(const char *path, const void *bytes, size_t size)
+{
+    FILE *out = fopen(path, "wb");
+    int ok = out != NULL && fwrite(bytes, 1, size, out) == size;
+    return (out != NULL && fclose(out) == 0 && ok) ? 0 : -1;
+}
+
+// the same stream as raw states, a codec stream and a store, on three threads, with
+// files that cannot be scored among them
+static void check_files(void)
+{
+    char dir[64], paths[6][96];
+    snprintf(dir, sizeof(dir), "/tmp/pitchflock_tune_%d", (int)getpid());
+    const char *names[6] = { "a.states", "b.pfc", "c.pfs", "d.chroma", "e.states", "missing" };
+    for (int i = 0; i < 6; i++)
+    {
+        snprintf(paths[i], sizeof(paths[i]), "%s_%s", dir, names[i]);
+    }
+
+    size_t cap = kpdve_codec_bound(FRAMES);
+    uint8_t *coded = malloc(cap);
+    long coded_size = coded ? kpdve_codec_encode_chunk(labels, FRAMES, coded, cap) : -1;
+    kpdve_store_writer writer;
+    uint16_t chroma[16] = { 0x91 };
+    if (coded_size <= 0 || write_file(paths[0], labels, sizeof(labels)) != 0
+        || write_file(paths[1], coded, (size_t)coded_size) != 0
+        || kpdve_store_writer_open(&writer, paths[2], 4096, 1) != KPDVE_STORE_OK
+        || kpdve_store_append(&writer, labels, FRAMES) != KPDVE_STORE_OK
+        || kpdve_store_writer_close(&writer) != KPDVE_STORE_OK
+        || write_file(paths[3], chroma, sizeof(chroma)) != 0
+        || write_file(paths[4], labels, 6) != 0)
+    {
+        fail("inputs not written");
+        free(coded);
+        return;
+    }
+    free(coded);
+
+    struct kpdve_tune_options options;
+    kpdve_tune_default_options(&options);
+    options.prior = &prior;
+    struct kpdve_tune_score one[CONFIGS] = { { 0 } };
+    kpdve_tune_evaluate_states(labels, FRAMES, configs, CONFIGS, &options, one);
+
+    options.threads = 3;
+    const char *list[6];
+    struct kpdve_tune_file files[6];
+    for (int i = 0; i < 6; i++)
+    {
+        list[i] = paths[i];
+    }
+    if (kpdve_tune_evaluate(list, 6, configs, CONFIGS, &options, files, scores) != KPDVE_TUNE_OK)
+    {
+        fail("corpus evaluation failed");
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        if (files[i].err != KPDVE_TUNE_OK || files[i].frames != FRAMES || files[i].labeled != one[0].frames)
+        {
+            printf("%s: err %d, %zu frames, %zu labeled\n", names[i], files[i].err, files[i].frames, files[i].labeled);
+            fail("labeled file not evaluated");
+        }
+    }
+    if (files[3].err != KPDVE_TUNE_ERR_FORMAT || files[4].err != KPDVE_TUNE_ERR_FORMAT
+        || files[5].err != KPDVE_TUNE_ERR_IO)
+    {
+        fail("unusable file not reported");
+    }
+    for (int c = 0; c < CONFIGS; c++)
+    {
+        const uint64_t *total = (const uint64_t *)&scores[c];
+        const uint64_t *single = (const uint64_t *)&one[c];
+        for (size_t f = 0; f < sizeof(one[c]) / sizeof(uint64_t); f++)
+        {
+            if (total[f] != 3 * single[f])
+            {
+                fail("corpus scores are not the sum of the files'");
+                c = CONFIGS;
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < 5; i++)
+    {
+        unlink(paths[i]);
+    }
+}
+
+/**
+ * @brief Checks every lane of the vectorized evaluation against the same configuration
+ * run through pf_rt, then the threaded corpus driver on every labeled file format.
+ */
+int main(void)
+{
+    srand(50);
+    make_labels();
+    make_configs();
+    check_lanes();
+    check_files();
+
+    printf("%d failures\n", failures);
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures != 0;
+}
@@ -0,0 +1,100 @@
+//
+//  pitchflock_analyze.c
+//  pitchflock
+//
+//  Analyzes a chroma or state file and renders the result on standard output, with the
+//  stages (read, chroma, analyze, format, write) running on their own threads:
+//
+//    pitchflock_analyze [-b batch_frames] [-q queue_depth] [-s] text|csv|jsonl <input>
+//
+//  Inputs are *.chroma (uint16 chroma per frame), codec streams (.pfc) or raw 32-bit
+//  encoded_state words, as for pitchflock_corpus. -s prints the per-stage throughput and
+//  backpressure counters to standard error.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/harmony_state.h"
+#include "../include/qdkpdve_corpus.h"
+#include "../include/qdkpdve_nametable.h"
+#include "../include/qdkpdve_pipeline.h"
+#include "../include/qdkpdve_statemaker.h"
+
+int main(int argc, char *argv[])
+{
+    size_t batch_frames = 0;
+    size_t queue_depth = 0;
+    int print_stats = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:q:s")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b': batch_frames = strtoul(optarg, NULL, 0); break;
+        case 'q': queue_depth = strtoul(optarg, NULL, 0); break;
+        case 's': print_stats = 1; break;
+        default: optind = argc + 1; break;
+        }
+    }
+    int format = -1;
+    if (argc - optind == 2)
+    {
+        const char *name = argv[optind];
+        format = strcmp(name, "text") == 0 ? KPDVE_FORMAT_TEXT
+               : strcmp(name, "csv") == 0 ? KPDVE_FORMAT_CSV
+               : strcmp(name, "jsonl") == 0 ? KPDVE_FORMAT_JSONL : -1;
+    }
+    if (format < 0)
+    {
+        fprintf(stderr, "usage: %s [-b batch_frames] [-q queue_depth] [-s] text|csv|jsonl <input>\n", argv[0]);
+        return 2;
+    }
+
+    const char *path = argv[optind + 1];
+    FILE *in = fopen(path, "rb");
+    if (in == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+    uint8_t magic[4];
+    size_t got = fread(magic, 1, sizeof(magic), in);
+    rewind(in);
+
+    struct kpdve_read_stage reader;
+    kpdve_read_stage_init(&reader, in, kpdve_corpus_format(path, magic, got));
+    harmony_state state = harmony_state_default();
+    int fd = STDOUT_FILENO;
+    kpdve_name_table_init();
+
+    kpdve_pipeline *pipeline = kpdve_pipeline_create(batch_frames, queue_depth);
+    if (pipeline == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    kpdve_pipeline_add_stage(pipeline, "read", kpdve_stage_read, &reader);
+    kpdve_pipeline_add_stage(pipeline, "chroma", kpdve_stage_chroma, NULL);
+    kpdve_pipeline_add_stage(pipeline, "analyze", kpdve_stage_analyze, &state);
+    kpdve_pipeline_add_stage(pipeline, "format", kpdve_stage_format, &format);
+    kpdve_pipeline_add_stage(pipeline, "write", kpdve_stage_write, &fd);
+
+    int err = kpdve_pipeline_run(pipeline);
+    if (err != KPDVE_PIPELINE_OK)
+    {
+        fprintf(stderr, "%s: analysis failed (%d)\n", path, err);
+    }
+    if (print_stats)
+    {
+        kpdve_pipeline_print(stderr, pipeline);
+    }
+
+    kpdve_pipeline_destroy(pipeline);
+    kpdve_read_stage_free(&reader);
+    fclose(in);
+    return err != KPDVE_PIPELINE_OK;
+}
@@ -0,0 +1,117 @@
+//
+//  pitchflock_blob.c
+//  pitchflock
+//
+//  Writes and checks table blobs (qdkpdve_blob.h):
+//
+//    pitchflock_blob write [-w k,p,d] <out.pfb>
+//    pitchflock_blob check <file.pfb>
+//
+//  -w sets the K, P and D weights the distances and decisions are computed with
+//  (default: the built-in kpdve_axis_scale; the tables do not depend on V and E). check verifies the checksum and compares every section
+//  with the tables this build of the library makes for the blob's weights.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_blob.h"
+#include "../include/qdkpdve_statemaker.h"
+
+static const char *section_names[KPDVE_BLOB_SECTIONS] = {
+    "crystal masks", "minimized", "offsets", "candidates", "K distance", "P distance",
+    "D distance", "decisions", "name entries", "name pool",
+};
+
+// K, P and D; V and E keep the built-in weights
+static int parse_weights(const char *text, float weights[5])
+{
+    char *end;
+    kpdve_default_axis_scale(weights);
+    for (int i = 0; i < 3; i++)
+    {
+        weights[i] = strtof(text, &end);
+        if (end == text || (i < 2 && *end != ',') || (i == 2 && *end != '\0'))
+        {
+            return -1;
+        }
+        text = end + 1;
+    }
+    return 0;
+}
+
+static int check(const char *path)
+{
+    kpdve_blob blob;
+    int err = kpdve_blob_open(&blob, path, 0);
+    if (err != KPDVE_BLOB_OK)
+    {
+        fprintf(stderr, "%s: %s\n", path, err == KPDVE_BLOB_ERR_IO ? "cannot read"
+                : err == KPDVE_BLOB_ERR_CONTENT ? "an index is out of bounds" : "not a version 1 table blob");
+        return 1;
+    }
+
+    const float *w = blob.header->axis_scale;
+    printf("%s: %zu bytes, weights %g,%g,%g,%g,%g\n", path, blob.map_size, w[0], w[1], w[2], w[3], w[4]);
+    int section;
+    err = kpdve_blob_validate(&blob, &section);
+    if (err == KPDVE_BLOB_ERR_CHECKSUM)
+    {
+        printf("checksum mismatch\n");
+    }
+    else if (err == KPDVE_BLOB_ERR_CONTENT)
+    {
+        printf("section %s differs from the tables this library builds\n", section_names[section]);
+    }
+    else if (err != KPDVE_BLOB_OK)
+    {
+        printf("out of memory\n");
+    }
+    else
+    {
+        printf("OK\n");
+    }
+    kpdve_blob_close(&blob);
+    return err != KPDVE_BLOB_OK;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc >= 2 && strcmp(argv[1], "check") == 0 && argc == 3)
+    {
+        return check(argv[2]);
+    }
+
+    float weights[5];
+    const float *axis_scale = NULL;
+    int usage = !(argc >= 2 && strcmp(argv[1], "write") == 0);
+    int opt;
+    optind = 2;
+    while (!usage && (opt = getopt(argc, argv, "w:")) != -1)
+    {
+        if (opt == 'w' && parse_weights(optarg, weights) == 0)
+        {
+            axis_scale = weights;
+        }
+        else
+        {
+            usage = 1;
+        }
+    }
+    if (usage || argc - optind != 1)
+    {
+        fprintf(stderr, "usage: %s write [-w k,p,d] <out.pfb>\n       %s check <file.pfb>\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    const char *path = argv[optind];
+    int err = kpdve_blob_write(path, axis_scale);
+    if (err != KPDVE_BLOB_OK)
+    {
+        fprintf(stderr, "%s: write failed (%d)\n", path, err);
+        return 1;
+    }
+    return check(path);
+}
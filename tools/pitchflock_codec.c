@@ -0,0 +1,153 @@
+//
+//  pitchflock_codec.c
+//  pitchflock
+//
+//  Command line front end for qdkpdve_codec:
+//
+//    pitchflock_codec encode <states.raw> <states.pfc>
+//    pitchflock_codec decode <states.pfc> <states.raw>
+//
+//  .raw files are plain arrays of 32-bit encoded_state words in native byte order.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/qdkpdve_codec.h"
+
+#define READ_FRAMES 65536
+
+static int file_sink(void *ctx, const uint8_t *bytes, size_t len)
+{
+    return fwrite(bytes, 1, len, (FILE *)ctx) == len ? 0 : -1;
+}
+
+static int encode_file(FILE *in, FILE *out)
+{
+    kpdve_encoder enc;
+    if (kpdve_encoder_init(&enc, 0) != 0)
+    {
+        return -1;
+    }
+
+    int *frames = malloc(READ_FRAMES * sizeof(int));
+    size_t total_in = 0;
+    size_t n;
+    int err = (frames == NULL) ? -1 : 0;
+
+    while (err == 0 && (n = fread(frames, sizeof(int), READ_FRAMES, in)) > 0)
+    {
+        total_in += n;
+        err = kpdve_encoder_push(&enc, frames, n, file_sink, out);
+    }
+    if (err == 0)
+    {
+        err = kpdve_encoder_finish(&enc, file_sink, out);
+    }
+
+    if (err == 0)
+    {
+        long total_out = ftell(out);
+        fprintf(stderr, "%zu frames, %zu -> %ld bytes (%.2f bits/frame)\n",
+                total_in, total_in * sizeof(int), total_out,
+                total_in ? (8.0 * total_out) / total_in : 0.0);
+    }
+    free(frames);
+    kpdve_encoder_free(&enc);
+    return err;
+}
+
+static int decode_file(FILE *in, FILE *out)
+{
+    // chunks are small enough to slurp the whole file; the codec is for archives, not pipes
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    if (size < 0)
+    {
+        return -1;
+    }
+
+    uint8_t *bytes = malloc((size_t)size + 1);
+    int *frames = NULL;
+    size_t frames_cap = 0;
+    int err = 0;
+
+    if (bytes == NULL || fread(bytes, 1, (size_t)size, in) != (size_t)size)
+    {
+        free(bytes);
+        return -1;
+    }
+
+    size_t pos = 0;
+    while (err == 0 && pos < (size_t)size)
+    {
+        size_t count, chunk_size;
+        if (kpdve_codec_chunk_info(bytes + pos, (size_t)size - pos, &count, &chunk_size) != KPDVE_CODEC_OK)
+        {
+            fprintf(stderr, "corrupt chunk at byte %zu\n", pos);
+            err = -1;
+            break;
+        }
+        if (count > frames_cap)
+        {
+            free(frames);
+            frames_cap = count;
+            frames = malloc(frames_cap * sizeof(int));
+            if (frames == NULL)
+            {
+                err = -1;
+                break;
+            }
+        }
+        long decoded = kpdve_codec_decode_chunk(bytes + pos, (size_t)size - pos, frames, frames_cap, NULL);
+        if (decoded < 0)
+        {
+            fprintf(stderr, "corrupt chunk at byte %zu\n", pos);
+            err = -1;
+            break;
+        }
+        if (fwrite(frames, sizeof(int), (size_t)decoded, out) != (size_t)decoded)
+        {
+            err = -1;
+        }
+        pos += chunk_size;
+    }
+
+    free(frames);
+    free(bytes);
+    return err;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 4 || (strcmp(argv[1], "encode") != 0 && strcmp(argv[1], "decode") != 0))
+    {
+        fprintf(stderr, "usage: %s encode|decode <input> <output>\n", argv[0]);
+        return 2;
+    }
+
+    FILE *in = fopen(argv[2], "rb");
+    if (in == NULL)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+    FILE *out = fopen(argv[3], "wb");
+    if (out == NULL)
+    {
+        perror(argv[3]);
+        fclose(in);
+        return 1;
+    }
+
+    int err = (argv[1][0] == 'e') ? encode_file(in, out) : decode_file(in, out);
+
+    fclose(in);
+    if (fclose(out) != 0)
+    {
+        err = -1;
+    }
+    return err == 0 ? 0 : 1;
+}
@@ -0,0 +1,180 @@
+//
+//  pitchflock_corpus.c
+//  pitchflock
+//
+//  Analyzes a corpus of chroma or state files on all cores into one store:
+//
+//    pitchflock_corpus [-j threads] [-s segment_frames] [-w warmup_frames] <out.pfs> <file|dir>...
+//
+//  Directories are searched recursively (hidden entries skipped), their files taken in
+//  name order. Inputs are *.chroma (uint16 chroma per frame), codec streams (.pfc) or
+//  raw 32-bit encoded_state words; see qdkpdve_corpus.h. One line per input goes to
+//  standard output (path, first frame in the store, frames, invalid frames), totals to
+//  standard error. Exits with 1 if any input could not be read.
+//
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_corpus.h"
+
+struct path_list {
+    char **paths;
+    size_t count;
+    size_t cap;
+};
+
+static int add_path(struct path_list *list, const char *path)
+{
+    if (list->count == list->cap)
+    {
+        size_t cap = list->cap ? 2 * list->cap : 64;
+        char **paths = realloc(list->paths, cap * sizeof(char *));
+        if (paths == NULL)
+        {
+            return -1;
+        }
+        list->paths = paths;
+        list->cap = cap;
+    }
+    list->paths[list->count] = strdup(path);
+    return list->paths[list->count++] ? 0 : -1;
+}
+
+static int by_name(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int add_input(struct path_list *list, const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+        return add_path(list, path); // a missing file is reported with the results
+    }
+
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+    {
+        perror(path);
+        return 0;
+    }
+    struct path_list entries = { 0 };
+    struct dirent *entry;
+    int err = 0;
+    while (!err && (entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+        size_t len = strlen(path) + strlen(entry->d_name) + 2;
+        char *child = malloc(len);
+        if (child == NULL)
+        {
+            err = -1;
+            break;
+        }
+        snprintf(child, len, "%s/%s", path, entry->d_name);
+        err = add_path(&entries, child);
+        free(child);
+    }
+    closedir(dir);
+
+    qsort(entries.paths, entries.count, sizeof(char *), by_name);
+    for (size_t i = 0; i < entries.count; i++)
+    {
+        if (!err)
+        {
+            err = add_input(list, entries.paths[i]);
+        }
+        free(entries.paths[i]);
+    }
+    free(entries.paths);
+    return err;
+}
+
+static const char *format_name(int format)
+{
+    switch (format)
+    {
+    case KPDVE_CORPUS_CHROMA: return "chroma";
+    case KPDVE_CORPUS_CODED: return "coded";
+    case KPDVE_CORPUS_STATES: return "states";
+    default: return "-";
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct kpdve_corpus_options options;
+    kpdve_corpus_default_options(&options);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "j:s:w:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j': options.threads = atoi(optarg); break;
+        case 's': options.segment_frames = strtoul(optarg, NULL, 0); break;
+        case 'w': options.warmup_frames = strtoul(optarg, NULL, 0); break;
+        default: optind = argc + 1; break;
+        }
+    }
+    if (argc - optind < 2)
+    {
+        fprintf(stderr, "usage: %s [-j threads] [-s segment_frames] [-w warmup_frames] <out.pfs> <file|dir>...\n", argv[0]);
+        return 2;
+    }
+    const char *store_path = argv[optind];
+
+    struct path_list inputs = { 0 };
+    for (int i = optind + 1; i < argc; i++)
+    {
+        if (add_input(&inputs, argv[i]) != 0)
+        {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+    }
+
+    struct kpdve_corpus_file *files = calloc(inputs.count ? inputs.count : 1, sizeof(struct kpdve_corpus_file));
+    struct kpdve_corpus_result result;
+    if (files == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    int status = kpdve_corpus_analyze((const char *const *)inputs.paths, inputs.count, store_path,
+                                      &options, files, &result);
+    if (status != KPDVE_CORPUS_OK)
+    {
+        fprintf(stderr, "%s: %s\n", store_path, status == KPDVE_CORPUS_ERR_IO ? "cannot write store" : "out of memory");
+        return 1;
+    }
+
+    int unreadable = 0;
+    for (size_t i = 0; i < inputs.count; i++)
+    {
+        printf("%s\t%s\t%llu\t%zu\t%zu%s\n", files[i].path, format_name(files[i].format),
+               (unsigned long long)files[i].first_frame, files[i].frames, files[i].invalid,
+               files[i].err ? "\tERROR" : "");
+        unreadable |= files[i].err;
+    }
+    fprintf(stderr, "%zu of %zu files, %zu frames in %zu segments on %d threads (%zu steals, %zu segments re-analyzed)\n",
+            result.files, inputs.count, result.frames, result.segments, result.threads,
+            result.steals, result.reanalyzed);
+
+    for (size_t i = 0; i < inputs.count; i++)
+    {
+        free(inputs.paths[i]);
+    }
+    free(inputs.paths);
+    free(files);
+    return unreadable ? 1 : 0;
+}
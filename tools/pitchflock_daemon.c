@@ -0,0 +1,112 @@
+//
+//  pitchflock_daemon.c
+//  pitchflock
+//
+//  Serves analysis to local processes over a Unix domain socket (qdkpdve_daemon.h):
+//
+//    pitchflock_daemon [-w workers] [-s sessions] [-f max_frames] [-p max_pending] <socket>
+//
+//  Runs until SIGINT or SIGTERM, then prints the connection, request and frame counts to
+//  standard error and removes the socket file.
+//
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_daemon.h"
+
+static pf_daemon *running;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    pf_daemon_stop(running);
+}
+
+static int parse_count(const char *text, unsigned long *value)
+{
+    char *end;
+    *value = strtoul(text, &end, 10);
+    return (end != text && *end == '\0' && *value > 0 && *value <= 0xFFFFFFFFul) ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    struct pf_daemon_options options;
+    pf_daemon_default_options(&options);
+
+    int usage = 0;
+    int opt;
+    unsigned long value;
+    while ((opt = getopt(argc, argv, "w:s:f:p:")) != -1)
+    {
+        if (optarg == NULL || parse_count(optarg, &value) != 0)
+        {
+            usage = 1;
+        }
+        else if (opt == 'w')
+        {
+            options.workers = (unsigned)value;
+        }
+        else if (opt == 's')
+        {
+            options.sessions = (uint32_t)value;
+        }
+        else if (opt == 'f')
+        {
+            options.max_frames = (uint32_t)value;
+        }
+        else if (opt == 'p')
+        {
+            options.max_pending = (unsigned)value;
+        }
+        else
+        {
+            usage = 1;
+        }
+    }
+    if (usage || argc - optind != 1)
+    {
+        fprintf(stderr, "usage: %s [-w workers] [-s sessions] [-f max_frames] [-p max_pending] <socket>\n", argv[0]);
+        return 2;
+    }
+    options.path = argv[optind];
+
+    int err = 0;
+    pf_daemon *daemon = pf_daemon_create(&options, &err);
+    if (daemon == NULL)
+    {
+        if (err == PF_DAEMON_ERR_UNSUPPORTED)
+        {
+            fprintf(stderr, "%s: the daemon is not supported on this platform\n", argv[0]);
+        }
+        else
+        {
+            perror(options.path);
+        }
+        return 1;
+    }
+
+    running = daemon;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "serving %u sessions on %s with %u workers\n", options.sessions, options.path,
+            options.workers ? options.workers : 1);
+    err = pf_daemon_run(daemon);
+
+    struct pf_daemon_stats stats;
+    pf_daemon_get_stats(daemon, &stats);
+    fprintf(stderr, "%llu connections, %llu requests, %llu frames, %llu protocol errors\n",
+            (unsigned long long)stats.connections, (unsigned long long)stats.requests,
+            (unsigned long long)stats.frames, (unsigned long long)stats.errors);
+    pf_daemon_destroy(daemon);
+    return err != PF_DAEMON_OK;
+}
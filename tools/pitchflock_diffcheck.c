@@ -0,0 +1,43 @@
+//
+//  pitchflock_diffcheck.c
+//  pitchflock
+//
+//  Runs every built-in analysis engine against the reference code:
+//
+//    pitchflock_diffcheck [threads [streams [frames_per_stream [seed]]]]
+//
+//  threads 0 (the default) uses one per online CPU. Exits with 1 and prints the first
+//  divergence if any engine differs from the reference.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/qdkpdve_diffcheck.h"
+
+int main(int argc, char *argv[])
+{
+    struct kpdve_diffcheck_options options;
+    struct kpdve_diffcheck_result result;
+
+    kpdve_diffcheck_default_options(&options);
+    if (argc > 1) options.threads = atoi(argv[1]);
+    if (argc > 2) options.stream_count = atoi(argv[2]);
+    if (argc > 3) options.stream_length = atoi(argv[3]);
+    if (argc > 4) options.seed = (unsigned int)strtoul(argv[4], NULL, 0);
+    if (argc > 5 || options.stream_count < 0 || options.stream_length < 0)
+    {
+        fprintf(stderr, "usage: %s [threads [streams [frames_per_stream [seed]]]]\n", argv[0]);
+        return 2;
+    }
+
+    int count;
+    const kpdve_engine *engines = kpdve_diffcheck_engines(&count);
+    int diverged = 0;
+    for (int i = 0; i < count; i++)
+    {
+        diverged |= kpdve_diffcheck_engine(&engines[i], &options, &result);
+        kpdve_diffcheck_print(stdout, &result);
+    }
+    return diverged;
+}
@@ -0,0 +1,110 @@
+//
+//  pitchflock_export.c
+//  pitchflock
+//
+//  Renders a file of encoded states as text, CSV or JSON lines on standard output:
+//
+//    pitchflock_export text|csv|jsonl <states.raw | states.pfc>
+//
+//  Files starting with the codec magic are decoded first; anything else is read as
+//  raw 32-bit encoded_state words in native byte order.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_codec.h"
+#include "../include/qdkpdve_format.h"
+
+static int *read_states(const char *path, size_t *count)
+{
+    FILE *in = fopen(path, "rb");
+    if (in == NULL)
+    {
+        perror(path);
+        return NULL;
+    }
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    uint8_t *bytes = malloc(size > 0 ? (size_t)size : 1);
+    if (bytes == NULL || size < 0 || fread(bytes, 1, (size_t)size, in) != (size_t)size)
+    {
+        fclose(in);
+        free(bytes);
+        return NULL;
+    }
+    fclose(in);
+
+    size_t frames, chunk_size;
+    if (kpdve_codec_chunk_info(bytes, (size_t)size, &frames, &chunk_size) != KPDVE_CODEC_OK)
+    {
+        // raw words
+        *count = (size_t)size / sizeof(int);
+        return (int *)bytes;
+    }
+
+    // count the frames of all chunks, then decode them back to back
+    size_t total = 0;
+    for (size_t pos = 0; pos < (size_t)size; pos += chunk_size)
+    {
+        if (kpdve_codec_chunk_info(bytes + pos, (size_t)size - pos, &frames, &chunk_size) != KPDVE_CODEC_OK)
+        {
+            fprintf(stderr, "%s: corrupt chunk at byte %zu\n", path, pos);
+            free(bytes);
+            return NULL;
+        }
+        total += frames;
+    }
+
+    int *states = malloc((total ? total : 1) * sizeof(int));
+    size_t done = 0;
+    for (size_t pos = 0; states != NULL && pos < (size_t)size; pos += chunk_size)
+    {
+        long n = kpdve_codec_decode_chunk(bytes + pos, (size_t)size - pos, states + done, total - done, &chunk_size);
+        if (n < 0)
+        {
+            fprintf(stderr, "%s: corrupt chunk at byte %zu\n", path, pos);
+            free(states);
+            states = NULL;
+            break;
+        }
+        done += (size_t)n;
+    }
+    free(bytes);
+    *count = total;
+    return states;
+}
+
+int main(int argc, char *argv[])
+{
+    int format = -1;
+    if (argc == 3)
+    {
+        if (strcmp(argv[1], "text") == 0) format = KPDVE_FORMAT_TEXT;
+        else if (strcmp(argv[1], "csv") == 0) format = KPDVE_FORMAT_CSV;
+        else if (strcmp(argv[1], "jsonl") == 0) format = KPDVE_FORMAT_JSONL;
+    }
+    if (format < 0)
+    {
+        fprintf(stderr, "usage: %s text|csv|jsonl <states file>\n", argv[0]);
+        return 2;
+    }
+
+    size_t count = 0;
+    int *states = read_states(argv[2], &count);
+    if (states == NULL)
+    {
+        return 1;
+    }
+
+    int err = kpdve_format_to_fd(STDOUT_FILENO, format, states, count);
+    if (err != 0)
+    {
+        perror("write");
+    }
+    free(states);
+    return err == 0 ? 0 : 1;
+}
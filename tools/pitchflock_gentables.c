@@ -0,0 +1,107 @@
+//
+//  pitchflock_gentables.c
+//  pitchflock
+//
+//  Writes the library's shared tables as C source, for builds that compile them in
+//  (PITCHFLOCK_PREBUILT_TABLES, see qdkpdve_init.h):
+//
+//    pitchflock_gentables <out.c>
+//
+//  The output defines the kpdve_prebuilt_* arrays that qdkpdve_tables.c and
+//  qdkpdve_nametable.c declare: the candidate, minimizer and distance tables, and the
+//  name table with its string pool. Floats are written as hex literals, so the compiled
+//  tables are bit-identical to the ones built at run time. The build runs it with a
+//  bootstrap copy of the library that builds the tables itself.
+//
+
+#include <stdio.h>
+
+#include "../include/qdkpdve_nametable.h"
+#include "../include/qdkpdve_tables.h"
+
+static void write_u16(FILE *out, const char *name, const uint16_t *values, size_t count)
+{
+    fprintf(out, "const uint16_t %s[%zu] = {", name, count);
+    for (size_t i = 0; i < count; i++)
+    {
+        fprintf(out, "%s0x%04x,", (i % 12 == 0) ? "\n    " : " ", values[i]);
+    }
+    fprintf(out, "\n};\n\n");
+}
+
+static void write_u32(FILE *out, const char *name, const uint32_t *values, size_t count)
+{
+    fprintf(out, "const uint32_t %s[%zu] = {", name, count);
+    for (size_t i = 0; i < count; i++)
+    {
+        fprintf(out, "%s0x%08x,", (i % 8 == 0) ? "\n    " : " ", values[i]);
+    }
+    fprintf(out, "\n};\n\n");
+}
+
+static void write_float(FILE *out, const char *name, const float *values, size_t count)
+{
+    fprintf(out, "const float %s[%zu] = {", name, count);
+    for (size_t i = 0; i < count; i++)
+    {
+        fprintf(out, "%s%af,", (i % 6 == 0) ? "\n    " : " ", (double)values[i]);
+    }
+    fprintf(out, "\n};\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <out.c>\n", argv[0]);
+        return 2;
+    }
+
+    const kpdve_tables *tables = kpdve_tables_default();
+    kpdve_name_table_init();
+    const struct kpdve_name_table *names = kpdve_name_table();
+
+    FILE *out = fopen(argv[1], "w");
+    if (out == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fprintf(out, "// generated by pitchflock_gentables -- do not edit\n\n");
+    fprintf(out, "#include \"qdkpdve_nametable.h\"\n#include \"qdkpdve_tables.h\"\n\n");
+
+    write_u16(out, "kpdve_prebuilt_crystal_masks", tables->crystal_masks, KPDVE_TABLES_CELLS);
+    write_u32(out, "kpdve_prebuilt_minimized", tables->minimized, 128);
+    write_u16(out, "kpdve_prebuilt_offsets", tables->offsets, KPDVE_TABLES_CHROMA + 1);
+    write_u32(out, "kpdve_prebuilt_candidates", tables->candidates, KPDVE_TABLES_CANDIDATES);
+    write_float(out, "kpdve_prebuilt_k_distance", tables->k_distance, 12 * 12);
+    write_float(out, "kpdve_prebuilt_p_distance", tables->p_distance, 8 * 8);
+    write_float(out, "kpdve_prebuilt_d_distance", tables->d_distance, 8 * 8);
+
+    fprintf(out, "const struct kpdve_name_entry kpdve_prebuilt_name_entries[%d] = {\n", KPDVE_NAME_TABLE_SIZE);
+    for (int i = 0; i < KPDVE_NAME_TABLE_SIZE; i++)
+    {
+        const struct kpdve_name_entry *e = &names->entries[i];
+        fprintf(out, "    { %u, %u, %u, %u, %u, %u, %u },\n", e->tonic, e->scale, e->distortion,
+                e->mode, e->degree, e->root, (unsigned int)e->chord);
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "const char kpdve_prebuilt_name_pool[%zu] = {", names->pool_size);
+    for (size_t i = 0; i < names->pool_size; i++)
+    {
+        fprintf(out, "%s%d,", (i % 16 == 0) ? "\n    " : " ", names->pool[i]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "const struct kpdve_name_table kpdve_prebuilt_name_table = {\n");
+    fprintf(out, "    kpdve_prebuilt_name_entries, kpdve_prebuilt_name_pool, %zu\n};\n", names->pool_size);
+
+    if (fclose(out) != 0)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+//
+//  pitchflock_prior.c
+//  pitchflock
+//
+//  Learns a transition prior (qdkpdve_prior.h) from analyzed corpora and shows priors:
+//
+//    pitchflock_prior learn [-a alpha] <out.pfp> <store.pfs>...
+//    pitchflock_prior show [-n count] <prior.pfp>
+//
+//  learn counts the K/P changes of every store (as pitchflock_corpus writes them), each
+//  store as one stream, and writes the smoothed, quantized prior (alpha defaults to 1).
+//  show prints the header and the count transitions with the highest levels, with the
+//  root of each K, P, D's chord.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_naming.h"
+#include "../include/qdkpdve_prior.h"
+#include "../include/qdkpdve_store.h"
+
+static kpdve_prior prior;
+
+static int learn(int argc, char *argv[])
+{
+    float alpha = 1.0f;
+    int opt;
+    while ((opt = getopt(argc, argv, "a:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a': alpha = strtof(optarg, NULL); break;
+        default: optind = argc + 1; break;
+        }
+    }
+    if (argc - optind < 2)
+    {
+        fprintf(stderr, "usage: pitchflock_prior learn [-a alpha] <out.pfp> <store.pfs>...\n");
+        return 2;
+    }
+
+    kpdve_prior_counts *counts = malloc(sizeof(kpdve_prior_counts));
+    if (counts == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    kpdve_prior_counts_reset(counts);
+    size_t frames = 0;
+    for (int i = optind + 1; i < argc; i++)
+    {
+        kpdve_store store;
+        if (kpdve_store_open(&store, argv[i]) != KPDVE_STORE_OK)
+        {
+            fprintf(stderr, "%s: not a store\n", argv[i]);
+            free(counts);
+            return 1;
+        }
+        kpdve_prior_count(counts, store.states, kpdve_store_frame_count(&store));
+        kpdve_prior_end_stream(counts);
+        frames += kpdve_store_frame_count(&store);
+        kpdve_store_close(&store);
+    }
+
+    kpdve_prior_build(&prior, counts, alpha, 1.0f);
+    free(counts);
+    if (kpdve_prior_write(&prior, argv[optind]) != KPDVE_PRIOR_OK)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+    fprintf(stderr, "%zu frames, %llu K/P changes, %u transitions with a level\n", frames,
+            (unsigned long long)prior.transitions, prior.entry_count);
+    return 0;
+}
+
+static int by_level(const void *a, const void *b)
+{
+    int la = prior.levels[*(const uint32_t *)a], lb = prior.levels[*(const uint32_t *)b];
+    return lb - la;
+}
+
+static int index_kpdve(int index)
+{
+    return (index / 49) << 12 | ((index / 7) % 7) << 9 | (index % 7) << 6;
+}
+
+static int show(int argc, char *argv[])
+{
+    int top = 20;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': top = atoi(optarg); break;
+        default: optind = argc + 1; break;
+        }
+    }
+    if (argc - optind != 1)
+    {
+        fprintf(stderr, "usage: pitchflock_prior show [-n count] <prior.pfp>\n");
+        return 2;
+    }
+    int err = kpdve_prior_read(&prior, argv[optind], 1.0f);
+    if (err != KPDVE_PRIOR_OK)
+    {
+        fprintf(stderr, "%s: %s\n", argv[optind], err == KPDVE_PRIOR_ERR_IO ? "cannot read" : "not a version 1 prior");
+        return 1;
+    }
+    printf("%s: %llu K/P changes counted, alpha %g, %u transitions with a level\n", argv[optind],
+           (unsigned long long)prior.transitions, prior.alpha, prior.entry_count);
+
+    uint32_t *entries = malloc(sizeof(uint32_t) * (prior.entry_count ? prior.entry_count : 1));
+    if (entries == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < sizeof(prior.levels); i++)
+    {
+        if (prior.levels[i] != 0)
+        {
+            entries[n++] = i;
+        }
+    }
+    qsort(entries, n, sizeof(uint32_t), by_level);
+    for (uint32_t i = 0; i < n && (int)i < top; i++)
+    {
+        int from = index_kpdve((int)(entries[i] / KPDVE_PRIOR_STATES));
+        int to = index_kpdve((int)(entries[i] % KPDVE_PRIOR_STATES));
+        printf("K %2d P %d D %d (%-2s) -> K %2d P %d D %d (%-2s) %6.2f bits\n", from >> 12, (from >> 9) & 7, (from >> 6) & 7,
+               nameStringForKPDVE(from), to >> 12, (to >> 9) & 7, (to >> 6) & 7, nameStringForKPDVE(to),
+               (double)prior.levels[entries[i]] / KPDVE_PRIOR_STEPS);
+    }
+    free(entries);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc >= 2 && strcmp(argv[1], "learn") == 0)
+    {
+        return learn(argc - 1, argv + 1);
+    }
+    if (argc >= 2 && strcmp(argv[1], "show") == 0)
+    {
+        return show(argc - 1, argv + 1);
+    }
+    fprintf(stderr, "usage: %s learn [-a alpha] <out.pfp> <store.pfs>...\n"
+                    "       %s show [-n count] <prior.pfp>\n", argv[0], argv[0]);
+    return 2;
+}
@@ -0,0 +1,210 @@
+//
+//  pitchflock_ring.c
+//  pitchflock
+//
+//  Reference consumer and producer for the shared-memory ring (qdkpdve_shmring.h):
+//
+//    pitchflock_ring serve [-c capacity] [-s spin_us] <name>
+//    pitchflock_ring feed [-b batch_frames] [-p period_us] <name> <input.chroma>
+//
+//  serve creates the ring and analyzes what comes through it until the producer shuts
+//  it down (or SIGINT/SIGTERM), then removes it. feed plays the audio host: it sends the
+//  uint16 chroma frames of the input ("-": standard input) in batches, one batch every
+//  period_us if given, writes the states it gets back as raw 32-bit words on standard
+//  output, and prints the round-trip latency to standard error.
+//
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_latency.h"
+#include "../include/qdkpdve_rt.h"
+#include "../include/qdkpdve_shmring.h"
+#include "../include/qdkpdve_tables.h"
+
+#define SPIN_NS 50000
+
+static int stop = 0;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+}
+
+static void print_stats(const char *side, const pf_ring *ring)
+{
+    struct pf_ring_stats stats;
+    pf_ring_get_stats(ring, &stats);
+    fprintf(stderr, "%s: %llu frames, %llu sleeps, %llu wakes\n", side, (unsigned long long)stats.frames,
+            (unsigned long long)stats.sleeps, (unsigned long long)stats.wakes);
+}
+
+static int serve(const char *name, uint32_t capacity, uint64_t spin_ns)
+{
+    int err = 0;
+    pf_ring *ring = pf_ring_create(name, capacity, &err);
+    if (ring == NULL)
+    {
+        fprintf(stderr, "%s: cannot create the ring (%d)\n", name, err);
+        return 1;
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    pf_rt_analyzer analyzer;
+    pf_rt_init(&analyzer, kpdve_tables_default());
+    fprintf(stderr, "serving %s (%u frames)\n", name, pf_ring_capacity(ring));
+    pf_ring_serve(ring, &analyzer, spin_ns, &stop);
+    print_stats("consumer", ring);
+    pf_ring_close(ring);
+    pf_ring_unlink(name);
+    return 0;
+}
+
+// writes out and releases every result there is
+static int drain(pf_ring *ring, kpdve_latency_histogram *latency, uint64_t *received)
+{
+    const struct pf_ring_frame *f;
+    uint32_t count;
+    while ((f = pf_ring_results(ring, &count)) != NULL)
+    {
+        uint64_t now = kpdve_latency_now_ns();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            int32_t state = (int32_t)f[i].state;
+            kpdve_latency_record(latency, now - f[i].timestamp_ns);
+            if (fwrite(&state, sizeof(state), 1, stdout) != 1)
+            {
+                return -1;
+            }
+        }
+        pf_ring_release(ring, count);
+        *received += count;
+    }
+    return 0;
+}
+
+static int feed(const char *name, const char *path, uint32_t batch, uint64_t period_ns)
+{
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (in == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+    int err = 0;
+    pf_ring *ring = pf_ring_open(name, &err);
+    if (ring == NULL)
+    {
+        fprintf(stderr, "%s: cannot open the ring (%d)\n", name, err);
+        return 1;
+    }
+
+    kpdve_latency_histogram latency;
+    kpdve_latency_init(&latency);
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    uint64_t next_batch = kpdve_latency_now_ns();
+    int done = 0;
+    int status = 0;
+    while (!done || received < sent)
+    {
+        if (drain(ring, &latency, &received) != 0)
+        {
+            status = 1;
+            break;
+        }
+        uint64_t now = kpdve_latency_now_ns();
+        int due = !done && (period_ns == 0 || now >= next_batch);
+        uint32_t room = 0;
+        struct pf_ring_frame *slots = due ? pf_ring_reserve(ring, &room) : NULL;
+        if (slots != NULL)
+        {
+            uint32_t n = 0;
+            uint16_t chroma;
+            while (n < room && n < batch && fread(&chroma, sizeof(chroma), 1, in) == 1)
+            {
+                slots[n++] = (struct pf_ring_frame){ now, chroma, 0, 0 };
+            }
+            done = n < room && n < batch;
+            if (n > 0)
+            {
+                pf_ring_publish(ring, n);
+            }
+            sent += n;
+            next_batch += period_ns;
+            continue;
+        }
+        // wait for results until the next batch is due, or as long as the ring is full
+        int64_t timeout = (done || due || period_ns == 0) ? 1000000000 : (int64_t)(next_batch - now);
+        if (received < sent && pf_ring_wait_results(ring, SPIN_NS, timeout) == 0 && timeout == 1000000000)
+        {
+            fprintf(stderr, "%s: no results for a second; is the consumer running?\n", name);
+            status = 1;
+            break;
+        }
+        if (received == sent && !done && next_batch > now)
+        {
+            uint64_t wait = next_batch - now;
+            struct timespec ts = { (time_t)(wait / 1000000000), (long)(wait % 1000000000) };
+            nanosleep(&ts, NULL);
+        }
+    }
+    pf_ring_shutdown(ring);
+
+    struct kpdve_latency_summary s;
+    kpdve_latency_summarize(&latency, &s, 0);
+    fprintf(stderr, "round trip: p50 %llu ns, p99 %llu ns, p99.9 %llu ns, max %llu ns\n",
+            (unsigned long long)s.p50_ns, (unsigned long long)s.p99_ns, (unsigned long long)s.p999_ns,
+            (unsigned long long)s.max_ns);
+    print_stats("producer", ring);
+    pf_ring_close(ring);
+    if (in != stdin)
+    {
+        fclose(in);
+    }
+    return status;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *mode = argc > 1 ? argv[1] : "";
+    uint32_t capacity = 4096;
+    uint32_t batch = 256;
+    uint64_t spin_ns = SPIN_NS;
+    uint64_t period_ns = 0;
+
+    int opt;
+    optind = 2;
+    while (argc > 1 && (opt = getopt(argc, argv, "c:s:b:p:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c': capacity = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 's': spin_ns = strtoull(optarg, NULL, 0) * 1000; break;
+        case 'b': batch = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'p': period_ns = strtoull(optarg, NULL, 0) * 1000; break;
+        default: mode = ""; break;
+        }
+    }
+    if (strcmp(mode, "serve") == 0 && argc - optind == 1)
+    {
+        return serve(argv[optind], capacity, spin_ns);
+    }
+    if (strcmp(mode, "feed") == 0 && argc - optind == 2 && batch > 0)
+    {
+        return feed(argv[optind], argv[optind + 1], batch, period_ns);
+    }
+    fprintf(stderr, "usage: %s serve [-c capacity] [-s spin_us] <name>\n"
+                    "       %s feed [-b batch_frames] [-p period_us] <name> <input.chroma>\n",
+            argv[0], argv[0]);
+    return 2;
+}
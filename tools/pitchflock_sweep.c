@@ -0,0 +1,113 @@
+//
+//  pitchflock_sweep.c
+//  pitchflock
+//
+//  Sweeps the whole chroma x context space and the whole KPDVE space on all cores and
+//  writes the results as binary tables:
+//
+//    pitchflock_sweep <out_dir> [threads]
+//
+//    <out_dir>/contexts.pft    int32 encoded_state [588 contexts][4096 chroma]
+//    <out_dir>/choices.pft     uint8 kpdve_min_index [588 contexts][4096 chroma]
+//    <out_dir>/candidates.pft  uint32 offsets [4097], then the packed candidates
+//    <out_dir>/kpdve.pft       int32 encoded_state [28812 KPDVE values]
+//
+//  Every file starts with a 32-byte header (native byte order):
+//  magic "PFT1", kind (1..4 as listed), rows, columns, element size, three zero words.
+//  The layouts are described in qdkpdve_sweep.h.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/qdkpdve_sweep.h"
+
+#define SWEEP_MAGIC 0x31544650u // "PFT1" little-endian
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + 1e-9 * (double)(now.tv_nsec - start->tv_nsec);
+}
+
+static int write_table(const char *dir, const char *name, uint32_t kind, uint32_t rows, uint32_t cols,
+                       uint32_t element_size, const void *data, size_t data_size,
+                       const void *more, size_t more_size)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *out = fopen(path, "wb");
+    if (out == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    uint32_t header[8] = { SWEEP_MAGIC, kind, rows, cols, element_size, 0, 0, 0 };
+    int ok = fwrite(header, sizeof(header), 1, out) == 1
+        && fwrite(data, 1, data_size, out) == data_size
+        && (more_size == 0 || fwrite(more, 1, more_size, out) == more_size);
+    ok = (fclose(out) == 0) && ok;
+    if (!ok)
+    {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: %s <out_dir> [threads]\n", argv[0]);
+        return 2;
+    }
+    const char *dir = argv[1];
+    int threads = (argc > 2) ? atoi(argv[2]) : 0;
+
+    int *contexts = malloc(sizeof(int) * KPDVE_SWEEP_CONTEXTS * KPDVE_SWEEP_CHROMA);
+    uint8_t *choices = malloc(KPDVE_SWEEP_CONTEXTS * KPDVE_SWEEP_CHROMA);
+    uint32_t *offsets = malloc(sizeof(uint32_t) * (KPDVE_SWEEP_CHROMA + 1));
+    uint32_t *candidates = malloc(sizeof(uint32_t) * KPDVE_SWEEP_CANDIDATES);
+    int *kpdves = malloc(sizeof(int) * KPDVE_SWEEP_KPDVES);
+    if (!contexts || !choices || !offsets || !candidates || !kpdves)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    kpdve_sweep_contexts(contexts, choices, threads);
+    fprintf(stderr, "contexts: %d analyses in %.3f s\n", KPDVE_SWEEP_CONTEXTS * KPDVE_SWEEP_CHROMA, seconds_since(&start));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t candidate_count = kpdve_sweep_candidates(offsets, candidates);
+    fprintf(stderr, "candidates: %zu in %.3f s\n", candidate_count, seconds_since(&start));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    kpdve_sweep_kpdves(kpdves, threads);
+    fprintf(stderr, "kpdve: %d analyses in %.3f s\n", KPDVE_SWEEP_KPDVES, seconds_since(&start));
+
+    int err = 0;
+    err |= write_table(dir, "contexts.pft", 1, KPDVE_SWEEP_CONTEXTS, KPDVE_SWEEP_CHROMA, 4,
+                       contexts, sizeof(int) * KPDVE_SWEEP_CONTEXTS * KPDVE_SWEEP_CHROMA, NULL, 0);
+    err |= write_table(dir, "choices.pft", 2, KPDVE_SWEEP_CONTEXTS, KPDVE_SWEEP_CHROMA, 1,
+                       choices, KPDVE_SWEEP_CONTEXTS * KPDVE_SWEEP_CHROMA, NULL, 0);
+    err |= write_table(dir, "candidates.pft", 3, KPDVE_SWEEP_CHROMA + 1, (uint32_t)candidate_count, 4,
+                       offsets, sizeof(uint32_t) * (KPDVE_SWEEP_CHROMA + 1),
+                       candidates, sizeof(uint32_t) * candidate_count);
+    err |= write_table(dir, "kpdve.pft", 4, KPDVE_SWEEP_KPDVES, 1, 4,
+                       kpdves, sizeof(int) * KPDVE_SWEEP_KPDVES, NULL, 0);
+
+    free(contexts);
+    free(choices);
+    free(offsets);
+    free(candidates);
+    free(kpdves);
+    return err ? 1 : 0;
+}
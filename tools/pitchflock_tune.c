@@ -0,0 +1,338 @@
+//
+//  pitchflock_tune.c
+//  pitchflock
+//
+//  Scores a grid of chooser configurations (qdkpdve_tune.h) against a labeled corpus:
+//
+//    pitchflock_tune [-j threads] [-k list] [-p list] [-d list] [-m l1,l2] [-w list]
+//                    [-r prior.pfp] <file|dir>...
+//
+//  A list is comma-separated values or start:stop:step (stop included); the grid is
+//  every combination of the K, P and D weights, the metrics and the prior weights (-w,
+//  used only with -r). Each list defaults to the built-in value, so with no lists the
+//  grid is the built-in configuration alone. Inputs are labeled state files (raw words,
+//  .pfc or stores), directories searched recursively as pitchflock_corpus does.
+//
+//  One tab-separated line per configuration goes to standard output: the weights, the
+//  metric, the prior weight, scored frames, the fractions in the label's K, K and P, and
+//  KPDVE, the K changes made, the label's K changes and those matched. The built-in
+//  configuration's line (when in the grid) and the one with the most frames in the
+//  label's K and P go to standard error. Exits with 1 if any input could not be read.
+//
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/qdkpdve_tune.h"
+
+#define MAX_VALUES 256
+#define MAX_CONFIGS (1 << 20)
+
+struct path_list {
+    char **paths;
+    size_t count;
+    size_t cap;
+};
+
+struct value_list {
+    float values[MAX_VALUES];
+    int count;
+};
+
+static int add_path(struct path_list *list, const char *path)
+{
+    if (list->count == list->cap)
+    {
+        size_t cap = list->cap ? 2 * list->cap : 64;
+        char **paths = realloc(list->paths, cap * sizeof(char *));
+        if (paths == NULL)
+        {
+            return -1;
+        }
+        list->paths = paths;
+        list->cap = cap;
+    }
+    list->paths[list->count] = strdup(path);
+    return list->paths[list->count++] ? 0 : -1;
+}
+
+static int by_name(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int add_input(struct path_list *list, const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+        return add_path(list, path); // a missing file is reported with the results
+    }
+
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+    {
+        perror(path);
+        return 0;
+    }
+    struct path_list entries = { 0 };
+    struct dirent *entry;
+    int err = 0;
+    while (!err && (entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+        size_t len = strlen(path) + strlen(entry->d_name) + 2;
+        char *child = malloc(len);
+        if (child == NULL)
+        {
+            err = -1;
+            break;
+        }
+        snprintf(child, len, "%s/%s", path, entry->d_name);
+        err = add_path(&entries, child);
+        free(child);
+    }
+    closedir(dir);
+
+    qsort(entries.paths, entries.count, sizeof(char *), by_name);
+    for (size_t i = 0; i < entries.count; i++)
+    {
+        if (!err)
+        {
+            err = add_input(list, entries.paths[i]);
+        }
+        free(entries.paths[i]);
+    }
+    free(entries.paths);
+    return err;
+}
+
+// "a,b,c" or "start:stop:step"; 0 if the list is malformed or too long
+static int parse_list(const char *text, struct value_list *list)
+{
+    char *end;
+    list->count = 0;
+    float start = strtof(text, &end);
+    if (end != text && *end == ':')
+    {
+        const char *rest = end + 1;
+        float stop = strtof(rest, &end);
+        if (end == rest || *end != ':')
+        {
+            return 0;
+        }
+        rest = end + 1;
+        float step = strtof(rest, &end);
+        if (end == rest || *end != '\0' || step <= 0.0f)
+        {
+            return 0;
+        }
+        // by index, so rounding does not drop the stop value
+        for (int i = 0; start + (float)i * step <= stop + step * 1e-3f; i++)
+        {
+            if (list->count == MAX_VALUES)
+            {
+                return 0;
+            }
+            list->values[list->count++] = start + (float)i * step;
+        }
+        return list->count;
+    }
+    for (const char *p = text;; p = end + 1)
+    {
+        float value = strtof(p, &end);
+        if (end == p || (*end != ',' && *end != '\0') || list->count == MAX_VALUES)
+        {
+            return 0;
+        }
+        list->values[list->count++] = value;
+        if (*end == '\0')
+        {
+            return list->count;
+        }
+    }
+}
+
+static int parse_metrics(const char *text, struct value_list *list)
+{
+    list->count = 0;
+    char copy[64];
+    snprintf(copy, sizeof(copy), "%s", text);
+    for (char *name = strtok(copy, ","); name != NULL; name = strtok(NULL, ","))
+    {
+        if (strcmp(name, "l1") != 0 && strcmp(name, "l2") != 0)
+        {
+            return 0;
+        }
+        if (list->count < 2)
+        {
+            list->values[list->count++] = strcmp(name, "l1") == 0 ? KPDVE_TUNE_L1 : KPDVE_TUNE_L2;
+        }
+    }
+    return list->count;
+}
+
+static void print_score(FILE *out, const struct kpdve_tune_config *config, const struct kpdve_tune_score *score)
+{
+    double frames = score->frames ? (double)score->frames : 1.0;
+    fprintf(out, "%g\t%g\t%g\t%s\t%g\t%llu\t%.4f\t%.4f\t%.4f\t%llu\t%llu\t%llu\n", config->axis_scale[0],
+            config->axis_scale[1], config->axis_scale[2], config->metric == KPDVE_TUNE_L2 ? "l2" : "l1",
+            config->prior_weight, (unsigned long long)score->frames, (double)score->k_right / frames,
+            (double)score->kp_right / frames, (double)score->kpdve_right / frames,
+            (unsigned long long)score->k_changes, (unsigned long long)score->label_k_changes,
+            (unsigned long long)score->k_change_hits);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-j threads] [-k list] [-p list] [-d list] [-m l1,l2] [-w list] [-r prior.pfp] <file|dir>...\n"
+                    "       a list is a,b,c or start:stop:step\n", name);
+}
+
+static kpdve_prior prior;
+
+int main(int argc, char *argv[])
+{
+    struct kpdve_tune_options options;
+    kpdve_tune_default_options(&options);
+    struct kpdve_tune_config builtin;
+    kpdve_tune_default_config(&builtin);
+
+    struct value_list axes[3], metrics, weights;
+    for (int a = 0; a < 3; a++)
+    {
+        axes[a].values[0] = builtin.axis_scale[a];
+        axes[a].count = 1;
+    }
+    metrics.values[0] = KPDVE_TUNE_L1;
+    metrics.count = 1;
+    weights.values[0] = 0.0f;
+    weights.count = 1;
+    const char *prior_path = NULL;
+
+    int opt, ok = 1;
+    while (ok && (opt = getopt(argc, argv, "j:k:p:d:m:w:r:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j': options.threads = atoi(optarg); break;
+        case 'k': ok = parse_list(optarg, &axes[0]); break;
+        case 'p': ok = parse_list(optarg, &axes[1]); break;
+        case 'd': ok = parse_list(optarg, &axes[2]); break;
+        case 'm': ok = parse_metrics(optarg, &metrics); break;
+        case 'w': ok = parse_list(optarg, &weights); break;
+        case 'r': prior_path = optarg; break;
+        default: ok = 0; break;
+        }
+    }
+    if (!ok || optind == argc)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    if (prior_path != NULL)
+    {
+        int err = kpdve_prior_read(&prior, prior_path, 1.0f);
+        if (err != KPDVE_PRIOR_OK)
+        {
+            fprintf(stderr, "%s: %s\n", prior_path, err == KPDVE_PRIOR_ERR_IO ? "cannot read" : "not a version 1 prior");
+            return 1;
+        }
+        options.prior = &prior;
+    }
+    else if (weights.count > 1 || weights.values[0] != 0.0f)
+    {
+        fprintf(stderr, "prior weights (-w) need a prior (-r)\n");
+        return 2;
+    }
+
+    size_t config_count = (size_t)axes[0].count * axes[1].count * axes[2].count * metrics.count * weights.count;
+    if (config_count > MAX_CONFIGS)
+    {
+        fprintf(stderr, "%zu configurations, at most %d\n", config_count, MAX_CONFIGS);
+        return 2;
+    }
+    struct kpdve_tune_config *configs = malloc(config_count * sizeof(struct kpdve_tune_config));
+    struct kpdve_tune_score *scores = calloc(config_count, sizeof(struct kpdve_tune_score));
+    struct path_list inputs = { 0 };
+    int status = configs != NULL && scores != NULL ? 0 : -1;
+    for (int i = optind; i < argc && status == 0; i++)
+    {
+        status = add_input(&inputs, argv[i]);
+    }
+    struct kpdve_tune_file *files = calloc(inputs.count ? inputs.count : 1, sizeof(struct kpdve_tune_file));
+    if (status != 0 || files == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    size_t n = 0;
+    for (int k = 0; k < axes[0].count; k++)
+        for (int p = 0; p < axes[1].count; p++)
+            for (int d = 0; d < axes[2].count; d++)
+                for (int m = 0; m < metrics.count; m++)
+                    for (int w = 0; w < weights.count; w++)
+                    {
+                        configs[n].axis_scale[0] = axes[0].values[k];
+                        configs[n].axis_scale[1] = axes[1].values[p];
+                        configs[n].axis_scale[2] = axes[2].values[d];
+                        configs[n].metric = (int)metrics.values[m];
+                        configs[n].prior_weight = weights.values[w];
+                        n++;
+                    }
+
+    if (kpdve_tune_evaluate((const char *const *)inputs.paths, inputs.count, configs, config_count, &options,
+                            files, scores) != KPDVE_TUNE_OK)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    int unreadable = 0;
+    for (size_t i = 0; i < inputs.count; i++)
+    {
+        if (files[i].err != KPDVE_TUNE_OK)
+        {
+            fprintf(stderr, "%s: %s\n", files[i].path,
+                    files[i].err == KPDVE_TUNE_ERR_IO ? "cannot read" : "no labels (chroma or corrupt)");
+            unreadable = 1;
+        }
+    }
+
+    printf("k\tp\td\tmetric\tprior\tframes\tk_right\tkp_right\tkpdve_right\tk_changes\tlabel_k_changes\tk_change_hits\n");
+    size_t best = 0;
+    for (size_t c = 0; c < config_count; c++)
+    {
+        print_score(stdout, &configs[c], &scores[c]);
+        best = scores[c].kp_right > scores[best].kp_right ? c : best;
+    }
+    for (size_t c = 0; c < config_count; c++)
+    {
+        if (memcmp(&configs[c], &builtin, sizeof(builtin)) == 0)
+        {
+            fprintf(stderr, "built-in\t");
+            print_score(stderr, &configs[c], &scores[c]);
+            break;
+        }
+    }
+    fprintf(stderr, "best\t");
+    print_score(stderr, &configs[best], &scores[best]);
+
+    for (size_t i = 0; i < inputs.count; i++)
+    {
+        free(inputs.paths[i]);
+    }
+    free(inputs.paths);
+    free(files);
+    free(configs);
+    free(scores);
+    return unreadable ? 1 : 0;
+}